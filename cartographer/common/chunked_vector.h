@@ -0,0 +1,127 @@
+/*
+ * Copyright 2017 The Cartographer Authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef CARTOGRAPHER_COMMON_CHUNKED_VECTOR_H_
+#define CARTOGRAPHER_COMMON_CHUNKED_VECTOR_H_
+
+#include <cstddef>
+#include <iterator>
+#include <memory>
+#include <vector>
+
+#include "glog/logging.h"
+
+namespace cartographer {
+namespace common {
+
+// A sequence of values which is stored in chunks of 'kChunkSize' values.
+// Copies share their chunks, and a shared chunk is only copied when it is
+// changed. Copying is therefore cheap, and appending to a copy only copies its
+// last chunk, so that each version of a growing sequence can be kept without
+// copying all of it.
+//
+// Chunks are never changed while they are shared, so different copies may be
+// read and changed from different threads.
+template <typename T, size_t kChunkSize = 512>
+class ChunkedVector {
+ public:
+  class ConstIterator
+      : public std::iterator<std::forward_iterator_tag, T, std::ptrdiff_t,
+                             const T*, const T&> {
+   public:
+    ConstIterator(const ChunkedVector* const chunked_vector, const size_t index)
+        : chunked_vector_(chunked_vector), index_(index) {}
+
+    const T& operator*() const { return (*chunked_vector_)[index_]; }
+    const T* operator->() const { return &(*chunked_vector_)[index_]; }
+
+    ConstIterator& operator++() {
+      ++index_;
+      return *this;
+    }
+
+    ConstIterator operator++(int) {
+      ConstIterator result = *this;
+      ++index_;
+      return result;
+    }
+
+    bool operator==(const ConstIterator& it) const {
+      return index_ == it.index_;
+    }
+    bool operator!=(const ConstIterator& it) const { return !(*this == it); }
+
+   private:
+    const ChunkedVector* chunked_vector_;
+    size_t index_;
+  };
+
+  ChunkedVector() {}
+
+  size_t size() const { return size_; }
+  bool empty() const { return size_ == 0; }
+
+  const T& operator[](const size_t index) const {
+    return (*chunks_[index / kChunkSize])[index % kChunkSize];
+  }
+
+  ConstIterator begin() const { return ConstIterator(this, 0); }
+  ConstIterator end() const { return ConstIterator(this, size_); }
+
+  void push_back(const T& value) {
+    if (size_ % kChunkSize == 0) {
+      chunks_.push_back(std::make_shared<std::vector<T>>());
+      chunks_.back()->reserve(kChunkSize);
+    }
+    MutableLastChunk()->push_back(value);
+    ++size_;
+  }
+
+  // Removes all values from 'size' on. Chunks before it stay shared.
+  void Truncate(const size_t size) {
+    CHECK_LE(size, size_);
+    chunks_.resize((size + kChunkSize - 1) / kChunkSize);
+    if (size % kChunkSize != 0) {
+      std::vector<T>* const last_chunk = MutableLastChunk();
+      last_chunk->erase(last_chunk->begin() + size % kChunkSize,
+                        last_chunk->end());
+    }
+    size_ = size;
+  }
+
+ private:
+  // Returns the last chunk after copying it, unless this is its only owner.
+  // Other owners cannot get a reference while it is, so this is thread-safe.
+  std::vector<T>* MutableLastChunk() {
+    CHECK(!chunks_.empty());
+    if (chunks_.back().use_count() != 1) {
+      auto chunk = std::make_shared<std::vector<T>>();
+      chunk->reserve(kChunkSize);
+      chunk->insert(chunk->end(), chunks_.back()->begin(),
+                    chunks_.back()->end());
+      chunks_.back() = std::move(chunk);
+    }
+    return chunks_.back().get();
+  }
+
+  std::vector<std::shared_ptr<std::vector<T>>> chunks_;
+  size_t size_ = 0;
+};
+
+}  // namespace common
+}  // namespace cartographer
+
+#endif  // CARTOGRAPHER_COMMON_CHUNKED_VECTOR_H_
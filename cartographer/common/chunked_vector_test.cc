@@ -0,0 +1,86 @@
+/*
+ * Copyright 2017 The Cartographer Authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "cartographer/common/chunked_vector.h"
+
+#include <vector>
+
+#include "gmock/gmock.h"
+
+namespace cartographer {
+namespace common {
+namespace {
+
+using ::testing::ElementsAre;
+using ::testing::ElementsAreArray;
+
+using SmallChunkedVector = ChunkedVector<int, 4>;
+
+std::vector<int> ToVector(const SmallChunkedVector& chunked_vector) {
+  return std::vector<int>(chunked_vector.begin(), chunked_vector.end());
+}
+
+TEST(ChunkedVectorTest, AppendsAcrossChunks) {
+  SmallChunkedVector chunked_vector;
+  EXPECT_TRUE(chunked_vector.empty());
+  std::vector<int> expected;
+  for (int i = 0; i != 10; ++i) {
+    chunked_vector.push_back(i);
+    expected.push_back(i);
+  }
+  EXPECT_FALSE(chunked_vector.empty());
+  EXPECT_EQ(10u, chunked_vector.size());
+  EXPECT_EQ(7, chunked_vector[7]);
+  EXPECT_THAT(ToVector(chunked_vector), ElementsAreArray(expected));
+}
+
+TEST(ChunkedVectorTest, CopiesAreIndependent) {
+  SmallChunkedVector chunked_vector;
+  for (int i = 0; i != 6; ++i) {
+    chunked_vector.push_back(i);
+  }
+  const SmallChunkedVector copy = chunked_vector;
+  chunked_vector.push_back(6);
+  chunked_vector.Truncate(5);
+  chunked_vector.push_back(-1);
+  EXPECT_THAT(ToVector(copy), ElementsAre(0, 1, 2, 3, 4, 5));
+  EXPECT_THAT(ToVector(chunked_vector), ElementsAre(0, 1, 2, 3, 4, -1));
+
+  // Changes to a chunk which is no longer shared are kept.
+  chunked_vector.Truncate(2);
+  chunked_vector.push_back(-2);
+  EXPECT_THAT(ToVector(chunked_vector), ElementsAre(0, 1, -2));
+  EXPECT_THAT(ToVector(copy), ElementsAre(0, 1, 2, 3, 4, 5));
+}
+
+TEST(ChunkedVectorTest, TruncatesAtChunkBoundaries) {
+  SmallChunkedVector chunked_vector;
+  for (int i = 0; i != 8; ++i) {
+    chunked_vector.push_back(i);
+  }
+  chunked_vector.Truncate(4);
+  EXPECT_THAT(ToVector(chunked_vector), ElementsAre(0, 1, 2, 3));
+  chunked_vector.push_back(4);
+  EXPECT_THAT(ToVector(chunked_vector), ElementsAre(0, 1, 2, 3, 4));
+  chunked_vector.Truncate(0);
+  EXPECT_TRUE(chunked_vector.empty());
+  chunked_vector.push_back(5);
+  EXPECT_THAT(ToVector(chunked_vector), ElementsAre(5));
+}
+
+}  // namespace
+}  // namespace common
+}  // namespace cartographer
@@ -0,0 +1,198 @@
+/*
+ * Copyright 2017 The Cartographer Authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef CARTOGRAPHER_COMMON_LRU_CACHE_H_
+#define CARTOGRAPHER_COMMON_LRU_CACHE_H_
+
+#include <chrono>
+#include <functional>
+#include <list>
+#include <map>
+#include <memory>
+#include <set>
+#include <sstream>
+#include <utility>
+
+#include "cartographer/common/mutex.h"
+#include "cartographer/common/port.h"
+#include "glog/logging.h"
+
+namespace cartographer {
+namespace common {
+
+// A thread-safe cache of immutable values by key which is bounded by the
+// memory the values use, as reported by 'ValueType::size_in_bytes()'. Once the
+// budget is exceeded, the least recently used values are evicted. Values still
+// referenced elsewhere stay valid after eviction.
+template <typename KeyType, typename ValueType>
+class LruCache {
+ public:
+  struct Statistics {
+    // Calls of GetOrCompute() which found a valid value and which did not.
+    int64 num_hits;
+    int64 num_misses;
+    int64 num_evictions;
+    // Time spent computing values in GetOrCompute().
+    double compute_seconds;
+    int64 size_in_bytes;
+
+    string ToString() const {
+      std::ostringstream result;
+      result << num_hits << " hits, " << num_misses << " misses, "
+             << num_evictions << " evictions, " << compute_seconds
+             << " s computing, " << size_in_bytes / (1024 * 1024)
+             << " MiB in use.";
+      return result.str();
+    }
+  };
+
+  explicit LruCache(const int64 max_size_in_bytes)
+      : max_size_in_bytes_(max_size_in_bytes) {
+    CHECK_GT(max_size_in_bytes_, 0);
+  }
+
+  LruCache(const LruCache&) = delete;
+  LruCache& operator=(const LruCache&) = delete;
+
+  // Returns the value for 'key' if one is cached and 'is_valid' accepts it, or
+  // else caches and returns the result of 'compute'. Only the calling thread is
+  // blocked while computing, except for concurrent calls for the same 'key'
+  // which wait for the value instead of computing it again. 'is_valid' may be
+  // empty to accept all cached values.
+  std::shared_ptr<const ValueType> GetOrCompute(
+      const KeyType& key,
+      const std::function<std::shared_ptr<const ValueType>()>& compute,
+      const std::function<bool(const ValueType&)>& is_valid = nullptr) {
+    {
+      MutexLocker locker(&mutex_);
+      locker.Await([this, &key]() REQUIRES(mutex_) {
+        return keys_in_computation_.count(key) == 0;
+      });
+      const auto it = entries_.find(key);
+      if (it != entries_.end() && (!is_valid || is_valid(*it->second.value))) {
+        ++num_hits_;
+        usage_order_.splice(usage_order_.begin(), usage_order_,
+                            it->second.position);
+        return it->second.value;
+      }
+      ++num_misses_;
+      keys_in_computation_.insert(key);
+    }
+    const auto start = std::chrono::steady_clock::now();
+    std::shared_ptr<const ValueType> value = compute();
+    const std::chrono::duration<double> compute_duration =
+        std::chrono::steady_clock::now() - start;
+    MutexLocker locker(&mutex_);
+    keys_in_computation_.erase(key);
+    compute_seconds_ += compute_duration.count();
+    InsertLocked(key, value);
+    return value;
+  }
+
+  // Returns the cached value for 'key' or nullptr.
+  std::shared_ptr<const ValueType> Get(const KeyType& key) {
+    MutexLocker locker(&mutex_);
+    const auto it = entries_.find(key);
+    if (it == entries_.end()) {
+      return nullptr;
+    }
+    usage_order_.splice(usage_order_.begin(), usage_order_,
+                        it->second.position);
+    return it->second.value;
+  }
+
+  // Adds 'value' for 'key', replacing any cached one.
+  void Insert(const KeyType& key, std::shared_ptr<const ValueType> value) {
+    MutexLocker locker(&mutex_);
+    InsertLocked(key, std::move(value));
+  }
+
+  // Removes the value for 'key' if it is cached.
+  void Erase(const KeyType& key) {
+    MutexLocker locker(&mutex_);
+    EraseLocked(key);
+  }
+
+  // Returns the memory used by all cached values.
+  int64 GetSizeInBytes() {
+    MutexLocker locker(&mutex_);
+    return size_in_bytes_;
+  }
+
+  Statistics GetStatistics() {
+    MutexLocker locker(&mutex_);
+    return Statistics{num_hits_, num_misses_, num_evictions_, compute_seconds_,
+                      size_in_bytes_};
+  }
+
+ private:
+  struct Entry {
+    std::shared_ptr<const ValueType> value;
+    // Position in 'usage_order_'.
+    typename std::list<KeyType>::iterator position;
+  };
+
+  void InsertLocked(const KeyType& key, std::shared_ptr<const ValueType> value)
+      REQUIRES(mutex_) {
+    CHECK(value != nullptr);
+    EraseLocked(key);
+    size_in_bytes_ += value->size_in_bytes();
+    usage_order_.push_front(key);
+    entries_[key] = Entry{std::move(value), usage_order_.begin()};
+    EvictLocked();
+  }
+
+  void EraseLocked(const KeyType& key) REQUIRES(mutex_) {
+    const auto it = entries_.find(key);
+    if (it == entries_.end()) {
+      return;
+    }
+    size_in_bytes_ -= it->second.value->size_in_bytes();
+    usage_order_.erase(it->second.position);
+    entries_.erase(it);
+  }
+
+  // Evicts least recently used entries other than the most recent one until
+  // the budget is met.
+  void EvictLocked() REQUIRES(mutex_) {
+    while (size_in_bytes_ > max_size_in_bytes_ && usage_order_.size() > 1) {
+      const KeyType key = usage_order_.back();
+      VLOG(1) << "Evicting " << key << ".";
+      EraseLocked(key);
+      ++num_evictions_;
+    }
+  }
+
+  const int64 max_size_in_bytes_;
+
+  Mutex mutex_;
+  std::map<KeyType, Entry> entries_ GUARDED_BY(mutex_);
+  // All cached keys, the most recently used first.
+  std::list<KeyType> usage_order_ GUARDED_BY(mutex_);
+  int64 size_in_bytes_ GUARDED_BY(mutex_) = 0;
+  // Keys for which a value is currently being computed.
+  std::set<KeyType> keys_in_computation_ GUARDED_BY(mutex_);
+
+  int64 num_hits_ GUARDED_BY(mutex_) = 0;
+  int64 num_misses_ GUARDED_BY(mutex_) = 0;
+  int64 num_evictions_ GUARDED_BY(mutex_) = 0;
+  double compute_seconds_ GUARDED_BY(mutex_) = 0.;
+};
+
+}  // namespace common
+}  // namespace cartographer
+
+#endif  // CARTOGRAPHER_COMMON_LRU_CACHE_H_
@@ -0,0 +1,132 @@
+/*
+ * Copyright 2017 The Cartographer Authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "cartographer/common/lru_cache.h"
+
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+namespace cartographer {
+namespace common {
+namespace {
+
+struct Value {
+  int64 size_in_bytes() const { return size; }
+
+  int64 size;
+};
+
+std::function<std::shared_ptr<const Value>()> ComputeValue(const int64 size,
+                                                           int* num_calls) {
+  return [size, num_calls]() {
+    ++*num_calls;
+    return std::make_shared<const Value>(Value{size});
+  };
+}
+
+TEST(LruCacheTest, ReturnsCachedValues) {
+  LruCache<int, Value> cache(100);
+  int num_calls = 0;
+  EXPECT_EQ(nullptr, cache.Get(1));
+  const auto value = cache.GetOrCompute(1, ComputeValue(10, &num_calls));
+  EXPECT_EQ(value, cache.Get(1));
+  EXPECT_EQ(value, cache.GetOrCompute(1, ComputeValue(10, &num_calls)));
+  EXPECT_EQ(1, num_calls);
+  EXPECT_EQ(10, cache.GetSizeInBytes());
+
+  // Values not accepted by 'is_valid' are recomputed.
+  const auto larger_value = cache.GetOrCompute(
+      1, ComputeValue(20, &num_calls),
+      [](const Value& cached_value) { return cached_value.size == 20; });
+  EXPECT_EQ(2, num_calls);
+  EXPECT_EQ(20, larger_value->size);
+  EXPECT_EQ(larger_value, cache.Get(1));
+  EXPECT_EQ(20, cache.GetSizeInBytes());
+
+  const LruCache<int, Value>::Statistics statistics = cache.GetStatistics();
+  EXPECT_EQ(1, statistics.num_hits);
+  EXPECT_EQ(2, statistics.num_misses);
+  EXPECT_EQ(0, statistics.num_evictions);
+  EXPECT_EQ(20, statistics.size_in_bytes);
+
+  cache.Erase(1);
+  EXPECT_EQ(nullptr, cache.Get(1));
+  EXPECT_EQ(0, cache.GetSizeInBytes());
+}
+
+TEST(LruCacheTest, EvictsLeastRecentlyUsed) {
+  LruCache<int, Value> cache(20);
+  int num_calls = 0;
+  const auto first = cache.GetOrCompute(1, ComputeValue(10, &num_calls));
+  cache.GetOrCompute(2, ComputeValue(10, &num_calls));
+  // Using 1 makes 2 the least recently used.
+  EXPECT_EQ(first, cache.Get(1));
+  cache.Insert(3, std::make_shared<const Value>(Value{10}));
+  EXPECT_EQ(first, cache.Get(1));
+  EXPECT_EQ(nullptr, cache.Get(2));
+  EXPECT_NE(nullptr, cache.Get(3));
+  EXPECT_EQ(20, cache.GetSizeInBytes());
+  EXPECT_EQ(1, cache.GetStatistics().num_evictions);
+
+  // Evicted values are computed again on demand.
+  cache.GetOrCompute(2, ComputeValue(10, &num_calls));
+  EXPECT_EQ(3, num_calls);
+  EXPECT_EQ(nullptr, cache.Get(1));
+}
+
+TEST(LruCacheTest, KeepsMostRecentValueAboveBudget) {
+  LruCache<int, Value> cache(1);
+  int num_calls = 0;
+  cache.GetOrCompute(1, ComputeValue(10, &num_calls));
+  const auto value = cache.GetOrCompute(2, ComputeValue(10, &num_calls));
+  EXPECT_EQ(nullptr, cache.Get(1));
+  EXPECT_EQ(value, cache.Get(2));
+  EXPECT_EQ(10, cache.GetSizeInBytes());
+}
+
+TEST(LruCacheTest, ComputesOnceForConcurrentCalls) {
+  LruCache<int, Value> cache(100);
+  std::atomic<int> num_calls(0);
+  constexpr int kNumThreads = 8;
+  std::vector<std::shared_ptr<const Value>> values(kNumThreads);
+  std::vector<std::thread> threads;
+  for (int i = 0; i != kNumThreads; ++i) {
+    threads.emplace_back([&cache, &num_calls, &values, i]() {
+      values[i] = cache.GetOrCompute(1, [&num_calls]() {
+        ++num_calls;
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        return std::make_shared<const Value>(Value{10});
+      });
+    });
+  }
+  for (std::thread& thread : threads) {
+    thread.join();
+  }
+  EXPECT_EQ(1, num_calls);
+  for (const auto& value : values) {
+    EXPECT_EQ(values.front(), value);
+  }
+}
+
+}  // namespace
+}  // namespace common
+}  // namespace cartographer
@@ -0,0 +1,283 @@
+/*
+ * Copyright 2017 The Cartographer Authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef CARTOGRAPHER_COMMON_MPSC_QUEUE_H_
+#define CARTOGRAPHER_COMMON_MPSC_QUEUE_H_
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+
+#include "cartographer/common/port.h"
+#include "cartographer/common/time.h"
+#include "glog/logging.h"
+
+namespace cartographer {
+namespace common {
+
+// A lock-free bounded queue for multiple producers and a single consumer,
+// implemented as a ring buffer with a sequence number per slot (after Dmitry
+// Vyukov's bounded MPMC queue). TryPush() may be called from any thread,
+// TryPop() and Peek() only from the consumer thread. 'T' must be default
+// constructible and movable.
+template <typename T>
+class MpscQueue {
+ public:
+  static constexpr size_t kDefaultCapacity = 64;
+
+  MpscQueue() : MpscQueue(kDefaultCapacity) {}
+
+  // Constructs a queue that can hold 'capacity' values, which must be a power
+  // of two and at least 2.
+  explicit MpscQueue(const size_t capacity)
+      : enqueue_position_(0), dequeue_position_(0) {
+    Allocate(capacity);
+  }
+
+  MpscQueue(const MpscQueue&) = delete;
+  MpscQueue& operator=(const MpscQueue&) = delete;
+
+  // Moves 't' into the queue and returns true, or returns false and leaves 't'
+  // untouched if the queue is full.
+  bool TryPush(T&& t) {
+    size_t position = enqueue_position_.load(std::memory_order_relaxed);
+    Cell* cell;
+    for (;;) {
+      cell = &cells_[position & mask_];
+      const size_t sequence = cell->sequence.load(std::memory_order_acquire);
+      const int64 difference =
+          static_cast<int64>(sequence) - static_cast<int64>(position);
+      if (difference == 0) {
+        if (enqueue_position_.compare_exchange_weak(
+                position, position + 1, std::memory_order_relaxed)) {
+          break;
+        }
+      } else if (difference < 0) {
+        return false;
+      } else {
+        position = enqueue_position_.load(std::memory_order_relaxed);
+      }
+    }
+    cell->value = std::move(t);
+    cell->sequence.store(position + 1, std::memory_order_release);
+    return true;
+  }
+
+  // Moves the next value into 't' and returns true, or returns false if no
+  // value is available. Must only be called by the consumer.
+  bool TryPop(T* const t) {
+    const size_t position = dequeue_position_.load(std::memory_order_relaxed);
+    Cell* const cell = &cells_[position & mask_];
+    if (cell->sequence.load(std::memory_order_acquire) != position + 1) {
+      return false;
+    }
+    *t = std::move(cell->value);
+    cell->value = T();
+    cell->sequence.store(position + mask_ + 1, std::memory_order_release);
+    dequeue_position_.store(position + 1, std::memory_order_relaxed);
+    return true;
+  }
+
+  // Returns the next value without removing it, or nullptr if no value is
+  // available. Must only be called by the consumer.
+  const T* Peek() const {
+    const size_t position = dequeue_position_.load(std::memory_order_relaxed);
+    const Cell* const cell = &cells_[position & mask_];
+    if (cell->sequence.load(std::memory_order_acquire) != position + 1) {
+      return nullptr;
+    }
+    return &cell->value;
+  }
+
+  // Returns the number of values in the queue. With concurrent producers this
+  // may include values that are not yet visible to the consumer.
+  size_t Size() const {
+    const size_t dequeue_position =
+        dequeue_position_.load(std::memory_order_relaxed);
+    const size_t enqueue_position =
+        enqueue_position_.load(std::memory_order_relaxed);
+    return enqueue_position - dequeue_position;
+  }
+
+  size_t capacity() const { return mask_ + 1; }
+
+  // Doubles the capacity keeping all queued values. Unlike all other methods,
+  // this requires exclusive access to the queue, i.e. it must not run
+  // concurrently with producers or the consumer.
+  void Grow() {
+    const size_t size = Size();
+    const size_t old_mask = mask_;
+    std::unique_ptr<Cell[]> old_cells = std::move(cells_);
+    const size_t dequeue_position =
+        dequeue_position_.load(std::memory_order_relaxed);
+    Allocate(2 * (old_mask + 1));
+    for (size_t i = 0; i != size; ++i) {
+      cells_[i].value =
+          std::move(old_cells[(dequeue_position + i) & old_mask].value);
+      cells_[i].sequence.store(i + 1, std::memory_order_relaxed);
+    }
+    dequeue_position_.store(0, std::memory_order_relaxed);
+    enqueue_position_.store(size, std::memory_order_relaxed);
+  }
+
+ private:
+  struct Cell {
+    std::atomic<size_t> sequence;
+    T value;
+  };
+
+  void Allocate(const size_t capacity) {
+    CHECK_GE(capacity, 2);
+    CHECK_EQ(capacity & (capacity - 1), 0) << "Capacity must be a power of 2.";
+    mask_ = capacity - 1;
+    cells_.reset(new Cell[capacity]);
+    for (size_t i = 0; i != capacity; ++i) {
+      cells_[i].sequence.store(i, std::memory_order_relaxed);
+    }
+  }
+
+  size_t mask_;
+  std::unique_ptr<Cell[]> cells_;
+
+  // Producers and the consumer modify different positions, so they are kept
+  // on separate cache lines.
+  alignas(64) std::atomic<size_t> enqueue_position_;
+  alignas(64) std::atomic<size_t> dequeue_position_;
+};
+
+// Wraps an 'MpscQueue' with the blocking interface of 'BlockingQueue'. The
+// mutex is only taken to wait for or to wake up blocked callers, and there is
+// only one thread allowed to call the Pop*() and Peek() methods.
+template <typename T>
+class BlockingMpscQueue {
+ public:
+  BlockingMpscQueue() : BlockingMpscQueue(MpscQueue<T>::kDefaultCapacity) {}
+
+  explicit BlockingMpscQueue(const size_t capacity)
+      : queue_(capacity), num_waiting_producers_(0), consumer_waiting_(false) {}
+
+  BlockingMpscQueue(const BlockingMpscQueue&) = delete;
+  BlockingMpscQueue& operator=(const BlockingMpscQueue&) = delete;
+
+  // Pushes a value onto the queue. Blocks if the queue is full.
+  void Push(T t) {
+    if (!queue_.TryPush(std::move(t))) {
+      std::unique_lock<std::mutex> lock(mutex_);
+      ++num_waiting_producers_;
+      std::atomic_thread_fence(std::memory_order_seq_cst);
+      not_full_.wait(lock,
+                     [this, &t]() { return queue_.TryPush(std::move(t)); });
+      --num_waiting_producers_;
+    }
+    WakeConsumer();
+  }
+
+  // Like Push, but returns false if 'timeout' is reached.
+  bool PushWithTimeout(T t, const common::Duration timeout) {
+    if (!queue_.TryPush(std::move(t))) {
+      std::unique_lock<std::mutex> lock(mutex_);
+      ++num_waiting_producers_;
+      std::atomic_thread_fence(std::memory_order_seq_cst);
+      const bool pushed = not_full_.wait_for(lock, timeout, [this, &t]() {
+        return queue_.TryPush(std::move(t));
+      });
+      --num_waiting_producers_;
+      if (!pushed) {
+        return false;
+      }
+    }
+    WakeConsumer();
+    return true;
+  }
+
+  // Pops the next value from the queue. Blocks until a value is available.
+  T Pop() {
+    T t;
+    if (!queue_.TryPop(&t)) {
+      std::unique_lock<std::mutex> lock(mutex_);
+      consumer_waiting_ = true;
+      std::atomic_thread_fence(std::memory_order_seq_cst);
+      not_empty_.wait(lock, [this, &t]() { return queue_.TryPop(&t); });
+      consumer_waiting_ = false;
+    }
+    WakeProducers();
+    return t;
+  }
+
+  // Like Pop, but can timeout. Returns nullptr in this case.
+  T PopWithTimeout(const common::Duration timeout) {
+    T t;
+    if (!queue_.TryPop(&t)) {
+      std::unique_lock<std::mutex> lock(mutex_);
+      consumer_waiting_ = true;
+      std::atomic_thread_fence(std::memory_order_seq_cst);
+      const bool popped = not_empty_.wait_for(
+          lock, timeout, [this, &t]() { return queue_.TryPop(&t); });
+      consumer_waiting_ = false;
+      if (!popped) {
+        return nullptr;
+      }
+    }
+    WakeProducers();
+    return t;
+  }
+
+  // Returns the next value in the queue or nullptr if the queue is empty.
+  // Maintains ownership. This assumes a member function get() that returns
+  // a pointer to the given type R.
+  template <typename R>
+  const R* Peek() {
+    const T* const t = queue_.Peek();
+    return t == nullptr ? nullptr : t->get();
+  }
+
+  // Returns the number of items currently in the queue.
+  size_t Size() const { return queue_.Size(); }
+
+ private:
+  // The fences pair with the ones in the waiting paths, so that either the
+  // waiting thread sees the change or we see that it is waiting. Taking the
+  // lock before notifying ensures that it is not between checking and waiting.
+  void WakeConsumer() {
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (consumer_waiting_.load()) {
+      { std::lock_guard<std::mutex> lock(mutex_); }
+      not_empty_.notify_one();
+    }
+  }
+
+  void WakeProducers() {
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (num_waiting_producers_.load() > 0) {
+      { std::lock_guard<std::mutex> lock(mutex_); }
+      not_full_.notify_all();
+    }
+  }
+
+  MpscQueue<T> queue_;
+  std::mutex mutex_;
+  std::condition_variable not_empty_;
+  std::condition_variable not_full_;
+  std::atomic<int> num_waiting_producers_;
+  std::atomic<bool> consumer_waiting_;
+};
+
+}  // namespace common
+}  // namespace cartographer
+
+#endif  // CARTOGRAPHER_COMMON_MPSC_QUEUE_H_
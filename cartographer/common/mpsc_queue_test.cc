@@ -0,0 +1,128 @@
+/*
+ * Copyright 2017 The Cartographer Authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "cartographer/common/mpsc_queue.h"
+
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "cartographer/common/make_unique.h"
+#include "cartographer/common/time.h"
+#include "gtest/gtest.h"
+
+namespace cartographer {
+namespace common {
+namespace {
+
+TEST(MpscQueueTest, PushPeekPop) {
+  MpscQueue<std::unique_ptr<int>> queue(2);
+  EXPECT_EQ(nullptr, queue.Peek());
+  EXPECT_TRUE(queue.TryPush(common::make_unique<int>(42)));
+  EXPECT_TRUE(queue.TryPush(common::make_unique<int>(24)));
+  EXPECT_EQ(2, queue.Size());
+  auto rejected = common::make_unique<int>(1);
+  EXPECT_FALSE(queue.TryPush(std::move(rejected)));
+  ASSERT_NE(nullptr, rejected);
+  EXPECT_EQ(42, **queue.Peek());
+  std::unique_ptr<int> value;
+  EXPECT_TRUE(queue.TryPop(&value));
+  EXPECT_EQ(42, *value);
+  EXPECT_TRUE(queue.TryPush(std::move(rejected)));
+  EXPECT_TRUE(queue.TryPop(&value));
+  EXPECT_EQ(24, *value);
+  EXPECT_TRUE(queue.TryPop(&value));
+  EXPECT_EQ(1, *value);
+  EXPECT_FALSE(queue.TryPop(&value));
+  EXPECT_EQ(0, queue.Size());
+}
+
+TEST(MpscQueueTest, GrowKeepsOrder) {
+  MpscQueue<std::unique_ptr<int>> queue(4);
+  std::unique_ptr<int> value;
+  // Move the positions so that the queued values wrap around.
+  for (int i = 0; i != 3; ++i) {
+    EXPECT_TRUE(queue.TryPush(common::make_unique<int>(-1)));
+    EXPECT_TRUE(queue.TryPop(&value));
+  }
+  for (int i = 0; i != 4; ++i) {
+    EXPECT_TRUE(queue.TryPush(common::make_unique<int>(i)));
+  }
+  EXPECT_FALSE(queue.TryPush(common::make_unique<int>(4)));
+  queue.Grow();
+  EXPECT_EQ(8, queue.capacity());
+  EXPECT_EQ(4, queue.Size());
+  for (int i = 4; i != 8; ++i) {
+    EXPECT_TRUE(queue.TryPush(common::make_unique<int>(i)));
+  }
+  for (int i = 0; i != 8; ++i) {
+    EXPECT_TRUE(queue.TryPop(&value));
+    EXPECT_EQ(i, *value);
+  }
+  EXPECT_FALSE(queue.TryPop(&value));
+}
+
+TEST(BlockingMpscQueueTest, ManyProducers) {
+  constexpr int kNumProducers = 4;
+  constexpr int kNumValuesPerProducer = 10000;
+  BlockingMpscQueue<std::unique_ptr<int>> queue(16);
+  std::vector<std::thread> producers;
+  for (int i = 0; i != kNumProducers; ++i) {
+    producers.emplace_back([&queue, i]() {
+      for (int j = 0; j != kNumValuesPerProducer; ++j) {
+        queue.Push(common::make_unique<int>(i * kNumValuesPerProducer + j));
+      }
+    });
+  }
+  // Values of each producer arrive in order.
+  std::vector<int> next_value(kNumProducers);
+  for (int i = 0; i != kNumProducers; ++i) {
+    next_value[i] = i * kNumValuesPerProducer;
+  }
+  for (int i = 0; i != kNumProducers * kNumValuesPerProducer; ++i) {
+    const int value = *queue.Pop();
+    const int producer = value / kNumValuesPerProducer;
+    EXPECT_EQ(next_value[producer], value);
+    ++next_value[producer];
+  }
+  for (std::thread& producer : producers) {
+    producer.join();
+  }
+  EXPECT_EQ(0, queue.Size());
+  EXPECT_EQ(nullptr, queue.Peek<int>());
+}
+
+TEST(BlockingMpscQueueTest, PopWithTimeout) {
+  BlockingMpscQueue<std::unique_ptr<int>> queue;
+  EXPECT_EQ(nullptr, queue.PopWithTimeout(common::FromMilliseconds(150)));
+}
+
+TEST(BlockingMpscQueueTest, PushWithTimeout) {
+  BlockingMpscQueue<std::unique_ptr<int>> queue(2);
+  EXPECT_TRUE(queue.PushWithTimeout(common::make_unique<int>(42),
+                                    common::FromMilliseconds(150)));
+  EXPECT_TRUE(queue.PushWithTimeout(common::make_unique<int>(24),
+                                    common::FromMilliseconds(150)));
+  EXPECT_FALSE(queue.PushWithTimeout(common::make_unique<int>(15),
+                                     common::FromMilliseconds(150)));
+  EXPECT_EQ(42, *queue.Pop());
+  EXPECT_EQ(24, *queue.Pop());
+  EXPECT_EQ(0, queue.Size());
+}
+
+}  // namespace
+}  // namespace common
+}  // namespace cartographer
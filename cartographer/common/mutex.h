@@ -66,9 +66,11 @@ class CAPABILITY("mutex") Mutex {
    public:
     Locker(Mutex* mutex) ACQUIRE(mutex) : mutex_(mutex), lock_(mutex->mutex_) {}
 
+    // Waiters are notified before the mutex is released, since a waiter may
+    // destroy the mutex as soon as it can acquire it.
     ~Locker() RELEASE() {
-      lock_.unlock();
       mutex_->condition_.notify_all();
+      lock_.unlock();
     }
 
     template <typename Predicate>
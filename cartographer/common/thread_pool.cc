@@ -21,60 +21,182 @@
 #include <chrono>
 #include <numeric>
 
+#include "cartographer/common/make_unique.h"
 #include "glog/logging.h"
 
 namespace cartographer {
 namespace common {
 
-ThreadPool::ThreadPool(int num_threads) {
-  MutexLocker locker(&mutex_);
+thread_local ThreadPool::Worker* ThreadPool::current_worker_ = nullptr;
+
+ThreadPool::ThreadPool(int num_threads)
+    : ThreadPool(num_threads, true /* lower_thread_priority */) {}
+
+ThreadPool::ThreadPool(int num_threads, const bool lower_thread_priority)
+    : lower_thread_priority_(lower_thread_priority),
+      num_queued_work_items_(0),
+      running_(true),
+      num_idle_workers_(0) {
+  for (std::atomic<int>& num_injected : num_injected_work_items_) {
+    num_injected.store(0);
+  }
+  // All workers have to exist before the first thread starts stealing.
   for (int i = 0; i != num_threads; ++i) {
-    pool_.emplace_back([this]() { ThreadPool::DoWork(); });
+    workers_.push_back(common::make_unique<Worker>());
+    workers_.back()->thread_pool = this;
+    workers_.back()->index = i;
+  }
+  for (const std::unique_ptr<Worker>& worker : workers_) {
+    Worker* const worker_ptr = worker.get();
+    pool_.emplace_back([this, worker_ptr]() { DoWork(worker_ptr); });
   }
 }
 
 ThreadPool::~ThreadPool() {
   {
-    MutexLocker locker(&mutex_);
+    std::lock_guard<std::mutex> lock(idle_mutex_);
     CHECK(running_);
     running_ = false;
-    CHECK_EQ(work_queue_.size(), 0);
   }
+  idle_condition_.notify_all();
   for (std::thread& thread : pool_) {
     thread.join();
   }
 }
 
 void ThreadPool::Schedule(const std::function<void()>& work_item) {
-  MutexLocker locker(&mutex_);
+  Schedule(work_item, Priority::kNormal);
+}
+
+void ThreadPool::Schedule(const std::function<void()>& work_item,
+                          const Priority priority) {
   CHECK(running_);
-  work_queue_.push_back(work_item);
+  CHECK(work_item);
+  const int priority_index = static_cast<int>(priority);
+  auto item = common::make_unique<WorkItem>(work_item);
+  if (current_worker_ != nullptr && current_worker_->thread_pool == this) {
+    current_worker_->queues[priority_index].Push(item.release());
+  } else {
+    MutexLocker locker(&injection_mutex_);
+    injection_queues_[priority_index].push_back(item.release());
+    ++num_injected_work_items_[priority_index];
+  }
+  ++num_queued_work_items_;
+  if (num_idle_workers_.load() > 0) {
+    // Taking the lock ensures that a thread which is about to go idle either
+    // sees the new work item or is already waiting and gets notified.
+    { std::lock_guard<std::mutex> lock(idle_mutex_); }
+    idle_condition_.notify_one();
+  }
 }
 
-void ThreadPool::DoWork() {
+ThreadPool::WorkItem* ThreadPool::PopInjectedWorkItem(const int priority) {
+  if (num_injected_work_items_[priority].load() == 0) {
+    return nullptr;
+  }
+  MutexLocker locker(&injection_mutex_);
+  std::deque<WorkItem*>& queue = injection_queues_[priority];
+  if (queue.empty()) {
+    return nullptr;
+  }
+  WorkItem* const item = queue.front();
+  queue.pop_front();
+  --num_injected_work_items_[priority];
+  return item;
+}
+
+std::unique_ptr<ThreadPool::WorkItem> ThreadPool::TryGetWorkItem(
+    Worker* const worker) {
+  const int num_workers = workers_.size();
+  for (int priority = 0; priority != kNumPriorities; ++priority) {
+    WorkItem* item = worker->queues[priority].Pop();
+    if (item == nullptr) {
+      item = PopInjectedWorkItem(priority);
+    }
+    for (int i = 1; item == nullptr && i < num_workers; ++i) {
+      Worker* const victim = workers_[(worker->index + i) % num_workers].get();
+      item = victim->queues[priority].Steal();
+    }
+    if (item != nullptr) {
+      --num_queued_work_items_;
+      return std::unique_ptr<WorkItem>(item);
+    }
+  }
+  return nullptr;
+}
+
+void ThreadPool::DoWork(Worker* const worker) {
 #ifdef __linux__
   // This changes the per-thread nice level of the current thread on Linux. We
   // do this so that the background work done by the thread pool is not taking
   // away CPU resources from more important foreground threads.
-  CHECK_NE(nice(10), -1);
+  if (lower_thread_priority_) {
+    CHECK_NE(nice(10), -1);
+  }
 #endif
+  current_worker_ = worker;
   for (;;) {
-    std::function<void()> work_item;
-    {
-      MutexLocker locker(&mutex_);
-      locker.Await([this]() REQUIRES(mutex_) {
-        return !work_queue_.empty() || !running_;
-      });
-      if (!work_queue_.empty()) {
-        work_item = work_queue_.front();
-        work_queue_.pop_front();
-      } else if (!running_) {
-        return;
+    const std::unique_ptr<WorkItem> work_item = TryGetWorkItem(worker);
+    if (work_item != nullptr) {
+      (*work_item)();
+      continue;
+    }
+    std::unique_lock<std::mutex> lock(idle_mutex_);
+    ++num_idle_workers_;
+    idle_condition_.wait(lock, [this]() {
+      return num_queued_work_items_.load() > 0 || !running_;
+    });
+    --num_idle_workers_;
+    if (!running_ && num_queued_work_items_.load() <= 0) {
+      return;
+    }
+  }
+}
+
+void ParallelFor(ThreadPool* const thread_pool, const int num_tasks,
+                 const std::function<void(int)>& task) {
+  CHECK_GE(num_tasks, 0);
+  // Helpers may only start after this function returned, so they share
+  // ownership of the state and must not touch 'task' once all indices were
+  // handed out.
+  struct State {
+    State(const std::function<void(int)>& task, const int num_tasks)
+        : task(task), num_tasks(num_tasks), next_index(0) {}
+
+    void RunTasks() {
+      for (;;) {
+        const int index = next_index++;
+        if (index >= num_tasks) {
+          return;
+        }
+        task(index);
+        MutexLocker locker(&mutex);
+        ++num_finished_tasks;
       }
     }
-    CHECK(work_item);
-    work_item();
+
+    const std::function<void(int)> task;
+    const int num_tasks;
+    std::atomic<int> next_index;
+    Mutex mutex;
+    int num_finished_tasks GUARDED_BY(mutex) = 0;
+  };
+  const auto state = std::make_shared<State>(task, num_tasks);
+  if (thread_pool != nullptr) {
+    const int num_helpers =
+        std::min(num_tasks - 1, thread_pool->num_threads());
+    for (int i = 0; i < num_helpers; ++i) {
+      // The calling thread is blocked until the tasks are done, so helpers
+      // should start before other queued work.
+      thread_pool->Schedule([state]() { state->RunTasks(); },
+                            ThreadPool::Priority::kHigh);
+    }
   }
+  state->RunTasks();
+  MutexLocker locker(&state->mutex);
+  locker.Await([&state]() REQUIRES(state->mutex) {
+    return state->num_finished_tasks == state->num_tasks;
+  });
 }
 
 }  // namespace common
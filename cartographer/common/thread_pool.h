@@ -17,40 +17,109 @@
 #ifndef CARTOGRAPHER_COMMON_THREAD_POOL_H_
 #define CARTOGRAPHER_COMMON_THREAD_POOL_H_
 
+#include <array>
+#include <atomic>
+#include <condition_variable>
 #include <deque>
 #include <functional>
+#include <memory>
+#include <mutex>
 #include <thread>
 #include <vector>
 
 #include "cartographer/common/mutex.h"
+#include "cartographer/common/work_stealing_queue.h"
 
 namespace cartographer {
 namespace common {
 
-// A fixed number of threads working on a work queue of work items. Adding a
-// new work item does not block, and will be executed by a background thread
-// eventually. The queue must be empty before calling the destructor. The thread
-// pool will then wait for the currently executing work items to finish and then
-// destroy the threads.
+// A fixed number of threads working on work items. Adding a new work item does
+// not block, and will be executed by a background thread eventually. No work
+// items may be scheduled once the destructor was called. The thread pool will
+// then wait for all queued and currently executing work items to finish and
+// then destroy the threads.
+//
+// Each thread owns a lock-free work-stealing queue per priority. Work items
+// scheduled from within a work item go to the local queue of the calling
+// thread, others go to a shared injection queue. Idle threads steal from the
+// other threads and only sleep when no work is queued anywhere.
 class ThreadPool {
  public:
+  // Queued work items of higher priority are started first. There is no
+  // ordering guarantee between work items of the same priority.
+  enum class Priority { kHigh = 0, kNormal = 1 };
+
+  // The threads lower their nice level, so that background work does not take
+  // CPU resources from foreground threads.
   explicit ThreadPool(int num_threads);
+  // Like the above, but keeps the nice level of the creating thread unless
+  // 'lower_thread_priority' is true. This is meant for pools whose work items
+  // are waited for by a foreground thread.
+  ThreadPool(int num_threads, bool lower_thread_priority);
   ~ThreadPool();
 
   ThreadPool(const ThreadPool&) = delete;
   ThreadPool& operator=(const ThreadPool&) = delete;
 
+  // Schedules 'work_item' with 'Priority::kNormal'.
   void Schedule(const std::function<void()>& work_item);
+  void Schedule(const std::function<void()>& work_item, Priority priority);
+
+  int num_threads() const { return workers_.size(); }
 
  private:
-  void DoWork();
+  static constexpr int kNumPriorities = 2;
+
+  using WorkItem = std::function<void()>;
+
+  struct Worker {
+    ThreadPool* thread_pool;
+    int index;
+    std::array<WorkStealingQueue<WorkItem>, kNumPriorities> queues;
+  };
+
+  void DoWork(Worker* worker);
+
+  // Returns the next work item for 'worker' or nullptr if none was found. Local
+  // work is preferred over the injection queue which is preferred over
+  // stealing, but only within the same priority.
+  std::unique_ptr<WorkItem> TryGetWorkItem(Worker* worker);
+  WorkItem* PopInjectedWorkItem(int priority);
 
-  Mutex mutex_;
-  bool running_ GUARDED_BY(mutex_) = true;
-  std::vector<std::thread> pool_ GUARDED_BY(mutex_);
-  std::deque<std::function<void()>> work_queue_ GUARDED_BY(mutex_);
+  // The worker running on the current thread, if any.
+  static thread_local Worker* current_worker_;
+
+  const bool lower_thread_priority_;
+
+  std::vector<std::unique_ptr<Worker>> workers_;
+  std::vector<std::thread> pool_;
+
+  // Work items scheduled from outside the pool.
+  Mutex injection_mutex_;
+  std::array<std::deque<WorkItem*>, kNumPriorities> injection_queues_
+      GUARDED_BY(injection_mutex_);
+  std::array<std::atomic<int>, kNumPriorities> num_injected_work_items_;
+
+  // Number of work items that have been scheduled but not yet started. This may
+  // transiently drop below zero while a work item is being scheduled.
+  std::atomic<int> num_queued_work_items_;
+
+  // Idle threads wait on 'idle_condition_' until work is queued. We do not use
+  // 'Mutex' here, since its locker wakes all waiting threads on every release.
+  std::atomic<bool> running_;
+  std::atomic<int> num_idle_workers_;
+  std::mutex idle_mutex_;
+  std::condition_variable idle_condition_;
 };
 
+// Calls 'task' for each index in [0, 'num_tasks') and returns once all calls
+// are done. The calls are distributed over the calling thread and the threads
+// of 'thread_pool', or all made on the calling thread if it is nullptr. Since
+// the calling thread takes part, this may also be called from a work item of
+// 'thread_pool'.
+void ParallelFor(ThreadPool* thread_pool, int num_tasks,
+                 const std::function<void(int)>& task);
+
 }  // namespace common
 }  // namespace cartographer
 
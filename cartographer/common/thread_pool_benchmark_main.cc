@@ -0,0 +1,239 @@
+/*
+ * Copyright 2017 The Cartographer Authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Measures the throughput of the ThreadPool for short work items, compared to
+// the previous thread pool which had a single mutex guarded work queue. Work
+// is either scheduled from several threads outside of the pool or, like the
+// constraint search, from within work items.
+
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <functional>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+#include "cartographer/common/mutex.h"
+#include "cartographer/common/thread_pool.h"
+#include "gflags/gflags.h"
+#include "glog/logging.h"
+
+DEFINE_int32(num_work_items, 200000, "Number of work items per run.");
+DEFINE_int32(work_item_iterations, 200,
+             "Iterations of busy work done by each work item.");
+DEFINE_int32(num_producers, 4,
+             "Number of threads outside the pool scheduling work items.");
+DEFINE_string(num_threads, "1,2,4,8,16",
+              "Comma separated numbers of threads of the pools.");
+
+namespace cartographer {
+namespace common {
+namespace {
+
+double SecondsSince(const std::chrono::steady_clock::time_point start) {
+  const std::chrono::duration<double> elapsed =
+      std::chrono::steady_clock::now() - start;
+  return elapsed.count();
+}
+
+// The thread pool as it was before it became work-stealing: one work queue
+// guarded by a Mutex whose release wakes all waiting threads.
+class MutexThreadPool {
+ public:
+  explicit MutexThreadPool(const int num_threads) {
+    MutexLocker locker(&mutex_);
+    for (int i = 0; i != num_threads; ++i) {
+      pool_.emplace_back([this]() { DoWork(); });
+    }
+  }
+
+  ~MutexThreadPool() {
+    {
+      MutexLocker locker(&mutex_);
+      running_ = false;
+      CHECK_EQ(work_queue_.size(), 0);
+    }
+    for (std::thread& thread : pool_) {
+      thread.join();
+    }
+  }
+
+  void Schedule(const std::function<void()>& work_item) {
+    MutexLocker locker(&mutex_);
+    work_queue_.push_back(work_item);
+  }
+
+ private:
+  void DoWork() {
+    for (;;) {
+      std::function<void()> work_item;
+      {
+        MutexLocker locker(&mutex_);
+        locker.Await([this]() REQUIRES(mutex_) {
+          return !work_queue_.empty() || !running_;
+        });
+        if (!work_queue_.empty()) {
+          work_item = work_queue_.front();
+          work_queue_.pop_front();
+        } else if (!running_) {
+          return;
+        }
+      }
+      work_item();
+    }
+  }
+
+  Mutex mutex_;
+  bool running_ GUARDED_BY(mutex_) = true;
+  std::vector<std::thread> pool_;
+  std::deque<std::function<void()>> work_queue_ GUARDED_BY(mutex_);
+};
+
+// Counts finished work items and lets the benchmark wait for all of them. Only
+// the last work item takes the lock, so that waking the waiting thread does not
+// dominate the measurement.
+class Countdown {
+ public:
+  explicit Countdown(const int count) : count_(count), done_(false) {}
+
+  void Decrement() {
+    if (--count_ == 0) {
+      MutexLocker locker(&mutex_);
+      done_ = true;
+    }
+  }
+
+  void Wait() {
+    MutexLocker locker(&mutex_);
+    locker.Await([this]() REQUIRES(mutex_) { return done_; });
+  }
+
+ private:
+  std::atomic<int> count_;
+  Mutex mutex_;
+  bool done_ GUARDED_BY(mutex_);
+};
+
+void BusyWork() {
+  volatile double value = 1.;
+  for (int i = 0; i != FLAGS_work_item_iterations; ++i) {
+    value = value * 1.0000001 + 1e-9;
+  }
+}
+
+// Schedules all work items from 'FLAGS_num_producers' threads outside of
+// 'thread_pool' and returns the seconds until all of them finished.
+template <typename Pool>
+double BenchmarkExternalScheduling(Pool* const thread_pool) {
+  Countdown countdown(FLAGS_num_work_items);
+  const auto start = std::chrono::steady_clock::now();
+  std::vector<std::thread> producers;
+  for (int i = 0; i != FLAGS_num_producers; ++i) {
+    producers.emplace_back([i, thread_pool, &countdown]() {
+      for (int j = i; j < FLAGS_num_work_items; j += FLAGS_num_producers) {
+        thread_pool->Schedule([&countdown]() {
+          BusyWork();
+          countdown.Decrement();
+        });
+      }
+    });
+  }
+  for (std::thread& producer : producers) {
+    producer.join();
+  }
+  countdown.Wait();
+  return SecondsSince(start);
+}
+
+// Schedules a few work items which each schedule further work items from
+// within the pool, similar to the constraint builder scheduling matches once
+// a scan matcher was built. Returns the seconds until all of them finished.
+template <typename Pool>
+double BenchmarkNestedScheduling(Pool* const thread_pool) {
+  constexpr int kFanOut = 100;
+  const int num_roots = FLAGS_num_work_items / (kFanOut + 1);
+  Countdown countdown(num_roots * (kFanOut + 1));
+  const auto start = std::chrono::steady_clock::now();
+  for (int i = 0; i != num_roots; ++i) {
+    thread_pool->Schedule([thread_pool, &countdown]() {
+      for (int j = 0; j != kFanOut; ++j) {
+        thread_pool->Schedule([&countdown]() {
+          BusyWork();
+          countdown.Decrement();
+        });
+      }
+      countdown.Decrement();
+    });
+  }
+  countdown.Wait();
+  return SecondsSince(start);
+}
+
+std::vector<int> ParseNumThreads() {
+  std::vector<int> result;
+  int value = 0;
+  for (const char c : FLAGS_num_threads + ",") {
+    if (c == ',') {
+      CHECK_GT(value, 0);
+      result.push_back(value);
+      value = 0;
+    } else {
+      CHECK(c >= '0' && c <= '9') << FLAGS_num_threads;
+      value = 10 * value + (c - '0');
+    }
+  }
+  return result;
+}
+
+void Run() {
+  CHECK_GT(FLAGS_num_work_items, 0);
+  CHECK_GT(FLAGS_num_producers, 0);
+  std::cout << "threads  scheduling  mutex pool (us/item)  "
+               "work-stealing pool (us/item)\n";
+  for (const int num_threads : ParseNumThreads()) {
+    double seconds[2][2];
+    {
+      MutexThreadPool thread_pool(num_threads);
+      seconds[0][0] = BenchmarkExternalScheduling(&thread_pool);
+      seconds[1][0] = BenchmarkNestedScheduling(&thread_pool);
+    }
+    {
+      ThreadPool thread_pool(num_threads);
+      seconds[0][1] = BenchmarkExternalScheduling(&thread_pool);
+      seconds[1][1] = BenchmarkNestedScheduling(&thread_pool);
+    }
+    for (int i = 0; i != 2; ++i) {
+      std::cout << num_threads << "  " << (i == 0 ? "external" : "nested")
+                << "  " << 1e6 * seconds[i][0] / FLAGS_num_work_items << "  "
+                << 1e6 * seconds[i][1] / FLAGS_num_work_items << "\n";
+    }
+  }
+}
+
+}  // namespace
+}  // namespace common
+}  // namespace cartographer
+
+int main(int argc, char** argv) {
+  google::InitGoogleLogging(argv[0]);
+  FLAGS_logtostderr = true;
+  google::SetUsageMessage(
+      "\n\n"
+      "Benchmarks the contention of the ThreadPool with short work items.\n");
+  google::ParseCommandLineFlags(&argc, &argv, true);
+  ::cartographer::common::Run();
+}
@@ -0,0 +1,176 @@
+/*
+ * Copyright 2017 The Cartographer Authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "cartographer/common/thread_pool.h"
+
+#include <unistd.h>
+#include <atomic>
+#include <vector>
+
+#include "cartographer/common/mutex.h"
+#include "gtest/gtest.h"
+
+namespace cartographer {
+namespace common {
+namespace {
+
+class Counter {
+ public:
+  void Increment() {
+    MutexLocker locker(&mutex_);
+    ++count_;
+  }
+
+  void WaitFor(const int count) {
+    MutexLocker locker(&mutex_);
+    locker.Await([this, count]() REQUIRES(mutex_) { return count_ == count; });
+  }
+
+ private:
+  Mutex mutex_;
+  int count_ GUARDED_BY(mutex_) = 0;
+};
+
+TEST(ThreadPoolTest, RunsAllWorkItems) {
+  constexpr int kNumWorkItems = 10000;
+  Counter counter;
+  ThreadPool thread_pool(4);
+  for (int i = 0; i != kNumWorkItems; ++i) {
+    thread_pool.Schedule([&counter]() { counter.Increment(); });
+  }
+  counter.WaitFor(kNumWorkItems);
+}
+
+TEST(ThreadPoolTest, RunsWorkItemsScheduledFromWorkItems) {
+  constexpr int kNumOuterWorkItems = 100;
+  constexpr int kNumInnerWorkItems = 100;
+  Counter counter;
+  ThreadPool thread_pool(4);
+  for (int i = 0; i != kNumOuterWorkItems; ++i) {
+    thread_pool.Schedule([&thread_pool, &counter]() {
+      for (int j = 0; j != kNumInnerWorkItems; ++j) {
+        thread_pool.Schedule([&counter]() { counter.Increment(); });
+      }
+      counter.Increment();
+    });
+  }
+  counter.WaitFor(kNumOuterWorkItems * (kNumInnerWorkItems + 1));
+}
+
+TEST(ThreadPoolTest, StartsHighPriorityWorkItemsFirst) {
+  Mutex mutex;
+  bool blocked = true;
+  std::vector<int> order;
+  Counter counter;
+  ThreadPool thread_pool(1);
+  // Keeps the only thread busy until all other work items are queued.
+  thread_pool.Schedule([&mutex, &blocked]() {
+    MutexLocker locker(&mutex);
+    locker.Await([&blocked]() { return !blocked; });
+  });
+  for (int i = 0; i != 3; ++i) {
+    thread_pool.Schedule([&mutex, &order, &counter, i]() {
+      {
+        MutexLocker locker(&mutex);
+        order.push_back(i);
+      }
+      counter.Increment();
+    });
+  }
+  thread_pool.Schedule(
+      [&mutex, &order, &counter]() {
+        {
+          MutexLocker locker(&mutex);
+          order.push_back(-1);
+        }
+        counter.Increment();
+      },
+      ThreadPool::Priority::kHigh);
+  {
+    MutexLocker locker(&mutex);
+    blocked = false;
+  }
+  counter.WaitFor(4);
+  MutexLocker locker(&mutex);
+  EXPECT_EQ((std::vector<int>{-1, 0, 1, 2}), order);
+}
+
+TEST(ThreadPoolTest, RunsQueuedWorkItemsBeforeDestruction) {
+  constexpr int kNumWorkItems = 1000;
+  std::atomic<int> count(0);
+  {
+    ThreadPool thread_pool(2);
+    for (int i = 0; i != kNumWorkItems; ++i) {
+      thread_pool.Schedule([&count]() { ++count; });
+    }
+  }
+  EXPECT_EQ(kNumWorkItems, count.load());
+}
+
+#ifdef __linux__
+TEST(ThreadPoolTest, LowersThreadPriorityUnlessDisabled) {
+  const int nice_level = nice(0);
+  for (const bool lower_thread_priority : {true, false}) {
+    std::atomic<int> thread_nice_level(0);
+    {
+      ThreadPool thread_pool(1, lower_thread_priority);
+      thread_pool.Schedule(
+          [&thread_nice_level]() { thread_nice_level = nice(0); });
+    }
+    if (lower_thread_priority) {
+      EXPECT_LT(nice_level, thread_nice_level.load());
+    } else {
+      EXPECT_EQ(nice_level, thread_nice_level.load());
+    }
+  }
+}
+#endif
+
+TEST(ParallelForTest, RunsEachTaskOnce) {
+  constexpr int kNumTasks = 1000;
+  std::vector<std::atomic<int>> counts(kNumTasks);
+  for (std::atomic<int>& count : counts) {
+    count.store(0);
+  }
+  ThreadPool thread_pool(4);
+  for (ThreadPool* const pool :
+       {&thread_pool, static_cast<ThreadPool*>(nullptr)}) {
+    ParallelFor(pool, kNumTasks,
+                [&counts](const int index) { ++counts[index]; });
+  }
+  for (const std::atomic<int>& count : counts) {
+    EXPECT_EQ(2, count.load());
+  }
+  ParallelFor(&thread_pool, 0, [](int) { LOG(FATAL) << "No tasks expected."; });
+}
+
+TEST(ParallelForTest, CanBeCalledFromAllThreadsOfThePool) {
+  constexpr int kNumOuterWorkItems = 8;
+  constexpr int kNumTasks = 100;
+  Counter counter;
+  ThreadPool thread_pool(2);
+  for (int i = 0; i != kNumOuterWorkItems; ++i) {
+    thread_pool.Schedule([&thread_pool, &counter]() {
+      ParallelFor(&thread_pool, kNumTasks,
+                  [&counter](int) { counter.Increment(); });
+    });
+  }
+  counter.WaitFor(kNumOuterWorkItems * kNumTasks);
+}
+
+}  // namespace
+}  // namespace common
+}  // namespace cartographer
@@ -0,0 +1,164 @@
+/*
+ * Copyright 2017 The Cartographer Authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef CARTOGRAPHER_COMMON_WORK_STEALING_QUEUE_H_
+#define CARTOGRAPHER_COMMON_WORK_STEALING_QUEUE_H_
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+#include "cartographer/common/make_unique.h"
+#include "cartographer/common/port.h"
+#include "glog/logging.h"
+
+namespace cartographer {
+namespace common {
+
+// A lock-free Chase-Lev work-stealing deque of pointers to 'T'. Exactly one
+// thread, the owner, may call Push() and Pop(), which operate on the bottom end
+// in LIFO order. Any number of other threads may concurrently call Steal(),
+// which takes elements from the top end in FIFO order. The queue does not own
+// the pointees.
+//
+// The memory orderings follow "Correct and Efficient Work-Stealing for Weak
+// Memory Models" by Lê, Pop, Cohen and Zappa Nardelli (PPoPP 2013).
+template <typename T>
+class WorkStealingQueue {
+ public:
+  explicit WorkStealingQueue(const int64 initial_capacity = 64)
+      : top_(0), bottom_(0) {
+    CHECK_GT(initial_capacity, 0);
+    CHECK_EQ(initial_capacity & (initial_capacity - 1), 0)
+        << "Capacity must be a power of two.";
+    buffers_.push_back(common::make_unique<Buffer>(initial_capacity));
+    buffer_.store(buffers_.back().get(), std::memory_order_relaxed);
+  }
+
+  WorkStealingQueue(const WorkStealingQueue&) = delete;
+  WorkStealingQueue& operator=(const WorkStealingQueue&) = delete;
+
+  // Adds 'item' at the bottom. Must only be called by the owner.
+  void Push(T* const item) {
+    const int64 bottom = bottom_.load(std::memory_order_relaxed);
+    const int64 top = top_.load(std::memory_order_acquire);
+    Buffer* buffer = buffer_.load(std::memory_order_relaxed);
+    if (bottom - top > buffer->capacity() - 1) {
+      buffer = Grow(buffer, top, bottom);
+    }
+    buffer->Put(bottom, item);
+    bottom_.store(bottom + 1, std::memory_order_release);
+  }
+
+  // Removes and returns the bottom element, or nullptr if the queue is empty.
+  // Must only be called by the owner.
+  T* Pop() {
+    const int64 bottom = bottom_.load(std::memory_order_relaxed) - 1;
+    Buffer* const buffer = buffer_.load(std::memory_order_relaxed);
+    bottom_.store(bottom, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    int64 top = top_.load(std::memory_order_relaxed);
+    if (top > bottom) {
+      // The queue was already empty.
+      bottom_.store(bottom + 1, std::memory_order_relaxed);
+      return nullptr;
+    }
+    T* item = buffer->Get(bottom);
+    if (top == bottom) {
+      // This was the last element, race against concurrent Steal()s for it.
+      if (!top_.compare_exchange_strong(top, top + 1,
+                                        std::memory_order_seq_cst,
+                                        std::memory_order_relaxed)) {
+        item = nullptr;
+      }
+      bottom_.store(bottom + 1, std::memory_order_relaxed);
+    }
+    return item;
+  }
+
+  // Removes and returns the top element, or nullptr if the queue is empty or
+  // another thread won the race for it. May be called from any thread.
+  T* Steal() {
+    int64 top = top_.load(std::memory_order_acquire);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    const int64 bottom = bottom_.load(std::memory_order_acquire);
+    if (top >= bottom) {
+      return nullptr;
+    }
+    Buffer* const buffer = buffer_.load(std::memory_order_acquire);
+    T* const item = buffer->Get(top);
+    if (!top_.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst,
+                                      std::memory_order_relaxed)) {
+      return nullptr;
+    }
+    return item;
+  }
+
+  // Returns true if the queue looked empty at the time of the call.
+  bool Empty() const {
+    const int64 top = top_.load(std::memory_order_acquire);
+    const int64 bottom = bottom_.load(std::memory_order_acquire);
+    return top >= bottom;
+  }
+
+ private:
+  // Circular array of atomic element slots.
+  class Buffer {
+   public:
+    explicit Buffer(const int64 capacity)
+        : mask_(capacity - 1),
+          slots_(new std::atomic<T*>[static_cast<size_t>(capacity)]) {}
+
+    int64 capacity() const { return mask_ + 1; }
+
+    T* Get(const int64 index) const {
+      return slots_[index & mask_].load(std::memory_order_relaxed);
+    }
+
+    void Put(const int64 index, T* const item) {
+      slots_[index & mask_].store(item, std::memory_order_relaxed);
+    }
+
+   private:
+    const int64 mask_;
+    std::unique_ptr<std::atomic<T*>[]> slots_;
+  };
+
+  // Replaces 'buffer' with one of twice its capacity. Thieves may still be
+  // reading from the old buffer, so it is kept alive until destruction.
+  Buffer* Grow(Buffer* const buffer, const int64 top, const int64 bottom) {
+    buffers_.push_back(common::make_unique<Buffer>(2 * buffer->capacity()));
+    Buffer* const new_buffer = buffers_.back().get();
+    for (int64 i = top; i != bottom; ++i) {
+      new_buffer->Put(i, buffer->Get(i));
+    }
+    buffer_.store(new_buffer, std::memory_order_release);
+    return new_buffer;
+  }
+
+  std::atomic<int64> top_;
+  std::atomic<int64> bottom_;
+  std::atomic<Buffer*> buffer_;
+
+  // All buffers ever used, only modified by the owner.
+  std::vector<std::unique_ptr<Buffer>> buffers_;
+};
+
+}  // namespace common
+}  // namespace cartographer
+
+#endif  // CARTOGRAPHER_COMMON_WORK_STEALING_QUEUE_H_
@@ -0,0 +1,90 @@
+/*
+ * Copyright 2017 The Cartographer Authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "cartographer/common/work_stealing_queue.h"
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+namespace cartographer {
+namespace common {
+namespace {
+
+TEST(WorkStealingQueueTest, PopIsLifoAndStealIsFifo) {
+  int values[] = {0, 1, 2, 3};
+  WorkStealingQueue<int> queue(2);
+  EXPECT_TRUE(queue.Empty());
+  for (int& value : values) {
+    queue.Push(&value);
+  }
+  EXPECT_FALSE(queue.Empty());
+  EXPECT_EQ(&values[0], queue.Steal());
+  EXPECT_EQ(&values[3], queue.Pop());
+  EXPECT_EQ(&values[1], queue.Steal());
+  EXPECT_EQ(&values[2], queue.Pop());
+  EXPECT_EQ(nullptr, queue.Pop());
+  EXPECT_EQ(nullptr, queue.Steal());
+  EXPECT_TRUE(queue.Empty());
+}
+
+TEST(WorkStealingQueueTest, EveryElementIsTakenExactlyOnce) {
+  constexpr int kNumElements = 100000;
+  constexpr int kNumThieves = 3;
+  std::vector<int> elements(kNumElements);
+  std::vector<std::atomic<int>> times_taken(kNumElements);
+  for (std::atomic<int>& count : times_taken) {
+    count.store(0);
+  }
+  WorkStealingQueue<int> queue;
+  std::atomic<bool> done(false);
+  std::vector<std::thread> thieves;
+  for (int i = 0; i != kNumThieves; ++i) {
+    thieves.emplace_back([&]() {
+      while (!done.load()) {
+        int* const element = queue.Steal();
+        if (element != nullptr) {
+          ++times_taken[element - elements.data()];
+        }
+      }
+    });
+  }
+  for (int i = 0; i != kNumElements; ++i) {
+    queue.Push(&elements[i]);
+    if (i % 3 == 0) {
+      int* const element = queue.Pop();
+      if (element != nullptr) {
+        ++times_taken[element - elements.data()];
+      }
+    }
+  }
+  while (int* const element = queue.Pop()) {
+    ++times_taken[element - elements.data()];
+  }
+  done.store(true);
+  for (std::thread& thief : thieves) {
+    thief.join();
+  }
+  for (const std::atomic<int>& count : times_taken) {
+    EXPECT_EQ(1, count.load());
+  }
+}
+
+}  // namespace
+}  // namespace common
+}  // namespace cartographer
@@ -89,7 +89,7 @@ class NestedVectorsById {
   }
 
   // TODO(whess): Remove once no longer needed.
-  const std::vector<std::vector<ValueType>> data() const { return data_; }
+  const std::vector<std::vector<ValueType>>& data() const { return data_; }
 
  private:
   static int GetIndex(const NodeId& id) { return id.node_index; }
@@ -147,9 +147,11 @@ string MapBuilder::SubmapToProto(const mapping::SubmapId& submap_id,
 void MapBuilder::SerializeState(io::ProtoStreamWriter* const writer) {
   // We serialize the pose graph followed by all the data referenced in it.
   writer->WriteProto(sparse_pose_graph_->ToProto());
+  const std::shared_ptr<const SparsePoseGraph::Snapshot> snapshot =
+      sparse_pose_graph_->GetSnapshot();
   // Next we serialize all submap data.
   {
-    const auto submap_data = sparse_pose_graph_->GetAllSubmapData();
+    const auto& submap_data = snapshot->submap_data;
     for (int trajectory_id = 0;
          trajectory_id != static_cast<int>(submap_data.size());
          ++trajectory_id) {
@@ -162,6 +164,20 @@ void MapBuilder::SerializeState(io::ProtoStreamWriter* const writer) {
         submap_proto->mutable_submap_id()->set_trajectory_id(trajectory_id);
         submap_proto->mutable_submap_id()->set_submap_index(submap_index);
         submap_data[trajectory_id][submap_index].submap->ToProto(submap_proto);
+        if (sparse_pose_graph_2d_ != nullptr &&
+            options_.sparse_pose_graph_options()
+                .constraint_builder_options()
+                .serialize_precomputation_grids()) {
+          // Only grids which are still cached are serialized, others will be
+          // recomputed when needed after loading.
+          const auto precomputation_grid_stack =
+              sparse_pose_graph_2d_->precomputation_grid_stack_cache()->Get(
+                  SubmapId{trajectory_id, submap_index});
+          if (precomputation_grid_stack != nullptr) {
+            *submap_proto->mutable_precomputation_grid_stack_2d() =
+                precomputation_grid_stack->ToProto();
+          }
+        }
         // TODO(whess): Only enable optionally? Resulting pbstream files will be
         // a lot larger now.
         writer->WriteProto(proto);
@@ -170,7 +186,7 @@ void MapBuilder::SerializeState(io::ProtoStreamWriter* const writer) {
   }
   // Next we serialize all node data.
   {
-    const auto node_data = sparse_pose_graph_->GetTrajectoryNodes();
+    const auto& node_data = snapshot->trajectory_nodes;
     for (int trajectory_id = 0;
          trajectory_id != static_cast<int>(node_data.size()); ++trajectory_id) {
       for (int node_index = 0;
@@ -43,7 +43,10 @@ class PoseGraphTrimmer {
  public:
   virtual ~PoseGraphTrimmer() {}
 
-  // Called once after each pose graph optimization.
+  // Called once before each periodic pose graph optimization, when no
+  // constraint computations are pending. The poses are those of the previous
+  // optimization, extrapolated for data added since. Trimmed submaps and nodes
+  // no longer take part in the following optimization.
   virtual void Trim(Trimmable* pose_graph) = 0;
 };
 
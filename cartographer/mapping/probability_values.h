@@ -60,6 +60,24 @@ inline uint16 ProbabilityToValue(const float probability) {
 
 extern const std::vector<float>* const kValueToProbability;
 
+// Converts a uint16 without update marker to a uint8 in the [1, 255] range, or
+// 0 if the probability is unknown.
+inline uint8 ValueToQuantizedValue(const uint16 value) {
+  if (value == kUnknownProbabilityValue) {
+    return 0;
+  }
+  DCHECK_LE(value, 32767);
+  return 1 + ((value - 1) * 254 + 16383) / 32766;
+}
+
+// Converts a uint8 from ValueToQuantizedValue() back to a uint16 value.
+inline uint16 QuantizedValueToValue(const uint8 quantized_value) {
+  if (quantized_value == 0) {
+    return kUnknownProbabilityValue;
+  }
+  return 1 + ((quantized_value - 1) * 32766 + 127) / 254;
+}
+
 // Converts a uint16 (which may or may not have the update marker set) to a
 // probability in the range [kMinProbability, kMaxProbability].
 inline float ValueToProbability(const uint16 value) {
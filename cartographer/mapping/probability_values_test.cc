@@ -30,6 +30,23 @@ TEST(ProbabilityValuesTest, OddsConversions) {
   EXPECT_NEAR(ProbabilityFromOdds(Odds(0.5)), 0.5, 1e-6);
 }
 
+TEST(ProbabilityValuesTest, QuantizedValueConversions) {
+  EXPECT_EQ(0, ValueToQuantizedValue(kUnknownProbabilityValue));
+  EXPECT_EQ(kUnknownProbabilityValue, QuantizedValueToValue(0));
+  EXPECT_EQ(1, ValueToQuantizedValue(ProbabilityToValue(kMinProbability)));
+  EXPECT_EQ(255, ValueToQuantizedValue(ProbabilityToValue(kMaxProbability)));
+  for (int quantized_value = 0; quantized_value != 256; ++quantized_value) {
+    EXPECT_EQ(quantized_value,
+              ValueToQuantizedValue(QuantizedValueToValue(quantized_value)));
+  }
+  for (int value = 1; value != 32768; ++value) {
+    EXPECT_NEAR(ValueToProbability(value),
+                ValueToProbability(
+                    QuantizedValueToValue(ValueToQuantizedValue(value))),
+                0.5f * (kMaxProbability - kMinProbability) / 254.f + 1e-6f);
+  }
+}
+
 }  // namespace
 }  // namespace mapping
 }  // namespace cartographer
@@ -63,14 +63,40 @@ proto::SparsePoseGraphOptions CreateSparsePoseGraphOptions(
   return options;
 }
 
+std::vector<std::vector<SparsePoseGraph::SubmapData>>
+SparsePoseGraph::GetAllSubmapData() {
+  std::vector<std::vector<SubmapData>> all_submap_data;
+  const auto snapshot = GetSnapshot();
+  for (const auto& submap_data : snapshot->submap_data) {
+    all_submap_data.emplace_back(submap_data.begin(), submap_data.end());
+  }
+  return all_submap_data;
+}
+
+std::vector<std::vector<TrajectoryNode>> SparsePoseGraph::GetTrajectoryNodes() {
+  std::vector<std::vector<TrajectoryNode>> trajectory_nodes;
+  const auto snapshot = GetSnapshot();
+  for (const auto& nodes : snapshot->trajectory_nodes) {
+    trajectory_nodes.emplace_back(nodes.begin(), nodes.end());
+  }
+  return trajectory_nodes;
+}
+
+std::vector<SparsePoseGraph::Constraint> SparsePoseGraph::constraints() {
+  const auto snapshot = GetSnapshot();
+  return std::vector<Constraint>(snapshot->constraints.begin(),
+                                 snapshot->constraints.end());
+}
+
 proto::SparsePoseGraph SparsePoseGraph::ToProto() {
   proto::SparsePoseGraph proto;
 
   std::map<NodeId, NodeId> node_id_remapping;        // Due to trimming.
   std::map<SubmapId, SubmapId> submap_id_remapping;  // Due to trimming.
 
-  const auto all_trajectory_nodes = GetTrajectoryNodes();
-  const auto all_submap_data = GetAllSubmapData();
+  const std::shared_ptr<const Snapshot> snapshot = GetSnapshot();
+  const auto& all_trajectory_nodes = snapshot->trajectory_nodes;
+  const auto& all_submap_data = snapshot->submap_data;
   for (size_t trajectory_id = 0; trajectory_id != all_trajectory_nodes.size();
        ++trajectory_id) {
     auto* trajectory_proto = proto.add_trajectory();
@@ -107,7 +133,7 @@ proto::SparsePoseGraph SparsePoseGraph::ToProto() {
     }
   }
 
-  for (const auto& constraint : constraints()) {
+  for (const auto& constraint : snapshot->constraints) {
     auto* const constraint_proto = proto.add_constraint();
     *constraint_proto->mutable_relative_pose() =
         transform::ToProto(constraint.pose.zbar_ij);
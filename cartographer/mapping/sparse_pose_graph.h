@@ -23,6 +23,7 @@
 #include <utility>
 #include <vector>
 
+#include "cartographer/common/chunked_vector.h"
 #include "cartographer/common/lua_parameter_dictionary.h"
 #include "cartographer/mapping/id.h"
 #include "cartographer/mapping/pose_graph_trimmer.h"
@@ -68,6 +69,14 @@ class SparsePoseGraph {
     transform::Rigid3d pose;
   };
 
+  // An immutable copy of the submaps, trajectory nodes and constraints. Chunks
+  // of data which did not change are shared between snapshots.
+  struct Snapshot {
+    std::vector<common::ChunkedVector<SubmapData>> submap_data;
+    std::vector<common::ChunkedVector<TrajectoryNode>> trajectory_nodes;
+    common::ChunkedVector<Constraint> constraints;
+  };
+
   SparsePoseGraph() {}
   virtual ~SparsePoseGraph() {}
 
@@ -101,7 +110,7 @@ class SparsePoseGraph {
   virtual SubmapData GetSubmapData(const SubmapId& submap_id) = 0;
 
   // Returns data for all Submaps by trajectory.
-  virtual std::vector<std::vector<SubmapData>> GetAllSubmapData() = 0;
+  std::vector<std::vector<SubmapData>> GetAllSubmapData();
 
   // Returns the transform converting data in the local map frame (i.e. the
   // continuous, non-loop-closed frame) into the global map frame (i.e. the
@@ -109,13 +118,19 @@ class SparsePoseGraph {
   virtual transform::Rigid3d GetLocalToGlobalTransform(int trajectory_id) = 0;
 
   // Returns the current optimized trajectories.
-  virtual std::vector<std::vector<TrajectoryNode>> GetTrajectoryNodes() = 0;
+  std::vector<std::vector<TrajectoryNode>> GetTrajectoryNodes();
 
   // Serializes the constraints and trajectories.
   proto::SparsePoseGraph ToProto();
 
   // Returns the collection of constraints.
-  virtual std::vector<Constraint> constraints() = 0;
+  std::vector<Constraint> constraints();
+
+  // Returns a consistent snapshot of the current state. Snapshots are
+  // published whenever the pose graph changes, and getting one does not wait
+  // for the pose graph, so frequent readers should prefer this to the copying
+  // accessors above.
+  virtual std::shared_ptr<const Snapshot> GetSnapshot() = 0;
 };
 
 }  // namespace mapping
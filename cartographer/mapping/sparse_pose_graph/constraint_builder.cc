@@ -40,6 +40,11 @@ proto::ConstraintBuilderOptions CreateConstraintBuilderOptions(
   options.set_loop_closure_rotation_weight(
       parameter_dictionary->GetDouble("loop_closure_rotation_weight"));
   options.set_log_matches(parameter_dictionary->GetBool("log_matches"));
+  options.set_precomputation_grid_cache_size_in_mb(
+      parameter_dictionary->GetNonNegativeInt(
+          "precomputation_grid_cache_size_in_mb"));
+  options.set_serialize_precomputation_grids(
+      parameter_dictionary->GetBool("serialize_precomputation_grids"));
   *options.mutable_fast_correlative_scan_matcher_options() =
       mapping_2d::scan_matching::CreateFastCorrelativeScanMatcherOptions(
           parameter_dictionary->GetDictionary("fast_correlative_scan_matcher")
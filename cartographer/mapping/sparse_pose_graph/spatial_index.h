@@ -0,0 +1,114 @@
+/*
+ * Copyright 2017 The Cartographer Authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef CARTOGRAPHER_MAPPING_SPARSE_POSE_GRAPH_SPATIAL_INDEX_H_
+#define CARTOGRAPHER_MAPPING_SPARSE_POSE_GRAPH_SPATIAL_INDEX_H_
+
+#include <algorithm>
+#include <cmath>
+#include <unordered_map>
+#include <vector>
+
+#include "Eigen/Core"
+#include "cartographer/common/port.h"
+#include "glog/logging.h"
+
+namespace cartographer {
+namespace mapping {
+namespace sparse_pose_graph {
+
+// Indexes IDs of submaps or nodes by their 2D position in a uniform grid of
+// square cells, so that all IDs near a position can be found without looking
+// at every ID. Queries cost time proportional to the number of IDs in the
+// cells they overlap, so the cell size should be about the query radius.
+template <typename IdType>
+class SpatialIndex {
+ public:
+  explicit SpatialIndex(const double cell_size) : cell_size_(cell_size) {
+    CHECK_GT(cell_size_, 0.);
+  }
+
+  // Adds 'id' at 'position'. Each ID should only be inserted once between
+  // calls to Clear().
+  void Insert(const IdType& id, const Eigen::Vector2d& position) {
+    cells_[ToKey(ToCell(position.x()), ToCell(position.y()))].push_back(
+        Entry{id, position.x(), position.y()});
+    ++size_;
+  }
+
+  // Removes all IDs.
+  void Clear() {
+    cells_.clear();
+    size_ = 0;
+  }
+
+  // Returns the IDs inserted at most 'radius' away from 'position' in
+  // ascending order.
+  std::vector<IdType> Query(const Eigen::Vector2d& position,
+                            const double radius) const {
+    std::vector<IdType> result;
+    const int min_x = ToCell(position.x() - radius);
+    const int max_x = ToCell(position.x() + radius);
+    const int min_y = ToCell(position.y() - radius);
+    const int max_y = ToCell(position.y() + radius);
+    for (int x = min_x; x <= max_x; ++x) {
+      for (int y = min_y; y <= max_y; ++y) {
+        const auto it = cells_.find(ToKey(x, y));
+        if (it == cells_.end()) {
+          continue;
+        }
+        for (const Entry& entry : it->second) {
+          const double dx = entry.x - position.x();
+          const double dy = entry.y - position.y();
+          if (dx * dx + dy * dy <= radius * radius) {
+            result.push_back(entry.id);
+          }
+        }
+      }
+    }
+    std::sort(result.begin(), result.end());
+    return result;
+  }
+
+  // Returns the number of IDs inserted since the last call to Clear().
+  size_t size() const { return size_; }
+
+ private:
+  struct Entry {
+    IdType id;
+    double x;
+    double y;
+  };
+
+  int ToCell(const double coordinate) const {
+    return static_cast<int>(std::floor(coordinate / cell_size_));
+  }
+
+  static uint64 ToKey(const int x, const int y) {
+    return (static_cast<uint64>(static_cast<uint32>(x)) << 32) |
+           static_cast<uint32>(y);
+  }
+
+  const double cell_size_;
+  std::unordered_map<uint64, std::vector<Entry>> cells_;
+  size_t size_ = 0;
+};
+
+}  // namespace sparse_pose_graph
+}  // namespace mapping
+}  // namespace cartographer
+
+#endif  // CARTOGRAPHER_MAPPING_SPARSE_POSE_GRAPH_SPATIAL_INDEX_H_
@@ -0,0 +1,69 @@
+/*
+ * Copyright 2017 The Cartographer Authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "cartographer/mapping/sparse_pose_graph/spatial_index.h"
+
+#include <algorithm>
+#include <random>
+#include <vector>
+
+#include "cartographer/mapping/id.h"
+#include "gtest/gtest.h"
+
+namespace cartographer {
+namespace mapping {
+namespace sparse_pose_graph {
+namespace {
+
+TEST(SpatialIndexTest, QueryMatchesBruteForce) {
+  std::mt19937 prng(42);
+  std::uniform_real_distribution<double> distribution(-100., 100.);
+  SpatialIndex<SubmapId> index(15.);
+  std::vector<Eigen::Vector2d> positions;
+  for (int i = 0; i != 1000; ++i) {
+    positions.emplace_back(distribution(prng), distribution(prng));
+    index.Insert(SubmapId{i % 3, i / 3}, positions.back());
+  }
+  EXPECT_EQ(1000, index.size());
+
+  for (const double radius : {0., 5., 15., 40.}) {
+    for (int query = 0; query != 50; ++query) {
+      const Eigen::Vector2d position(distribution(prng), distribution(prng));
+      std::vector<SubmapId> expected;
+      for (int i = 0; i != 1000; ++i) {
+        if ((positions[i] - position).norm() <= radius) {
+          expected.push_back(SubmapId{i % 3, i / 3});
+        }
+      }
+      std::sort(expected.begin(), expected.end());
+      EXPECT_EQ(expected, index.Query(position, radius));
+    }
+  }
+
+  // Querying an inserted position exactly finds it even with zero radius.
+  const std::vector<SubmapId> found = index.Query(positions[0], 0.);
+  ASSERT_EQ(1, found.size());
+  EXPECT_EQ((SubmapId{0, 0}), found.front());
+
+  index.Clear();
+  EXPECT_EQ(0, index.size());
+  EXPECT_TRUE(index.Query(positions[0], 100.).empty());
+}
+
+}  // namespace
+}  // namespace sparse_pose_graph
+}  // namespace mapping
+}  // namespace cartographer
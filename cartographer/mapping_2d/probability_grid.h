@@ -18,6 +18,8 @@
 #define CARTOGRAPHER_MAPPING_2D_PROBABILITY_GRID_H_
 
 #include <algorithm>
+#include <array>
+#include <atomic>
 #include <cmath>
 #include <iostream>
 #include <limits>
@@ -25,8 +27,10 @@
 #include <string>
 #include <vector>
 
+#include "cartographer/common/make_unique.h"
 #include "cartographer/common/math.h"
 #include "cartographer/common/port.h"
+#include "cartographer/common/thread_pool.h"
 #include "cartographer/mapping/probability_values.h"
 #include "cartographer/mapping_2d/map_limits.h"
 #include "cartographer/mapping_2d/proto/probability_grid.pb.h"
@@ -37,48 +41,93 @@ namespace cartographer {
 namespace mapping_2d {
 
 // Represents a 2D grid of probabilities.
+//
+// Cells are stored in square tiles which are only allocated once a cell in
+// them becomes known, so unknown regions take no memory. Growing the grid only
+// moves tile pointers and never copies cells.
+//
+// Each grid has a version which changes whenever its cells change, and every
+// tile remembers the version it was last modified at. This allows caches of
+// data derived from the grid to only refresh what changed.
+//
+// Cells updated in the current update sequence carry an update marker in their
+// highest bit. Instead of remembering each updated cell, only the tiles holding
+// markers are flagged and FinishUpdate() clears them tile by tile.
+//
+// Once no more updates are expected, Quantize() converts the grid to 8 bits
+// per cell, halving its memory. A quantized grid is read-only.
 class ProbabilityGrid {
  public:
+  // Scratch space of ApplyLookupTable() with a thread pool. For each task and
+  // owning thread, the cells as tile index and index in the tile packed into
+  // 32 bits. Keeping it between updates saves reallocating the buckets.
+  using CellBuckets = std::vector<std::vector<std::vector<uint32>>>;
+
   explicit ProbabilityGrid(const MapLimits& limits)
       : limits_(limits),
-        cells_(limits_.cell_limits().num_x_cells *
-                   limits_.cell_limits().num_y_cells,
-               mapping::kUnknownProbabilityValue) {}
+        origin_(Eigen::Array2i::Zero()),
+        id_(NextVersion()),
+        version_(NextVersion()) {
+    ResizeTiles();
+  }
 
   explicit ProbabilityGrid(const proto::ProbabilityGrid& proto)
-      : limits_(proto.limits()), cells_() {
+      : ProbabilityGrid(MapLimits(proto.limits())) {
     if (proto.has_min_x()) {
       known_cells_box_ =
           Eigen::AlignedBox2i(Eigen::Vector2i(proto.min_x(), proto.min_y()),
                               Eigen::Vector2i(proto.max_x(), proto.max_y()));
     }
-    cells_.reserve(proto.cells_size());
-    for (const auto cell : proto.cells()) {
+    const int num_x_cells = limits_.cell_limits().num_x_cells;
+    CHECK_LE(proto.cells_size(),
+             num_x_cells * limits_.cell_limits().num_y_cells);
+    for (int i = 0; i != proto.cells_size(); ++i) {
+      const auto cell = proto.cells(i);
       CHECK_LE(cell, std::numeric_limits<uint16>::max());
-      cells_.push_back(cell);
+      if (cell != mapping::kUnknownProbabilityValue) {
+        *MutableCell(Eigen::Array2i(i % num_x_cells, i / num_x_cells)) = cell;
+      }
     }
+    version_ = NextVersion();
   }
 
+  ProbabilityGrid(ProbabilityGrid&&) = default;
+  ProbabilityGrid& operator=(ProbabilityGrid&&) = default;
+
   // Returns the limits of this ProbabilityGrid.
   const MapLimits& limits() const { return limits_; }
 
+  // Returns an identifier which is unique among all grids of this process.
+  uint64 id() const { return id_; }
+
+  // Returns the current version. Versions are increasing and change whenever
+  // cells are set, an update sequence is finished or the limits grow.
+  uint64 version() const { return version_; }
+
   // Finishes the update sequence.
   void FinishUpdate() {
-    while (!update_indices_.empty()) {
-      DCHECK_GE(cells_[update_indices_.back()], mapping::kUpdateMarker);
-      cells_[update_indices_.back()] -= mapping::kUpdateMarker;
-      update_indices_.pop_back();
+    for (int i = 0; i != static_cast<int>(tiles_.size()); ++i) {
+      if (updated_tiles_[i]) {
+        for (uint16& cell : *tiles_[i]) {
+          cell &= mapping::kUpdateMarker - 1;
+        }
+        updated_tiles_[i] = 0;
+      }
     }
+    version_ = NextVersion();
   }
 
   // Sets the probability of the cell at 'cell_index' to the given
   // 'probability'. Only allowed if the cell was unknown before.
   void SetProbability(const Eigen::Array2i& cell_index,
                       const float probability) {
-    uint16& cell = cells_[ToFlatIndex(cell_index)];
+    CHECK(!quantized_);
+    CHECK(limits_.Contains(cell_index)) << cell_index;
+    uint16& cell = *MutableCell(cell_index);
     CHECK_EQ(cell, mapping::kUnknownProbabilityValue);
     cell = mapping::ProbabilityToValue(probability);
     known_cells_box_.extend(cell_index.matrix());
+    version_ = NextVersion();
   }
 
   // Applies the 'odds' specified when calling ComputeLookupTableToApplyOdds()
@@ -88,25 +137,93 @@ class ProbabilityGrid {
   //
   // If this is the first call to ApplyOdds() for the specified cell, its value
   // will be set to probability corresponding to 'odds'.
+  //
+  // 'cell_index' must be within the limits, which is only checked in debug
+  // builds.
   bool ApplyLookupTable(const Eigen::Array2i& cell_index,
                         const std::vector<uint16>& table) {
     DCHECK_EQ(table.size(), mapping::kUpdateMarker);
-    const int flat_index = ToFlatIndex(cell_index);
-    uint16& cell = cells_[flat_index];
-    if (cell >= mapping::kUpdateMarker) {
-      return false;
-    }
-    update_indices_.push_back(flat_index);
-    cell = table[cell];
-    DCHECK_GE(cell, mapping::kUpdateMarker);
+    int tile_index;
+    int index_in_tile;
+    ToTileIndex(cell_index, &tile_index, &index_in_tile);
     known_cells_box_.extend(cell_index.matrix());
-    return true;
+    return ApplyLookupTableInTile(tile_index, index_in_tile, table);
+  }
+
+  // Calls ApplyLookupTable() for all cells generated by 'cell_generator'. For
+  // each task in [0, 'num_tasks'), 'cell_generator(task, callback)' is called
+  // and has to call 'callback(cell_index)' for each cell of that task.
+  //
+  // Without 'thread_pool', cells are updated as they are generated. Otherwise,
+  // the tasks run in parallel and sort their cells into 'cell_buckets' by
+  // tile. Then one task per thread applies the updates, each to the cells of
+  // the tiles it owns, so no cell is ever touched by two threads.
+  template <typename CellGenerator>
+  void ApplyLookupTable(const int num_tasks,
+                        const CellGenerator& cell_generator,
+                        const std::vector<uint16>& table,
+                        common::ThreadPool* const thread_pool,
+                        CellBuckets* const cell_buckets) {
+    DCHECK_EQ(table.size(), mapping::kUpdateMarker);
+    if (thread_pool == nullptr) {
+      const auto callback = [this, &table](const Eigen::Array2i& cell_index) {
+        ApplyLookupTable(cell_index, table);
+      };
+      for (int task = 0; task != num_tasks; ++task) {
+        cell_generator(task, callback);
+      }
+      return;
+    }
+    CHECK_LE(tiles_.size(), std::numeric_limits<uint32>::max() >>
+                                (2 * kTileSizeLog2));
+    const int num_owners = thread_pool->num_threads() + 1;
+    CellBuckets& buckets = *CHECK_NOTNULL(cell_buckets);
+    buckets.resize(num_tasks);
+    for (std::vector<std::vector<uint32>>& task_buckets : buckets) {
+      task_buckets.resize(num_owners);
+      for (std::vector<uint32>& bucket : task_buckets) {
+        bucket.clear();
+      }
+    }
+    std::vector<Eigen::AlignedBox2i> boxes(num_tasks);
+    common::ParallelFor(thread_pool, num_tasks, [&](const int task) {
+      // Consecutive cells are mostly in the same tile, so we only look up the
+      // bucket when the tile changes.
+      int last_tile_index = -1;
+      std::vector<uint32>* bucket = nullptr;
+      Eigen::AlignedBox2i& box = boxes[task];
+      cell_generator(task, [&](const Eigen::Array2i& cell_index) {
+        int tile_index;
+        int index_in_tile;
+        ToTileIndex(cell_index, &tile_index, &index_in_tile);
+        if (tile_index != last_tile_index) {
+          last_tile_index = tile_index;
+          bucket = &buckets[task][tile_index % num_owners];
+        }
+        bucket->push_back(
+            (static_cast<uint32>(tile_index) << (2 * kTileSizeLog2)) |
+            index_in_tile);
+        box.extend(cell_index.matrix());
+      });
+    });
+    common::ParallelFor(thread_pool, num_owners, [&](const int owner) {
+      for (const std::vector<std::vector<uint32>>& task_buckets : buckets) {
+        for (const uint32 packed_index : task_buckets[owner]) {
+          ApplyLookupTableInTile(packed_index >> (2 * kTileSizeLog2),
+                                 packed_index & (kTileSize * kTileSize - 1),
+                                 table);
+        }
+      }
+    });
+    for (const Eigen::AlignedBox2i& box : boxes) {
+      known_cells_box_.extend(box);
+    }
   }
 
   // Returns the probability of the cell with 'cell_index'.
   float GetProbability(const Eigen::Array2i& cell_index) const {
     if (limits_.Contains(cell_index)) {
-      return mapping::ValueToProbability(cells_[ToFlatIndex(cell_index)]);
+      return mapping::ValueToProbability(GetValue(cell_index));
     }
     return mapping::kMinProbability;
   }
@@ -114,7 +231,7 @@ class ProbabilityGrid {
   // Returns true if the probability at the specified index is known.
   bool IsKnown(const Eigen::Array2i& cell_index) const {
     return limits_.Contains(cell_index) &&
-           cells_[ToFlatIndex(cell_index)] != mapping::kUnknownProbabilityValue;
+           GetValue(cell_index) != mapping::kUnknownProbabilityValue;
   }
 
   // Fills in 'offset' and 'limits' to define a subregion of that contains all
@@ -135,45 +252,90 @@ class ProbabilityGrid {
   // these coordinates going forward. This method must be called immediately
   // after 'FinishUpdate', before any calls to 'ApplyLookupTable'.
   void GrowLimits(const Eigen::Vector2f& point) {
-    CHECK(update_indices_.empty());
+    CHECK(!quantized_);
+    CHECK(!HasUpdatedTiles());
+    Eigen::Array2i total_offset = Eigen::Array2i::Zero();
     while (!limits_.Contains(limits_.GetCellIndex(point))) {
       const int x_offset = limits_.cell_limits().num_x_cells / 2;
       const int y_offset = limits_.cell_limits().num_y_cells / 2;
-      const MapLimits new_limits(
+      limits_ = MapLimits(
           limits_.resolution(),
           limits_.max() +
               limits_.resolution() * Eigen::Vector2d(y_offset, x_offset),
           CellLimits(2 * limits_.cell_limits().num_x_cells,
                      2 * limits_.cell_limits().num_y_cells));
-      const int stride = new_limits.cell_limits().num_x_cells;
-      const int offset = x_offset + stride * y_offset;
-      const int new_size = new_limits.cell_limits().num_x_cells *
-                           new_limits.cell_limits().num_y_cells;
-      std::vector<uint16> new_cells(new_size,
-                                    mapping::kUnknownProbabilityValue);
-      for (int i = 0; i < limits_.cell_limits().num_y_cells; ++i) {
-        for (int j = 0; j < limits_.cell_limits().num_x_cells; ++j) {
-          new_cells[offset + j + i * stride] =
-              cells_[j + i * limits_.cell_limits().num_x_cells];
-        }
+      total_offset += Eigen::Array2i(x_offset, y_offset);
+    }
+    if ((total_offset == 0).all()) {
+      return;
+    }
+    // Cell indices moved by 'total_offset'. Instead of moving the cells we
+    // move the origin, and where that is not enough, whole tiles.
+    origin_ -= total_offset;
+    Eigen::Array2i tile_offset = Eigen::Array2i::Zero();
+    for (int i = 0; i != 2; ++i) {
+      if (origin_[i] < 0) {
+        tile_offset[i] = (kTileMask - origin_[i]) >> kTileSizeLog2;
+        origin_[i] += tile_offset[i] << kTileSizeLog2;
       }
-      cells_ = new_cells;
-      limits_ = new_limits;
-      if (!known_cells_box_.isEmpty()) {
-        known_cells_box_.translate(Eigen::Vector2i(x_offset, y_offset));
+    }
+    std::vector<std::unique_ptr<Tile>> old_tiles;
+    old_tiles.swap(tiles_);
+    std::vector<uint64> old_tile_versions;
+    old_tile_versions.swap(tile_versions_);
+    const int old_num_x_tiles = num_x_tiles_;
+    const int old_num_tiles = old_tiles.size();
+    ResizeTiles();
+    for (int i = 0; i != old_num_tiles; ++i) {
+      if (old_tiles[i] != nullptr) {
+        const int x = i % old_num_x_tiles + tile_offset.x();
+        const int y = i / old_num_x_tiles + tile_offset.y();
+        tiles_[y * num_x_tiles_ + x] = std::move(old_tiles[i]);
+        tile_versions_[y * num_x_tiles_ + x] = old_tile_versions[i];
+      }
+    }
+    if (!known_cells_box_.isEmpty()) {
+      known_cells_box_.translate(total_offset.matrix());
+    }
+    version_ = NextVersion();
+  }
+
+  // Calls 'callback' with the first cell index and the cell limits of the
+  // region covered by each tile which was modified at or after 'version'.
+  // Regions are clipped to the limits and only cover allocated tiles.
+  template <typename Callback>
+  void ForEachRegionModifiedSince(const uint64 version,
+                                  Callback callback) const {
+    const CellLimits& cell_limits = limits_.cell_limits();
+    for (int i = 0; i != static_cast<int>(tiles_.size()); ++i) {
+      if (!IsTileAllocated(i) || tile_versions_[i] < version) {
+        continue;
       }
+      const Eigen::Array2i tile_begin =
+          Eigen::Array2i(i % num_x_tiles_, i / num_x_tiles_) * kTileSize -
+          origin_;
+      const Eigen::Array2i begin = tile_begin.max(0);
+      const Eigen::Array2i end =
+          (tile_begin + kTileSize)
+              .min(Eigen::Array2i(cell_limits.num_x_cells,
+                                  cell_limits.num_y_cells));
+      callback(begin, CellLimits(end.x() - begin.x(), end.y() - begin.y()));
     }
   }
 
   proto::ProbabilityGrid ToProto() const {
     proto::ProbabilityGrid result;
     *result.mutable_limits() = cartographer::mapping_2d::ToProto(limits_);
-    result.mutable_cells()->Reserve(cells_.size());
-    for (const auto cell : cells_) {
-      result.mutable_cells()->Add(cell);
+    const CellLimits& cell_limits = limits_.cell_limits();
+    result.mutable_cells()->Reserve(cell_limits.num_x_cells *
+                                    cell_limits.num_y_cells);
+    for (int y = 0; y != cell_limits.num_y_cells; ++y) {
+      for (int x = 0; x != cell_limits.num_x_cells; ++x) {
+        result.mutable_cells()->Add(GetValue(Eigen::Array2i(x, y)));
+      }
     }
-    CHECK(update_indices_.empty()) << "Serializing a grid during an update is "
-                                      "not supported. Finish the update first.";
+    CHECK(!HasUpdatedTiles()) << "Serializing a grid during an update is "
+                                     "not supported. Finish the update first.";
     if (!known_cells_box_.isEmpty()) {
       result.set_max_x(known_cells_box_.max().x());
       result.set_max_y(known_cells_box_.max().y());
@@ -183,16 +345,183 @@ class ProbabilityGrid {
     return result;
   }
 
+  // Converts all cells to 8 bits and frees the 16-bit tiles. Probabilities
+  // are rounded to one of 255 values evenly spaced between
+  // 'mapping::kMinProbability' and 'mapping::kMaxProbability'; which cells are
+  // known does not change. Afterwards, the grid can no longer be modified.
+  void Quantize() {
+    CHECK(!quantized_);
+    CHECK(!HasUpdatedTiles());
+    for (int i = 0; i != static_cast<int>(tiles_.size()); ++i) {
+      if (tiles_[i] == nullptr) {
+        continue;
+      }
+      quantized_tiles_[i] = common::make_unique<QuantizedTile>();
+      std::transform(tiles_[i]->begin(), tiles_[i]->end(),
+                     quantized_tiles_[i]->begin(),
+                     mapping::ValueToQuantizedValue);
+      tiles_[i].reset();
+      tile_versions_[i] = version_;
+    }
+    quantized_ = true;
+    version_ = NextVersion();
+  }
+
+  // Returns true if Quantize() was called.
+  bool quantized() const { return quantized_; }
+
+  // Returns the number of tiles which have cell storage allocated.
+  int num_allocated_tiles() const {
+    int num_allocated_tiles = 0;
+    for (int i = 0; i != static_cast<int>(tiles_.size()); ++i) {
+      if (IsTileAllocated(i)) {
+        ++num_allocated_tiles;
+      }
+    }
+    return num_allocated_tiles;
+  }
+
+  // Returns the approximate number of bytes used to store the cells.
+  size_t num_bytes() const {
+    return num_allocated_tiles() *
+               (quantized_ ? sizeof(QuantizedTile) : sizeof(Tile)) +
+           tiles_.size() *
+               (sizeof(std::unique_ptr<Tile>) +
+                sizeof(std::unique_ptr<QuantizedTile>) + sizeof(uint64) +
+                sizeof(uint8));
+  }
+
  private:
-  // Converts a 'cell_index' into an index into 'cells_'.
-  int ToFlatIndex(const Eigen::Array2i& cell_index) const {
-    CHECK(limits_.Contains(cell_index)) << cell_index;
-    return limits_.cell_limits().num_x_cells * cell_index.y() + cell_index.x();
+  static constexpr int kTileSizeLog2 = 6;
+  static constexpr int kTileSize = 1 << kTileSizeLog2;
+  static constexpr int kTileMask = kTileSize - 1;
+
+  // Highest bit of each cell is the update marker.
+  using Tile = std::array<uint16, kTileSize * kTileSize>;
+  using QuantizedTile = std::array<uint8, kTileSize * kTileSize>;
+
+  // Returns a new version which is larger than all versions returned before,
+  // by any grid.
+  static uint64 NextVersion() {
+    static std::atomic<uint64> next_version(1);
+    return next_version.fetch_add(1);
+  }
+
+  // Sizes 'tiles_' to cover all cells in 'limits_' given 'origin_'.
+  void ResizeTiles() {
+    num_x_tiles_ =
+        (limits_.cell_limits().num_x_cells + origin_.x() + kTileMask) >>
+        kTileSizeLog2;
+    const int num_y_tiles =
+        (limits_.cell_limits().num_y_cells + origin_.y() + kTileMask) >>
+        kTileSizeLog2;
+    tiles_.resize(num_x_tiles_ * num_y_tiles);
+    quantized_tiles_.resize(tiles_.size());
+    tile_versions_.resize(tiles_.size(), 0);
+    updated_tiles_.resize(tiles_.size(), 0);
+  }
+
+  // Returns true if the tile at 'tile_index' has cell storage allocated.
+  bool IsTileAllocated(const int tile_index) const {
+    return (quantized_ ? quantized_tiles_[tile_index] != nullptr
+                       : tiles_[tile_index] != nullptr);
+  }
+
+  // Returns true if some tile holds cells with update markers, i.e. an update
+  // sequence is in progress.
+  bool HasUpdatedTiles() const {
+    return std::find(updated_tiles_.begin(), updated_tiles_.end(), 1) !=
+           updated_tiles_.end();
+  }
+
+  // Converts a 'cell_index' into an index into 'tiles_' and an index of the
+  // cell inside that tile.
+  void ToTileIndex(const Eigen::Array2i& cell_index, int* const tile_index,
+                   int* const index_in_tile) const {
+    DCHECK(limits_.Contains(cell_index)) << cell_index;
+    const Eigen::Array2i position = cell_index + origin_;
+    *tile_index = (position.y() >> kTileSizeLog2) * num_x_tiles_ +
+                  (position.x() >> kTileSizeLog2);
+    *index_in_tile = ((position.y() & kTileMask) << kTileSizeLog2) +
+                     (position.x() & kTileMask);
+  }
+
+  uint16 GetValue(const Eigen::Array2i& cell_index) const {
+    int tile_index;
+    int index_in_tile;
+    ToTileIndex(cell_index, &tile_index, &index_in_tile);
+    if (quantized_) {
+      const QuantizedTile* const tile = quantized_tiles_[tile_index].get();
+      return tile == nullptr
+                 ? mapping::kUnknownProbabilityValue
+                 : mapping::QuantizedValueToValue((*tile)[index_in_tile]);
+    }
+    const Tile* const tile = tiles_[tile_index].get();
+    return tile == nullptr ? mapping::kUnknownProbabilityValue
+                           : (*tile)[index_in_tile];
+  }
+
+  // Returns a pointer to the cell at 'cell_index', allocating its tile if
+  // needed, and marks the tile as modified. The pointer stays valid until the
+  // tile is destroyed.
+  uint16* MutableCell(const Eigen::Array2i& cell_index) {
+    int tile_index;
+    int index_in_tile;
+    ToTileIndex(cell_index, &tile_index, &index_in_tile);
+    return &(*MutableTile(tile_index))[index_in_tile];
+  }
+
+  // Returns the tile at 'tile_index', allocating it if needed, and marks it as
+  // modified. Only state of this tile is touched, so different tiles may be
+  // modified concurrently.
+  Tile* MutableTile(const int tile_index) {
+    DCHECK(!quantized_);
+    std::unique_ptr<Tile>& tile = tiles_[tile_index];
+    if (tile == nullptr) {
+      tile = common::make_unique<Tile>();
+      tile->fill(mapping::kUnknownProbabilityValue);
+    }
+    tile_versions_[tile_index] = version_;
+    return tile.get();
+  }
+
+  // Applies 'table' to a cell given by its tile and index in the tile unless
+  // it was already updated. Like MutableTile(), this may be called
+  // concurrently for different tiles.
+  bool ApplyLookupTableInTile(const int tile_index, const int index_in_tile,
+                              const std::vector<uint16>& table) {
+    uint16& cell = (*MutableTile(tile_index))[index_in_tile];
+    if (cell >= mapping::kUpdateMarker) {
+      return false;
+    }
+    cell = table[cell];
+    DCHECK_GE(cell, mapping::kUpdateMarker);
+    updated_tiles_[tile_index] = 1;
+    return true;
   }
 
   MapLimits limits_;
-  std::vector<uint16> cells_;  // Highest bit is update marker.
-  std::vector<int> update_indices_;
+
+  // Cell 'cell_index' is stored at position 'cell_index + origin_' in a
+  // row-major grid of tiles which is 'num_x_tiles_' tiles wide. Tiles without
+  // known cells are nullptr.
+  Eigen::Array2i origin_;
+  int num_x_tiles_;
+  std::vector<std::unique_ptr<Tile>> tiles_;
+
+  // After Quantize(), the cells are stored here instead of in 'tiles_'.
+  bool quantized_ = false;
+  std::vector<std::unique_ptr<QuantizedTile>> quantized_tiles_;
+
+  // Set for the tiles holding cells with update markers. This is not a
+  // std::vector<bool>, since tiles are flagged concurrently.
+  std::vector<uint8> updated_tiles_;
+
+  // Tiles are stamped with 'version_' when modified, so a tile was modified
+  // since a cache was refreshed at version V iff its version is at least V.
+  uint64 id_;
+  uint64 version_;
+  std::vector<uint64> tile_versions_;
 
   // Bounding box of known cells to efficiently compute cropping limits.
   Eigen::AlignedBox2i known_cells_box_;
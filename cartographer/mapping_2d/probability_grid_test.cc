@@ -191,6 +191,147 @@ TEST(ProbabilityGridTest, CorrectCropping) {
   EXPECT_EQ(limits.num_y_cells, 200);
 }
 
+TEST(ProbabilityGridTest, GrowLimitsKeepsCells) {
+  ProbabilityGrid probability_grid(
+      MapLimits(0.05, Eigen::Vector2d(5., 5.), CellLimits(200, 200)));
+  const std::vector<Eigen::Vector2f> points = {
+      Eigen::Vector2f(0.f, 0.f), Eigen::Vector2f(4.9f, -4.9f),
+      Eigen::Vector2f(-4.9f, 4.9f), Eigen::Vector2f(-2.f, -3.f)};
+  std::vector<float> probabilities;
+  for (size_t i = 0; i != points.size(); ++i) {
+    probabilities.push_back(0.2f + 0.1f * i);
+    probability_grid.SetProbability(
+        probability_grid.limits().GetCellIndex(points[i]), probabilities[i]);
+  }
+  Eigen::Array2i old_offset;
+  CellLimits old_limits;
+  probability_grid.ComputeCroppedLimits(&old_offset, &old_limits);
+
+  probability_grid.GrowLimits(Eigen::Vector2f(-30.f, 20.f));
+  const MapLimits& limits = probability_grid.limits();
+  EXPECT_TRUE(
+      limits.Contains(limits.GetCellIndex(Eigen::Vector2f(-30.f, 20.f))));
+  for (size_t i = 0; i != points.size(); ++i) {
+    const Eigen::Array2i cell_index = limits.GetCellIndex(points[i]);
+    EXPECT_TRUE(probability_grid.IsKnown(cell_index));
+    EXPECT_NEAR(probabilities[i], probability_grid.GetProbability(cell_index),
+                1e-3);
+  }
+  Eigen::Array2i offset;
+  CellLimits cropped_limits;
+  probability_grid.ComputeCroppedLimits(&offset, &cropped_limits);
+  EXPECT_EQ(old_limits.num_x_cells, cropped_limits.num_x_cells);
+  EXPECT_EQ(old_limits.num_y_cells, cropped_limits.num_y_cells);
+  int num_known_cells = 0;
+  for (const Eigen::Array2i& xy_index :
+       XYIndexRangeIterator(limits.cell_limits())) {
+    num_known_cells += probability_grid.IsKnown(xy_index);
+  }
+  EXPECT_EQ(static_cast<int>(points.size()), num_known_cells);
+}
+
+TEST(ProbabilityGridTest, UnknownRegionsAreNotAllocated) {
+  ProbabilityGrid probability_grid(
+      MapLimits(0.05, Eigen::Vector2d(10., 10.), CellLimits(400, 400)));
+  EXPECT_EQ(0, probability_grid.num_allocated_tiles());
+  probability_grid.SetProbability(Eigen::Array2i(1, 2), 0.7f);
+  probability_grid.SetProbability(Eigen::Array2i(3, 4), 0.7f);
+  EXPECT_EQ(1, probability_grid.num_allocated_tiles());
+  probability_grid.GrowLimits(Eigen::Vector2f(100.f, 100.f));
+  EXPECT_EQ(1, probability_grid.num_allocated_tiles());
+  EXPECT_FALSE(probability_grid.IsKnown(Eigen::Array2i::Zero()));
+}
+
+TEST(ProbabilityGridTest, ModifiedRegionsAreTracked) {
+  ProbabilityGrid probability_grid(
+      MapLimits(0.05, Eigen::Vector2d(10., 10.), CellLimits(400, 400)));
+  probability_grid.SetProbability(Eigen::Array2i(1, 2), 0.7f);
+  const uint64 version = probability_grid.version();
+  const std::vector<uint16> table =
+      mapping::ComputeLookupTableToApplyOdds(mapping::Odds(0.7f));
+  probability_grid.ApplyLookupTable(Eigen::Array2i(100, 70), table);
+  probability_grid.FinishUpdate();
+  EXPECT_GT(probability_grid.version(), version);
+
+  int num_regions = 0;
+  probability_grid.ForEachRegionModifiedSince(
+      version, [&num_regions](const Eigen::Array2i& begin,
+                              const CellLimits& cell_limits) {
+        ++num_regions;
+        EXPECT_LE(begin.x(), 100);
+        EXPECT_LE(begin.y(), 70);
+        EXPECT_GT(begin.x() + cell_limits.num_x_cells, 100);
+        EXPECT_GT(begin.y() + cell_limits.num_y_cells, 70);
+      });
+  EXPECT_EQ(1, num_regions);
+
+  const ProbabilityGrid other_probability_grid(probability_grid.limits());
+  EXPECT_NE(probability_grid.id(), other_probability_grid.id());
+}
+
+TEST(ProbabilityGridTest, ProtoRoundTrip) {
+  ProbabilityGrid probability_grid(
+      MapLimits(0.05, Eigen::Vector2d(1., 1.), CellLimits(70, 90)));
+  probability_grid.SetProbability(Eigen::Array2i(3, 80), 0.3f);
+  probability_grid.SetProbability(Eigen::Array2i(69, 2), 0.8f);
+  const proto::ProbabilityGrid proto = probability_grid.ToProto();
+  EXPECT_EQ(70 * 90, proto.cells_size());
+
+  const ProbabilityGrid restored(proto);
+  EXPECT_EQ(2, restored.num_allocated_tiles());
+  for (const Eigen::Array2i& xy_index :
+       XYIndexRangeIterator(probability_grid.limits().cell_limits())) {
+    EXPECT_EQ(probability_grid.IsKnown(xy_index), restored.IsKnown(xy_index));
+    EXPECT_EQ(probability_grid.GetProbability(xy_index),
+              restored.GetProbability(xy_index));
+  }
+  EXPECT_EQ(proto.DebugString(), restored.ToProto().DebugString());
+}
+
+TEST(ProbabilityGridTest, QuantizeKeepsProbabilities) {
+  ProbabilityGrid probability_grid(
+      MapLimits(0.05, Eigen::Vector2d(10., 10.), CellLimits(400, 400)));
+  std::mt19937 rng(42);
+  std::uniform_int_distribution<int> cell_distribution(0, 399);
+  std::uniform_real_distribution<float> probability_distribution(
+      mapping::kMinProbability, mapping::kMaxProbability);
+  for (int i = 0; i != 1000; ++i) {
+    const Eigen::Array2i cell_index(cell_distribution(rng),
+                                    cell_distribution(rng));
+    if (!probability_grid.IsKnown(cell_index)) {
+      probability_grid.SetProbability(cell_index,
+                                      probability_distribution(rng));
+    }
+  }
+  ProbabilityGrid quantized_grid(probability_grid.ToProto());
+  const uint64 version = quantized_grid.version();
+  const size_t num_bytes = quantized_grid.num_bytes();
+  quantized_grid.Quantize();
+  EXPECT_TRUE(quantized_grid.quantized());
+  EXPECT_GT(quantized_grid.version(), version);
+  EXPECT_LT(quantized_grid.num_bytes(), num_bytes / 2 + num_bytes / 10);
+  EXPECT_EQ(probability_grid.num_allocated_tiles(),
+            quantized_grid.num_allocated_tiles());
+
+  const float tolerance =
+      0.5f * (mapping::kMaxProbability - mapping::kMinProbability) / 254.f +
+      1e-6f;
+  for (const Eigen::Array2i& xy_index :
+       XYIndexRangeIterator(probability_grid.limits().cell_limits())) {
+    ASSERT_EQ(probability_grid.IsKnown(xy_index),
+              quantized_grid.IsKnown(xy_index));
+    EXPECT_NEAR(probability_grid.GetProbability(xy_index),
+                quantized_grid.GetProbability(xy_index), tolerance);
+  }
+
+  int num_regions = 0;
+  quantized_grid.ForEachRegionModifiedSince(
+      version, [&num_regions](const Eigen::Array2i&, const CellLimits&) {
+        ++num_regions;
+      });
+  EXPECT_EQ(quantized_grid.num_allocated_tiles(), num_regions);
+}
+
 }  // namespace
 }  // namespace mapping_2d
 }  // namespace cartographer
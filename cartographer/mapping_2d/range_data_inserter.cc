@@ -20,6 +20,7 @@
 
 #include "Eigen/Core"
 #include "Eigen/Geometry"
+#include "cartographer/common/make_unique.h"
 #include "cartographer/mapping_2d/ray_casting.h"
 #include "cartographer/mapping_2d/xy_index.h"
 #include "glog/logging.h"
@@ -38,8 +39,11 @@ proto::RangeDataInserterOptions CreateRangeDataInserterOptions(
       parameter_dictionary->HasKey("insert_free_space")
           ? parameter_dictionary->GetBool("insert_free_space")
           : true);
+  options.set_num_threads(
+      parameter_dictionary->GetNonNegativeInt("num_threads"));
   CHECK_GT(options.hit_probability(), 0.5);
   CHECK_LT(options.miss_probability(), 0.5);
+  CHECK_GT(options.num_threads(), 0);
   return options;
 }
 
@@ -49,14 +53,22 @@ RangeDataInserter::RangeDataInserter(
       hit_table_(mapping::ComputeLookupTableToApplyOdds(
           mapping::Odds(options.hit_probability()))),
       miss_table_(mapping::ComputeLookupTableToApplyOdds(
-          mapping::Odds(options.miss_probability()))) {}
+          mapping::Odds(options.miss_probability()))) {
+  if (options_.num_threads() > 1) {
+    // Insert() waits for the rays to be cast, so the threads must not run at a
+    // lower priority than the calling thread.
+    thread_pool_ = common::make_unique<common::ThreadPool>(
+        options_.num_threads() - 1, false /* lower_thread_priority */);
+  }
+}
 
 void RangeDataInserter::Insert(const sensor::RangeData& range_data,
                                ProbabilityGrid* const probability_grid) const {
   // By not finishing the update after hits are inserted, we give hits priority
   // (i.e. no hits will be ignored because of a miss in the same cell).
+  common::MutexLocker locker(&mutex_);
   CastRays(range_data, hit_table_, miss_table_, options_.insert_free_space(),
-           CHECK_NOTNULL(probability_grid));
+           thread_pool_.get(), &cell_buckets_, CHECK_NOTNULL(probability_grid));
   probability_grid->FinishUpdate();
 }
 
@@ -17,11 +17,14 @@
 #ifndef CARTOGRAPHER_MAPPING_2D_RANGE_DATA_INSERTER_H_
 #define CARTOGRAPHER_MAPPING_2D_RANGE_DATA_INSERTER_H_
 
+#include <memory>
 #include <utility>
 #include <vector>
 
 #include "cartographer/common/lua_parameter_dictionary.h"
+#include "cartographer/common/mutex.h"
 #include "cartographer/common/port.h"
+#include "cartographer/common/thread_pool.h"
 #include "cartographer/mapping_2d/probability_grid.h"
 #include "cartographer/mapping_2d/proto/range_data_inserter_options.pb.h"
 #include "cartographer/mapping_2d/xy_index.h"
@@ -49,6 +52,10 @@ class RangeDataInserter {
   const proto::RangeDataInserterOptions options_;
   const std::vector<uint16> hit_table_;
   const std::vector<uint16> miss_table_;
+  // Used together with the calling thread if 'num_threads' is larger than 1.
+  std::unique_ptr<common::ThreadPool> thread_pool_;
+  mutable common::Mutex mutex_;
+  mutable ProbabilityGrid::CellBuckets cell_buckets_ GUARDED_BY(mutex_);
 };
 
 }  // namespace mapping_2d
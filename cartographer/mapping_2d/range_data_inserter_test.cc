@@ -16,7 +16,9 @@
 
 #include "cartographer/mapping_2d/range_data_inserter.h"
 
+#include <cmath>
 #include <memory>
+#include <random>
 
 #include "cartographer/common/lua_parameter_dictionary.h"
 #include "cartographer/common/lua_parameter_dictionary_test_helpers.h"
@@ -38,6 +40,7 @@ class RangeDataInserterTest : public ::testing::Test {
         "insert_free_space = true, "
         "hit_probability = 0.7, "
         "miss_probability = 0.4, "
+        "num_threads = 1, "
         "}");
     options_ = CreateRangeDataInserterOptions(parameter_dictionary.get());
     range_data_inserter_ = common::make_unique<RangeDataInserter>(options_);
@@ -128,6 +131,67 @@ TEST_F(RangeDataInserterTest, ProbabilityProgression) {
       1e-3);
 }
 
+TEST_F(RangeDataInserterTest, ParallelInsertionMatchesSerial) {
+  proto::RangeDataInserterOptions parallel_options = options_;
+  parallel_options.set_num_threads(4);
+  const RangeDataInserter parallel_range_data_inserter(parallel_options);
+  const MapLimits limits(0.05, Eigen::Vector2d(1., 1.), CellLimits(40, 40));
+  ProbabilityGrid serial_probability_grid(limits);
+  ProbabilityGrid parallel_probability_grid(limits);
+
+  std::mt19937 prng(42);
+  std::uniform_real_distribution<float> angle_distribution(-M_PI, M_PI);
+  std::uniform_real_distribution<float> range_distribution(0.5f, 12.f);
+  for (int i = 0; i != 3; ++i) {
+    sensor::RangeData range_data;
+    range_data.origin = Eigen::Vector3f(0.3f * i, -0.2f * i, 0.f);
+    for (int j = 0; j != 2000; ++j) {
+      const float angle = angle_distribution(prng);
+      const Eigen::Vector3f point =
+          range_data.origin + range_distribution(prng) *
+                                  Eigen::Vector3f(std::cos(angle),
+                                                  std::sin(angle), 0.f);
+      if (j % 10 == 0) {
+        range_data.misses.push_back(point);
+      } else {
+        range_data.returns.push_back(point);
+      }
+    }
+    range_data_inserter_->Insert(range_data, &serial_probability_grid);
+    parallel_range_data_inserter.Insert(range_data,
+                                        &parallel_probability_grid);
+  }
+
+  ASSERT_EQ(serial_probability_grid.limits().cell_limits().num_x_cells,
+            parallel_probability_grid.limits().cell_limits().num_x_cells);
+  ASSERT_EQ(serial_probability_grid.limits().cell_limits().num_y_cells,
+            parallel_probability_grid.limits().cell_limits().num_y_cells);
+  Eigen::Array2i serial_offset;
+  CellLimits serial_cell_limits;
+  serial_probability_grid.ComputeCroppedLimits(&serial_offset,
+                                               &serial_cell_limits);
+  Eigen::Array2i parallel_offset;
+  CellLimits parallel_cell_limits;
+  parallel_probability_grid.ComputeCroppedLimits(&parallel_offset,
+                                                 &parallel_cell_limits);
+  EXPECT_TRUE((serial_offset == parallel_offset).all());
+  EXPECT_EQ(serial_cell_limits.num_x_cells, parallel_cell_limits.num_x_cells);
+  EXPECT_EQ(serial_cell_limits.num_y_cells, parallel_cell_limits.num_y_cells);
+  const CellLimits& cell_limits =
+      serial_probability_grid.limits().cell_limits();
+  for (int y = 0; y != cell_limits.num_y_cells; ++y) {
+    for (int x = 0; x != cell_limits.num_x_cells; ++x) {
+      const Eigen::Array2i cell_index(x, y);
+      ASSERT_EQ(serial_probability_grid.IsKnown(cell_index),
+                parallel_probability_grid.IsKnown(cell_index))
+          << cell_index;
+      ASSERT_EQ(serial_probability_grid.GetProbability(cell_index),
+                parallel_probability_grid.GetProbability(cell_index))
+          << cell_index;
+    }
+  }
+}
+
 }  // namespace
 }  // namespace mapping_2d
 }  // namespace cartographer
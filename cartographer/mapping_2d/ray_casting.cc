@@ -16,6 +16,9 @@
 
 #include "cartographer/mapping_2d/ray_casting.h"
 
+#include <algorithm>
+#include <cmath>
+
 namespace cartographer {
 namespace mapping_2d {
 
@@ -24,21 +27,26 @@ namespace {
 // Factor for subpixel accuracy of start and end point.
 constexpr int kSubpixelScale = 1000;
 
+// Number of angular sectors per thread in which rays are cast. Using more
+// sectors than threads balances the load when some sectors have longer rays.
+constexpr int kNumSectorsPerThread = 4;
+
 // We divide each pixel in kSubpixelScale x kSubpixelScale subpixels. 'begin'
 // and 'end' are coordinates at subpixel precision. We compute all pixels in
-// which some part of the line segment connecting 'begin' and 'end' lies.
+// which some part of the line segment connecting 'begin' and 'end' lies and
+// call 'callback' for each of them.
+template <typename Callback>
 void CastRay(const Eigen::Array2i& begin, const Eigen::Array2i& end,
-             const std::vector<uint16>& miss_table,
-             ProbabilityGrid* const probability_grid) {
+             const Callback& callback) {
   // For simplicity, we order 'begin' and 'end' by their x coordinate.
   if (begin.x() > end.x()) {
-    CastRay(end, begin, miss_table, probability_grid);
+    CastRay(end, begin, callback);
     return;
   }
 
-  CHECK_GE(begin.x(), 0);
-  CHECK_GE(begin.y(), 0);
-  CHECK_GE(end.y(), 0);
+  DCHECK_GE(begin.x(), 0);
+  DCHECK_GE(begin.y(), 0);
+  DCHECK_GE(end.y(), 0);
 
   // Special case: We have to draw a vertical line in full pixels, as 'begin'
   // and 'end' have the same full pixel x coordinate.
@@ -47,7 +55,7 @@ void CastRay(const Eigen::Array2i& begin, const Eigen::Array2i& end,
                            std::min(begin.y(), end.y()) / kSubpixelScale);
     const int end_y = std::max(begin.y(), end.y()) / kSubpixelScale;
     for (; current.y() <= end_y; ++current.y()) {
-      probability_grid->ApplyLookupTable(current, miss_table);
+      callback(current);
     }
     return;
   }
@@ -87,11 +95,11 @@ void CastRay(const Eigen::Array2i& begin, const Eigen::Array2i& end,
   sub_y += dy * first_pixel;
   if (dy > 0) {
     while (true) {
-      probability_grid->ApplyLookupTable(current, miss_table);
+      callback(current);
       while (sub_y > denominator) {
         sub_y -= denominator;
         ++current.y();
-        probability_grid->ApplyLookupTable(current, miss_table);
+        callback(current);
       }
       ++current.x();
       if (sub_y == denominator) {
@@ -106,24 +114,24 @@ void CastRay(const Eigen::Array2i& begin, const Eigen::Array2i& end,
     }
     // Move from the pixel border on the right to 'end'.
     sub_y += dy * last_pixel;
-    probability_grid->ApplyLookupTable(current, miss_table);
+    callback(current);
     while (sub_y > denominator) {
       sub_y -= denominator;
       ++current.y();
-      probability_grid->ApplyLookupTable(current, miss_table);
+      callback(current);
     }
-    CHECK_NE(sub_y, denominator);
-    CHECK_EQ(current.y(), end.y() / kSubpixelScale);
+    DCHECK_NE(sub_y, denominator);
+    DCHECK_EQ(current.y(), end.y() / kSubpixelScale);
     return;
   }
 
   // Same for lines non-ascending in y coordinates.
   while (true) {
-    probability_grid->ApplyLookupTable(current, miss_table);
+    callback(current);
     while (sub_y < 0) {
       sub_y += denominator;
       --current.y();
-      probability_grid->ApplyLookupTable(current, miss_table);
+      callback(current);
     }
     ++current.x();
     if (sub_y == 0) {
@@ -136,16 +144,35 @@ void CastRay(const Eigen::Array2i& begin, const Eigen::Array2i& end,
     sub_y += dy * 2 * kSubpixelScale;
   }
   sub_y += dy * last_pixel;
-  probability_grid->ApplyLookupTable(current, miss_table);
+  callback(current);
   while (sub_y < 0) {
     sub_y += denominator;
     --current.y();
-    probability_grid->ApplyLookupTable(current, miss_table);
+    callback(current);
   }
-  CHECK_NE(sub_y, 0);
-  CHECK_EQ(current.y(), end.y() / kSubpixelScale);
+  DCHECK_NE(sub_y, 0);
+  DCHECK_EQ(current.y(), end.y() / kSubpixelScale);
 }
 
+// Casts the rays from 'begin' to the ends of one angular sector.
+class SectorRayCaster {
+ public:
+  SectorRayCaster(const Eigen::Array2i& begin,
+                  const std::vector<std::vector<Eigen::Array2i>>& sector_ends)
+      : begin_(begin), sector_ends_(sector_ends) {}
+
+  template <typename Callback>
+  void operator()(const int sector, const Callback& callback) const {
+    for (const Eigen::Array2i& end : sector_ends_[sector]) {
+      CastRay(begin_, end, callback);
+    }
+  }
+
+ private:
+  const Eigen::Array2i begin_;
+  const std::vector<std::vector<Eigen::Array2i>>& sector_ends_;
+};
+
 void GrowAsNeeded(const sensor::RangeData& range_data,
                   ProbabilityGrid* const probability_grid) {
   Eigen::AlignedBox2f bounding_box(range_data.origin.head<2>());
@@ -168,6 +195,8 @@ void CastRays(const sensor::RangeData& range_data,
               const std::vector<uint16>& hit_table,
               const std::vector<uint16>& miss_table,
               const bool insert_free_space,
+              common::ThreadPool* const thread_pool,
+              ProbabilityGrid::CellBuckets* const cell_buckets,
               ProbabilityGrid* const probability_grid) {
   GrowAsNeeded(range_data, probability_grid);
 
@@ -191,16 +220,32 @@ void CastRays(const sensor::RangeData& range_data,
     return;
   }
 
-  // Now add the misses.
+  // Now add the misses, and empty rays based on misses in the scan. Rays are
+  // sorted into angular sectors around the origin which are cast in parallel.
+  const int num_sectors =
+      thread_pool == nullptr
+          ? 1
+          : kNumSectorsPerThread * (thread_pool->num_threads() + 1);
+  std::vector<std::vector<Eigen::Array2i>> sector_ends(num_sectors);
+  const auto add_ray = [&](const Eigen::Array2i& end) {
+    int sector = 0;
+    if (num_sectors > 1) {
+      const double angle = std::atan2(end.y() - begin.y(), end.x() - begin.x());
+      sector = std::min(static_cast<int>((angle + M_PI) / (2. * M_PI) *
+                                         num_sectors),
+                        num_sectors - 1);
+    }
+    sector_ends[sector].push_back(end);
+  };
   for (const Eigen::Array2i& end : ends) {
-    CastRay(begin, end, miss_table, probability_grid);
+    add_ray(end);
   }
-
-  // Finally, compute and add empty rays based on misses in the scan.
   for (const Eigen::Vector3f& missing_echo : range_data.misses) {
-    CastRay(begin, superscaled_limits.GetCellIndex(missing_echo.head<2>()),
-            miss_table, probability_grid);
+    add_ray(superscaled_limits.GetCellIndex(missing_echo.head<2>()));
   }
+  probability_grid->ApplyLookupTable(num_sectors,
+                                     SectorRayCaster(begin, sector_ends),
+                                     miss_table, thread_pool, cell_buckets);
 }
 
 }  // namespace mapping_2d
@@ -20,6 +20,7 @@
 #include <vector>
 
 #include "cartographer/common/port.h"
+#include "cartographer/common/thread_pool.h"
 #include "cartographer/mapping_2d/probability_grid.h"
 #include "cartographer/sensor/point_cloud.h"
 #include "cartographer/sensor/range_data.h"
@@ -29,10 +30,14 @@ namespace cartographer {
 namespace mapping_2d {
 
 // For each ray in 'range_data', inserts hits and misses into
-// 'probability_grid'. Hits are handled before misses.
+// 'probability_grid'. Hits are handled before misses. If 'thread_pool' is not
+// nullptr, misses are cast and inserted in parallel using 'cell_buckets' as
+// scratch space.
 void CastRays(const sensor::RangeData& range_data,
               const std::vector<uint16>& hit_table,
               const std::vector<uint16>& miss_table, bool insert_free_space,
+              common::ThreadPool* thread_pool,
+              ProbabilityGrid::CellBuckets* cell_buckets,
               ProbabilityGrid* probability_grid);
 
 }  // namespace mapping_2d
@@ -0,0 +1,145 @@
+/*
+ * Copyright 2016 The Cartographer Authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Measures inserting dense 2D scans of a hall into a ProbabilityGrid with
+// CastRays(), on the calling thread only and with a thread pool.
+
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <vector>
+
+#include "cartographer/common/make_unique.h"
+#include "cartographer/common/thread_pool.h"
+#include "cartographer/mapping/probability_values.h"
+#include "cartographer/mapping_2d/probability_grid.h"
+#include "cartographer/mapping_2d/ray_casting.h"
+#include "cartographer/sensor/range_data.h"
+#include "gflags/gflags.h"
+#include "glog/logging.h"
+
+DEFINE_int32(num_points, 2000, "Number of points per scan.");
+DEFINE_int32(scans_per_accumulation, 2,
+             "Number of scans accumulated into each insertion.");
+DEFINE_int32(num_insertions, 200, "Number of insertions to time.");
+DEFINE_int32(num_threads, 4,
+             "Number of threads, including the calling thread, for the "
+             "parallel insertion.");
+
+namespace cartographer {
+namespace mapping_2d {
+namespace {
+
+constexpr double kResolution = 0.05;
+
+double SecondsSince(const std::chrono::steady_clock::time_point start) {
+  const std::chrono::duration<double> elapsed =
+      std::chrono::steady_clock::now() - start;
+  return elapsed.count();
+}
+
+// Returns accumulated scans of a 40 m x 20 m hall taken around 'origin', with
+// 10 % of the rays being misses.
+sensor::RangeData SimulateRangeData(const Eigen::Vector3f& origin,
+                                    std::mt19937* const prng) {
+  std::normal_distribution<float> noise(0.f, 0.02f);
+  sensor::RangeData range_data{origin, {}, {}};
+  for (int scan = 0; scan != FLAGS_scans_per_accumulation; ++scan) {
+    for (int i = 0; i != FLAGS_num_points; ++i) {
+      // Rays are offset by half a step so that none is parallel to a wall.
+      const float angle = 2.f * M_PI * (i + 0.5f) / FLAGS_num_points - M_PI;
+      const Eigen::Vector2f direction(std::cos(angle), std::sin(angle));
+      // Distance to the first wall in 'direction'.
+      const Eigen::Array2f distances =
+          ((direction.array() > 0.f)
+               .select(Eigen::Array2f(20.f, 10.f),
+                       Eigen::Array2f(-20.f, -10.f)) -
+           origin.head<2>().array()) /
+          direction.array();
+      const float range = distances.minCoeff() + noise(*prng);
+      const Eigen::Vector3f point =
+          origin + range * Eigen::Vector3f(direction.x(), direction.y(), 0.f);
+      if (i % 10 == 0) {
+        range_data.misses.push_back(point);
+      } else {
+        range_data.returns.push_back(point);
+      }
+    }
+  }
+  return range_data;
+}
+
+// Returns the seconds per insertion of 'range_data' into a fresh grid.
+double TimeInsertions(const std::vector<sensor::RangeData>& range_data,
+                      common::ThreadPool* const thread_pool) {
+  const std::vector<uint16> hit_table =
+      mapping::ComputeLookupTableToApplyOdds(mapping::Odds(0.55f));
+  const std::vector<uint16> miss_table =
+      mapping::ComputeLookupTableToApplyOdds(mapping::Odds(0.49f));
+  ProbabilityGrid probability_grid(
+      MapLimits(kResolution, Eigen::Vector2d(25., 15.), CellLimits(600, 1000)));
+  ProbabilityGrid::CellBuckets cell_buckets;
+  const auto start = std::chrono::steady_clock::now();
+  for (const sensor::RangeData& data : range_data) {
+    CastRays(data, hit_table, miss_table, true /* insert_free_space */,
+             thread_pool, &cell_buckets, &probability_grid);
+    probability_grid.FinishUpdate();
+  }
+  return SecondsSince(start) / range_data.size();
+}
+
+void Run() {
+  CHECK_GT(FLAGS_num_insertions, 0);
+  CHECK_GT(FLAGS_num_threads, 1);
+  std::mt19937 prng(42);
+  std::uniform_real_distribution<float> x_distribution(-15.f, 15.f);
+  std::uniform_real_distribution<float> y_distribution(-5.f, 5.f);
+  std::vector<sensor::RangeData> range_data;
+  for (int i = 0; i != FLAGS_num_insertions; ++i) {
+    range_data.push_back(SimulateRangeData(
+        Eigen::Vector3f(x_distribution(prng), y_distribution(prng), 0.f),
+        &prng));
+  }
+
+  const double serial_seconds = TimeInsertions(range_data, nullptr);
+  common::ThreadPool thread_pool(FLAGS_num_threads - 1);
+  const double parallel_seconds = TimeInsertions(range_data, &thread_pool);
+
+  const int num_rays = FLAGS_num_points * FLAGS_scans_per_accumulation;
+  std::cout << "CastRays() of " << num_rays << " rays\n"
+            << "  calling thread: " << 1e3 * serial_seconds
+            << " ms per insertion, " << 1e9 * serial_seconds / num_rays
+            << " ns per ray\n"
+            << "  " << FLAGS_num_threads << " threads: "
+            << 1e3 * parallel_seconds << " ms per insertion, "
+            << 1e9 * parallel_seconds / num_rays << " ns per ray\n";
+}
+
+}  // namespace
+}  // namespace mapping_2d
+}  // namespace cartographer
+
+int main(int argc, char** argv) {
+  google::InitGoogleLogging(argv[0]);
+  FLAGS_logtostderr = true;
+  google::SetUsageMessage(
+      "\n\n"
+      "Benchmarks inserting 2D range data with CastRays().\n");
+  google::ParseCommandLineFlags(&argc, &argv, true);
+  ::cartographer::mapping_2d::Run();
+}
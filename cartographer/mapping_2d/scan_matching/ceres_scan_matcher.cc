@@ -23,6 +23,8 @@
 #include "cartographer/common/ceres_solver_options.h"
 #include "cartographer/common/lua_parameter_dictionary.h"
 #include "cartographer/mapping_2d/probability_grid.h"
+#include "cartographer/common/make_unique.h"
+#include "cartographer/mapping_2d/scan_matching/occupied_space_cost_function.h"
 #include "cartographer/mapping_2d/scan_matching/occupied_space_cost_functor.h"
 #include "cartographer/mapping_2d/scan_matching/rotation_delta_cost_functor.h"
 #include "cartographer/mapping_2d/scan_matching/translation_delta_cost_functor.h"
@@ -43,6 +45,8 @@ proto::CeresScanMatcherOptions CreateCeresScanMatcherOptions(
       parameter_dictionary->GetDouble("translation_weight"));
   options.set_rotation_weight(
       parameter_dictionary->GetDouble("rotation_weight"));
+  options.set_use_analytic_occupied_space_cost(
+      parameter_dictionary->GetBool("use_analytic_occupied_space_cost"));
   *options.mutable_ceres_solver_options() =
       common::CreateCeresSolverOptionsProto(
           parameter_dictionary->GetDictionary("ceres_solver_options").get());
@@ -65,20 +69,43 @@ void CeresScanMatcher::Match(const transform::Rigid2d& previous_pose,
                              const ProbabilityGrid& probability_grid,
                              transform::Rigid2d* const pose_estimate,
                              ceres::Solver::Summary* const summary) const {
+  CHECK_GT(options_.occupied_space_weight(), 0.);
+  const double occupied_space_scaling_factor =
+      options_.occupied_space_weight() /
+      std::sqrt(static_cast<double>(point_cloud.size()));
+  if (options_.use_analytic_occupied_space_cost()) {
+    common::MutexLocker locker(&mutex_);
+    if (interpolation_grid_ == nullptr) {
+      interpolation_grid_ =
+          common::make_unique<InterpolationGrid>(probability_grid);
+    } else {
+      interpolation_grid_->Update(probability_grid);
+    }
+    Solve(previous_pose, initial_pose_estimate,
+          new OccupiedSpaceCostFunction(occupied_space_scaling_factor,
+                                        point_cloud, *interpolation_grid_),
+          pose_estimate, summary);
+    return;
+  }
+  Solve(previous_pose, initial_pose_estimate,
+        new ceres::AutoDiffCostFunction<OccupiedSpaceCostFunctor,
+                                        ceres::DYNAMIC, 3>(
+            new OccupiedSpaceCostFunctor(occupied_space_scaling_factor,
+                                         point_cloud, probability_grid),
+            point_cloud.size()),
+        pose_estimate, summary);
+}
+
+void CeresScanMatcher::Solve(const transform::Rigid2d& previous_pose,
+                             const transform::Rigid2d& initial_pose_estimate,
+                             ceres::CostFunction* const occupied_space_cost,
+                             transform::Rigid2d* const pose_estimate,
+                             ceres::Solver::Summary* const summary) const {
   double ceres_pose_estimate[3] = {initial_pose_estimate.translation().x(),
                                    initial_pose_estimate.translation().y(),
                                    initial_pose_estimate.rotation().angle()};
   ceres::Problem problem;
-  CHECK_GT(options_.occupied_space_weight(), 0.);
-  problem.AddResidualBlock(
-      new ceres::AutoDiffCostFunction<OccupiedSpaceCostFunctor, ceres::DYNAMIC,
-                                      3>(
-          new OccupiedSpaceCostFunctor(
-              options_.occupied_space_weight() /
-                  std::sqrt(static_cast<double>(point_cloud.size())),
-              point_cloud, probability_grid),
-          point_cloud.size()),
-      nullptr, ceres_pose_estimate);
+  problem.AddResidualBlock(occupied_space_cost, nullptr, ceres_pose_estimate);
   CHECK_GT(options_.translation_weight(), 0.);
   problem.AddResidualBlock(
       new ceres::AutoDiffCostFunction<TranslationDeltaCostFunctor, 2, 3>(
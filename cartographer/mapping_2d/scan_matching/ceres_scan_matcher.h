@@ -22,7 +22,9 @@
 
 #include "Eigen/Core"
 #include "cartographer/common/lua_parameter_dictionary.h"
+#include "cartographer/common/mutex.h"
 #include "cartographer/mapping_2d/probability_grid.h"
+#include "cartographer/mapping_2d/scan_matching/interpolation_grid.h"
 #include "cartographer/mapping_2d/scan_matching/proto/ceres_scan_matcher_options.pb.h"
 #include "cartographer/sensor/point_cloud.h"
 #include "ceres/ceres.h"
@@ -46,6 +48,9 @@ class CeresScanMatcher {
   // Aligns 'point_cloud' within the 'probability_grid' given an
   // 'initial_pose_estimate' and returns a 'pose_estimate' and the solver
   // 'summary'.
+  //
+  // With 'use_analytic_occupied_space_cost', the last matched grid is kept as
+  // an InterpolationGrid and concurrent calls are serialized.
   void Match(const transform::Rigid2d& previous_pose,
              const transform::Rigid2d& initial_pose_estimate,
              const sensor::PointCloud& point_cloud,
@@ -54,8 +59,20 @@ class CeresScanMatcher {
              ceres::Solver::Summary* summary) const;
 
  private:
+  // Solves for the pose using 'occupied_space_cost' and the delta cost
+  // functors. Takes ownership of 'occupied_space_cost'.
+  void Solve(const transform::Rigid2d& previous_pose,
+             const transform::Rigid2d& initial_pose_estimate,
+             ceres::CostFunction* occupied_space_cost,
+             transform::Rigid2d* pose_estimate,
+             ceres::Solver::Summary* summary) const;
+
   const proto::CeresScanMatcherOptions options_;
   ceres::Solver::Options ceres_solver_options_;
+
+  mutable common::Mutex mutex_;
+  mutable std::unique_ptr<InterpolationGrid> interpolation_grid_
+      GUARDED_BY(mutex_);
 };
 
 }  // namespace scan_matching
@@ -17,6 +17,7 @@
 #include "cartographer/mapping_2d/scan_matching/ceres_scan_matcher.h"
 
 #include <memory>
+#include <string>
 
 #include "cartographer/common/lua_parameter_dictionary.h"
 #include "cartographer/common/lua_parameter_dictionary_test_helpers.h"
@@ -31,7 +32,8 @@ namespace mapping_2d {
 namespace scan_matching {
 namespace {
 
-class CeresScanMatcherTest : public ::testing::Test {
+// The parameter selects 'use_analytic_occupied_space_cost'.
+class CeresScanMatcherTest : public ::testing::TestWithParam<bool> {
  protected:
   CeresScanMatcherTest()
       : probability_grid_(
@@ -42,11 +44,16 @@ class CeresScanMatcherTest : public ::testing::Test {
 
     point_cloud_.emplace_back(-3.f, 2.f, 0.f);
 
-    auto parameter_dictionary = common::MakeDictionary(R"text(
+    const std::string use_analytic_occupied_space_cost =
+        GetParam() ? "true" : "false";
+    auto parameter_dictionary = common::MakeDictionary(
+        R"text(
         return {
           occupied_space_weight = 1.,
           translation_weight = 0.1,
           rotation_weight = 1.5,
+          use_analytic_occupied_space_cost = )text" +
+        use_analytic_occupied_space_cost + R"text(,
           ceres_solver_options = {
             use_nonmonotonic_steps = true,
             max_num_iterations = 50,
@@ -76,22 +83,25 @@ class CeresScanMatcherTest : public ::testing::Test {
   std::unique_ptr<CeresScanMatcher> ceres_scan_matcher_;
 };
 
-TEST_F(CeresScanMatcherTest, testPerfectEstimate) {
+TEST_P(CeresScanMatcherTest, testPerfectEstimate) {
   TestFromInitialPose(transform::Rigid2d::Translation({-0.5, 0.5}));
 }
 
-TEST_F(CeresScanMatcherTest, testOptimizeAlongX) {
+TEST_P(CeresScanMatcherTest, testOptimizeAlongX) {
   TestFromInitialPose(transform::Rigid2d::Translation({-0.3, 0.5}));
 }
 
-TEST_F(CeresScanMatcherTest, testOptimizeAlongY) {
+TEST_P(CeresScanMatcherTest, testOptimizeAlongY) {
   TestFromInitialPose(transform::Rigid2d::Translation({-0.45, 0.3}));
 }
 
-TEST_F(CeresScanMatcherTest, testOptimizeAlongXY) {
+TEST_P(CeresScanMatcherTest, testOptimizeAlongXY) {
   TestFromInitialPose(transform::Rigid2d::Translation({-0.3, 0.3}));
 }
 
+INSTANTIATE_TEST_CASE_P(OccupiedSpaceCost, CeresScanMatcherTest,
+                        ::testing::Bool());
+
 }  // namespace
 }  // namespace scan_matching
 }  // namespace mapping_2d
@@ -23,6 +23,7 @@
 #include <limits>
 
 #include "Eigen/Geometry"
+#include "cartographer/common/make_unique.h"
 #include "cartographer/common/math.h"
 #include "cartographer/mapping_2d/probability_grid.h"
 #include "cartographer/sensor/point_cloud.h"
@@ -73,6 +74,14 @@ class SlidingWindowMaximum {
   std::deque<float> non_ascending_maxima_;
 };
 
+// Raises 'best_score' to 'score' unless it is already at least as high.
+void UpdateBestScore(const float score, std::atomic<float>* const best_score) {
+  float current_best_score = best_score->load();
+  while (score > current_best_score &&
+         !best_score->compare_exchange_weak(current_best_score, score)) {
+  }
+}
+
 }  // namespace
 
 proto::FastCorrelativeScanMatcherOptions
@@ -85,6 +94,8 @@ CreateFastCorrelativeScanMatcherOptions(
       parameter_dictionary->GetDouble("angular_search_window"));
   options.set_branch_and_bound_depth(
       parameter_dictionary->GetInt("branch_and_bound_depth"));
+  options.set_parallel_branch_and_bound(
+      parameter_dictionary->GetBool("parallel_branch_and_bound"));
   return options;
 }
 
@@ -94,7 +105,8 @@ PrecomputationGrid::PrecomputationGrid(
     : offset_(-width + 1, -width + 1),
       wide_limits_(limits.num_x_cells + width - 1,
                    limits.num_y_cells + width - 1),
-      cells_(wide_limits_.num_x_cells * wide_limits_.num_y_cells) {
+      cells_(wide_limits_.num_x_cells * wide_limits_.num_y_cells +
+             kScoringGridPadding) {
   CHECK_GE(width, 1);
   CHECK_GE(limits.num_x_cells, 1);
   CHECK_GE(limits.num_y_cells, 1);
@@ -158,6 +170,16 @@ PrecomputationGrid::PrecomputationGrid(
   }
 }
 
+int PrecomputationGrid::SumValues(const DiscreteScan& xy_indices,
+                                  const Eigen::Array2i& xy_offset) const {
+  static const ScoringFunction scoring_function =
+      GetScoringFunction(GetFastestScoringKernel());
+  return scoring_function(
+      ScoringGrid{cells_.data(), wide_limits_.num_x_cells,
+                  wide_limits_.num_y_cells},
+      xy_indices.data(), xy_indices.size(), xy_offset - offset_);
+}
+
 uint8 PrecomputationGrid::ComputeCellValue(const float probability) const {
   const int cell_value = common::RoundToInt(
       (probability - mapping::kMinProbability) *
@@ -167,42 +189,108 @@ uint8 PrecomputationGrid::ComputeCellValue(const float probability) const {
   return cell_value;
 }
 
-class PrecomputationGridStack {
- public:
-  PrecomputationGridStack(
-      const ProbabilityGrid& probability_grid,
-      const proto::FastCorrelativeScanMatcherOptions& options) {
-    CHECK_GE(options.branch_and_bound_depth(), 1);
-    const int max_width = 1 << (options.branch_and_bound_depth() - 1);
-    precomputation_grids_.reserve(options.branch_and_bound_depth());
-    std::vector<float> reusable_intermediate_grid;
-    const CellLimits limits = probability_grid.limits().cell_limits();
-    reusable_intermediate_grid.reserve((limits.num_x_cells + max_width - 1) *
-                                       limits.num_y_cells);
-    for (int i = 0; i != options.branch_and_bound_depth(); ++i) {
-      const int width = 1 << i;
-      precomputation_grids_.emplace_back(probability_grid, limits, width,
-                                         &reusable_intermediate_grid);
-    }
+PrecomputationGrid::PrecomputationGrid(const proto::PrecomputationGrid& proto)
+    : offset_(-proto.width() + 1, -proto.width() + 1),
+      wide_limits_(proto.num_x_cells(), proto.num_y_cells()),
+      cells_(proto.cells().begin(), proto.cells().end()) {
+  CHECK_GE(proto.width(), 1);
+  CHECK_EQ(cells_.size(), static_cast<size_t>(wide_limits_.num_x_cells) *
+                              wide_limits_.num_y_cells);
+  cells_.resize(cells_.size() + kScoringGridPadding);
+}
+
+proto::PrecomputationGrid PrecomputationGrid::ToProto() const {
+  proto::PrecomputationGrid result;
+  result.set_width(1 - offset_.x());
+  result.set_num_x_cells(wide_limits_.num_x_cells);
+  result.set_num_y_cells(wide_limits_.num_y_cells);
+  result.set_cells(cells_.data(), cells_.size() - kScoringGridPadding);
+  return result;
+}
+
+PrecomputationGridStack::PrecomputationGridStack(
+    const ProbabilityGrid& probability_grid,
+    const proto::FastCorrelativeScanMatcherOptions& options,
+    common::ThreadPool* const thread_pool)
+    : limits_(probability_grid.limits()) {
+  CHECK_GE(options.branch_and_bound_depth(), 1);
+  precomputation_grids_.resize(options.branch_and_bound_depth());
+  const CellLimits limits = limits_.cell_limits();
+  // The grids of all depths only depend on 'probability_grid', so each is
+  // computed in its own task.
+  common::ParallelFor(
+      thread_pool, options.branch_and_bound_depth(), [&](const int index) {
+        const int width = 1 << index;
+        std::vector<float> intermediate_grid;
+        precomputation_grids_[index] = common::make_unique<PrecomputationGrid>(
+            probability_grid, limits, width, &intermediate_grid);
+      });
+}
+
+PrecomputationGridStack::PrecomputationGridStack(
+    const proto::PrecomputationGridStack& proto)
+    : limits_(proto.limits()) {
+  CHECK_GE(proto.precomputation_grids_size(), 1);
+  const CellLimits& limits = limits_.cell_limits();
+  for (const auto& precomputation_grid : proto.precomputation_grids()) {
+    const int width = 1 << precomputation_grids_.size();
+    CHECK_EQ(precomputation_grid.width(), width);
+    CHECK_EQ(precomputation_grid.num_x_cells(),
+             limits.num_x_cells + width - 1);
+    CHECK_EQ(precomputation_grid.num_y_cells(),
+             limits.num_y_cells + width - 1);
+    precomputation_grids_.push_back(
+        common::make_unique<PrecomputationGrid>(precomputation_grid));
   }
+}
+
+bool PrecomputationGridStack::IsComputedFor(const MapLimits& limits) const {
+  return limits.resolution() == limits_.resolution() &&
+         limits.max() == limits_.max() &&
+         limits.cell_limits().num_x_cells ==
+             limits_.cell_limits().num_x_cells &&
+         limits.cell_limits().num_y_cells == limits_.cell_limits().num_y_cells;
+}
 
-  const PrecomputationGrid& Get(int index) {
-    return precomputation_grids_[index];
+int64 PrecomputationGridStack::size_in_bytes() const {
+  int64 result = 0;
+  for (const auto& precomputation_grid : precomputation_grids_) {
+    result += precomputation_grid->size_in_bytes();
   }
+  return result;
+}
 
-  int max_depth() const { return precomputation_grids_.size() - 1; }
+proto::PrecomputationGridStack PrecomputationGridStack::ToProto() const {
+  proto::PrecomputationGridStack result;
+  for (const auto& precomputation_grid : precomputation_grids_) {
+    *result.add_precomputation_grids() = precomputation_grid->ToProto();
+  }
+  *result.mutable_limits() = mapping_2d::ToProto(limits_);
+  return result;
+}
 
- private:
-  std::vector<PrecomputationGrid> precomputation_grids_;
-};
+FastCorrelativeScanMatcher::FastCorrelativeScanMatcher(
+    const ProbabilityGrid& probability_grid,
+    const proto::FastCorrelativeScanMatcherOptions& options,
+    common::ThreadPool* const thread_pool)
+    : FastCorrelativeScanMatcher(
+          probability_grid,
+          std::make_shared<const PrecomputationGridStack>(
+              probability_grid, options, thread_pool),
+          options, thread_pool) {}
 
 FastCorrelativeScanMatcher::FastCorrelativeScanMatcher(
     const ProbabilityGrid& probability_grid,
-    const proto::FastCorrelativeScanMatcherOptions& options)
+    std::shared_ptr<const PrecomputationGridStack> precomputation_grid_stack,
+    const proto::FastCorrelativeScanMatcherOptions& options,
+    common::ThreadPool* const thread_pool)
     : options_(options),
       limits_(probability_grid.limits()),
-      precomputation_grid_stack_(
-          new PrecomputationGridStack(probability_grid, options)) {}
+      precomputation_grid_stack_(std::move(precomputation_grid_stack)),
+      thread_pool_(thread_pool) {
+  CHECK_EQ(precomputation_grid_stack_->max_depth() + 1,
+           options_.branch_and_bound_depth());
+}
 
 FastCorrelativeScanMatcher::~FastCorrelativeScanMatcher() {}
 
@@ -258,9 +346,14 @@ bool FastCorrelativeScanMatcher::MatchWithSearchParameters(
 
   const std::vector<Candidate> lowest_resolution_candidates =
       ComputeLowestResolutionCandidates(discrete_scans, search_parameters);
-  const Candidate best_candidate = BranchAndBound(
-      discrete_scans, search_parameters, lowest_resolution_candidates,
-      precomputation_grid_stack_->max_depth(), min_score);
+  const Candidate best_candidate =
+      options_.parallel_branch_and_bound() && thread_pool_ != nullptr
+          ? ParallelBranchAndBound(discrete_scans, search_parameters,
+                                   lowest_resolution_candidates, min_score)
+          : BranchAndBound(discrete_scans, search_parameters,
+                           lowest_resolution_candidates,
+                           precomputation_grid_stack_->max_depth(), min_score,
+                           nullptr /* best_score */);
   if (best_candidate.score > min_score) {
     *score = best_candidate.score;
     *pose_estimate = transform::Rigid2d(
@@ -328,14 +421,9 @@ void FastCorrelativeScanMatcher::ScoreCandidates(
     const SearchParameters& search_parameters,
     std::vector<Candidate>* const candidates) const {
   for (Candidate& candidate : *candidates) {
-    int sum = 0;
-    for (const Eigen::Array2i& xy_index :
-         discrete_scans[candidate.scan_index]) {
-      const Eigen::Array2i proposed_xy_index(
-          xy_index.x() + candidate.x_index_offset,
-          xy_index.y() + candidate.y_index_offset);
-      sum += precomputation_grid.GetValue(proposed_xy_index);
-    }
+    const int sum = precomputation_grid.SumValues(
+        discrete_scans[candidate.scan_index],
+        Eigen::Array2i(candidate.x_index_offset, candidate.y_index_offset));
     candidate.score = PrecomputationGrid::ToProbability(
         sum / static_cast<float>(discrete_scans[candidate.scan_index].size()));
   }
@@ -346,7 +434,7 @@ Candidate FastCorrelativeScanMatcher::BranchAndBound(
     const std::vector<DiscreteScan>& discrete_scans,
     const SearchParameters& search_parameters,
     const std::vector<Candidate>& candidates, const int candidate_depth,
-    float min_score) const {
+    float min_score, std::atomic<float>* const best_score) const {
   if (candidate_depth == 0) {
     // Return the best candidate.
     return *candidates.begin();
@@ -355,7 +443,10 @@ Candidate FastCorrelativeScanMatcher::BranchAndBound(
   Candidate best_high_resolution_candidate(0, 0, 0, search_parameters);
   best_high_resolution_candidate.score = min_score;
   for (const Candidate& candidate : candidates) {
-    if (candidate.score <= min_score) {
+    // Candidates as good as one found by a concurrent search are kept, so that
+    // ties are resolved as in the sequential search.
+    if (candidate.score <= min_score ||
+        (best_score != nullptr && candidate.score < best_score->load())) {
       break;
     }
     std::vector<Candidate> higher_resolution_candidates;
@@ -382,11 +473,42 @@ Candidate FastCorrelativeScanMatcher::BranchAndBound(
         best_high_resolution_candidate,
         BranchAndBound(discrete_scans, search_parameters,
                        higher_resolution_candidates, candidate_depth - 1,
-                       best_high_resolution_candidate.score));
+                       best_high_resolution_candidate.score, best_score));
+    if (best_score != nullptr) {
+      UpdateBestScore(best_high_resolution_candidate.score, best_score);
+    }
   }
   return best_high_resolution_candidate;
 }
 
+Candidate FastCorrelativeScanMatcher::ParallelBranchAndBound(
+    const std::vector<DiscreteScan>& discrete_scans,
+    const SearchParameters& search_parameters,
+    const std::vector<Candidate>& candidates, const float min_score) const {
+  // The candidates are sorted, so only a prefix can beat 'min_score'.
+  const int num_tasks =
+      std::find_if(candidates.begin(), candidates.end(),
+                   [min_score](const Candidate& candidate) {
+                     return candidate.score <= min_score;
+                   }) -
+      candidates.begin();
+  std::atomic<float> best_score(min_score);
+  std::vector<Candidate> best_candidates(
+      num_tasks, Candidate(0, 0, 0, search_parameters));
+  common::ParallelFor(thread_pool_, num_tasks, [&](const int index) {
+    best_candidates[index] = BranchAndBound(
+        discrete_scans, search_parameters, {candidates[index]},
+        precomputation_grid_stack_->max_depth(), min_score, &best_score);
+  });
+  // On ties, the first candidate wins as it would in the sequential search.
+  Candidate best_candidate(0, 0, 0, search_parameters);
+  best_candidate.score = min_score;
+  for (const Candidate& candidate : best_candidates) {
+    best_candidate = std::max(best_candidate, candidate);
+  }
+  return best_candidate;
+}
+
 }  // namespace scan_matching
 }  // namespace mapping_2d
 }  // namespace cartographer
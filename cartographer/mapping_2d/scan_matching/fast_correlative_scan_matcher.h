@@ -25,14 +25,18 @@
 #ifndef CARTOGRAPHER_MAPPING_2D_SCAN_MATCHING_FAST_CORRELATIVE_SCAN_MATCHER_H_
 #define CARTOGRAPHER_MAPPING_2D_SCAN_MATCHING_FAST_CORRELATIVE_SCAN_MATCHER_H_
 
+#include <atomic>
 #include <memory>
 #include <vector>
 
 #include "Eigen/Core"
 #include "cartographer/common/port.h"
+#include "cartographer/common/thread_pool.h"
 #include "cartographer/mapping_2d/probability_grid.h"
 #include "cartographer/mapping_2d/scan_matching/correlative_scan_matcher.h"
 #include "cartographer/mapping_2d/scan_matching/proto/fast_correlative_scan_matcher_options.pb.h"
+#include "cartographer/mapping_2d/scan_matching/proto/precomputation_grid.pb.h"
+#include "cartographer/mapping_2d/scan_matching/scoring_kernels.h"
 #include "cartographer/sensor/point_cloud.h"
 
 namespace cartographer {
@@ -51,6 +55,7 @@ class PrecomputationGrid {
   PrecomputationGrid(const ProbabilityGrid& probability_grid,
                      const CellLimits& limits, int width,
                      std::vector<float>* reusable_intermediate_grid);
+  explicit PrecomputationGrid(const proto::PrecomputationGrid& proto);
 
   // Returns a value between 0 and 255 to represent probabilities between
   // kMinProbability and kMaxProbability.
@@ -71,6 +76,11 @@ class PrecomputationGrid {
     return cells_[local_xy_index.x() + local_xy_index.y() * stride];
   }
 
+  // Returns the sum of 'GetValue' over all 'xy_indices' shifted by
+  // 'xy_offset', using the fastest scoring kernel supported by this CPU.
+  int SumValues(const DiscreteScan& xy_indices,
+                const Eigen::Array2i& xy_offset) const;
+
   // Maps values from [0, 255] to [kMinProbability, kMaxProbability].
   static float ToProbability(float value) {
     return mapping::kMinProbability +
@@ -78,6 +88,11 @@ class PrecomputationGrid {
                ((mapping::kMaxProbability - mapping::kMinProbability) / 255.f);
   }
 
+  // Returns the memory used by the cells.
+  int64 size_in_bytes() const { return cells_.size(); }
+
+  proto::PrecomputationGrid ToProto() const;
+
  private:
   uint8 ComputeCellValue(float probability) const;
 
@@ -88,18 +103,63 @@ class PrecomputationGrid {
   // Size of the precomputation grid.
   const CellLimits wide_limits_;
 
-  // Probabilites mapped to 0 to 255.
+  // Probabilites mapped to 0 to 255, followed by 'kScoringGridPadding' unused
+  // values.
   std::vector<uint8> cells_;
 };
 
-class PrecomputationGridStack;
+// The precomputation grids for all depths of the branch-and-bound search.
+class PrecomputationGridStack {
+ public:
+  // Computes 'options.branch_and_bound_depth()' grids for 'probability_grid'.
+  // If 'thread_pool' is not nullptr, the grids are computed in parallel.
+  PrecomputationGridStack(
+      const ProbabilityGrid& probability_grid,
+      const proto::FastCorrelativeScanMatcherOptions& options,
+      common::ThreadPool* thread_pool);
+  explicit PrecomputationGridStack(const proto::PrecomputationGridStack& proto);
+
+  PrecomputationGridStack(const PrecomputationGridStack&) = delete;
+  PrecomputationGridStack& operator=(const PrecomputationGridStack&) = delete;
+
+  const PrecomputationGrid& Get(int index) const {
+    return *precomputation_grids_[index];
+  }
+
+  int max_depth() const { return precomputation_grids_.size() - 1; }
+
+  // Returns true if the grids were computed for a probability grid with
+  // 'limits', i.e. they can be used to match against it.
+  bool IsComputedFor(const MapLimits& limits) const;
+
+  // Returns the memory used by all grids.
+  int64 size_in_bytes() const;
+
+  proto::PrecomputationGridStack ToProto() const;
+
+ private:
+  MapLimits limits_;
+  std::vector<std::unique_ptr<PrecomputationGrid>> precomputation_grids_;
+};
 
 // An implementation of "Real-Time Correlative Scan Matching" by Olson.
 class FastCorrelativeScanMatcher {
  public:
+  // If 'options.parallel_branch_and_bound()' is set and 'thread_pool' is not
+  // nullptr, the branch-and-bound search is split into tasks on 'thread_pool'.
+  // The result is the same as for the sequential search.
+  FastCorrelativeScanMatcher(
+      const ProbabilityGrid& probability_grid,
+      const proto::FastCorrelativeScanMatcherOptions& options,
+      common::ThreadPool* thread_pool);
+  // Like the above, but uses the 'precomputation_grid_stack' previously
+  // computed for 'probability_grid', e.g. one shared through a
+  // 'PrecomputationGridStackCache'.
   FastCorrelativeScanMatcher(
       const ProbabilityGrid& probability_grid,
-      const proto::FastCorrelativeScanMatcherOptions& options);
+      std::shared_ptr<const PrecomputationGridStack> precomputation_grid_stack,
+      const proto::FastCorrelativeScanMatcherOptions& options,
+      common::ThreadPool* thread_pool);
   ~FastCorrelativeScanMatcher();
 
   FastCorrelativeScanMatcher(const FastCorrelativeScanMatcher&) = delete;
@@ -139,14 +199,26 @@ class FastCorrelativeScanMatcher {
                        const std::vector<DiscreteScan>& discrete_scans,
                        const SearchParameters& search_parameters,
                        std::vector<Candidate>* const candidates) const;
+  // Returns the best candidate with a score above 'min_score', or one with a
+  // score of 'min_score' if there is none. If 'best_score' is not nullptr, it
+  // is the score of the best candidate found by any concurrent search. It is
+  // used for pruning and raised for each better candidate found.
   Candidate BranchAndBound(const std::vector<DiscreteScan>& discrete_scans,
                            const SearchParameters& search_parameters,
                            const std::vector<Candidate>& candidates,
-                           int candidate_depth, float min_score) const;
+                           int candidate_depth, float min_score,
+                           std::atomic<float>* best_score) const;
+  // Like BranchAndBound(), but searches below each of the 'candidates' in a
+  // separate task on 'thread_pool_'.
+  Candidate ParallelBranchAndBound(
+      const std::vector<DiscreteScan>& discrete_scans,
+      const SearchParameters& search_parameters,
+      const std::vector<Candidate>& candidates, float min_score) const;
 
   const proto::FastCorrelativeScanMatcherOptions options_;
   MapLimits limits_;
-  std::unique_ptr<PrecomputationGridStack> precomputation_grid_stack_;
+  std::shared_ptr<const PrecomputationGridStack> precomputation_grid_stack_;
+  common::ThreadPool* const thread_pool_;
 };
 
 }  // namespace scan_matching
@@ -111,11 +111,48 @@ CreateFastCorrelativeScanMatcherTestOptions(const int branch_and_bound_depth) {
       return {
          linear_search_window = 3.,
          angular_search_window = 1.,
+         parallel_branch_and_bound = false,
          branch_and_bound_depth = )text" +
                              std::to_string(branch_and_bound_depth) + "}");
   return CreateFastCorrelativeScanMatcherOptions(parameter_dictionary.get());
 }
 
+TEST(PrecomputationGridStackTest, ParallelAndSerializedGridsAreEqual) {
+  std::mt19937 prng(42);
+  std::uniform_int_distribution<int> distribution(0, 255);
+  ProbabilityGrid probability_grid(
+      MapLimits(0.05, Eigen::Vector2d(5., 5.), CellLimits(100, 120)));
+  for (const Eigen::Array2i& xy_index :
+       XYIndexRangeIterator(Eigen::Array2i(20, 10), Eigen::Array2i(89, 99))) {
+    probability_grid.SetProbability(
+        xy_index, PrecomputationGrid::ToProbability(distribution(prng)));
+  }
+  const auto options = CreateFastCorrelativeScanMatcherTestOptions(5);
+  common::ThreadPool thread_pool(4);
+  const PrecomputationGridStack expected(probability_grid, options,
+                                         nullptr /* thread_pool */);
+  const PrecomputationGridStack parallel(probability_grid, options,
+                                         &thread_pool);
+  const PrecomputationGridStack deserialized(expected.ToProto());
+  ASSERT_EQ(4, expected.max_depth());
+  EXPECT_EQ(expected.max_depth(), parallel.max_depth());
+  EXPECT_EQ(expected.max_depth(), deserialized.max_depth());
+  EXPECT_EQ(expected.size_in_bytes(), deserialized.size_in_bytes());
+  EXPECT_TRUE(deserialized.IsComputedFor(probability_grid.limits()));
+  EXPECT_FALSE(deserialized.IsComputedFor(
+      MapLimits(0.05, Eigen::Vector2d(5., 5.), CellLimits(120, 100))));
+  EXPECT_FALSE(deserialized.IsComputedFor(
+      MapLimits(0.05, Eigen::Vector2d(5.5, 5.), CellLimits(100, 120))));
+  for (int depth = 0; depth <= expected.max_depth(); ++depth) {
+    for (const Eigen::Array2i& xy_index : XYIndexRangeIterator(
+             Eigen::Array2i(-20, -20), Eigen::Array2i(120, 140))) {
+      const int value = expected.Get(depth).GetValue(xy_index);
+      EXPECT_EQ(value, parallel.Get(depth).GetValue(xy_index));
+      EXPECT_EQ(value, deserialized.Get(depth).GetValue(xy_index));
+    }
+  }
+}
+
 mapping_2d::proto::RangeDataInserterOptions
 CreateRangeDataInserterTestOptions() {
   auto parameter_dictionary = common::MakeDictionary(R"text(
@@ -123,6 +160,7 @@ CreateRangeDataInserterTestOptions() {
         insert_free_space = true,
         hit_probability = 0.7,
         miss_probability = 0.4,
+        num_threads = 1,
       })text");
   return mapping_2d::CreateRangeDataInserterOptions(parameter_dictionary.get());
 }
@@ -159,8 +197,8 @@ TEST(FastCorrelativeScanMatcherTest, CorrectPose) {
         &probability_grid);
     probability_grid.FinishUpdate();
 
-    FastCorrelativeScanMatcher fast_correlative_scan_matcher(probability_grid,
-                                                             options);
+    FastCorrelativeScanMatcher fast_correlative_scan_matcher(
+        probability_grid, options, nullptr /* thread_pool */);
     transform::Rigid2d pose_estimate;
     float score;
     EXPECT_TRUE(fast_correlative_scan_matcher.Match(
@@ -211,8 +249,8 @@ TEST(FastCorrelativeScanMatcherTest, FullSubmapMatching) {
         &probability_grid);
     probability_grid.FinishUpdate();
 
-    FastCorrelativeScanMatcher fast_correlative_scan_matcher(probability_grid,
-                                                             options);
+    FastCorrelativeScanMatcher fast_correlative_scan_matcher(
+        probability_grid, options, nullptr /* thread_pool */);
     transform::Rigid2d pose_estimate;
     float score;
     EXPECT_TRUE(fast_correlative_scan_matcher.MatchFullSubmap(
@@ -225,6 +263,59 @@ TEST(FastCorrelativeScanMatcherTest, FullSubmapMatching) {
   }
 }
 
+TEST(FastCorrelativeScanMatcherTest, ParallelSearchFindsSamePose) {
+  std::mt19937 prng(42);
+  std::uniform_real_distribution<float> distribution(-1.f, 1.f);
+  RangeDataInserter range_data_inserter(CreateRangeDataInserterTestOptions());
+  constexpr float kMinScore = 0.1f;
+  const auto options = CreateFastCorrelativeScanMatcherTestOptions(6);
+  auto parallel_options = options;
+  parallel_options.set_parallel_branch_and_bound(true);
+  common::ThreadPool thread_pool(4);
+
+  sensor::PointCloud point_cloud;
+  point_cloud.emplace_back(-2.5f, 0.5f, 0.f);
+  point_cloud.emplace_back(-2.25f, 0.5f, 0.f);
+  point_cloud.emplace_back(0.f, 0.5f, 0.f);
+  point_cloud.emplace_back(0.25f, 1.6f, 0.f);
+  point_cloud.emplace_back(2.5f, 0.5f, 0.f);
+  point_cloud.emplace_back(2.0f, 1.8f, 0.f);
+
+  for (int i = 0; i != 10; ++i) {
+    const transform::Rigid2f expected_pose(
+        {2. * distribution(prng), 2. * distribution(prng)},
+        0.5 * distribution(prng));
+
+    ProbabilityGrid probability_grid(
+        MapLimits(0.05, Eigen::Vector2d(5., 5.), CellLimits(200, 200)));
+    range_data_inserter.Insert(
+        sensor::RangeData{
+            Eigen::Vector3f(expected_pose.translation().x(),
+                            expected_pose.translation().y(), 0.f),
+            sensor::TransformPointCloud(
+                point_cloud, transform::Embed3D(expected_pose.cast<float>())),
+            {}},
+        &probability_grid);
+    probability_grid.FinishUpdate();
+
+    FastCorrelativeScanMatcher fast_correlative_scan_matcher(
+        probability_grid, options, nullptr /* thread_pool */);
+    FastCorrelativeScanMatcher parallel_fast_correlative_scan_matcher(
+        probability_grid, parallel_options, &thread_pool);
+    transform::Rigid2d pose_estimate;
+    float score;
+    EXPECT_TRUE(fast_correlative_scan_matcher.MatchFullSubmap(
+        point_cloud, kMinScore, &score, &pose_estimate));
+    transform::Rigid2d parallel_pose_estimate;
+    float parallel_score;
+    EXPECT_TRUE(parallel_fast_correlative_scan_matcher.MatchFullSubmap(
+        point_cloud, kMinScore, &parallel_score, &parallel_pose_estimate));
+    EXPECT_EQ(score, parallel_score);
+    EXPECT_EQ(transform::ToProto(pose_estimate).DebugString(),
+              transform::ToProto(parallel_pose_estimate).DebugString());
+  }
+}
+
 }  // namespace
 }  // namespace scan_matching
 }  // namespace mapping_2d
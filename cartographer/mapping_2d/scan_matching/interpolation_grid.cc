@@ -0,0 +1,112 @@
+/*
+ * Copyright 2016 The Cartographer Authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "cartographer/mapping_2d/scan_matching/interpolation_grid.h"
+
+namespace cartographer {
+namespace mapping_2d {
+namespace scan_matching {
+
+namespace {
+
+// Number of kMinProbability cells around the known region needed so that
+// interpolations touching the border only see kMinProbability.
+constexpr int kBorder = 3;
+
+// Minimum number of extra cells on each side to allow the known region to grow
+// without reallocating.
+constexpr int kMinSlack = 16;
+
+bool SameLimits(const MapLimits& lhs, const MapLimits& rhs) {
+  return lhs.resolution() == rhs.resolution() && lhs.max() == rhs.max() &&
+         lhs.cell_limits().num_x_cells == rhs.cell_limits().num_x_cells &&
+         lhs.cell_limits().num_y_cells == rhs.cell_limits().num_y_cells;
+}
+
+}  // namespace
+
+InterpolationGrid::InterpolationGrid(const ProbabilityGrid& probability_grid)
+    : limits_(probability_grid.limits()) {
+  Reset(probability_grid);
+}
+
+void InterpolationGrid::Update(const ProbabilityGrid& probability_grid) {
+  if (probability_grid.id() != grid_id_ ||
+      !SameLimits(probability_grid.limits(), limits_)) {
+    Reset(probability_grid);
+    return;
+  }
+  if (probability_grid.version() == grid_version_) {
+    return;
+  }
+  Eigen::Array2i known_offset;
+  CellLimits known_limits;
+  probability_grid.ComputeCroppedLimits(&known_offset, &known_limits);
+  const Eigen::Array2i known_end =
+      known_offset +
+      Eigen::Array2i(known_limits.num_x_cells, known_limits.num_y_cells);
+  if ((known_offset < offset_ + kBorder).any() ||
+      (known_end > offset_ + Eigen::Array2i(width_, height_) - kBorder).any()) {
+    Reset(probability_grid);
+    return;
+  }
+  probability_grid.ForEachRegionModifiedSince(
+      grid_version_,
+      [this, &probability_grid](const Eigen::Array2i& begin,
+                                const CellLimits& size) {
+        CopyRegion(probability_grid, begin, size);
+      });
+  grid_version_ = probability_grid.version();
+}
+
+void InterpolationGrid::Reset(const ProbabilityGrid& probability_grid) {
+  limits_ = probability_grid.limits();
+  grid_id_ = probability_grid.id();
+  grid_version_ = probability_grid.version();
+  Eigen::Array2i known_offset;
+  CellLimits known_limits;
+  probability_grid.ComputeCroppedLimits(&known_offset, &known_limits);
+  const Eigen::Array2i known_size(known_limits.num_x_cells,
+                                  known_limits.num_y_cells);
+  // Grow by a quarter on each side, so that the known region of a growing
+  // submap only causes a logarithmic number of resets.
+  const Eigen::Array2i border = kBorder + (known_size / 4).max(kMinSlack);
+  offset_ = known_offset - border;
+  width_ = known_size.x() + 2 * border.x();
+  height_ = known_size.y() + 2 * border.y();
+  values_.assign(width_ * height_, mapping::kMinProbability);
+  CopyRegion(probability_grid, known_offset, known_limits);
+}
+
+void InterpolationGrid::CopyRegion(const ProbabilityGrid& probability_grid,
+                                   const Eigen::Array2i& begin,
+                                   const CellLimits& size) {
+  const Eigen::Array2i first = begin.max(offset_);
+  const Eigen::Array2i end =
+      (begin + Eigen::Array2i(size.num_x_cells, size.num_y_cells))
+          .min(offset_ + Eigen::Array2i(width_, height_));
+  for (int y = first.y(); y < end.y(); ++y) {
+    float* const row = &values_[(y - offset_.y()) * width_];
+    for (int x = first.x(); x < end.x(); ++x) {
+      row[x - offset_.x()] =
+          probability_grid.GetProbability(Eigen::Array2i(x, y));
+    }
+  }
+}
+
+}  // namespace scan_matching
+}  // namespace mapping_2d
+}  // namespace cartographer
@@ -0,0 +1,124 @@
+/*
+ * Copyright 2016 The Cartographer Authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef CARTOGRAPHER_MAPPING_2D_SCAN_MATCHING_INTERPOLATION_GRID_H_
+#define CARTOGRAPHER_MAPPING_2D_SCAN_MATCHING_INTERPOLATION_GRID_H_
+
+#include <vector>
+
+#include "Eigen/Core"
+#include "cartographer/common/port.h"
+#include "cartographer/mapping/probability_values.h"
+#include "cartographer/mapping_2d/map_limits.h"
+#include "cartographer/mapping_2d/probability_grid.h"
+
+namespace cartographer {
+namespace mapping_2d {
+namespace scan_matching {
+
+// A dense float copy of the probabilities of the known region of a
+// ProbabilityGrid, surrounded by cells of kMinProbability. It evaluates the
+// same bicubic interpolation as ceres::BiCubicInterpolator does in the
+// OccupiedSpaceCostFunctor, but without bounds checks and table lookups per
+// sample.
+class InterpolationGrid {
+ public:
+  explicit InterpolationGrid(const ProbabilityGrid& probability_grid);
+
+  InterpolationGrid(const InterpolationGrid&) = delete;
+  InterpolationGrid& operator=(const InterpolationGrid&) = delete;
+
+  // Brings the copy up to date with 'probability_grid'. Only the tiles
+  // modified since the last update are copied, unless 'probability_grid' is a
+  // different grid, its limits changed or its known region outgrew the copy.
+  void Update(const ProbabilityGrid& probability_grid);
+
+  const MapLimits& limits() const { return limits_; }
+
+  // Evaluates the interpolated probability and its partial derivatives at the
+  // continuous cell index ('x', 'y'), where integer values are cell centers.
+  void Evaluate(const double x, const double y, double* const value,
+                double* const dvalue_dx, double* const dvalue_dy) const {
+    const double column = x - offset_.x();
+    const double row = y - offset_.y();
+    // Outside of this range, all 4x4 cells used for the interpolation are in
+    // the border and therefore kMinProbability. This is also false for NaNs.
+    if (!(column >= 1. && column < width_ - 2 && row >= 1. &&
+          row < height_ - 2)) {
+      *value = mapping::kMinProbability;
+      *dvalue_dx = 0.;
+      *dvalue_dy = 0.;
+      return;
+    }
+    const int c = static_cast<int>(column);
+    const int r = static_cast<int>(row);
+    const double fraction_x = column - c;
+    const double fraction_y = row - r;
+    const float* cell = &values_[(r - 1) * width_ + c - 1];
+    double f[4];
+    double df_dx[4];
+    for (int i = 0; i != 4; ++i, cell += width_) {
+      CubicHermiteSpline(cell[0], cell[1], cell[2], cell[3], fraction_x, &f[i],
+                         &df_dx[i]);
+    }
+    CubicHermiteSpline(f[0], f[1], f[2], f[3], fraction_y, value, dvalue_dy);
+    double unused;
+    CubicHermiteSpline(df_dx[0], df_dx[1], df_dx[2], df_dx[3], fraction_y,
+                       dvalue_dx, &unused);
+  }
+
+  // Returns the number of bytes used for the copied values.
+  size_t num_bytes() const { return values_.size() * sizeof(float); }
+
+ private:
+  // Catmull-Rom spline through 'p1' and 'p2' evaluated at 'x' in [0, 1), as in
+  // ceres/cubic_interpolation.h.
+  static void CubicHermiteSpline(const double p0, const double p1,
+                                 const double p2, const double p3,
+                                 const double x, double* const f,
+                                 double* const dfdx) {
+    const double a = 0.5 * (-p0 + 3. * p1 - 3. * p2 + p3);
+    const double b = 0.5 * (2. * p0 - 5. * p1 + 4. * p2 - p3);
+    const double c = 0.5 * (-p0 + p2);
+    *f = p1 + x * (c + x * (b + x * a));
+    *dfdx = c + x * (2. * b + 3. * a * x);
+  }
+
+  // Reallocates the copy to cover the known region of 'probability_grid' with
+  // room to grow and copies all cells.
+  void Reset(const ProbabilityGrid& probability_grid);
+
+  // Copies the cells in the region starting at 'begin' of size 'size' which
+  // are inside the copy.
+  void CopyRegion(const ProbabilityGrid& probability_grid,
+                  const Eigen::Array2i& begin, const CellLimits& size);
+
+  MapLimits limits_;
+  uint64 grid_id_;
+  uint64 grid_version_;
+
+  // Cell index of the first value, row-major 'width_' by 'height_' values.
+  Eigen::Array2i offset_;
+  int width_;
+  int height_;
+  std::vector<float> values_;
+};
+
+}  // namespace scan_matching
+}  // namespace mapping_2d
+}  // namespace cartographer
+
+#endif  // CARTOGRAPHER_MAPPING_2D_SCAN_MATCHING_INTERPOLATION_GRID_H_
@@ -0,0 +1,76 @@
+/*
+ * Copyright 2016 The Cartographer Authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "cartographer/mapping_2d/scan_matching/occupied_space_cost_function.h"
+
+#include <cmath>
+
+namespace cartographer {
+namespace mapping_2d {
+namespace scan_matching {
+
+OccupiedSpaceCostFunction::OccupiedSpaceCostFunction(
+    const double scaling_factor, const sensor::PointCloud& point_cloud,
+    const InterpolationGrid& interpolation_grid)
+    : scaling_factor_(scaling_factor),
+      point_cloud_(point_cloud),
+      interpolation_grid_(interpolation_grid) {
+  set_num_residuals(point_cloud_.size());
+  mutable_parameter_block_sizes()->push_back(3);
+}
+
+bool OccupiedSpaceCostFunction::Evaluate(double const* const* parameters,
+                                         double* const residuals,
+                                         double** const jacobians) const {
+  const double* const pose = parameters[0];
+  const double cos_theta = std::cos(pose[2]);
+  const double sin_theta = std::sin(pose[2]);
+  const MapLimits& limits = interpolation_grid_.limits();
+  const double max_x = limits.max().x();
+  const double max_y = limits.max().y();
+  const double inverse_resolution = 1. / limits.resolution();
+  // Cell indices decrease with increasing world coordinates, hence the sign.
+  const double scale = scaling_factor_ * inverse_resolution;
+  double* const jacobian = jacobians != nullptr ? jacobians[0] : nullptr;
+
+  for (size_t i = 0; i < point_cloud_.size(); ++i) {
+    const double x = point_cloud_[i].x();
+    const double y = point_cloud_[i].y();
+    // The rotated point, i.e. the world position relative to the translation.
+    const double rotated_x = cos_theta * x - sin_theta * y;
+    const double rotated_y = sin_theta * x + cos_theta * y;
+    // World x maps to the y cell index and world y to the x cell index.
+    double value;
+    double dvalue_dcell_x;
+    double dvalue_dcell_y;
+    interpolation_grid_.Evaluate(
+        (max_y - rotated_y - pose[1]) * inverse_resolution - 0.5,
+        (max_x - rotated_x - pose[0]) * inverse_resolution - 0.5, &value,
+        &dvalue_dcell_x, &dvalue_dcell_y);
+    residuals[i] = scaling_factor_ * (1. - value);
+    if (jacobian != nullptr) {
+      double* const row = jacobian + 3 * i;
+      row[0] = scale * dvalue_dcell_y;
+      row[1] = scale * dvalue_dcell_x;
+      row[2] = scale * (dvalue_dcell_x * rotated_x - dvalue_dcell_y * rotated_y);
+    }
+  }
+  return true;
+}
+
+}  // namespace scan_matching
+}  // namespace mapping_2d
+}  // namespace cartographer
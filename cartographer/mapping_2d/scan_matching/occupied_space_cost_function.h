@@ -0,0 +1,54 @@
+/*
+ * Copyright 2016 The Cartographer Authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef CARTOGRAPHER_MAPPING_2D_SCAN_MATCHING_OCCUPIED_SPACE_COST_FUNCTION_H_
+#define CARTOGRAPHER_MAPPING_2D_SCAN_MATCHING_OCCUPIED_SPACE_COST_FUNCTION_H_
+
+#include "cartographer/mapping_2d/scan_matching/interpolation_grid.h"
+#include "cartographer/sensor/point_cloud.h"
+#include "ceres/ceres.h"
+
+namespace cartographer {
+namespace mapping_2d {
+namespace scan_matching {
+
+// Computes the same cost as the OccupiedSpaceCostFunctor, but with analytic
+// derivatives evaluated on an InterpolationGrid instead of automatic
+// differentiation. Parameters are the pose (x, y, theta) of 'point_cloud'.
+class OccupiedSpaceCostFunction : public ceres::CostFunction {
+ public:
+  OccupiedSpaceCostFunction(double scaling_factor,
+                            const sensor::PointCloud& point_cloud,
+                            const InterpolationGrid& interpolation_grid);
+
+  OccupiedSpaceCostFunction(const OccupiedSpaceCostFunction&) = delete;
+  OccupiedSpaceCostFunction& operator=(const OccupiedSpaceCostFunction&) =
+      delete;
+
+  bool Evaluate(double const* const* parameters, double* residuals,
+                double** jacobians) const override;
+
+ private:
+  const double scaling_factor_;
+  const sensor::PointCloud& point_cloud_;
+  const InterpolationGrid& interpolation_grid_;
+};
+
+}  // namespace scan_matching
+}  // namespace mapping_2d
+}  // namespace cartographer
+
+#endif  // CARTOGRAPHER_MAPPING_2D_SCAN_MATCHING_OCCUPIED_SPACE_COST_FUNCTION_H_
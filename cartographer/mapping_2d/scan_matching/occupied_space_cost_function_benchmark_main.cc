@@ -0,0 +1,158 @@
+/*
+ * Copyright 2016 The Cartographer Authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Compares the automatically differentiated OccupiedSpaceCostFunctor with the
+// analytic OccupiedSpaceCostFunction on a grid and scan of typical 2D submap
+// and range data sizes, including the cost of refreshing the InterpolationGrid.
+
+#include <chrono>
+#include <iostream>
+#include <random>
+#include <vector>
+
+#include "cartographer/mapping/probability_values.h"
+#include "cartographer/mapping_2d/probability_grid.h"
+#include "cartographer/mapping_2d/scan_matching/interpolation_grid.h"
+#include "cartographer/mapping_2d/scan_matching/occupied_space_cost_function.h"
+#include "cartographer/mapping_2d/scan_matching/occupied_space_cost_functor.h"
+#include "cartographer/sensor/point_cloud.h"
+#include "ceres/ceres.h"
+#include "gflags/gflags.h"
+#include "glog/logging.h"
+
+DEFINE_int32(num_known_cells, 600,
+             "Width and height of the known region of the grid in cells.");
+DEFINE_int32(num_points, 500, "Number of points in the scan.");
+DEFINE_int32(num_evaluations, 2000,
+             "Number of cost function evaluations to time.");
+DEFINE_int32(num_updated_cells, 5000,
+             "Number of cells updated before each incremental refresh.");
+
+namespace cartographer {
+namespace mapping_2d {
+namespace scan_matching {
+namespace {
+
+constexpr double kResolution = 0.05;
+
+double SecondsSince(const std::chrono::steady_clock::time_point start) {
+  const std::chrono::duration<double> elapsed =
+      std::chrono::steady_clock::now() - start;
+  return elapsed.count();
+}
+
+// Returns the seconds per evaluation of 'cost_function' with Jacobians.
+double TimeEvaluations(const ceres::CostFunction& cost_function,
+                       const int num_points) {
+  std::vector<double> residuals(num_points);
+  std::vector<double> jacobian(3 * num_points);
+  double* jacobians[] = {jacobian.data()};
+  double pose[3] = {0., 0., 0.};
+  const double* parameters[] = {pose};
+  const auto start = std::chrono::steady_clock::now();
+  for (int i = 0; i != FLAGS_num_evaluations; ++i) {
+    pose[2] = 1e-4 * i;
+    CHECK(cost_function.Evaluate(parameters, residuals.data(), jacobians));
+  }
+  return SecondsSince(start) / FLAGS_num_evaluations;
+}
+
+void Run() {
+  CHECK_GT(FLAGS_num_known_cells, 0);
+  CHECK_GT(FLAGS_num_evaluations, 0);
+  const int num_cells = 2 * FLAGS_num_known_cells;
+  const double half_size = 0.5 * num_cells * kResolution;
+  ProbabilityGrid probability_grid(
+      MapLimits(kResolution, Eigen::Vector2d(half_size, half_size),
+                CellLimits(num_cells, num_cells)));
+  std::mt19937 prng(42);
+  std::uniform_real_distribution<float> probability_distribution(
+      mapping::kMinProbability, mapping::kMaxProbability);
+  const int begin = FLAGS_num_known_cells / 2;
+  for (int y = begin; y != begin + FLAGS_num_known_cells; ++y) {
+    for (int x = begin; x != begin + FLAGS_num_known_cells; ++x) {
+      probability_grid.SetProbability(Eigen::Array2i(x, y),
+                                      probability_distribution(prng));
+    }
+  }
+
+  sensor::PointCloud point_cloud;
+  const float known_half_size = 0.5f * FLAGS_num_known_cells * kResolution;
+  std::uniform_real_distribution<float> point_distribution(-known_half_size,
+                                                           known_half_size);
+  for (int i = 0; i != FLAGS_num_points; ++i) {
+    point_cloud.emplace_back(point_distribution(prng),
+                             point_distribution(prng), 0.f);
+  }
+
+  auto start = std::chrono::steady_clock::now();
+  InterpolationGrid interpolation_grid(probability_grid);
+  const double full_copy_seconds = SecondsSince(start);
+
+  // Refresh after updating cells near the center, as inserting a scan would.
+  const std::vector<uint16> table =
+      mapping::ComputeLookupTableToApplyOdds(mapping::Odds(0.55f));
+  std::normal_distribution<float> cell_distribution(num_cells / 2.f,
+                                                    FLAGS_num_known_cells / 8.f);
+  const MapLimits& limits = probability_grid.limits();
+  for (int i = 0; i != FLAGS_num_updated_cells; ++i) {
+    const Eigen::Array2i cell_index(cell_distribution(prng),
+                                    cell_distribution(prng));
+    if (limits.Contains(cell_index)) {
+      probability_grid.ApplyLookupTable(cell_index, table);
+    }
+  }
+  probability_grid.FinishUpdate();
+  start = std::chrono::steady_clock::now();
+  interpolation_grid.Update(probability_grid);
+  const double update_seconds = SecondsSince(start);
+
+  const ceres::AutoDiffCostFunction<OccupiedSpaceCostFunctor, ceres::DYNAMIC, 3>
+      autodiff_cost_function(
+          new OccupiedSpaceCostFunctor(1., point_cloud, probability_grid),
+          point_cloud.size());
+  const OccupiedSpaceCostFunction analytic_cost_function(1., point_cloud,
+                                                         interpolation_grid);
+  const double autodiff_seconds =
+      TimeEvaluations(autodiff_cost_function, point_cloud.size());
+  const double analytic_seconds =
+      TimeEvaluations(analytic_cost_function, point_cloud.size());
+
+  std::cout << "InterpolationGrid: full copy " << 1e3 * full_copy_seconds
+            << " ms (" << interpolation_grid.num_bytes() / 1024
+            << " KiB), incremental update " << 1e3 * update_seconds
+            << " ms\n"
+            << "autodiff: " << 1e6 * autodiff_seconds << " us per evaluation, "
+            << 1e9 * autodiff_seconds / FLAGS_num_points << " ns per point\n"
+            << "analytic: " << 1e6 * analytic_seconds << " us per evaluation, "
+            << 1e9 * analytic_seconds / FLAGS_num_points << " ns per point\n";
+}
+
+}  // namespace
+}  // namespace scan_matching
+}  // namespace mapping_2d
+}  // namespace cartographer
+
+int main(int argc, char** argv) {
+  google::InitGoogleLogging(argv[0]);
+  FLAGS_logtostderr = true;
+  google::SetUsageMessage(
+      "\n\n"
+      "Benchmarks the 2D occupied space cost with automatic and analytic "
+      "derivatives.\n");
+  google::ParseCommandLineFlags(&argc, &argv, true);
+  ::cartographer::mapping_2d::scan_matching::Run();
+}
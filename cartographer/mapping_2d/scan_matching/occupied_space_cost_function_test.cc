@@ -0,0 +1,158 @@
+/*
+ * Copyright 2016 The Cartographer Authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "cartographer/mapping_2d/scan_matching/occupied_space_cost_function.h"
+
+#include <random>
+#include <vector>
+
+#include "cartographer/mapping/probability_values.h"
+#include "cartographer/mapping_2d/probability_grid.h"
+#include "cartographer/mapping_2d/scan_matching/interpolation_grid.h"
+#include "cartographer/mapping_2d/scan_matching/occupied_space_cost_functor.h"
+#include "cartographer/sensor/point_cloud.h"
+#include "gtest/gtest.h"
+
+namespace cartographer {
+namespace mapping_2d {
+namespace scan_matching {
+namespace {
+
+constexpr double kScalingFactor = 2.5;
+
+// Sets random probabilities for the cells in a square in the center of
+// 'probability_grid'.
+void FillRandomly(const int size, std::mt19937* const prng,
+                  ProbabilityGrid* const probability_grid) {
+  std::uniform_real_distribution<float> distribution(mapping::kMinProbability,
+                                                     mapping::kMaxProbability);
+  const CellLimits& cell_limits = probability_grid->limits().cell_limits();
+  const Eigen::Array2i begin(cell_limits.num_x_cells / 2 - size / 2,
+                             cell_limits.num_y_cells / 2 - size / 2);
+  for (int y = 0; y != size; ++y) {
+    for (int x = 0; x != size; ++x) {
+      probability_grid->SetProbability(begin + Eigen::Array2i(x, y),
+                                       distribution(*prng));
+    }
+  }
+}
+
+// Evaluates 'cost_function' at 'pose' and returns residuals and the
+// row-major Jacobian.
+void Evaluate(const ceres::CostFunction& cost_function, const double* pose,
+              std::vector<double>* const residuals,
+              std::vector<double>* const jacobian) {
+  residuals->resize(cost_function.num_residuals());
+  jacobian->resize(3 * cost_function.num_residuals());
+  double* jacobians[] = {jacobian->data()};
+  ASSERT_TRUE(cost_function.Evaluate(&pose, residuals->data(), jacobians));
+}
+
+// Expects the analytic cost to match the automatically differentiated
+// OccupiedSpaceCostFunctor on 'probability_grid' at 'pose'.
+void ExpectEquivalent(const ProbabilityGrid& probability_grid,
+                      const InterpolationGrid& interpolation_grid,
+                      const sensor::PointCloud& point_cloud,
+                      const double* pose) {
+  const ceres::AutoDiffCostFunction<OccupiedSpaceCostFunctor, ceres::DYNAMIC, 3>
+      autodiff_cost_function(
+          new OccupiedSpaceCostFunctor(kScalingFactor, point_cloud,
+                                       probability_grid),
+          point_cloud.size());
+  const OccupiedSpaceCostFunction analytic_cost_function(
+      kScalingFactor, point_cloud, interpolation_grid);
+  std::vector<double> expected_residuals;
+  std::vector<double> expected_jacobian;
+  Evaluate(autodiff_cost_function, pose, &expected_residuals,
+           &expected_jacobian);
+  std::vector<double> residuals;
+  std::vector<double> jacobian;
+  Evaluate(analytic_cost_function, pose, &residuals, &jacobian);
+  for (size_t i = 0; i != residuals.size(); ++i) {
+    EXPECT_NEAR(expected_residuals[i], residuals[i], 1e-9) << i;
+  }
+  for (size_t i = 0; i != jacobian.size(); ++i) {
+    EXPECT_NEAR(expected_jacobian[i], jacobian[i], 1e-6) << i;
+  }
+}
+
+class OccupiedSpaceCostFunctionTest : public ::testing::Test {
+ protected:
+  OccupiedSpaceCostFunctionTest()
+      : prng_(42),
+        probability_grid_(
+            MapLimits(0.05, Eigen::Vector2d(2., 2.), CellLimits(80, 80))) {
+    FillRandomly(40, &prng_, &probability_grid_);
+    // Points inside the known region, near its border and outside the limits.
+    std::uniform_real_distribution<float> distribution(-2.5f, 2.5f);
+    for (int i = 0; i != 500; ++i) {
+      point_cloud_.emplace_back(distribution(prng_), distribution(prng_), 0.f);
+    }
+  }
+
+  void ExpectEquivalentAtRandomPoses(
+      const InterpolationGrid& interpolation_grid) {
+    std::uniform_real_distribution<double> translation_distribution(-0.3, 0.3);
+    std::uniform_real_distribution<double> angle_distribution(-M_PI, M_PI);
+    for (int i = 0; i != 10; ++i) {
+      const double pose[3] = {translation_distribution(prng_),
+                              translation_distribution(prng_),
+                              angle_distribution(prng_)};
+      ExpectEquivalent(probability_grid_, interpolation_grid, point_cloud_,
+                       pose);
+    }
+  }
+
+  std::mt19937 prng_;
+  ProbabilityGrid probability_grid_;
+  sensor::PointCloud point_cloud_;
+};
+
+TEST_F(OccupiedSpaceCostFunctionTest, MatchesAutoDiff) {
+  const InterpolationGrid interpolation_grid(probability_grid_);
+  ExpectEquivalentAtRandomPoses(interpolation_grid);
+}
+
+TEST_F(OccupiedSpaceCostFunctionTest, MatchesAutoDiffAfterUpdates) {
+  InterpolationGrid interpolation_grid(probability_grid_);
+  const std::vector<uint16> table =
+      mapping::ComputeLookupTableToApplyOdds(mapping::Odds(0.7f));
+  for (int y = 30; y != 45; ++y) {
+    probability_grid_.ApplyLookupTable(Eigen::Array2i(10 + y, y), table);
+  }
+  probability_grid_.FinishUpdate();
+  interpolation_grid.Update(probability_grid_);
+  ExpectEquivalentAtRandomPoses(interpolation_grid);
+
+  // Growing the limits changes the cell indices.
+  probability_grid_.GrowLimits(Eigen::Vector2f(-3.f, -3.f));
+  interpolation_grid.Update(probability_grid_);
+  ExpectEquivalentAtRandomPoses(interpolation_grid);
+}
+
+TEST_F(OccupiedSpaceCostFunctionTest, UpdateSwitchesGrids) {
+  InterpolationGrid interpolation_grid(probability_grid_);
+  ProbabilityGrid other_probability_grid(probability_grid_.limits());
+  FillRandomly(60, &prng_, &other_probability_grid);
+  interpolation_grid.Update(other_probability_grid);
+  probability_grid_ = std::move(other_probability_grid);
+  ExpectEquivalentAtRandomPoses(interpolation_grid);
+}
+
+}  // namespace
+}  // namespace scan_matching
+}  // namespace mapping_2d
+}  // namespace cartographer
@@ -0,0 +1,75 @@
+/*
+ * Copyright 2017 The Cartographer Authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "cartographer/mapping_2d/scan_matching/precomputation_grid_stack_cache.h"
+
+#include <utility>
+
+namespace cartographer {
+namespace mapping_2d {
+namespace scan_matching {
+
+PrecomputationGridStackCache::PrecomputationGridStackCache(
+    const int64 max_size_in_bytes, common::ThreadPool* const thread_pool)
+    : thread_pool_(thread_pool), cache_(max_size_in_bytes) {}
+
+std::shared_ptr<const PrecomputationGridStack>
+PrecomputationGridStackCache::GetOrCompute(
+    const mapping::SubmapId& submap_id,
+    const ProbabilityGrid& probability_grid,
+    const proto::FastCorrelativeScanMatcherOptions& options) {
+  return cache_.GetOrCompute(
+      submap_id,
+      [this, &probability_grid, &options]() {
+        return std::make_shared<const PrecomputationGridStack>(
+            probability_grid, options, thread_pool_);
+      },
+      [&probability_grid,
+       &options](const PrecomputationGridStack& precomputation_grid_stack) {
+        return precomputation_grid_stack.max_depth() + 1 ==
+                   options.branch_and_bound_depth() &&
+               precomputation_grid_stack.IsComputedFor(
+                   probability_grid.limits());
+      });
+}
+
+std::shared_ptr<const PrecomputationGridStack>
+PrecomputationGridStackCache::Get(const mapping::SubmapId& submap_id) {
+  return cache_.Get(submap_id);
+}
+
+void PrecomputationGridStackCache::Insert(
+    const mapping::SubmapId& submap_id,
+    std::shared_ptr<const PrecomputationGridStack> precomputation_grid_stack) {
+  cache_.Insert(submap_id, std::move(precomputation_grid_stack));
+}
+
+void PrecomputationGridStackCache::Erase(const mapping::SubmapId& submap_id) {
+  cache_.Erase(submap_id);
+}
+
+int64 PrecomputationGridStackCache::GetSizeInBytes() {
+  return cache_.GetSizeInBytes();
+}
+
+common::LruCache<mapping::SubmapId, PrecomputationGridStack>::Statistics
+PrecomputationGridStackCache::GetStatistics() {
+  return cache_.GetStatistics();
+}
+
+}  // namespace scan_matching
+}  // namespace mapping_2d
+}  // namespace cartographer
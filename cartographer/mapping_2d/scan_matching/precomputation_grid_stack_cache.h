@@ -0,0 +1,90 @@
+/*
+ * Copyright 2017 The Cartographer Authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef CARTOGRAPHER_MAPPING_2D_SCAN_MATCHING_PRECOMPUTATION_GRID_STACK_CACHE_H_
+#define CARTOGRAPHER_MAPPING_2D_SCAN_MATCHING_PRECOMPUTATION_GRID_STACK_CACHE_H_
+
+#include <memory>
+
+#include "cartographer/common/lru_cache.h"
+#include "cartographer/common/port.h"
+#include "cartographer/common/thread_pool.h"
+#include "cartographer/mapping/id.h"
+#include "cartographer/mapping_2d/probability_grid.h"
+#include "cartographer/mapping_2d/scan_matching/fast_correlative_scan_matcher.h"
+#include "cartographer/mapping_2d/scan_matching/proto/fast_correlative_scan_matcher_options.pb.h"
+
+namespace cartographer {
+namespace mapping_2d {
+namespace scan_matching {
+
+// Caches the 'PrecomputationGridStack's of finished submaps by 'SubmapId', so
+// that all scan matchers for a submap share them. Once the memory used by the
+// cached stacks exceeds the budget, the least recently used ones are evicted.
+// Stacks still referenced by a scan matcher stay valid after eviction.
+//
+// This class is thread-safe.
+class PrecomputationGridStackCache {
+ public:
+  // 'thread_pool' is used to compute the grids of a stack in parallel and may
+  // be nullptr.
+  PrecomputationGridStackCache(int64 max_size_in_bytes,
+                               common::ThreadPool* thread_pool);
+
+  PrecomputationGridStackCache(const PrecomputationGridStackCache&) = delete;
+  PrecomputationGridStackCache& operator=(const PrecomputationGridStackCache&) =
+      delete;
+
+  // Returns the stack for 'submap_id', computing it from 'probability_grid'
+  // unless a stack of the depth given by 'options' which was computed for the
+  // limits of 'probability_grid' is cached. Concurrent calls for the same
+  // 'submap_id' compute it only once.
+  std::shared_ptr<const PrecomputationGridStack> GetOrCompute(
+      const mapping::SubmapId& submap_id,
+      const ProbabilityGrid& probability_grid,
+      const proto::FastCorrelativeScanMatcherOptions& options);
+
+  // Returns the cached stack for 'submap_id' or nullptr.
+  std::shared_ptr<const PrecomputationGridStack> Get(
+      const mapping::SubmapId& submap_id);
+
+  // Adds 'precomputation_grid_stack' for 'submap_id', e.g. after loading it,
+  // replacing any cached one.
+  void Insert(
+      const mapping::SubmapId& submap_id,
+      std::shared_ptr<const PrecomputationGridStack> precomputation_grid_stack);
+
+  // Removes the stack for 'submap_id' if it is cached.
+  void Erase(const mapping::SubmapId& submap_id);
+
+  // Returns the memory used by all cached stacks.
+  int64 GetSizeInBytes();
+
+  // Returns how often stacks were found in the cache, how long computing them
+  // took and how much memory they use.
+  common::LruCache<mapping::SubmapId, PrecomputationGridStack>::Statistics
+  GetStatistics();
+
+ private:
+  common::ThreadPool* const thread_pool_;
+  common::LruCache<mapping::SubmapId, PrecomputationGridStack> cache_;
+};
+
+}  // namespace scan_matching
+}  // namespace mapping_2d
+}  // namespace cartographer
+
+#endif  // CARTOGRAPHER_MAPPING_2D_SCAN_MATCHING_PRECOMPUTATION_GRID_STACK_CACHE_H_
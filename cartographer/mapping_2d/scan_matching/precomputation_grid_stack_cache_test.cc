@@ -0,0 +1,144 @@
+/*
+ * Copyright 2017 The Cartographer Authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "cartographer/mapping_2d/scan_matching/precomputation_grid_stack_cache.h"
+
+#include <memory>
+#include <vector>
+
+#include "cartographer/common/lua_parameter_dictionary_test_helpers.h"
+#include "gtest/gtest.h"
+
+namespace cartographer {
+namespace mapping_2d {
+namespace scan_matching {
+namespace {
+
+class PrecomputationGridStackCacheTest : public ::testing::Test {
+ protected:
+  PrecomputationGridStackCacheTest()
+      : probability_grid_(
+            MapLimits(0.05, Eigen::Vector2d(5., 5.), CellLimits(100, 100))),
+        thread_pool_(4) {
+    auto parameter_dictionary = common::MakeDictionary(
+        "return { "
+        "linear_search_window = 3., "
+        "angular_search_window = 1., "
+        "branch_and_bound_depth = 4, "
+        "parallel_branch_and_bound = false, "
+        "}");
+    options_ =
+        CreateFastCorrelativeScanMatcherOptions(parameter_dictionary.get());
+    probability_grid_.SetProbability(Eigen::Array2i(50, 50), 0.7f);
+    stack_size_in_bytes_ =
+        PrecomputationGridStack(probability_grid_, options_, nullptr)
+            .size_in_bytes();
+  }
+
+  ProbabilityGrid probability_grid_;
+  common::ThreadPool thread_pool_;
+  proto::FastCorrelativeScanMatcherOptions options_;
+  int64 stack_size_in_bytes_;
+};
+
+TEST_F(PrecomputationGridStackCacheTest, ReturnsCachedStacks) {
+  PrecomputationGridStackCache cache(10 * stack_size_in_bytes_, &thread_pool_);
+  const mapping::SubmapId submap_id{0, 0};
+  EXPECT_EQ(nullptr, cache.Get(submap_id));
+  const auto stack =
+      cache.GetOrCompute(submap_id, probability_grid_, options_);
+  EXPECT_EQ(3, stack->max_depth());
+  EXPECT_EQ(stack, cache.Get(submap_id));
+  EXPECT_EQ(stack, cache.GetOrCompute(submap_id, probability_grid_, options_));
+  EXPECT_EQ(stack_size_in_bytes_, cache.GetSizeInBytes());
+
+  // A different depth requires recomputation.
+  proto::FastCorrelativeScanMatcherOptions deeper_options = options_;
+  deeper_options.set_branch_and_bound_depth(5);
+  const auto deeper_stack =
+      cache.GetOrCompute(submap_id, probability_grid_, deeper_options);
+  EXPECT_EQ(4, deeper_stack->max_depth());
+  EXPECT_EQ(deeper_stack, cache.Get(submap_id));
+
+  cache.Erase(submap_id);
+  EXPECT_EQ(nullptr, cache.Get(submap_id));
+  EXPECT_EQ(0, cache.GetSizeInBytes());
+}
+
+TEST_F(PrecomputationGridStackCacheTest, RecomputesStacksForOtherLimits) {
+  PrecomputationGridStackCache cache(10 * stack_size_in_bytes_, &thread_pool_);
+  const mapping::SubmapId submap_id{0, 0};
+  ProbabilityGrid other_probability_grid(
+      MapLimits(0.05, Eigen::Vector2d(6., 5.), CellLimits(100, 120)));
+  other_probability_grid.SetProbability(Eigen::Array2i(50, 50), 0.7f);
+  const auto other_stack = std::make_shared<const PrecomputationGridStack>(
+      other_probability_grid, options_, nullptr /* thread_pool */);
+  cache.Insert(submap_id, other_stack);
+  EXPECT_EQ(other_stack, cache.Get(submap_id));
+
+  const auto stack =
+      cache.GetOrCompute(submap_id, probability_grid_, options_);
+  EXPECT_NE(other_stack, stack);
+  EXPECT_TRUE(stack->IsComputedFor(probability_grid_.limits()));
+  EXPECT_EQ(stack, cache.Get(submap_id));
+  EXPECT_EQ(stack_size_in_bytes_, cache.GetSizeInBytes());
+}
+
+TEST_F(PrecomputationGridStackCacheTest, EvictsLeastRecentlyUsed) {
+  PrecomputationGridStackCache cache(2 * stack_size_in_bytes_, &thread_pool_);
+  const mapping::SubmapId first{0, 0};
+  const mapping::SubmapId second{0, 1};
+  const mapping::SubmapId third{1, 0};
+  const auto first_stack =
+      cache.GetOrCompute(first, probability_grid_, options_);
+  cache.GetOrCompute(second, probability_grid_, options_);
+  // Using 'first' makes 'second' the least recently used.
+  EXPECT_EQ(first_stack, cache.Get(first));
+  cache.GetOrCompute(third, probability_grid_, options_);
+  EXPECT_EQ(first_stack, cache.Get(first));
+  EXPECT_EQ(nullptr, cache.Get(second));
+  EXPECT_NE(nullptr, cache.Get(third));
+  EXPECT_EQ(2 * stack_size_in_bytes_, cache.GetSizeInBytes());
+}
+
+TEST_F(PrecomputationGridStackCacheTest, KeepsMostRecentStackAboveBudget) {
+  PrecomputationGridStackCache cache(1, nullptr /* thread_pool */);
+  const mapping::SubmapId submap_id{0, 0};
+  cache.GetOrCompute(mapping::SubmapId{0, 1}, probability_grid_, options_);
+  const auto stack =
+      cache.GetOrCompute(submap_id, probability_grid_, options_);
+  EXPECT_EQ(stack, cache.Get(submap_id));
+  EXPECT_EQ(stack_size_in_bytes_, cache.GetSizeInBytes());
+}
+
+TEST_F(PrecomputationGridStackCacheTest, ComputesOnceForConcurrentCalls) {
+  PrecomputationGridStackCache cache(10 * stack_size_in_bytes_, &thread_pool_);
+  const mapping::SubmapId submap_id{0, 0};
+  constexpr int kNumCalls = 16;
+  std::vector<std::shared_ptr<const PrecomputationGridStack>> stacks(
+      kNumCalls);
+  common::ParallelFor(&thread_pool_, kNumCalls, [&](const int index) {
+    stacks[index] = cache.GetOrCompute(submap_id, probability_grid_, options_);
+  });
+  for (const auto& stack : stacks) {
+    EXPECT_EQ(stacks.front(), stack);
+  }
+}
+
+}  // namespace
+}  // namespace scan_matching
+}  // namespace mapping_2d
+}  // namespace cartographer
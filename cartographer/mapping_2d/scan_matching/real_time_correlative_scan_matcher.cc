@@ -20,6 +20,7 @@
 #include <cmath>
 #include <functional>
 #include <limits>
+#include <tuple>
 
 #include "Eigen/Geometry"
 #include "cartographer/common/lua_parameter_dictionary.h"
@@ -33,6 +34,78 @@ namespace cartographer {
 namespace mapping_2d {
 namespace scan_matching {
 
+namespace {
+
+// Precomputed maxima of the probabilities in a region of a probability grid.
+// At 'depth' d, each cell holds the maximum over the 2^d x 2^d cells starting
+// at it. This is the idea of the 'PrecomputationGrid' of the fast correlative
+// scan matcher, but computed in floats, so that the bounds are exact, and only
+// for the region the scan can touch, since the grid is still changing.
+class MaximumPyramid {
+ public:
+  // Covers 'limits' cells starting at 'offset' with 'num_depths' levels.
+  MaximumPyramid(const ProbabilityGrid& probability_grid,
+                 const Eigen::Array2i& offset, const CellLimits& limits,
+                 const int num_depths)
+      : offset_(offset), limits_(limits), levels_(num_depths) {
+    const int num_x_cells = limits_.num_x_cells;
+    const int num_y_cells = limits_.num_y_cells;
+    levels_[0].reserve(num_x_cells * num_y_cells);
+    for (int y = 0; y != num_y_cells; ++y) {
+      for (int x = 0; x != num_x_cells; ++x) {
+        levels_[0].push_back(
+            probability_grid.GetProbability(offset_ + Eigen::Array2i(x, y)));
+      }
+    }
+    // Each level combines 4 cells of the previous one. Cells at the border
+    // reuse the last cell instead, which keeps the maximum an upper bound.
+    for (int depth = 1; depth != num_depths; ++depth) {
+      const int half_width = 1 << (depth - 1);
+      const std::vector<float>& previous = levels_[depth - 1];
+      std::vector<float>& current = levels_[depth];
+      current.resize(previous.size());
+      for (int y = 0; y != num_y_cells; ++y) {
+        const int row = y * num_x_cells;
+        const int next_row =
+            std::min(y + half_width, num_y_cells - 1) * num_x_cells;
+        for (int x = 0; x != num_x_cells; ++x) {
+          const int next_x = std::min(x + half_width, num_x_cells - 1);
+          current[row + x] = std::max(
+              std::max(previous[row + x], previous[row + next_x]),
+              std::max(previous[next_row + x], previous[next_row + next_x]));
+        }
+      }
+    }
+  }
+
+  float Get(const int depth, const Eigen::Array2i& xy_index) const {
+    const Eigen::Array2i local_xy_index = xy_index - offset_;
+    DCHECK_GE(local_xy_index.x(), 0);
+    DCHECK_GE(local_xy_index.y(), 0);
+    DCHECK_LT(local_xy_index.x(), limits_.num_x_cells);
+    DCHECK_LT(local_xy_index.y(), limits_.num_y_cells);
+    const int stride = limits_.num_x_cells;
+    return levels_[depth][local_xy_index.x() + local_xy_index.y() * stride];
+  }
+
+ private:
+  const Eigen::Array2i offset_;
+  const CellLimits limits_;
+  std::vector<std::vector<float>> levels_;
+};
+
+// Returns true if 'candidate' comes before 'other' in the order in which
+// candidates are scored by the exhaustive search.
+bool IsBeforeInExhaustiveSearch(const Candidate& candidate,
+                                const Candidate& other) {
+  return std::forward_as_tuple(candidate.scan_index, candidate.x_index_offset,
+                               candidate.y_index_offset) <
+         std::forward_as_tuple(other.scan_index, other.x_index_offset,
+                               other.y_index_offset);
+}
+
+}  // namespace
+
 proto::RealTimeCorrelativeScanMatcherOptions
 CreateRealTimeCorrelativeScanMatcherOptions(
     common::LuaParameterDictionary* const parameter_dictionary) {
@@ -45,8 +118,11 @@ CreateRealTimeCorrelativeScanMatcherOptions(
       parameter_dictionary->GetDouble("translation_delta_cost_weight"));
   options.set_rotation_delta_cost_weight(
       parameter_dictionary->GetDouble("rotation_delta_cost_weight"));
+  options.set_branch_and_bound_depth(
+      parameter_dictionary->GetInt("branch_and_bound_depth"));
   CHECK_GE(options.translation_delta_cost_weight(), 0.);
   CHECK_GE(options.rotation_delta_cost_weight(), 0.);
+  CHECK_GE(options.branch_and_bound_depth(), 1);
   return options;
 }
 
@@ -110,13 +186,17 @@ double RealTimeCorrelativeScanMatcher::Match(
       probability_grid.limits(), rotated_scans,
       Eigen::Translation2f(initial_pose_estimate.translation().x(),
                            initial_pose_estimate.translation().y()));
-  std::vector<Candidate> candidates =
-      GenerateExhaustiveSearchCandidates(search_parameters);
-  ScoreCandidates(probability_grid, discrete_scans, search_parameters,
-                  &candidates);
-
-  const Candidate& best_candidate =
-      *std::max_element(candidates.begin(), candidates.end());
+  Candidate best_candidate(0, 0, 0, search_parameters);
+  if (options_.branch_and_bound_depth() > 1) {
+    best_candidate = BranchAndBoundSearch(probability_grid, discrete_scans,
+                                          search_parameters);
+  } else {
+    std::vector<Candidate> candidates =
+        GenerateExhaustiveSearchCandidates(search_parameters);
+    ScoreCandidates(probability_grid, discrete_scans, search_parameters,
+                    &candidates);
+    best_candidate = *std::max_element(candidates.begin(), candidates.end());
+  }
   *pose_estimate = transform::Rigid2d(
       {initial_pose_estimate.translation().x() + best_candidate.x,
        initial_pose_estimate.translation().y() + best_candidate.y},
@@ -140,17 +220,149 @@ void RealTimeCorrelativeScanMatcher::ScoreCandidates(
           probability_grid.GetProbability(proposed_xy_index);
       candidate.score += probability;
     }
-    candidate.score /=
-        static_cast<float>(discrete_scans[candidate.scan_index].size());
-    candidate.score *=
-        std::exp(-common::Pow2(std::hypot(candidate.x, candidate.y) *
-                                   options_.translation_delta_cost_weight() +
-                               std::abs(candidate.orientation) *
-                                   options_.rotation_delta_cost_weight()));
+    ApplyNormalizationAndPenalty(discrete_scans[candidate.scan_index].size(),
+                                 &candidate);
     CHECK_GT(candidate.score, 0.f);
   }
 }
 
+void RealTimeCorrelativeScanMatcher::ApplyNormalizationAndPenalty(
+    const int num_points, Candidate* const candidate) const {
+  candidate->score /= static_cast<float>(num_points);
+  candidate->score *=
+      std::exp(-common::Pow2(std::hypot(candidate->x, candidate->y) *
+                                 options_.translation_delta_cost_weight() +
+                             std::abs(candidate->orientation) *
+                                 options_.rotation_delta_cost_weight()));
+}
+
+Candidate RealTimeCorrelativeScanMatcher::BranchAndBoundSearch(
+    const ProbabilityGrid& probability_grid,
+    const std::vector<DiscreteScan>& discrete_scans,
+    const SearchParameters& search_parameters) const {
+  const int max_depth = options_.branch_and_bound_depth() - 1;
+  const int max_width = 1 << max_depth;
+
+  // Precompute the maxima for all cells the candidates can touch, including
+  // those covered by the last, partial candidates at lower resolutions.
+  Eigen::Array2i min_xy_index(std::numeric_limits<int>::max(),
+                              std::numeric_limits<int>::max());
+  Eigen::Array2i max_xy_index(std::numeric_limits<int>::min(),
+                              std::numeric_limits<int>::min());
+  for (int scan_index = 0; scan_index != search_parameters.num_scans;
+       ++scan_index) {
+    const SearchParameters::LinearBounds& linear_bounds =
+        search_parameters.linear_bounds[scan_index];
+    for (const Eigen::Array2i& xy_index : discrete_scans[scan_index]) {
+      min_xy_index = min_xy_index.min(
+          xy_index + Eigen::Array2i(linear_bounds.min_x, linear_bounds.min_y));
+      max_xy_index = max_xy_index.max(
+          xy_index + Eigen::Array2i(linear_bounds.max_x + max_width - 1,
+                                    linear_bounds.max_y + max_width - 1));
+    }
+  }
+  CHECK_LE(min_xy_index.x(), max_xy_index.x()) << "Empty point cloud.";
+  const MaximumPyramid maximum_pyramid(
+      probability_grid, min_xy_index,
+      CellLimits(max_xy_index.x() - min_xy_index.x() + 1,
+                 max_xy_index.y() - min_xy_index.y() + 1),
+      max_depth + 1);
+
+  // Scores the candidate at the given depth with an upper bound for all
+  // candidates in its 2^depth x 2^depth block, which at depth 0 is its score.
+  const auto score_candidate = [this, &maximum_pyramid, &discrete_scans,
+                                &search_parameters](const int depth,
+                                                    Candidate* candidate) {
+    const int width = 1 << depth;
+    const SearchParameters::LinearBounds& linear_bounds =
+        search_parameters.linear_bounds[candidate->scan_index];
+    float sum = 0.f;
+    for (const Eigen::Array2i& xy_index :
+         discrete_scans[candidate->scan_index]) {
+      sum += maximum_pyramid.Get(
+          depth, xy_index + Eigen::Array2i(candidate->x_index_offset,
+                                           candidate->y_index_offset));
+    }
+    // The penalty is smallest for the candidate closest to the initial pose.
+    Candidate closest_candidate(
+        candidate->scan_index,
+        common::Clamp(0, candidate->x_index_offset,
+                      std::min(candidate->x_index_offset + width - 1,
+                               linear_bounds.max_x)),
+        common::Clamp(0, candidate->y_index_offset,
+                      std::min(candidate->y_index_offset + width - 1,
+                               linear_bounds.max_y)),
+        search_parameters);
+    closest_candidate.score = sum;
+    ApplyNormalizationAndPenalty(
+        discrete_scans[candidate->scan_index].size(), &closest_candidate);
+    candidate->score = closest_candidate.score;
+  };
+
+  std::vector<Candidate> candidates;
+  for (int scan_index = 0; scan_index != search_parameters.num_scans;
+       ++scan_index) {
+    const SearchParameters::LinearBounds& linear_bounds =
+        search_parameters.linear_bounds[scan_index];
+    for (int x_index_offset = linear_bounds.min_x;
+         x_index_offset <= linear_bounds.max_x; x_index_offset += max_width) {
+      for (int y_index_offset = linear_bounds.min_y;
+           y_index_offset <= linear_bounds.max_y;
+           y_index_offset += max_width) {
+        candidates.emplace_back(scan_index, x_index_offset, y_index_offset,
+                                search_parameters);
+        score_candidate(max_depth, &candidates.back());
+      }
+    }
+  }
+
+  // Only candidates with a bound below the best score are pruned, so that
+  // ties are resolved as in the exhaustive search.
+  Candidate best_candidate(0, 0, 0, search_parameters);
+  best_candidate.score = -std::numeric_limits<float>::infinity();
+  std::function<void(std::vector<Candidate>*, int)> branch_and_bound =
+      [&](std::vector<Candidate>* const candidates, const int depth) {
+        std::sort(candidates->begin(), candidates->end(),
+                  std::greater<Candidate>());
+        for (const Candidate& candidate : *candidates) {
+          if (candidate.score < best_candidate.score) {
+            break;
+          }
+          if (depth == 0) {
+            if (candidate.score > best_candidate.score ||
+                IsBeforeInExhaustiveSearch(candidate, best_candidate)) {
+              best_candidate = candidate;
+            }
+            continue;
+          }
+          const int half_width = 1 << (depth - 1);
+          const SearchParameters::LinearBounds& linear_bounds =
+              search_parameters.linear_bounds[candidate.scan_index];
+          std::vector<Candidate> higher_resolution_candidates;
+          for (const int x_index_offset :
+               {candidate.x_index_offset,
+                candidate.x_index_offset + half_width}) {
+            for (const int y_index_offset :
+                 {candidate.y_index_offset,
+                  candidate.y_index_offset + half_width}) {
+              if (x_index_offset > linear_bounds.max_x ||
+                  y_index_offset > linear_bounds.max_y) {
+                continue;
+              }
+              higher_resolution_candidates.emplace_back(
+                  candidate.scan_index, x_index_offset, y_index_offset,
+                  search_parameters);
+              score_candidate(depth - 1, &higher_resolution_candidates.back());
+            }
+          }
+          branch_and_bound(&higher_resolution_candidates, depth - 1);
+        }
+      };
+  branch_and_bound(&candidates, max_depth);
+  CHECK_GT(best_candidate.score, 0.f);
+  return best_candidate;
+}
+
 }  // namespace scan_matching
 }  // namespace mapping_2d
 }  // namespace cartographer
@@ -54,6 +54,9 @@ CreateRealTimeCorrelativeScanMatcherOptions(
     common::LuaParameterDictionary* const parameter_dictionary);
 
 // An implementation of "Real-Time Correlative Scan Matching" by Olson.
+//
+// With 'options.branch_and_bound_depth()' greater than 1, this is not
+// exhaustive anymore, but uses the multi-resolution search of the paper.
 class RealTimeCorrelativeScanMatcher {
  public:
   explicit RealTimeCorrelativeScanMatcher(
@@ -86,6 +89,17 @@ class RealTimeCorrelativeScanMatcher {
   std::vector<Candidate> GenerateExhaustiveSearchCandidates(
       const SearchParameters& search_parameters) const;
 
+  // Turns the sum of the probabilities of 'num_points' points in
+  // 'candidate->score' into its score.
+  void ApplyNormalizationAndPenalty(int num_points, Candidate* candidate) const;
+
+  // Returns the candidate the exhaustive search would return, but searches
+  // by branch-and-bound over maxima of 'probability_grid'.
+  Candidate BranchAndBoundSearch(
+      const ProbabilityGrid& probability_grid,
+      const std::vector<DiscreteScan>& discrete_scans,
+      const SearchParameters& search_parameters) const;
+
   const proto::RealTimeCorrelativeScanMatcherOptions options_;
 };
 
@@ -18,6 +18,8 @@
 
 #include <cmath>
 #include <memory>
+#include <random>
+#include <string>
 
 #include "Eigen/Geometry"
 #include "cartographer/common/lua_parameter_dictionary_test_helpers.h"
@@ -44,6 +46,7 @@ class RealTimeCorrelativeScanMatcherTest : public ::testing::Test {
           "insert_free_space = true, "
           "hit_probability = 0.7, "
           "miss_probability = 0.4, "
+          "num_threads = 1, "
           "}");
       range_data_inserter_ = common::make_unique<RangeDataInserter>(
           CreateRangeDataInserterOptions(parameter_dictionary.get()));
@@ -66,6 +69,7 @@ class RealTimeCorrelativeScanMatcherTest : public ::testing::Test {
           "angular_search_window = 0.16, "
           "translation_delta_cost_weight = 0., "
           "rotation_delta_cost_weight = 0., "
+          "branch_and_bound_depth = 1, "
           "}");
       real_time_correlative_scan_matcher_ =
           common::make_unique<RealTimeCorrelativeScanMatcher>(
@@ -118,6 +122,58 @@ TEST_F(RealTimeCorrelativeScanMatcherTest,
   EXPECT_GT(0.7, candidates[0].score);
 }
 
+TEST(RealTimeCorrelativeScanMatcherBranchAndBoundTest,
+     FindsSameResultAsExhaustiveSearch) {
+  std::mt19937 prng(42);
+  std::uniform_real_distribution<float> probability_distribution(
+      mapping::kMinProbability, mapping::kMaxProbability);
+  std::uniform_real_distribution<float> point_distribution(-2.f, 2.f);
+  ProbabilityGrid probability_grid(
+      MapLimits(0.05, Eigen::Vector2d(3., 3.), CellLimits(120, 120)));
+  for (const Eigen::Array2i& xy_index :
+       XYIndexRangeIterator(Eigen::Array2i(10, 10), Eigen::Array2i(109, 99))) {
+    probability_grid.SetProbability(xy_index, probability_distribution(prng));
+  }
+  sensor::PointCloud point_cloud;
+  for (int i = 0; i != 50; ++i) {
+    point_cloud.emplace_back(point_distribution(prng),
+                             point_distribution(prng), 0.f);
+  }
+  for (const int branch_and_bound_depth : {2, 3, 5}) {
+    for (const double translation_delta_cost_weight : {0., 1.}) {
+      auto parameter_dictionary = common::MakeDictionary(
+          "return {"
+          "linear_search_window = 0.5, "
+          "angular_search_window = 0.2, "
+          "translation_delta_cost_weight = " +
+          std::to_string(translation_delta_cost_weight) +
+          ", "
+          "rotation_delta_cost_weight = 0.5, "
+          "branch_and_bound_depth = 1, "
+          "}");
+      auto options = CreateRealTimeCorrelativeScanMatcherOptions(
+          parameter_dictionary.get());
+      const RealTimeCorrelativeScanMatcher exhaustive_scan_matcher(options);
+      options.set_branch_and_bound_depth(branch_and_bound_depth);
+      const RealTimeCorrelativeScanMatcher scan_matcher(options);
+
+      const transform::Rigid2d initial_pose_estimate({0.1, -0.2}, 0.3);
+      transform::Rigid2d expected_pose_estimate;
+      const double expected_score = exhaustive_scan_matcher.Match(
+          initial_pose_estimate, point_cloud, probability_grid,
+          &expected_pose_estimate);
+      transform::Rigid2d pose_estimate;
+      const double score = scan_matcher.Match(
+          initial_pose_estimate, point_cloud, probability_grid, &pose_estimate);
+      EXPECT_EQ(expected_score, score);
+      EXPECT_EQ(expected_pose_estimate.translation(),
+                pose_estimate.translation());
+      EXPECT_EQ(expected_pose_estimate.rotation().angle(),
+                pose_estimate.rotation().angle());
+    }
+  }
+}
+
 }  // namespace
 }  // namespace scan_matching
 }  // namespace mapping_2d
@@ -0,0 +1,200 @@
+/*
+ * Copyright 2017 The Cartographer Authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "cartographer/mapping_2d/scan_matching/scoring_kernels.h"
+
+#include "glog/logging.h"
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#define CARTOGRAPHER_X86_SCORING_KERNELS
+#include <immintrin.h>
+#endif
+
+namespace cartographer {
+namespace mapping_2d {
+namespace scan_matching {
+
+namespace {
+
+static_assert(sizeof(Eigen::Array2i) == 2 * sizeof(int),
+              "Kernels expect densely packed indices.");
+
+// Same as 'PrecomputationGrid::GetValue'.
+inline int GetValue(const ScoringGrid& grid, const int x, const int y) {
+  if (static_cast<unsigned>(x) >= static_cast<unsigned>(grid.num_x_cells) ||
+      static_cast<unsigned>(y) >= static_cast<unsigned>(grid.num_y_cells)) {
+    return 0;
+  }
+  return grid.cells[x + y * grid.num_x_cells];
+}
+
+int ScoreScalar(const ScoringGrid& grid, const Eigen::Array2i* xy_indices,
+                const int num_xy_indices, const Eigen::Array2i& xy_offset) {
+  int sum = 0;
+  for (int i = 0; i != num_xy_indices; ++i) {
+    sum += GetValue(grid, xy_indices[i].x() + xy_offset.x(),
+                    xy_indices[i].y() + xy_offset.y());
+  }
+  return sum;
+}
+
+#ifdef CARTOGRAPHER_X86_SCORING_KERNELS
+
+// SSE4.1 has no gather instruction, so only the offsets, bounds checks and
+// flat indices are computed for 4 points at a time, and the cells are loaded
+// one by one.
+__attribute__((target("sse4.1"))) int ScoreSse41(
+    const ScoringGrid& grid, const Eigen::Array2i* xy_indices,
+    const int num_xy_indices, const Eigen::Array2i& xy_offset) {
+  const __m128i x_offset = _mm_set1_epi32(xy_offset.x());
+  const __m128i y_offset = _mm_set1_epi32(xy_offset.y());
+  const __m128i num_x_cells = _mm_set1_epi32(grid.num_x_cells);
+  const __m128i num_y_cells = _mm_set1_epi32(grid.num_y_cells);
+  const __m128i minus_one = _mm_set1_epi32(-1);
+  alignas(16) int32 flat_indices[4];
+  alignas(16) int32 in_bounds[4];
+  int sum = 0;
+  int i = 0;
+  for (; i + 4 <= num_xy_indices; i += 4) {
+    // Loads (x0, y0, x1, y1) and (x2, y2, x3, y3) and deinterleaves them.
+    const __m128i xy01 = _mm_shuffle_epi32(
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(xy_indices + i)),
+        _MM_SHUFFLE(3, 1, 2, 0));
+    const __m128i xy23 = _mm_shuffle_epi32(
+        _mm_loadu_si128(reinterpret_cast<const __m128i*>(xy_indices + i + 2)),
+        _MM_SHUFFLE(3, 1, 2, 0));
+    const __m128i x = _mm_add_epi32(_mm_unpacklo_epi64(xy01, xy23), x_offset);
+    const __m128i y = _mm_add_epi32(_mm_unpackhi_epi64(xy01, xy23), y_offset);
+    const __m128i mask = _mm_and_si128(
+        _mm_and_si128(_mm_cmpgt_epi32(x, minus_one),
+                      _mm_cmpgt_epi32(num_x_cells, x)),
+        _mm_and_si128(_mm_cmpgt_epi32(y, minus_one),
+                      _mm_cmpgt_epi32(num_y_cells, y)));
+    const __m128i flat_index =
+        _mm_and_si128(_mm_add_epi32(x, _mm_mullo_epi32(y, num_x_cells)), mask);
+    _mm_store_si128(reinterpret_cast<__m128i*>(flat_indices), flat_index);
+    _mm_store_si128(reinterpret_cast<__m128i*>(in_bounds), mask);
+    for (int j = 0; j != 4; ++j) {
+      sum += grid.cells[flat_indices[j]] & in_bounds[j];
+    }
+  }
+  return sum + ScoreScalar(grid, xy_indices + i, num_xy_indices - i, xy_offset);
+}
+
+// Processes 8 points at a time, loading 32 bits at each cell with a masked
+// gather and keeping the lowest byte. This relies on 'kScoringGridPadding'.
+__attribute__((target("avx2"))) int ScoreAvx2(
+    const ScoringGrid& grid, const Eigen::Array2i* xy_indices,
+    const int num_xy_indices, const Eigen::Array2i& xy_offset) {
+  const __m256i x_offset = _mm256_set1_epi32(xy_offset.x());
+  const __m256i y_offset = _mm256_set1_epi32(xy_offset.y());
+  const __m256i num_x_cells = _mm256_set1_epi32(grid.num_x_cells);
+  const __m256i num_y_cells = _mm256_set1_epi32(grid.num_y_cells);
+  const __m256i minus_one = _mm256_set1_epi32(-1);
+  const __m256i low_byte = _mm256_set1_epi32(0xff);
+  const __m256i deinterleave = _mm256_setr_epi32(0, 2, 4, 6, 1, 3, 5, 7);
+  const int* const cells = reinterpret_cast<const int*>(grid.cells);
+  __m256i sums = _mm256_setzero_si256();
+  int i = 0;
+  for (; i + 8 <= num_xy_indices; i += 8) {
+    // Both loads are reordered to (x0, x1, x2, x3, y0, y1, y2, y3).
+    const __m256i xy0123 = _mm256_permutevar8x32_epi32(
+        _mm256_loadu_si256(reinterpret_cast<const __m256i*>(xy_indices + i)),
+        deinterleave);
+    const __m256i xy4567 = _mm256_permutevar8x32_epi32(
+        _mm256_loadu_si256(
+            reinterpret_cast<const __m256i*>(xy_indices + i + 4)),
+        deinterleave);
+    const __m256i x = _mm256_add_epi32(
+        _mm256_permute2x128_si256(xy0123, xy4567, 0x20), x_offset);
+    const __m256i y = _mm256_add_epi32(
+        _mm256_permute2x128_si256(xy0123, xy4567, 0x31), y_offset);
+    const __m256i mask = _mm256_and_si256(
+        _mm256_and_si256(_mm256_cmpgt_epi32(x, minus_one),
+                         _mm256_cmpgt_epi32(num_x_cells, x)),
+        _mm256_and_si256(_mm256_cmpgt_epi32(y, minus_one),
+                         _mm256_cmpgt_epi32(num_y_cells, y)));
+    const __m256i flat_index =
+        _mm256_add_epi32(x, _mm256_mullo_epi32(y, num_x_cells));
+    const __m256i values = _mm256_mask_i32gather_epi32(
+        _mm256_setzero_si256(), cells, flat_index, mask, 1 /* scale */);
+    sums = _mm256_add_epi32(sums, _mm256_and_si256(values, low_byte));
+  }
+  const __m128i sums4 = _mm_add_epi32(_mm256_castsi256_si128(sums),
+                                      _mm256_extracti128_si256(sums, 1));
+  const __m128i sums2 = _mm_add_epi32(sums4, _mm_unpackhi_epi64(sums4, sums4));
+  const int sum = _mm_cvtsi128_si32(
+      _mm_add_epi32(sums2, _mm_shuffle_epi32(sums2, _MM_SHUFFLE(1, 1, 1, 1))));
+  return sum + ScoreScalar(grid, xy_indices + i, num_xy_indices - i, xy_offset);
+}
+
+#endif  // CARTOGRAPHER_X86_SCORING_KERNELS
+
+}  // namespace
+
+bool IsScoringKernelSupported(const ScoringKernel kernel) {
+  switch (kernel) {
+    case ScoringKernel::kScalar:
+      return true;
+#ifdef CARTOGRAPHER_X86_SCORING_KERNELS
+    case ScoringKernel::kSse41:
+      __builtin_cpu_init();
+      return __builtin_cpu_supports("sse4.1");
+    case ScoringKernel::kAvx2:
+      __builtin_cpu_init();
+      return __builtin_cpu_supports("avx2");
+#else
+    case ScoringKernel::kSse41:
+    case ScoringKernel::kAvx2:
+      return false;
+#endif
+  }
+  LOG(FATAL) << "Unknown scoring kernel.";
+  return false;
+}
+
+ScoringKernel GetFastestScoringKernel() {
+  for (const ScoringKernel kernel :
+       {ScoringKernel::kAvx2, ScoringKernel::kSse41}) {
+    if (IsScoringKernelSupported(kernel)) {
+      return kernel;
+    }
+  }
+  return ScoringKernel::kScalar;
+}
+
+ScoringFunction GetScoringFunction(const ScoringKernel kernel) {
+  CHECK(IsScoringKernelSupported(kernel));
+  switch (kernel) {
+    case ScoringKernel::kScalar:
+      return &ScoreScalar;
+#ifdef CARTOGRAPHER_X86_SCORING_KERNELS
+    case ScoringKernel::kSse41:
+      return &ScoreSse41;
+    case ScoringKernel::kAvx2:
+      return &ScoreAvx2;
+#else
+    default:
+      break;
+#endif
+  }
+  LOG(FATAL) << "Unsupported scoring kernel.";
+  return nullptr;
+}
+
+}  // namespace scan_matching
+}  // namespace mapping_2d
+}  // namespace cartographer
@@ -0,0 +1,64 @@
+/*
+ * Copyright 2017 The Cartographer Authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef CARTOGRAPHER_MAPPING_2D_SCAN_MATCHING_SCORING_KERNELS_H_
+#define CARTOGRAPHER_MAPPING_2D_SCAN_MATCHING_SCORING_KERNELS_H_
+
+#include "Eigen/Core"
+#include "cartographer/common/port.h"
+
+namespace cartographer {
+namespace mapping_2d {
+namespace scan_matching {
+
+// Number of bytes after the last cell of a 'ScoringGrid' which kernels may
+// read. Values read there are never used.
+constexpr int kScoringGridPadding = 3;
+
+// A row-major grid of 'num_x_cells' x 'num_y_cells' values as used by
+// 'PrecomputationGrid'. 'cells' must be followed by 'kScoringGridPadding'
+// readable bytes.
+struct ScoringGrid {
+  const uint8* cells;
+  int num_x_cells;
+  int num_y_cells;
+};
+
+// Implementations of the innermost loop of the fast correlative scan matcher.
+// All kernels compute exactly the same result.
+enum class ScoringKernel { kScalar, kSse41, kAvx2 };
+
+// Returns the sum of the values of 'grid' at 'xy_indices[i] + xy_offset' for
+// all 'i' < 'num_xy_indices'. Indices outside of 'grid' contribute 0.
+using ScoringFunction = int (*)(const ScoringGrid& grid,
+                                const Eigen::Array2i* xy_indices,
+                                int num_xy_indices,
+                                const Eigen::Array2i& xy_offset);
+
+// Returns true if 'kernel' was compiled in and is supported by this CPU.
+bool IsScoringKernelSupported(ScoringKernel kernel);
+
+// Returns the fastest kernel supported by this CPU.
+ScoringKernel GetFastestScoringKernel();
+
+// Returns the implementation of 'kernel' which must be supported.
+ScoringFunction GetScoringFunction(ScoringKernel kernel);
+
+}  // namespace scan_matching
+}  // namespace mapping_2d
+}  // namespace cartographer
+
+#endif  // CARTOGRAPHER_MAPPING_2D_SCAN_MATCHING_SCORING_KERNELS_H_
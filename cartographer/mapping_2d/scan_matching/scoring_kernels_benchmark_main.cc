@@ -0,0 +1,119 @@
+/*
+ * Copyright 2017 The Cartographer Authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Compares the candidate scoring kernels of the fast correlative scan matcher
+// on a grid and scan of typical 2D submap and range data sizes.
+
+#include <chrono>
+#include <iostream>
+#include <random>
+#include <vector>
+
+#include "cartographer/mapping_2d/scan_matching/scoring_kernels.h"
+#include "gflags/gflags.h"
+#include "glog/logging.h"
+
+DEFINE_int32(num_x_cells, 800, "Width of the precomputation grid in cells.");
+DEFINE_int32(num_y_cells, 800, "Height of the precomputation grid in cells.");
+DEFINE_int32(num_points, 700, "Number of points in the discretized scan.");
+DEFINE_int32(search_window_cells, 140,
+             "Number of cells in each direction of the linear search window.");
+
+namespace cartographer {
+namespace mapping_2d {
+namespace scan_matching {
+namespace {
+
+const char* ToString(const ScoringKernel kernel) {
+  switch (kernel) {
+    case ScoringKernel::kScalar:
+      return "scalar";
+    case ScoringKernel::kSse41:
+      return "sse4.1";
+    case ScoringKernel::kAvx2:
+      return "avx2";
+  }
+  return "unknown";
+}
+
+void Run() {
+  CHECK_GT(FLAGS_num_x_cells, 0);
+  CHECK_GT(FLAGS_num_y_cells, 0);
+  std::mt19937 prng(42);
+  std::uniform_int_distribution<int> value_distribution(0, 255);
+  std::vector<uint8> cells(FLAGS_num_x_cells * FLAGS_num_y_cells +
+                           kScoringGridPadding);
+  for (uint8& cell : cells) {
+    cell = value_distribution(prng);
+  }
+  const ScoringGrid grid{cells.data(), FLAGS_num_x_cells, FLAGS_num_y_cells};
+
+  // Points of a scan taken near the center of the submap.
+  std::normal_distribution<float> x_distribution(FLAGS_num_x_cells / 2.f,
+                                                 FLAGS_num_x_cells / 6.f);
+  std::normal_distribution<float> y_distribution(FLAGS_num_y_cells / 2.f,
+                                                 FLAGS_num_y_cells / 6.f);
+  std::vector<Eigen::Array2i> xy_indices;
+  for (int i = 0; i != FLAGS_num_points; ++i) {
+    xy_indices.emplace_back(x_distribution(prng), y_distribution(prng));
+  }
+
+  const int window = FLAGS_search_window_cells;
+  const int num_candidates = (2 * window + 1) * (2 * window + 1);
+  int expected_total = 0;
+  for (const ScoringKernel kernel :
+       {ScoringKernel::kScalar, ScoringKernel::kSse41, ScoringKernel::kAvx2}) {
+    if (!IsScoringKernelSupported(kernel)) {
+      std::cout << ToString(kernel) << ": not supported\n";
+      continue;
+    }
+    const ScoringFunction scoring_function = GetScoringFunction(kernel);
+    int total = 0;
+    const auto start = std::chrono::steady_clock::now();
+    for (int y = -window; y <= window; ++y) {
+      for (int x = -window; x <= window; ++x) {
+        total += scoring_function(grid, xy_indices.data(), xy_indices.size(),
+                                  Eigen::Array2i(x, y));
+      }
+    }
+    const std::chrono::duration<double> elapsed =
+        std::chrono::steady_clock::now() - start;
+    const double seconds = elapsed.count();
+    if (kernel == ScoringKernel::kScalar) {
+      expected_total = total;
+    }
+    CHECK_EQ(total, expected_total) << ToString(kernel);
+    std::cout << ToString(kernel) << ": " << num_candidates << " candidates in "
+              << seconds << " s, "
+              << 1e9 * seconds / (num_candidates * FLAGS_num_points)
+              << " ns per point\n";
+  }
+}
+
+}  // namespace
+}  // namespace scan_matching
+}  // namespace mapping_2d
+}  // namespace cartographer
+
+int main(int argc, char** argv) {
+  google::InitGoogleLogging(argv[0]);
+  FLAGS_logtostderr = true;
+  google::SetUsageMessage(
+      "\n\n"
+      "Benchmarks the 2D fast correlative scan matcher scoring kernels.\n");
+  google::ParseCommandLineFlags(&argc, &argv, true);
+  ::cartographer::mapping_2d::scan_matching::Run();
+}
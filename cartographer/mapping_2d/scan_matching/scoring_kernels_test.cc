@@ -0,0 +1,99 @@
+/*
+ * Copyright 2017 The Cartographer Authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "cartographer/mapping_2d/scan_matching/scoring_kernels.h"
+
+#include <random>
+#include <vector>
+
+#include "gtest/gtest.h"
+
+namespace cartographer {
+namespace mapping_2d {
+namespace scan_matching {
+namespace {
+
+TEST(ScoringKernelsTest, ScalarIsAlwaysSupported) {
+  EXPECT_TRUE(IsScoringKernelSupported(ScoringKernel::kScalar));
+  EXPECT_TRUE(IsScoringKernelSupported(GetFastestScoringKernel()));
+}
+
+TEST(ScoringKernelsTest, AllKernelsAgree) {
+  std::mt19937 prng(42);
+  std::uniform_int_distribution<int> value_distribution(0, 255);
+  constexpr int kNumXCells = 131;
+  constexpr int kNumYCells = 77;
+  std::vector<uint8> cells(kNumXCells * kNumYCells + kScoringGridPadding);
+  for (uint8& cell : cells) {
+    cell = value_distribution(prng);
+  }
+  const ScoringGrid grid{cells.data(), kNumXCells, kNumYCells};
+
+  // Some of the points are outside of the grid.
+  std::uniform_int_distribution<int> x_distribution(-20, kNumXCells + 20);
+  std::uniform_int_distribution<int> y_distribution(-20, kNumYCells + 20);
+  std::vector<Eigen::Array2i> xy_indices;
+  for (int i = 0; i != 1001; ++i) {
+    xy_indices.emplace_back(x_distribution(prng), y_distribution(prng));
+  }
+  // Including the very last cell to check the padding.
+  xy_indices.emplace_back(kNumXCells - 1, kNumYCells - 1);
+
+  const ScoringFunction scalar = GetScoringFunction(ScoringKernel::kScalar);
+  for (const ScoringKernel kernel :
+       {ScoringKernel::kSse41, ScoringKernel::kAvx2}) {
+    if (!IsScoringKernelSupported(kernel)) {
+      continue;
+    }
+    const ScoringFunction scoring_function = GetScoringFunction(kernel);
+    for (const int num_xy_indices : {0, 1, 7, 8, 9, 1002}) {
+      for (const Eigen::Array2i& xy_offset :
+           {Eigen::Array2i(0, 0), Eigen::Array2i(-5, 3),
+            Eigen::Array2i(40, -30)}) {
+        const int start = xy_indices.size() - num_xy_indices;
+        EXPECT_EQ(scalar(grid, xy_indices.data() + start, num_xy_indices,
+                         xy_offset),
+                  scoring_function(grid, xy_indices.data() + start,
+                                   num_xy_indices, xy_offset));
+      }
+    }
+  }
+}
+
+TEST(ScoringKernelsTest, OutOfBoundsScoresZero) {
+  std::vector<uint8> cells(4 + kScoringGridPadding, 255);
+  const ScoringGrid grid{cells.data(), 2, 2};
+  const std::vector<Eigen::Array2i> xy_indices(16, Eigen::Array2i(0, 0));
+  for (const ScoringKernel kernel :
+       {ScoringKernel::kScalar, ScoringKernel::kSse41, ScoringKernel::kAvx2}) {
+    if (!IsScoringKernelSupported(kernel)) {
+      continue;
+    }
+    const ScoringFunction scoring_function = GetScoringFunction(kernel);
+    EXPECT_EQ(16 * 255, scoring_function(grid, xy_indices.data(), 16,
+                                         Eigen::Array2i(1, 1)));
+    for (const Eigen::Array2i& xy_offset :
+         {Eigen::Array2i(-1, 0), Eigen::Array2i(0, -1), Eigen::Array2i(2, 0),
+          Eigen::Array2i(0, 2)}) {
+      EXPECT_EQ(0, scoring_function(grid, xy_indices.data(), 16, xy_offset));
+    }
+  }
+}
+
+}  // namespace
+}  // namespace scan_matching
+}  // namespace mapping_2d
+}  // namespace cartographer
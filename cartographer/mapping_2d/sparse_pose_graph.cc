@@ -23,6 +23,7 @@
 #include <iomanip>
 #include <iostream>
 #include <limits>
+#include <map>
 #include <memory>
 #include <sstream>
 #include <string>
@@ -38,12 +39,37 @@
 namespace cartographer {
 namespace mapping_2d {
 
+namespace {
+
+// Lowers the first index of 'trajectory_id' in 'first_index_changed' to
+// 'index'.
+void MarkChangedSinceSnapshot(const int trajectory_id, const int index,
+                              std::map<int, int>* const first_index_changed) {
+  const auto it = first_index_changed->emplace(trajectory_id, index).first;
+  it->second = std::min(it->second, index);
+}
+
+}  // namespace
+
 SparsePoseGraph::SparsePoseGraph(
     const mapping::proto::SparsePoseGraphOptions& options,
     common::ThreadPool* thread_pool)
     : options_(options),
       optimization_problem_(options_.optimization_problem_options()),
-      constraint_builder_(options_.constraint_builder_options(), thread_pool) {}
+      precomputation_grid_stack_cache_(
+          static_cast<int64>(options_.constraint_builder_options()
+                                 .precomputation_grid_cache_size_in_mb()) *
+              1024 * 1024,
+          thread_pool),
+      constraint_builder_(options_.constraint_builder_options(), thread_pool,
+                          &precomputation_grid_stack_cache_),
+      submap_index_(
+          options_.constraint_builder_options().max_constraint_distance()),
+      node_index_(
+          options_.constraint_builder_options().max_constraint_distance()) {
+  common::MutexLocker locker(&mutex_);
+  PublishSnapshot();
+}
 
 SparsePoseGraph::~SparsePoseGraph() {
   WaitForAllComputations();
@@ -118,6 +144,8 @@ void SparsePoseGraph::AddScan(
     const mapping::SubmapId submap_id =
         submap_data_.Append(trajectory_id, SubmapData());
     submap_data_.at(submap_id).submap = insertion_submaps.back();
+    submap_data_.at(submap_id).local_pose =
+        insertion_submaps.back()->local_pose();
   }
 
   // Make sure we have a sampler for this trajectory.
@@ -137,6 +165,7 @@ void SparsePoseGraph::AddScan(
                              transform::Rigid3d::Rotation(
                                  constant_data->gravity_alignment.inverse())));
   });
+  PublishSnapshot();
 }
 
 void SparsePoseGraph::AddWorkItem(const std::function<void()>& work_item) {
@@ -144,6 +173,7 @@ void SparsePoseGraph::AddWorkItem(const std::function<void()>& work_item) {
     work_item();
   } else {
     work_queue_->push_back(work_item);
+    max_work_queue_size_ = std::max(max_work_queue_size_, work_queue_->size());
   }
 }
 
@@ -209,16 +239,42 @@ void SparsePoseGraph::ComputeConstraintsForOldScans(
     const mapping::SubmapId& submap_id) {
   const auto& submap_data = submap_data_.at(submap_id);
   const auto& node_data = optimization_problem_.node_data();
+  // Unless a global search is possible, only nodes near the submap can be
+  // matched against it.
+  const std::vector<mapping::NodeId> nearby_node_ids = node_index_.Query(
+      optimization_problem_.submap_data()
+          .at(submap_id.trajectory_id)
+          .at(submap_id.submap_index)
+          .pose.translation(),
+      options_.constraint_builder_options().max_constraint_distance());
+  auto nearby_node_id = nearby_node_ids.begin();
+  std::vector<mapping::NodeId> node_ids;
   for (size_t trajectory_id = 0; trajectory_id != node_data.size();
        ++trajectory_id) {
-    for (const auto& index_node_data : node_data[trajectory_id]) {
-      const mapping::NodeId node_id{static_cast<int>(trajectory_id),
-                                    index_node_data.first};
-      CHECK(!trajectory_nodes_.at(node_id).trimmed());
-      if (submap_data.node_ids.count(node_id) == 0) {
-        ComputeConstraint(node_id, submap_id);
+    const bool all_nodes = MayMatchGlobally(
+        trajectory_id, submap_id.trajectory_id,
+        std::max(GetLatestScanTime(trajectory_id),
+                 GetLatestScanTime(submap_id.trajectory_id)));
+    if (all_nodes) {
+      for (const auto& index_node_data : node_data[trajectory_id]) {
+        node_ids.push_back(mapping::NodeId{static_cast<int>(trajectory_id),
+                                           index_node_data.first});
       }
     }
+    for (; nearby_node_id != nearby_node_ids.end() &&
+           nearby_node_id->trajectory_id == static_cast<int>(trajectory_id);
+         ++nearby_node_id) {
+      // Trimmed nodes stay in the index until it is rebuilt.
+      if (!all_nodes && !trajectory_nodes_.at(*nearby_node_id).trimmed()) {
+        node_ids.push_back(*nearby_node_id);
+      }
+    }
+  }
+  for (const mapping::NodeId& node_id : node_ids) {
+    CHECK(!trajectory_nodes_.at(node_id).trimmed());
+    if (submap_data.node_ids.count(node_id) == 0) {
+      ComputeConstraint(node_id, submap_id);
+    }
   }
 }
 
@@ -254,6 +310,7 @@ void SparsePoseGraph::ComputeConstraintsForScan(
   optimization_problem_.AddTrajectoryNode(matching_id.trajectory_id,
                                           node_data->time, pose, optimized_pose,
                                           node_data->gravity_alignment);
+  node_index_.Insert(node_id, optimized_pose.translation());
   for (size_t i = 0; i < insertion_submaps.size(); ++i) {
     const mapping::SubmapId submap_id = submap_ids[i];
     // Even if this was the last scan added to 'submap_id', the submap will only
@@ -271,17 +328,40 @@ void SparsePoseGraph::ComputeConstraintsForScan(
                                       Constraint::INTRA_SUBMAP});
   }
 
+  // Unless a global search is possible, only submaps near the scan can be
+  // matched against it.
+  const std::vector<mapping::SubmapId> nearby_submap_ids = submap_index_.Query(
+      optimized_pose.translation(),
+      options_.constraint_builder_options().max_constraint_distance());
+  auto nearby_submap_id = nearby_submap_ids.begin();
+  std::vector<mapping::SubmapId> candidate_submap_ids;
   for (int trajectory_id = 0; trajectory_id < submap_data_.num_trajectories();
        ++trajectory_id) {
-    for (int submap_index = 0;
-         submap_index < submap_data_.num_indices(trajectory_id);
-         ++submap_index) {
-      const mapping::SubmapId submap_id{trajectory_id, submap_index};
-      if (submap_data_.at(submap_id).state == SubmapState::kFinished) {
-        CHECK_EQ(submap_data_.at(submap_id).node_ids.count(node_id), 0);
-        ComputeConstraint(node_id, submap_id);
+    const bool all_submaps = MayMatchGlobally(
+        node_id.trajectory_id, trajectory_id,
+        std::max(GetLatestScanTime(node_id.trajectory_id),
+                 GetLatestScanTime(trajectory_id)));
+    if (all_submaps) {
+      for (int submap_index = 0;
+           submap_index < submap_data_.num_indices(trajectory_id);
+           ++submap_index) {
+        candidate_submap_ids.push_back(
+            mapping::SubmapId{trajectory_id, submap_index});
       }
     }
+    for (; nearby_submap_id != nearby_submap_ids.end() &&
+           nearby_submap_id->trajectory_id == trajectory_id;
+         ++nearby_submap_id) {
+      if (!all_submaps) {
+        candidate_submap_ids.push_back(*nearby_submap_id);
+      }
+    }
+  }
+  for (const mapping::SubmapId& submap_id : candidate_submap_ids) {
+    if (submap_data_.at(submap_id).state == SubmapState::kFinished) {
+      CHECK_EQ(submap_data_.at(submap_id).node_ids.count(node_id), 0);
+      ComputeConstraint(node_id, submap_id);
+    }
   }
 
   if (newly_finished_submap) {
@@ -289,6 +369,11 @@ void SparsePoseGraph::ComputeConstraintsForScan(
     SubmapData& finished_submap_data = submap_data_.at(finished_submap_id);
     CHECK(finished_submap_data.state == SubmapState::kActive);
     finished_submap_data.state = SubmapState::kFinished;
+    submap_index_.Insert(finished_submap_id,
+                         optimization_problem_.submap_data()
+                             .at(finished_submap_id.trajectory_id)
+                             .at(finished_submap_id.submap_index)
+                             .pose.translation());
     // We have a new completed submap, so we look into adding constraints for
     // old scans.
     ComputeConstraintsForOldScans(finished_submap_id);
@@ -302,7 +387,61 @@ void SparsePoseGraph::ComputeConstraintsForScan(
     // If there is a 'work_queue_' already, some other thread will take care.
     if (work_queue_ == nullptr) {
       work_queue_ = common::make_unique<std::deque<std::function<void()>>>();
-      HandleWorkQueue();
+      work_queue_start_time_ = std::chrono::steady_clock::now();
+      max_work_queue_size_ = 0;
+      // A running optimization schedules the next one when it finishes.
+      if (!optimization_in_progress_) {
+        HandleWorkQueue();
+      }
+    }
+  }
+}
+
+bool SparsePoseGraph::MayMatchGlobally(const int node_trajectory_id,
+                                       const int submap_trajectory_id,
+                                       const common::Time latest_scan_time) {
+  // This is the condition for a global search in ComputeConstraint().
+  return node_trajectory_id != submap_trajectory_id &&
+         latest_scan_time >=
+             trajectory_connectivity_state_.LastConnectionTime(
+                 node_trajectory_id, submap_trajectory_id) +
+                 common::FromSeconds(
+                     options_.global_constraint_search_after_n_seconds());
+}
+
+common::Time SparsePoseGraph::GetLatestScanTime(const int trajectory_id) const {
+  if (trajectory_id >= trajectory_nodes_.num_trajectories() ||
+      trajectory_nodes_.num_indices(trajectory_id) == 0) {
+    return common::Time::min();
+  }
+  const mapping::TrajectoryNode& node = trajectory_nodes_.at(mapping::NodeId{
+      trajectory_id, trajectory_nodes_.num_indices(trajectory_id) - 1});
+  // Trimmed nodes have no time, so we have to assume the worst.
+  return node.trimmed() ? common::Time::max() : node.constant_data->time;
+}
+
+void SparsePoseGraph::UpdateSpatialIndices() {
+  submap_index_.Clear();
+  const auto& submap_data = optimization_problem_.submap_data();
+  for (size_t trajectory_id = 0; trajectory_id != submap_data.size();
+       ++trajectory_id) {
+    for (const auto& index_submap_data : submap_data[trajectory_id]) {
+      const mapping::SubmapId submap_id{static_cast<int>(trajectory_id),
+                                        index_submap_data.first};
+      if (submap_data_.at(submap_id).state == SubmapState::kFinished) {
+        submap_index_.Insert(submap_id,
+                             index_submap_data.second.pose.translation());
+      }
+    }
+  }
+  node_index_.Clear();
+  const auto& node_data = optimization_problem_.node_data();
+  for (size_t trajectory_id = 0; trajectory_id != node_data.size();
+       ++trajectory_id) {
+    for (const auto& index_node_data : node_data[trajectory_id]) {
+      node_index_.Insert(mapping::NodeId{static_cast<int>(trajectory_id),
+                                         index_node_data.first},
+                         index_node_data.second.pose.translation());
     }
   }
 }
@@ -336,37 +475,44 @@ void SparsePoseGraph::UpdateTrajectoryConnectivity(
 }
 
 void SparsePoseGraph::HandleWorkQueue() {
+  optimization_in_progress_ = true;
   constraint_builder_.WhenDone(
       [this](const sparse_pose_graph::ConstraintBuilder::Result& result) {
         {
           common::MutexLocker locker(&mutex_);
           constraints_.insert(constraints_.end(), result.begin(), result.end());
-        }
-        RunOptimization();
-
-        common::MutexLocker locker(&mutex_);
-        UpdateTrajectoryConnectivity(result);
-        TrimmingHandle trimming_handle(this);
-        for (auto& trimmer : trimmers_) {
-          trimmer->Trim(&trimming_handle);
-        }
-
-        num_scans_since_last_loop_closure_ = 0;
-        run_loop_closure_ = false;
-        while (!run_loop_closure_) {
-          if (work_queue_->empty()) {
-            LOG(INFO) << "We caught up. Hooray!";
-            work_queue_.reset();
-            return;
+          UpdateTrajectoryConnectivity(result);
+          // Trimming requires that no constraint computations are pending,
+          // which only holds until the 'work_queue_' is drained. Since work
+          // items are done while solving, this is before the optimization.
+          TrimmingHandle trimming_handle(this);
+          for (auto& trimmer : trimmers_) {
+            trimmer->Trim(&trimming_handle);
           }
-          work_queue_->front()();
-          work_queue_->pop_front();
+          num_scans_since_last_loop_closure_ = 0;
+          run_loop_closure_ = false;
         }
-        // We have to optimize again.
-        HandleWorkQueue();
+        RunOptimization(options_.optimization_problem_options()
+                            .ceres_solver_options()
+                            .max_num_iterations());
       });
 }
 
+void SparsePoseGraph::DrainWorkQueue() {
+  while (work_queue_ != nullptr && !run_loop_closure_) {
+    if (work_queue_->empty()) {
+      const std::chrono::duration<double> latency =
+          std::chrono::steady_clock::now() - work_queue_start_time_;
+      work_queue_latency_histogram_.Add(latency.count());
+      work_queue_size_histogram_.Add(max_work_queue_size_);
+      work_queue_.reset();
+      return;
+    }
+    work_queue_->front()();
+    work_queue_->pop_front();
+  }
+}
+
 void SparsePoseGraph::WaitForAllComputations() {
   bool notification = false;
   common::MutexLocker locker(&mutex_);
@@ -387,10 +533,16 @@ void SparsePoseGraph::WaitForAllComputations() {
     std::cout << "\r\x1b[K" << progress_info.str() << std::flush;
   }
   std::cout << "\r\x1b[KOptimizing: Done.     " << std::endl;
+  locker.Await(
+      [this]() REQUIRES(mutex_) { return !optimization_in_progress_; });
+  // Scans added from now on must not schedule an optimization before ours,
+  // since the 'constraint_builder_' only takes one callback at a time.
+  optimization_in_progress_ = true;
   constraint_builder_.WhenDone([this, &notification](
       const sparse_pose_graph::ConstraintBuilder::Result& result) {
     common::MutexLocker locker(&mutex_);
     constraints_.insert(constraints_.end(), result.begin(), result.end());
+    PublishSnapshot();
     notification = true;
   });
   locker.Await([&notification]() { return notification; });
@@ -421,6 +573,29 @@ void SparsePoseGraph::AddSubmapFromProto(const int trajectory_id,
   const mapping::SubmapId submap_id =
       submap_data_.Append(trajectory_id, SubmapData());
   submap_data_.at(submap_id).submap = submap_ptr;
+  submap_data_.at(submap_id).local_pose = submap_ptr->local_pose();
+  if (submap.has_precomputation_grid_stack_2d()) {
+    // A stack which was not computed for the limits of this submap's grid is
+    // dropped and recomputed when it is needed.
+    const auto& precomputation_grid_stack_proto =
+        submap.precomputation_grid_stack_2d();
+    std::shared_ptr<const scan_matching::PrecomputationGridStack>
+        precomputation_grid_stack;
+    if (precomputation_grid_stack_proto.has_limits()) {
+      precomputation_grid_stack =
+          std::make_shared<const scan_matching::PrecomputationGridStack>(
+              precomputation_grid_stack_proto);
+    }
+    if (precomputation_grid_stack != nullptr &&
+        precomputation_grid_stack->IsComputedFor(
+            submap_ptr->probability_grid().limits())) {
+      precomputation_grid_stack_cache_.Insert(
+          submap_id, std::move(precomputation_grid_stack));
+    } else {
+      LOG(WARNING) << "Ignoring precomputation grids which do not match submap "
+                   << submap_id << ".";
+    }
+  }
   // Immediately show the submap at the optimized pose.
   CHECK_GE(static_cast<size_t>(submap_data_.num_trajectories()),
            optimized_submap_transforms_.size());
@@ -434,7 +609,9 @@ void SparsePoseGraph::AddSubmapFromProto(const int trajectory_id,
     CHECK_EQ(frozen_trajectories_.count(submap_id.trajectory_id), 1);
     submap_data_.at(submap_id).state = SubmapState::kFinished;
     optimization_problem_.AddSubmap(submap_id.trajectory_id, initial_pose_2d);
+    submap_index_.Insert(submap_id, initial_pose_2d.translation());
   });
+  PublishSnapshot();
 }
 
 void SparsePoseGraph::AddTrimmer(
@@ -448,25 +625,41 @@ void SparsePoseGraph::AddTrimmer(
 
 void SparsePoseGraph::RunFinalOptimization() {
   WaitForAllComputations();
-  optimization_problem_.SetMaxNumIterations(
-      options_.max_num_final_iterations());
-  RunOptimization();
-  optimization_problem_.SetMaxNumIterations(
-      options_.optimization_problem_options()
-          .ceres_solver_options()
-          .max_num_iterations());
+  RunOptimization(options_.max_num_final_iterations());
 }
 
-void SparsePoseGraph::RunOptimization() {
-  if (optimization_problem_.submap_data().empty()) {
-    return;
+void SparsePoseGraph::RunOptimization(const int32 max_num_iterations) {
+  bool optimize;
+  {
+    common::MutexLocker locker(&mutex_);
+    CHECK(optimization_in_progress_);
+    optimize = !optimization_problem_.submap_data().empty();
+    if (optimize) {
+      // Only the running optimization reads the solver options.
+      optimization_problem_.SetMaxNumIterations(max_num_iterations);
+      optimization_problem_.PrepareSolve(constraints_, frozen_trajectories_);
+    }
+    // The solver only works on the prepared problem, so queued work items no
+    // longer have to wait.
+    DrainWorkQueue();
+    PublishSnapshot();
   }
+  // Solve is time consuming, so the mutex is not held while it runs. Work
+  // items keep adding data to the 'optimization_problem_' in the meantime.
+  optimization_problem_.SolvePrepared();
 
-  // No other thread is accessing the optimization_problem_, constraints_ and
-  // frozen_trajectories_ when executing the Solve. Solve is time consuming, so
-  // not taking the mutex before Solve to avoid blocking foreground processing.
-  optimization_problem_.Solve(constraints_, frozen_trajectories_);
   common::MutexLocker locker(&mutex_);
+  optimization_in_progress_ = false;
+  if (run_loop_closure_) {
+    // We have to optimize again.
+    HandleWorkQueue();
+  }
+  if (!optimize) {
+    PublishSnapshot();
+    return;
+  }
+  optimization_problem_.FinishSolve();
+  UpdateSpatialIndices();
 
   const auto& submap_data = optimization_problem_.submap_data();
   const auto& node_data = optimization_problem_.node_data();
@@ -499,29 +692,31 @@ void SparsePoseGraph::RunOptimization() {
     }
   }
   optimized_submap_transforms_ = submap_data;
+  for (int trajectory_id = 0; trajectory_id != submap_data_.num_trajectories();
+       ++trajectory_id) {
+    first_submap_index_changed_since_snapshot_[trajectory_id] = 0;
+  }
+  for (int trajectory_id = 0;
+       trajectory_id != trajectory_nodes_.num_trajectories(); ++trajectory_id) {
+    first_node_index_changed_since_snapshot_[trajectory_id] = 0;
+  }
+  PublishSnapshot();
+}
+
+std::shared_ptr<const mapping::SparsePoseGraph::Snapshot>
+SparsePoseGraph::GetSnapshot() {
+  common::MutexLocker locker(&snapshot_mutex_);
+  return snapshot_;
 }
 
-std::vector<std::vector<mapping::TrajectoryNode>>
-SparsePoseGraph::GetTrajectoryNodes() {
+common::Histogram SparsePoseGraph::GetWorkQueueLatencyHistogram() {
   common::MutexLocker locker(&mutex_);
-  return trajectory_nodes_.data();
+  return work_queue_latency_histogram_;
 }
 
-std::vector<SparsePoseGraph::Constraint> SparsePoseGraph::constraints() {
-  std::vector<Constraint> result;
+common::Histogram SparsePoseGraph::GetWorkQueueSizeHistogram() {
   common::MutexLocker locker(&mutex_);
-  for (const Constraint& constraint : constraints_) {
-    result.push_back(Constraint{
-        constraint.submap_id, constraint.node_id,
-        Constraint::Pose{constraint.pose.zbar_ij *
-                             transform::Rigid3d::Rotation(
-                                 trajectory_nodes_.at(constraint.node_id)
-                                     .constant_data->gravity_alignment),
-                         constraint.pose.translation_weight,
-                         constraint.pose.rotation_weight},
-        constraint.tag});
-  }
-  return result;
+  return work_queue_size_histogram_;
 }
 
 transform::Rigid3d SparsePoseGraph::GetLocalToGlobalTransform(
@@ -549,25 +744,6 @@ mapping::SparsePoseGraph::SubmapData SparsePoseGraph::GetSubmapData(
   return GetSubmapDataUnderLock(submap_id);
 }
 
-std::vector<std::vector<mapping::SparsePoseGraph::SubmapData>>
-SparsePoseGraph::GetAllSubmapData() {
-  common::MutexLocker locker(&mutex_);
-  std::vector<std::vector<mapping::SparsePoseGraph::SubmapData>>
-      all_submap_data(submap_data_.num_trajectories());
-  for (int trajectory_id = 0; trajectory_id < submap_data_.num_trajectories();
-       ++trajectory_id) {
-    all_submap_data[trajectory_id].reserve(
-        submap_data_.num_indices(trajectory_id));
-    for (int submap_index = 0;
-         submap_index < submap_data_.num_indices(trajectory_id);
-         ++submap_index) {
-      all_submap_data[trajectory_id].emplace_back(GetSubmapDataUnderLock(
-          mapping::SubmapId{trajectory_id, submap_index}));
-    }
-  }
-  return all_submap_data;
-}
-
 transform::Rigid3d SparsePoseGraph::ComputeLocalToGlobalTransform(
     const std::vector<std::map<int, sparse_pose_graph::SubmapData>>&
         submap_transforms,
@@ -579,12 +755,9 @@ transform::Rigid3d SparsePoseGraph::ComputeLocalToGlobalTransform(
 
   const int submap_index = submap_transforms.at(trajectory_id).rbegin()->first;
   const mapping::SubmapId last_optimized_submap_id{trajectory_id, submap_index};
-  // Accessing 'local_pose' in Submap is okay, since the member is const.
   return transform::Embed3D(
              submap_transforms.at(trajectory_id).at(submap_index).pose) *
-         submap_data_.at(last_optimized_submap_id)
-             .submap->local_pose()
-             .inverse();
+         submap_data_.at(last_optimized_submap_id).local_pose.inverse();
 }
 
 mapping::SparsePoseGraph::SubmapData SparsePoseGraph::GetSubmapDataUnderLock(
@@ -610,6 +783,77 @@ mapping::SparsePoseGraph::SubmapData SparsePoseGraph::GetSubmapDataUnderLock(
                       submap->local_pose()};
 }
 
+void SparsePoseGraph::PublishSnapshot() {
+  std::shared_ptr<Snapshot> snapshot;
+  {
+    common::MutexLocker locker(&snapshot_mutex_);
+    snapshot = snapshot_ == nullptr ? std::make_shared<Snapshot>()
+                                    : std::make_shared<Snapshot>(*snapshot_);
+  }
+  // Returns the number of leading values of 'trajectory_id' which did not
+  // change since the last snapshot, which has 'num_values' of them.
+  const auto num_unchanged_values = [](
+      const std::map<int, int>& first_index_changed, const int trajectory_id,
+      const size_t num_values) {
+    const auto it = first_index_changed.find(trajectory_id);
+    return it == first_index_changed.end()
+               ? num_values
+               : std::min(num_values, static_cast<size_t>(it->second));
+  };
+
+  snapshot->submap_data.resize(submap_data_.num_trajectories());
+  for (int trajectory_id = 0; trajectory_id < submap_data_.num_trajectories();
+       ++trajectory_id) {
+    auto& submap_data = snapshot->submap_data[trajectory_id];
+    submap_data.Truncate(num_unchanged_values(
+        first_submap_index_changed_since_snapshot_, trajectory_id,
+        submap_data.size()));
+    for (int submap_index = static_cast<int>(submap_data.size());
+         submap_index < submap_data_.num_indices(trajectory_id);
+         ++submap_index) {
+      submap_data.push_back(GetSubmapDataUnderLock(
+          mapping::SubmapId{trajectory_id, submap_index}));
+    }
+  }
+  snapshot->trajectory_nodes.resize(trajectory_nodes_.num_trajectories());
+  for (int trajectory_id = 0;
+       trajectory_id < trajectory_nodes_.num_trajectories(); ++trajectory_id) {
+    auto& nodes = snapshot->trajectory_nodes[trajectory_id];
+    nodes.Truncate(num_unchanged_values(
+        first_node_index_changed_since_snapshot_, trajectory_id, nodes.size()));
+    for (int node_index = static_cast<int>(nodes.size());
+         node_index < trajectory_nodes_.num_indices(trajectory_id);
+         ++node_index) {
+      nodes.push_back(
+          trajectory_nodes_.at(mapping::NodeId{trajectory_id, node_index}));
+    }
+  }
+  // Constraints are only appended, unless submaps were trimmed.
+  if (constraints_trimmed_since_snapshot_) {
+    snapshot->constraints.Truncate(0);
+  }
+  CHECK_LE(snapshot->constraints.size(), constraints_.size());
+  for (size_t i = snapshot->constraints.size(); i != constraints_.size();
+       ++i) {
+    const Constraint& constraint = constraints_[i];
+    snapshot->constraints.push_back(Constraint{
+        constraint.submap_id, constraint.node_id,
+        Constraint::Pose{constraint.pose.zbar_ij *
+                             transform::Rigid3d::Rotation(
+                                 trajectory_nodes_.at(constraint.node_id)
+                                     .constant_data->gravity_alignment),
+                         constraint.pose.translation_weight,
+                         constraint.pose.rotation_weight},
+        constraint.tag});
+  }
+  first_submap_index_changed_since_snapshot_.clear();
+  first_node_index_changed_since_snapshot_.clear();
+  constraints_trimmed_since_snapshot_ = false;
+
+  common::MutexLocker locker(&snapshot_mutex_);
+  snapshot_ = std::move(snapshot);
+}
+
 SparsePoseGraph::TrimmingHandle::TrimmingHandle(SparsePoseGraph* const parent)
     : parent_(parent) {}
 
@@ -662,6 +906,16 @@ void SparsePoseGraph::TrimmingHandle::MarkSubmapAsTrimmed(
     parent_->constraints_ = std::move(constraints);
   }
 
+  parent_->constraints_trimmed_since_snapshot_ = true;
+  MarkChangedSinceSnapshot(
+      submap_id.trajectory_id, submap_id.submap_index,
+      &parent_->first_submap_index_changed_since_snapshot_);
+  for (const mapping::NodeId& node_id : nodes_to_remove) {
+    MarkChangedSinceSnapshot(
+        node_id.trajectory_id, node_id.node_index,
+        &parent_->first_node_index_changed_since_snapshot_);
+  }
+
   // Mark the submap with 'submap_id' as trimmed and remove its data.
   auto& submap_data = parent_->submap_data_.at(submap_id);
   CHECK(submap_data.state == SubmapState::kFinished);
@@ -17,6 +17,7 @@
 #ifndef CARTOGRAPHER_MAPPING_2D_SPARSE_POSE_GRAPH_H_
 #define CARTOGRAPHER_MAPPING_2D_SPARSE_POSE_GRAPH_H_
 
+#include <chrono>
 #include <deque>
 #include <functional>
 #include <limits>
@@ -29,12 +30,16 @@
 #include "Eigen/Core"
 #include "Eigen/Geometry"
 #include "cartographer/common/fixed_ratio_sampler.h"
+#include "cartographer/common/histogram.h"
 #include "cartographer/common/mutex.h"
+#include "cartographer/common/port.h"
 #include "cartographer/common/thread_pool.h"
 #include "cartographer/common/time.h"
 #include "cartographer/mapping/pose_graph_trimmer.h"
 #include "cartographer/mapping/sparse_pose_graph.h"
+#include "cartographer/mapping/sparse_pose_graph/spatial_index.h"
 #include "cartographer/mapping/trajectory_connectivity_state.h"
+#include "cartographer/mapping_2d/scan_matching/precomputation_grid_stack_cache.h"
 #include "cartographer/mapping_2d/sparse_pose_graph/constraint_builder.h"
 #include "cartographer/mapping_2d/sparse_pose_graph/optimization_problem.h"
 #include "cartographer/mapping_2d/submaps.h"
@@ -92,17 +97,27 @@ class SparsePoseGraph : public mapping::SparsePoseGraph {
   int num_submaps(int trajectory_id) EXCLUDES(mutex_) override;
   mapping::SparsePoseGraph::SubmapData GetSubmapData(
       const mapping::SubmapId& submap_id) EXCLUDES(mutex_) override;
-  std::vector<std::vector<mapping::SparsePoseGraph::SubmapData>>
-  GetAllSubmapData() EXCLUDES(mutex_) override;
   transform::Rigid3d GetLocalToGlobalTransform(int trajectory_id)
       EXCLUDES(mutex_) override;
-  std::vector<std::vector<mapping::TrajectoryNode>> GetTrajectoryNodes()
-      override EXCLUDES(mutex_);
-  std::vector<Constraint> constraints() override EXCLUDES(mutex_);
+  std::shared_ptr<const Snapshot> GetSnapshot() override
+      EXCLUDES(snapshot_mutex_);
+
+  // Returns histograms with one value per periodic optimization: the seconds
+  // from queueing work behind it until all queued work was done, and the
+  // maximum number of queued work items.
+  common::Histogram GetWorkQueueLatencyHistogram() EXCLUDES(mutex_);
+  common::Histogram GetWorkQueueSizeHistogram() EXCLUDES(mutex_);
   common::Time GetLatestScanTime(const mapping::NodeId& node_id,
                                  const mapping::SubmapId& submap_id) const
       REQUIRES(mutex_);
 
+  // Returns the cache of the precomputation grids of all submaps, which may
+  // also be used by scan matchers outside of the pose graph.
+  scan_matching::PrecomputationGridStackCache*
+  precomputation_grid_stack_cache() {
+    return &precomputation_grid_stack_cache_;
+  }
+
  private:
   // The current state of the submap in the background threads. When this
   // transitions to kFinished, all scans are tried to match against this submap.
@@ -111,6 +126,11 @@ class SparsePoseGraph : public mapping::SparsePoseGraph {
   struct SubmapData {
     std::shared_ptr<const Submap> submap;
 
+    // The local pose of 'submap'. It is kept when the submap is trimmed, since
+    // the last optimized submap of a trajectory may be trimmed before the next
+    // optimization and still defines the local to global transform.
+    transform::Rigid3d local_pose;
+
     // IDs of the scans that were inserted into this map together with
     // constraints for them. They are not to be matched again when this submap
     // becomes 'finished'.
@@ -144,17 +164,38 @@ class SparsePoseGraph : public mapping::SparsePoseGraph {
   void ComputeConstraintsForOldScans(const mapping::SubmapId& submap_id)
       REQUIRES(mutex_);
 
+  // Returns true if a scan of 'node_trajectory_id' might be matched against a
+  // submap of 'submap_trajectory_id' using a global search, given that the
+  // latest scan time of the pair is at most 'latest_scan_time'. Only then can
+  // submaps and scans which are far apart lead to constraints.
+  bool MayMatchGlobally(int node_trajectory_id, int submap_trajectory_id,
+                        common::Time latest_scan_time) REQUIRES(mutex_);
+
+  // Returns the time of the latest scan of 'trajectory_id'.
+  common::Time GetLatestScanTime(int trajectory_id) const REQUIRES(mutex_);
+
+  // Rebuilds 'submap_index_' and 'node_index_' from the poses in the
+  // 'optimization_problem_'.
+  void UpdateSpatialIndices() REQUIRES(mutex_);
+
   // Registers the callback to run the optimization once all constraints have
   // been computed, that will also do all work that queue up in 'work_queue_'.
   void HandleWorkQueue() REQUIRES(mutex_);
 
+  // Does the work that queued up in 'work_queue_' until the next optimization
+  // has to run or the queue is empty, in which case it is removed.
+  void DrainWorkQueue() REQUIRES(mutex_);
+
   // Waits until we caught up (i.e. nothing is waiting to be scheduled), and
-  // all computations have finished.
+  // all computations have finished. Leaves 'optimization_in_progress_' set, so
+  // that no periodic optimization is scheduled before the caller's.
   void WaitForAllComputations() EXCLUDES(mutex_);
 
-  // Runs the optimization. Callers have to make sure, that there is only one
-  // optimization being run at a time.
-  void RunOptimization() EXCLUDES(mutex_);
+  // Runs the optimization with at most 'max_num_iterations'. Callers have to
+  // set 'optimization_in_progress_' first, so that there is only one
+  // optimization being run at a time. Once the problem has been prepared, the
+  // 'work_queue_' is drained and new work items are done while solving.
+  void RunOptimization(int32 max_num_iterations) EXCLUDES(mutex_);
 
   // Updates the trajectory connectivity structure with the new constraints.
   void UpdateTrajectoryConnectivity(
@@ -171,6 +212,11 @@ class SparsePoseGraph : public mapping::SparsePoseGraph {
   mapping::SparsePoseGraph::SubmapData GetSubmapDataUnderLock(
       const mapping::SubmapId& submap_id) REQUIRES(mutex_);
 
+  // Publishes a snapshot of the current state. Chunks of submaps, nodes and
+  // constraints which did not change since the last snapshot are shared with
+  // it, so that publishing after appending a scan does not copy all data.
+  void PublishSnapshot() REQUIRES(mutex_) EXCLUDES(snapshot_mutex_);
+
   const mapping::proto::SparsePoseGraphOptions options_;
   common::Mutex mutex_;
 
@@ -178,6 +224,13 @@ class SparsePoseGraph : public mapping::SparsePoseGraph {
   // considered later.
   std::unique_ptr<std::deque<std::function<void()>>> work_queue_
       GUARDED_BY(mutex_);
+  // When the 'work_queue_' was created and its maximum size, to measure how
+  // long and how much work had to wait.
+  std::chrono::steady_clock::time_point work_queue_start_time_
+      GUARDED_BY(mutex_);
+  size_t max_work_queue_size_ GUARDED_BY(mutex_) = 0;
+  common::Histogram work_queue_latency_histogram_ GUARDED_BY(mutex_);
+  common::Histogram work_queue_size_histogram_ GUARDED_BY(mutex_);
 
   // How our various trajectories are related.
   mapping::TrajectoryConnectivityState trajectory_connectivity_state_;
@@ -192,8 +245,27 @@ class SparsePoseGraph : public mapping::SparsePoseGraph {
   // Whether the optimization has to be run before more data is added.
   bool run_loop_closure_ GUARDED_BY(mutex_) = false;
 
+  // Per trajectory, the first index of submaps and nodes which changed since
+  // the last snapshot was published, and whether constraints were removed by
+  // trimming. Otherwise submaps, nodes and constraints are only appended.
+  std::map<int, int> first_submap_index_changed_since_snapshot_
+      GUARDED_BY(mutex_);
+  std::map<int, int> first_node_index_changed_since_snapshot_
+      GUARDED_BY(mutex_);
+  bool constraints_trimmed_since_snapshot_ GUARDED_BY(mutex_) = false;
+
+  // Only guards the 'snapshot_', so that readers never wait for 'mutex_'.
+  common::Mutex snapshot_mutex_;
+  std::shared_ptr<const Snapshot> snapshot_ GUARDED_BY(snapshot_mutex_);
+
+  // Whether an optimization has been scheduled by HandleWorkQueue(), is
+  // waited for by WaitForAllComputations() or is running. Further
+  // optimizations are only scheduled after it finished.
+  bool optimization_in_progress_ GUARDED_BY(mutex_) = false;
+
   // Current optimization problem.
   sparse_pose_graph::OptimizationProblem optimization_problem_;
+  scan_matching::PrecomputationGridStackCache precomputation_grid_stack_cache_;
   sparse_pose_graph::ConstraintBuilder constraint_builder_ GUARDED_BY(mutex_);
   std::vector<Constraint> constraints_ GUARDED_BY(mutex_);
 
@@ -211,6 +283,14 @@ class SparsePoseGraph : public mapping::SparsePoseGraph {
   std::vector<std::map<int, sparse_pose_graph::SubmapData>>
       optimized_submap_transforms_ GUARDED_BY(mutex_);
 
+  // Finished submaps and nodes by their positions in the
+  // 'optimization_problem_', so that matching in a local search window only
+  // has to consider those nearby. Rebuilt after each optimization.
+  mapping::sparse_pose_graph::SpatialIndex<mapping::SubmapId> submap_index_
+      GUARDED_BY(mutex_);
+  mapping::sparse_pose_graph::SpatialIndex<mapping::NodeId> node_index_
+      GUARDED_BY(mutex_);
+
   // List of all trimmers to consult when optimizations finish.
   std::vector<std::unique_ptr<mapping::PoseGraphTrimmer>> trimmers_
       GUARDED_BY(mutex_);
@@ -44,9 +44,12 @@ transform::Rigid2d ComputeSubmapPose(const Submap& submap) {
 
 ConstraintBuilder::ConstraintBuilder(
     const mapping::sparse_pose_graph::proto::ConstraintBuilderOptions& options,
-    common::ThreadPool* const thread_pool)
+    common::ThreadPool* const thread_pool,
+    scan_matching::PrecomputationGridStackCache* const
+        precomputation_grid_stack_cache)
     : options_(options),
       thread_pool_(thread_pool),
+      precomputation_grid_stack_cache_(precomputation_grid_stack_cache),
       sampler_(options.sampling_ratio()),
       ceres_scan_matcher_(options.ceres_scan_matcher_options()) {}
 
@@ -122,25 +125,26 @@ void ConstraintBuilder::WhenDone(
 void ConstraintBuilder::ScheduleSubmapScanMatcherConstructionAndQueueWorkItem(
     const mapping::SubmapId& submap_id, const ProbabilityGrid* const submap,
     const std::function<void()>& work_item) {
-  if (submap_scan_matchers_[submap_id].fast_correlative_scan_matcher !=
-      nullptr) {
+  if (submap_scan_matchers_.count(submap_id) != 0) {
     thread_pool_->Schedule(work_item);
   } else {
     submap_queued_work_items_[submap_id].push_back(work_item);
     if (submap_queued_work_items_[submap_id].size() == 1) {
+      // Building the scan matcher unblocks all work items queued on it, so it
+      // runs ahead of other matching work.
       thread_pool_->Schedule(
-          [=]() { ConstructSubmapScanMatcher(submap_id, submap); });
+          [=]() { ConstructSubmapScanMatcher(submap_id, submap); },
+          common::ThreadPool::Priority::kHigh);
     }
   }
 }
 
 void ConstraintBuilder::ConstructSubmapScanMatcher(
     const mapping::SubmapId& submap_id, const ProbabilityGrid* const submap) {
-  auto submap_scan_matcher =
-      common::make_unique<scan_matching::FastCorrelativeScanMatcher>(
-          *submap, options_.fast_correlative_scan_matcher_options());
+  precomputation_grid_stack_cache_->GetOrCompute(
+      submap_id, *submap, options_.fast_correlative_scan_matcher_options());
   common::MutexLocker locker(&mutex_);
-  submap_scan_matchers_[submap_id] = {submap, std::move(submap_scan_matcher)};
+  submap_scan_matchers_.insert(submap_id);
   for (const std::function<void()>& work_item :
        submap_queued_work_items_[submap_id]) {
     thread_pool_->Schedule(work_item);
@@ -148,13 +152,18 @@ void ConstraintBuilder::ConstructSubmapScanMatcher(
   submap_queued_work_items_.erase(submap_id);
 }
 
-const ConstraintBuilder::SubmapScanMatcher*
-ConstraintBuilder::GetSubmapScanMatcher(const mapping::SubmapId& submap_id) {
-  common::MutexLocker locker(&mutex_);
-  const SubmapScanMatcher* submap_scan_matcher =
-      &submap_scan_matchers_[submap_id];
-  CHECK(submap_scan_matcher->fast_correlative_scan_matcher != nullptr);
-  return submap_scan_matcher;
+std::unique_ptr<scan_matching::FastCorrelativeScanMatcher>
+ConstraintBuilder::CreateSubmapScanMatcher(
+    const mapping::SubmapId& submap_id, const ProbabilityGrid* const submap) {
+  {
+    common::MutexLocker locker(&mutex_);
+    CHECK_EQ(submap_scan_matchers_.count(submap_id), 1);
+  }
+  return common::make_unique<scan_matching::FastCorrelativeScanMatcher>(
+      *submap,
+      precomputation_grid_stack_cache_->GetOrCompute(
+          submap_id, *submap, options_.fast_correlative_scan_matcher_options()),
+      options_.fast_correlative_scan_matcher_options(), thread_pool_);
 }
 
 void ConstraintBuilder::ComputeConstraint(
@@ -165,8 +174,9 @@ void ConstraintBuilder::ComputeConstraint(
     std::unique_ptr<ConstraintBuilder::Constraint>* constraint) {
   const transform::Rigid2d initial_pose =
       ComputeSubmapPose(*submap) * initial_relative_pose;
-  const SubmapScanMatcher* const submap_scan_matcher =
-      GetSubmapScanMatcher(submap_id);
+  const std::unique_ptr<scan_matching::FastCorrelativeScanMatcher>
+      fast_correlative_scan_matcher =
+          CreateSubmapScanMatcher(submap_id, &submap->probability_grid());
 
   // The 'constraint_transform' (submap i <- scan j) is computed from:
   // - a 'filtered_gravity_aligned_point_cloud' in scan j,
@@ -181,7 +191,7 @@ void ConstraintBuilder::ComputeConstraint(
   // 2. Prune if the score is too low.
   // 3. Refine.
   if (match_full_submap) {
-    if (submap_scan_matcher->fast_correlative_scan_matcher->MatchFullSubmap(
+    if (fast_correlative_scan_matcher->MatchFullSubmap(
             constant_data->filtered_gravity_aligned_point_cloud,
             options_.global_localization_min_score(), &score, &pose_estimate)) {
       CHECK_GT(score, options_.global_localization_min_score());
@@ -191,7 +201,7 @@ void ConstraintBuilder::ComputeConstraint(
       return;
     }
   } else {
-    if (submap_scan_matcher->fast_correlative_scan_matcher->Match(
+    if (fast_correlative_scan_matcher->Match(
             initial_pose, constant_data->filtered_gravity_aligned_point_cloud,
             options_.min_score(), &score, &pose_estimate)) {
       // We've reported a successful local match.
@@ -211,7 +221,7 @@ void ConstraintBuilder::ComputeConstraint(
   ceres::Solver::Summary unused_summary;
   ceres_scan_matcher_.Match(pose_estimate, pose_estimate,
                             constant_data->filtered_gravity_aligned_point_cloud,
-                            *submap_scan_matcher->probability_grid,
+                            submap->probability_grid(),
                             &pose_estimate, &unused_summary);
 
   const transform::Rigid2d constraint_transform =
@@ -262,6 +272,9 @@ void ConstraintBuilder::FinishComputation(const int computation_index) {
           LOG(INFO) << constraints_.size() << " computations resulted in "
                     << result.size() << " additional constraints.";
           LOG(INFO) << "Score histogram:\n" << score_histogram_.ToString(10);
+          LOG(INFO) << "Precomputation grid cache: "
+                    << precomputation_grid_stack_cache_->GetStatistics()
+                           .ToString();
         }
         constraints_.clear();
         callback = std::move(when_done_);
@@ -286,6 +299,7 @@ void ConstraintBuilder::DeleteScanMatcher(const mapping::SubmapId& submap_id) {
   common::MutexLocker locker(&mutex_);
   CHECK(pending_computations_.empty());
   submap_scan_matchers_.erase(submap_id);
+  precomputation_grid_stack_cache_->Erase(submap_id);
 }
 
 }  // namespace sparse_pose_graph
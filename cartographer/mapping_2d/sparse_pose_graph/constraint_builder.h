@@ -21,6 +21,7 @@
 #include <deque>
 #include <functional>
 #include <limits>
+#include <set>
 #include <vector>
 
 #include "Eigen/Core"
@@ -34,6 +35,7 @@
 #include "cartographer/mapping/sparse_pose_graph/proto/constraint_builder_options.pb.h"
 #include "cartographer/mapping_2d/scan_matching/ceres_scan_matcher.h"
 #include "cartographer/mapping_2d/scan_matching/fast_correlative_scan_matcher.h"
+#include "cartographer/mapping_2d/scan_matching/precomputation_grid_stack_cache.h"
 #include "cartographer/mapping_2d/submaps.h"
 #include "cartographer/mapping_3d/scan_matching/ceres_scan_matcher.h"
 #include "cartographer/mapping_3d/scan_matching/fast_correlative_scan_matcher.h"
@@ -55,6 +57,9 @@ transform::Rigid2d ComputeSubmapPose(const Submap& submap);
 // done the 'callback' will be called with the result and another
 // MaybeAdd(Global)Constraint()/WhenDone() cycle can follow.
 //
+// The precomputation grids of the scan matchers are taken from
+// 'precomputation_grid_stack_cache', which must outlive this object.
+//
 // This class is thread-safe.
 class ConstraintBuilder {
  public:
@@ -64,7 +69,9 @@ class ConstraintBuilder {
   ConstraintBuilder(
       const mapping::sparse_pose_graph::proto::ConstraintBuilderOptions&
           options,
-      common::ThreadPool* thread_pool);
+      common::ThreadPool* thread_pool,
+      scan_matching::PrecomputationGridStackCache*
+          precomputation_grid_stack_cache);
   ~ConstraintBuilder();
 
   ConstraintBuilder(const ConstraintBuilder&) = delete;
@@ -107,26 +114,24 @@ class ConstraintBuilder {
   void DeleteScanMatcher(const mapping::SubmapId& submap_id);
 
  private:
-  struct SubmapScanMatcher {
-    const ProbabilityGrid* probability_grid;
-    std::unique_ptr<scan_matching::FastCorrelativeScanMatcher>
-        fast_correlative_scan_matcher;
-  };
-
   // Either schedules the 'work_item', or if needed, schedules the scan matcher
   // construction and queues the 'work_item'.
   void ScheduleSubmapScanMatcherConstructionAndQueueWorkItem(
       const mapping::SubmapId& submap_id, const ProbabilityGrid* submap,
       const std::function<void()>& work_item) REQUIRES(mutex_);
 
-  // Constructs the scan matcher for a 'submap', then schedules its work items.
+  // Computes the precomputation grids for a 'submap' unless they are cached,
+  // then schedules its work items.
   void ConstructSubmapScanMatcher(const mapping::SubmapId& submap_id,
                                   const ProbabilityGrid* submap)
       EXCLUDES(mutex_);
 
-  // Returns the scan matcher for a submap, which has to exist.
-  const SubmapScanMatcher* GetSubmapScanMatcher(
-      const mapping::SubmapId& submap_id) EXCLUDES(mutex_);
+  // Returns a scan matcher for a submap, which has to have been constructed
+  // before. This only recomputes the precomputation grids if they have been
+  // evicted from the cache in the meantime.
+  std::unique_ptr<scan_matching::FastCorrelativeScanMatcher>
+  CreateSubmapScanMatcher(const mapping::SubmapId& submap_id,
+                          const ProbabilityGrid* submap) EXCLUDES(mutex_);
 
   // Runs in a background thread and does computations for an additional
   // constraint, assuming 'submap' and 'compressed_point_cloud' do not change
@@ -144,6 +149,8 @@ class ConstraintBuilder {
 
   const mapping::sparse_pose_graph::proto::ConstraintBuilderOptions options_;
   common::ThreadPool* thread_pool_;
+  scan_matching::PrecomputationGridStackCache* const
+      precomputation_grid_stack_cache_;
   common::Mutex mutex_;
 
   // 'callback' set by WhenDone().
@@ -163,9 +170,8 @@ class ConstraintBuilder {
   // keep pointers valid when adding more entries.
   std::deque<std::unique_ptr<Constraint>> constraints_ GUARDED_BY(mutex_);
 
-  // Map of already constructed scan matchers by 'submap_id'.
-  std::map<mapping::SubmapId, SubmapScanMatcher> submap_scan_matchers_
-      GUARDED_BY(mutex_);
+  // Submaps for which scan matchers have already been constructed.
+  std::set<mapping::SubmapId> submap_scan_matchers_ GUARDED_BY(mutex_);
 
   // Map by 'submap_id' of scan matchers under construction, and the work
   // to do once construction is done.
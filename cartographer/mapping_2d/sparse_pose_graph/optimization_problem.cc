@@ -18,6 +18,7 @@
 
 #include <algorithm>
 #include <array>
+#include <chrono>
 #include <cmath>
 #include <map>
 #include <memory>
@@ -26,6 +27,7 @@
 
 #include "cartographer/common/ceres_solver_options.h"
 #include "cartographer/common/histogram.h"
+#include "cartographer/common/make_unique.h"
 #include "cartographer/common/math.h"
 #include "cartographer/mapping_2d/sparse_pose_graph/spa_cost_function.h"
 #include "cartographer/sensor/odometry_data.h"
@@ -94,8 +96,26 @@ void OptimizationProblem::AddTrajectoryNode(
 }
 
 void OptimizationProblem::TrimTrajectoryNode(const mapping::NodeId& node_id) {
+  CHECK(!solve_prepared_);
   auto& node_data = node_data_.at(node_id.trajectory_id);
   CHECK(node_data.erase(node_id.node_index));
+  if (node_id.trajectory_id <
+      static_cast<int>(ceres_trajectory_data_.size())) {
+    auto& ceres_nodes = ceres_trajectory_data_[node_id.trajectory_id].nodes;
+    const auto it = ceres_nodes.find(node_id.node_index);
+    if (it != ceres_nodes.end()) {
+      RemoveParameterBlock(it->second.data());
+      ceres_nodes.erase(it);
+    }
+  }
+  if (node_id.trajectory_id <
+      static_cast<int>(residual_blocks_without_odometry_.size())) {
+    // The residual blocks to the previous and next node were removed with it.
+    auto& residual_blocks =
+        residual_blocks_without_odometry_[node_id.trajectory_id];
+    residual_blocks.erase(node_id.node_index);
+    residual_blocks.erase(node_id.node_index + 1);
+  }
 
   if (!node_data.empty() &&
       node_id.trajectory_id < static_cast<int>(imu_data_.size())) {
@@ -121,8 +141,19 @@ void OptimizationProblem::AddSubmap(const int trajectory_id,
 }
 
 void OptimizationProblem::TrimSubmap(const mapping::SubmapId& submap_id) {
+  CHECK(!solve_prepared_);
   auto& submap_data = submap_data_.at(submap_id.trajectory_id);
   CHECK(submap_data.erase(submap_id.submap_index));
+  if (submap_id.trajectory_id <
+      static_cast<int>(ceres_trajectory_data_.size())) {
+    auto& ceres_submaps =
+        ceres_trajectory_data_[submap_id.trajectory_id].submaps;
+    const auto it = ceres_submaps.find(submap_id.submap_index);
+    if (it != ceres_submaps.end()) {
+      RemoveParameterBlock(it->second.data());
+      ceres_submaps.erase(it);
+    }
+  }
 }
 
 void OptimizationProblem::SetMaxNumIterations(const int32 max_num_iterations) {
@@ -132,148 +163,294 @@ void OptimizationProblem::SetMaxNumIterations(const int32 max_num_iterations) {
 
 void OptimizationProblem::Solve(const std::vector<Constraint>& constraints,
                                 const std::set<int>& frozen_trajectories) {
+  PrepareSolve(constraints, frozen_trajectories);
+  SolvePrepared();
+  FinishSolve();
+}
+
+void OptimizationProblem::PrepareSolve(
+    const std::vector<Constraint>& constraints,
+    const std::set<int>& frozen_trajectories) {
+  CHECK(!solve_prepared_);
   if (node_data_.empty()) {
     // Nothing to optimize.
     return;
   }
 
-  ceres::Problem::Options problem_options;
-  ceres::Problem problem(problem_options);
+  const auto update_start = std::chrono::steady_clock::now();
+  UpdateProblem(constraints, frozen_trajectories);
+  problem_update_duration_ = std::chrono::steady_clock::now() - update_start;
+  solve_prepared_ = true;
+}
+
+void OptimizationProblem::SolvePrepared() {
+  if (!solve_prepared_) {
+    return;
+  }
+
+  ceres::Solver::Summary summary;
+  ceres::Solve(
+      common::CreateCeresSolverOptions(options_.ceres_solver_options()),
+      problem_.get(), &summary);
+  if (options_.log_solver_summary()) {
+    LOG(INFO) << summary.FullReport();
+    LOG(INFO) << "Updating the problem took "
+              << problem_update_duration_.count() << " s, solving it took "
+              << summary.total_time_in_seconds << " s.";
+  }
+}
 
-  // Set the starting point.
-  // TODO(hrapp): Move ceres data into SubmapData.
-  std::vector<std::map<int, std::array<double, 3>>> C_submaps(
-      submap_data_.size());
-  std::vector<std::map<int, std::array<double, 3>>> C_nodes(node_data_.size());
-  bool first_submap = true;
-  for (size_t trajectory_id = 0; trajectory_id != submap_data_.size();
+void OptimizationProblem::FinishSolve() {
+  if (!solve_prepared_) {
+    return;
+  }
+  solve_prepared_ = false;
+
+  // Store the result.
+  for (size_t trajectory_id = 0; trajectory_id != ceres_trajectory_data_.size();
        ++trajectory_id) {
-    const bool frozen = frozen_trajectories.count(trajectory_id);
-    for (const auto& index_submap_data : submap_data_[trajectory_id]) {
-      const int submap_index = index_submap_data.first;
-      const SubmapData& submap_data = index_submap_data.second;
-
-      C_submaps[trajectory_id].emplace(submap_index,
-                                       FromPose(submap_data.pose));
-      problem.AddParameterBlock(
-          C_submaps[trajectory_id].at(submap_index).data(), 3);
-      if (first_submap || frozen) {
-        first_submap = false;
-        // Fix the pose of the first submap or all submaps of a frozen
-        // trajectory.
-        problem.SetParameterBlockConstant(
-            C_submaps[trajectory_id].at(submap_index).data());
+    const CeresTrajectoryData& ceres_data =
+        ceres_trajectory_data_[trajectory_id];
+    // Submaps and nodes added while solving have not been optimized. They
+    // move along with the last optimized submap.
+    transform::Rigid2d correction = transform::Rigid2d::Identity();
+    if (!ceres_data.submaps.empty()) {
+      const auto& last_submap = *ceres_data.submaps.rbegin();
+      correction =
+          ToPose(last_submap.second) *
+          submap_data_[trajectory_id].at(last_submap.first).pose.inverse();
+    }
+    if (trajectory_id < submap_data_.size()) {
+      for (auto& index_submap_data : submap_data_[trajectory_id]) {
+        transform::Rigid2d& pose = index_submap_data.second.pose;
+        pose = index_submap_data.first < ceres_data.next_submap_index
+                   ? ToPose(ceres_data.submaps.at(index_submap_data.first))
+                   : correction * pose;
+      }
+    }
+    if (trajectory_id < node_data_.size()) {
+      for (auto& index_node_data : node_data_[trajectory_id]) {
+        transform::Rigid2d& pose = index_node_data.second.pose;
+        pose = index_node_data.first < ceres_data.next_node_index
+                   ? ToPose(ceres_data.nodes.at(index_node_data.first))
+                   : correction * pose;
       }
     }
   }
-  for (size_t trajectory_id = 0; trajectory_id != node_data_.size();
+
+  if (!options_.incremental_problem()) {
+    problem_.reset();
+    ceres_trajectory_data_.clear();
+    fixed_submap_id_ = mapping::SubmapId{-1, -1};
+    constraint_residual_blocks_.clear();
+    num_constraints_in_problem_ = 0;
+    residual_blocks_without_odometry_.clear();
+  }
+}
+
+void OptimizationProblem::UpdateProblem(
+    const std::vector<Constraint>& constraints,
+    const std::set<int>& frozen_trajectories) {
+  if (problem_ == nullptr) {
+    ceres::Problem::Options problem_options;
+    // Trimming removes parameter blocks from a persistent problem.
+    problem_options.enable_fast_removal = options_.incremental_problem();
+    problem_ = common::make_unique<ceres::Problem>(problem_options);
+  }
+  ceres_trajectory_data_.resize(
+      std::max(submap_data_.size(), node_data_.size()));
+  residual_blocks_without_odometry_.resize(ceres_trajectory_data_.size());
+
+  // Add the starting points of new submaps and nodes and fix the poses of all
+  // submaps and nodes of frozen trajectories.
+  std::vector<mapping::NodeId> new_node_ids;
+  for (size_t trajectory_id = 0; trajectory_id != ceres_trajectory_data_.size();
        ++trajectory_id) {
+    CeresTrajectoryData& ceres_data = ceres_trajectory_data_[trajectory_id];
     const bool frozen = frozen_trajectories.count(trajectory_id);
-    for (const auto& index_node_data : node_data_[trajectory_id]) {
-      const int node_index = index_node_data.first;
-      const NodeData& node_data = index_node_data.second;
-      C_nodes[trajectory_id].emplace(node_index, FromPose(node_data.pose));
-      problem.AddParameterBlock(C_nodes[trajectory_id].at(node_index).data(),
-                                3);
-      if (frozen) {
-        problem.SetParameterBlockConstant(
-            C_nodes[trajectory_id].at(node_index).data());
+    if (frozen != ceres_data.frozen) {
+      for (auto& index_values : ceres_data.submaps) {
+        SetParameterBlockFrozen(index_values.second.data(), frozen);
+      }
+      for (auto& index_values : ceres_data.nodes) {
+        SetParameterBlockFrozen(index_values.second.data(), frozen);
+      }
+      ceres_data.frozen = frozen;
+    }
+    if (trajectory_id < submap_data_.size()) {
+      for (auto it = submap_data_[trajectory_id].lower_bound(
+               ceres_data.next_submap_index);
+           it != submap_data_[trajectory_id].end(); ++it) {
+        auto& values =
+            ceres_data.submaps.emplace(it->first, FromPose(it->second.pose))
+                .first->second;
+        problem_->AddParameterBlock(values.data(), 3);
+        if (frozen) {
+          problem_->SetParameterBlockConstant(values.data());
+        }
+        ceres_data.next_submap_index = it->first + 1;
+      }
+    }
+    if (trajectory_id < node_data_.size()) {
+      for (auto it = node_data_[trajectory_id].lower_bound(
+               ceres_data.next_node_index);
+           it != node_data_[trajectory_id].end(); ++it) {
+        auto& values =
+            ceres_data.nodes.emplace(it->first, FromPose(it->second.pose))
+                .first->second;
+        problem_->AddParameterBlock(values.data(), 3);
+        if (frozen) {
+          problem_->SetParameterBlockConstant(values.data());
+        }
+        new_node_ids.push_back(
+            mapping::NodeId{static_cast<int>(trajectory_id), it->first});
+        ceres_data.next_node_index = it->first + 1;
       }
     }
   }
-  // Add cost functions for intra- and inter-submap constraints.
-  for (const Constraint& constraint : constraints) {
-    problem.AddResidualBlock(
+
+  // Fix the pose of the first submap.
+  for (size_t trajectory_id = 0; trajectory_id != ceres_trajectory_data_.size();
+       ++trajectory_id) {
+    auto& submaps = ceres_trajectory_data_[trajectory_id].submaps;
+    if (submaps.empty()) {
+      continue;
+    }
+    const mapping::SubmapId first_submap_id{static_cast<int>(trajectory_id),
+                                            submaps.begin()->first};
+    if (first_submap_id != fixed_submap_id_ &&
+        fixed_submap_id_.trajectory_id >= 0) {
+      // The previously fixed submap has been trimmed or now comes after
+      // 'first_submap_id'.
+      CeresTrajectoryData& ceres_data =
+          ceres_trajectory_data_.at(fixed_submap_id_.trajectory_id);
+      const auto it = ceres_data.submaps.find(fixed_submap_id_.submap_index);
+      if (it != ceres_data.submaps.end() && !ceres_data.frozen) {
+        problem_->SetParameterBlockVariable(it->second.data());
+      }
+    }
+    fixed_submap_id_ = first_submap_id;
+    problem_->SetParameterBlockConstant(submaps.begin()->second.data());
+    break;
+  }
+
+  // Add cost functions for new intra- and inter-submap constraints.
+  CHECK_LE(num_constraints_in_problem_, constraints.size());
+  for (auto it = constraints.begin() + num_constraints_in_problem_;
+       it != constraints.end(); ++it) {
+    const Constraint& constraint = *it;
+    constraint_residual_blocks_.insert(problem_->AddResidualBlock(
         new ceres::AutoDiffCostFunction<SpaCostFunction, 3, 3, 3>(
             new SpaCostFunction(constraint.pose)),
         // Only loop closure constraints should have a loss function.
         constraint.tag == Constraint::INTER_SUBMAP
             ? new ceres::HuberLoss(options_.huber_scale())
             : nullptr,
-        C_submaps.at(constraint.submap_id.trajectory_id)
-            .at(constraint.submap_id.submap_index)
+        ceres_trajectory_data_.at(constraint.submap_id.trajectory_id)
+            .submaps.at(constraint.submap_id.submap_index)
             .data(),
-        C_nodes.at(constraint.node_id.trajectory_id)
-            .at(constraint.node_id.node_index)
-            .data());
+        ceres_trajectory_data_.at(constraint.node_id.trajectory_id)
+            .nodes.at(constraint.node_id.node_index)
+            .data()));
   }
+  num_constraints_in_problem_ = constraints.size();
 
   // Add penalties for violating odometry or changes between consecutive scans
   // if odometry is not available.
-  for (size_t trajectory_id = 0; trajectory_id != node_data_.size();
-       ++trajectory_id) {
-    if (node_data_[trajectory_id].empty()) {
-      continue;
-    }
+  UpdateResidualsWithoutOdometry();
+  for (const mapping::NodeId& node_id : new_node_ids) {
+    AddConsecutiveNodeResidual(node_id);
+  }
+}
 
-    for (auto node_it = node_data_[trajectory_id].begin();;) {
-      const int node_index = node_it->first;
-      const NodeData& node_data = node_it->second;
-      ++node_it;
-      if (node_it == node_data_[trajectory_id].end()) {
-        break;
-      }
+void OptimizationProblem::AddConsecutiveNodeResidual(
+    const mapping::NodeId& node_id) {
+  const int trajectory_id = node_id.trajectory_id;
+  auto& ceres_nodes = ceres_trajectory_data_[trajectory_id].nodes;
+  const auto previous_node_it = ceres_nodes.find(node_id.node_index - 1);
+  if (previous_node_it == ceres_nodes.end()) {
+    return;
+  }
 
-      const int next_node_index = node_it->first;
-      const NodeData& next_node_data = node_it->second;
+  const NodeData& node_data =
+      node_data_[trajectory_id].at(previous_node_it->first);
+  const NodeData& next_node_data =
+      node_data_[trajectory_id].at(node_id.node_index);
+  const bool odometry_available =
+      trajectory_id < static_cast<int>(odometry_data_.size()) &&
+      odometry_data_[trajectory_id].Has(next_node_data.time) &&
+      odometry_data_[trajectory_id].Has(node_data.time);
+  const transform::Rigid3d relative_pose =
+      odometry_available
+          ? transform::Rigid3d::Rotation(node_data.gravity_alignment) *
+                odometry_data_[trajectory_id].Lookup(node_data.time).inverse() *
+                odometry_data_[trajectory_id].Lookup(next_node_data.time) *
+                transform::Rigid3d::Rotation(
+                    next_node_data.gravity_alignment.inverse())
+          : transform::Embed3D(node_data.initial_pose.inverse() *
+                               next_node_data.initial_pose);
+  const ceres::ResidualBlockId residual_block = problem_->AddResidualBlock(
+      new ceres::AutoDiffCostFunction<SpaCostFunction, 3, 3, 3>(
+          new SpaCostFunction(Constraint::Pose{
+              relative_pose,
+              options_.consecutive_scan_translation_penalty_factor(),
+              options_.consecutive_scan_rotation_penalty_factor()})),
+      nullptr /* loss function */, previous_node_it->second.data(),
+      ceres_nodes.at(node_id.node_index).data());
+  if (!odometry_available && options_.incremental_problem() &&
+      OdometryMayArrive(trajectory_id, next_node_data.time)) {
+    residual_blocks_without_odometry_[trajectory_id].emplace(
+        node_id.node_index, residual_block);
+  }
+}
 
-      if (next_node_index != node_index + 1) {
-        continue;
+void OptimizationProblem::UpdateResidualsWithoutOdometry() {
+  for (size_t trajectory_id = 0;
+       trajectory_id != residual_blocks_without_odometry_.size();
+       ++trajectory_id) {
+    auto& residual_blocks = residual_blocks_without_odometry_[trajectory_id];
+    // Nodes are added in order of time, so odometry arrives for them in order.
+    while (!residual_blocks.empty()) {
+      const auto it = residual_blocks.begin();
+      const mapping::NodeId node_id{static_cast<int>(trajectory_id),
+                                    it->first};
+      if (OdometryMayArrive(trajectory_id,
+                            node_data_[trajectory_id].at(it->first).time)) {
+        break;
       }
-
-      const bool odometry_available =
-          trajectory_id < odometry_data_.size() &&
-          odometry_data_[trajectory_id].Has(
-              node_data_[trajectory_id][next_node_index].time) &&
-          odometry_data_[trajectory_id].Has(
-              node_data_[trajectory_id][node_index].time);
-      const transform::Rigid3d relative_pose =
-          odometry_available
-              ? transform::Rigid3d::Rotation(node_data.gravity_alignment) *
-                    odometry_data_[trajectory_id]
-                        .Lookup(node_data.time)
-                        .inverse() *
-                    odometry_data_[trajectory_id].Lookup(next_node_data.time) *
-                    transform::Rigid3d::Rotation(
-                        next_node_data.gravity_alignment.inverse())
-              : transform::Embed3D(node_data.initial_pose.inverse() *
-                                   next_node_data.initial_pose);
-      problem.AddResidualBlock(
-          new ceres::AutoDiffCostFunction<SpaCostFunction, 3, 3, 3>(
-              new SpaCostFunction(Constraint::Pose{
-                  relative_pose,
-                  options_.consecutive_scan_translation_penalty_factor(),
-                  options_.consecutive_scan_rotation_penalty_factor()})),
-          nullptr /* loss function */,
-          C_nodes[trajectory_id][node_index].data(),
-          C_nodes[trajectory_id][next_node_index].data());
+      problem_->RemoveResidualBlock(it->second);
+      residual_blocks.erase(it);
+      AddConsecutiveNodeResidual(node_id);
     }
   }
+}
 
-  // Solve.
-  ceres::Solver::Summary summary;
-  ceres::Solve(
-      common::CreateCeresSolverOptions(options_.ceres_solver_options()),
-      &problem, &summary);
-  if (options_.log_solver_summary()) {
-    LOG(INFO) << summary.FullReport();
-  }
+bool OptimizationProblem::OdometryMayArrive(const int trajectory_id,
+                                            const common::Time time) const {
+  return trajectory_id < static_cast<int>(odometry_data_.size()) &&
+         !odometry_data_[trajectory_id].empty() &&
+         odometry_data_[trajectory_id].latest_time() < time;
+}
 
-  // Store the result.
-  for (size_t trajectory_id = 0; trajectory_id != submap_data_.size();
-       ++trajectory_id) {
-    for (auto& index_submap_data : submap_data_[trajectory_id]) {
-      index_submap_data.second.pose =
-          ToPose(C_submaps[trajectory_id].at(index_submap_data.first));
-    }
+void OptimizationProblem::SetParameterBlockFrozen(double* const parameter_block,
+                                                  const bool frozen) {
+  if (frozen) {
+    problem_->SetParameterBlockConstant(parameter_block);
+  } else {
+    problem_->SetParameterBlockVariable(parameter_block);
   }
-  for (size_t trajectory_id = 0; trajectory_id != node_data_.size();
-       ++trajectory_id) {
-    for (auto& index_node_data : node_data_[trajectory_id]) {
-      index_node_data.second.pose =
-          ToPose(C_nodes[trajectory_id].at(index_node_data.first));
+}
+
+void OptimizationProblem::RemoveParameterBlock(double* const parameter_block) {
+  std::vector<ceres::ResidualBlockId> residual_blocks;
+  problem_->GetResidualBlocksForParameterBlock(parameter_block,
+                                               &residual_blocks);
+  for (const ceres::ResidualBlockId residual_block : residual_blocks) {
+    if (constraint_residual_blocks_.erase(residual_block)) {
+      --num_constraints_in_problem_;
     }
   }
+  problem_->RemoveParameterBlock(parameter_block);
 }
 
 const std::vector<std::map<int, NodeData>>& OptimizationProblem::node_data()
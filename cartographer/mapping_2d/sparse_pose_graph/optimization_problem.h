@@ -18,9 +18,12 @@
 #define CARTOGRAPHER_MAPPING_2D_SPARSE_POSE_GRAPH_OPTIMIZATION_PROBLEM_H_
 
 #include <array>
+#include <chrono>
 #include <deque>
 #include <map>
+#include <memory>
 #include <set>
+#include <unordered_set>
 #include <vector>
 
 #include "Eigen/Core"
@@ -32,6 +35,7 @@
 #include "cartographer/sensor/imu_data.h"
 #include "cartographer/sensor/odometry_data.h"
 #include "cartographer/transform/transform_interpolation_buffer.h"
+#include "ceres/ceres.h"
 
 namespace cartographer {
 namespace mapping_2d {
@@ -74,10 +78,22 @@ class OptimizationProblem {
 
   void SetMaxNumIterations(int32 max_num_iterations);
 
-  // Computes the optimized poses.
+  // Computes the optimized poses. If 'options.incremental_problem()' is set,
+  // 'constraints' must be the constraints passed to the last call, minus those
+  // involving trimmed submaps or nodes, followed by new ones.
   void Solve(const std::vector<Constraint>& constraints,
              const std::set<int>& frozen_trajectories);
 
+  // Solve() split into three steps. Only SolvePrepared() is time consuming.
+  // While it runs, other threads may add data, but nothing may be trimmed.
+  // FinishSolve() stores the optimized poses and moves submaps and nodes added
+  // since PrepareSolve() along with the last optimized submap of their
+  // trajectory.
+  void PrepareSolve(const std::vector<Constraint>& constraints,
+                    const std::set<int>& frozen_trajectories);
+  void SolvePrepared();
+  void FinishSolve();
+
   const std::vector<std::map<int, NodeData>>& node_data() const;
   const std::vector<std::map<int, SubmapData>>& submap_data() const;
 
@@ -87,12 +103,57 @@ class OptimizationProblem {
     int next_submap_index = 0;
     int next_node_index = 0;
   };
+
+  // Parameter blocks of one trajectory in 'problem_'.
+  struct CeresTrajectoryData {
+    std::map<int, std::array<double, 3>> submaps;
+    std::map<int, std::array<double, 3>> nodes;
+    // Submaps and nodes with lower indices have already been added.
+    int next_submap_index = 0;
+    int next_node_index = 0;
+    bool frozen = false;
+  };
+
+  // Adds the parameter blocks and residual blocks which are not yet part of
+  // 'problem_', creating it if necessary.
+  void UpdateProblem(const std::vector<Constraint>& constraints,
+                     const std::set<int>& frozen_trajectories);
+  // Adds the residual between the node before 'node_id' and 'node_id' based on
+  // odometry or, if it is not available, on the local SLAM poses.
+  void AddConsecutiveNodeResidual(const mapping::NodeId& node_id);
+  // Replaces residuals added without odometry once odometry covering them
+  // arrived.
+  void UpdateResidualsWithoutOdometry();
+  // Returns true if 'trajectory_id' has odometry, but not yet up to 'time'.
+  bool OdometryMayArrive(int trajectory_id, common::Time time) const;
+  void SetParameterBlockFrozen(double* parameter_block, bool frozen);
+  // Removes 'parameter_block' and all residual blocks depending on it from
+  // 'problem_'.
+  void RemoveParameterBlock(double* parameter_block);
+
   mapping::sparse_pose_graph::proto::OptimizationProblemOptions options_;
   std::vector<std::deque<sensor::ImuData>> imu_data_;
   std::vector<std::map<int, NodeData>> node_data_;
   std::vector<transform::TransformInterpolationBuffer> odometry_data_;
   std::vector<std::map<int, SubmapData>> submap_data_;
   std::vector<TrajectoryData> trajectory_data_;
+
+  // Unless 'options_.incremental_problem()' is set, the Ceres problem only
+  // exists from PrepareSolve() to FinishSolve().
+  std::unique_ptr<ceres::Problem> problem_;
+  std::vector<CeresTrajectoryData> ceres_trajectory_data_;
+  mapping::SubmapId fixed_submap_id_{-1, -1};
+  // Residual blocks in 'problem_' for the first 'num_constraints_in_problem_'
+  // constraints.
+  std::unordered_set<ceres::ResidualBlockId> constraint_residual_blocks_;
+  size_t num_constraints_in_problem_ = 0;
+  // Residual blocks between consecutive nodes of a persistent 'problem_' that
+  // were added before odometry for them arrived, by trajectory and index of the
+  // later node.
+  std::vector<std::map<int, ceres::ResidualBlockId>>
+      residual_blocks_without_odometry_;
+  bool solve_prepared_ = false;
+  std::chrono::duration<double> problem_update_duration_;
 };
 
 }  // namespace sparse_pose_graph
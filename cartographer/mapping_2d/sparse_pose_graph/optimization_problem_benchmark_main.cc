@@ -0,0 +1,259 @@
+/*
+ * Copyright 2017 The Cartographer Authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Measures Solve() of the 2D OptimizationProblem as the pose graph of a robot
+// driving laps grows, with the Ceres problem rebuilt for every solve and with
+// it kept between solves ('incremental_problem'). Local SLAM drifts, and every
+// few nodes are matched against the submaps of earlier laps.
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <set>
+#include <vector>
+
+#include "Eigen/Core"
+#include "Eigen/Geometry"
+#include "cartographer/common/config.h"
+#include "cartographer/common/configuration_file_resolver.h"
+#include "cartographer/common/lua_parameter_dictionary.h"
+#include "cartographer/common/make_unique.h"
+#include "cartographer/common/time.h"
+#include "cartographer/mapping/sparse_pose_graph/optimization_problem_options.h"
+#include "cartographer/mapping_2d/sparse_pose_graph/optimization_problem.h"
+#include "cartographer/sensor/odometry_data.h"
+#include "cartographer/transform/rigid_transform.h"
+#include "cartographer/transform/transform.h"
+#include "gflags/gflags.h"
+#include "glog/logging.h"
+
+DEFINE_int32(num_nodes, 3000, "Number of nodes to add to the pose graph.");
+DEFINE_int32(optimize_every_n_nodes, 90,
+             "Number of nodes added between solves.");
+DEFINE_int32(nodes_per_lap, 200, "Number of nodes of each lap.");
+DEFINE_int32(loop_closure_every_n_nodes, 5,
+             "Every how many nodes, from the second lap on, a node is matched "
+             "against the submaps of earlier laps.");
+
+namespace cartographer {
+namespace mapping_2d {
+namespace sparse_pose_graph {
+namespace {
+
+using Constraint = OptimizationProblem::Constraint;
+
+// Nodes are inserted into two submaps, and a submap is started every
+// 'kNodesPerSubmap' nodes, as with the default 'num_range_data' of 90.
+constexpr int kNodesPerSubmap = 45;
+
+double SecondsSince(const std::chrono::steady_clock::time_point start) {
+  const std::chrono::duration<double> elapsed =
+      std::chrono::steady_clock::now() - start;
+  return elapsed.count();
+}
+
+mapping::sparse_pose_graph::proto::OptimizationProblemOptions LoadOptions(
+    const bool incremental_problem) {
+  const string kCode = R"text(
+      include "sparse_pose_graph.lua"
+      SPARSE_POSE_GRAPH.optimization_problem.log_solver_summary = false
+      return SPARSE_POSE_GRAPH.optimization_problem)text";
+  common::LuaParameterDictionary parameter_dictionary(
+      kCode, common::make_unique<common::ConfigurationFileResolver>(
+                 std::vector<string>{string(common::kSourceDirectory) +
+                                     "/configuration_files"}));
+  auto options = mapping::sparse_pose_graph::CreateOptimizationProblemOptions(
+      &parameter_dictionary);
+  options.set_incremental_problem(incremental_problem);
+  return options;
+}
+
+// Returns the pose of node 'index' on laps around a 16 m x 8 m ellipse.
+transform::Rigid2d PoseOnLap(const int index) {
+  const double angle = 2. * M_PI * index / FLAGS_nodes_per_lap;
+  return transform::Rigid2d({8. * std::cos(angle), 4. * std::sin(angle)},
+                            angle + M_PI / 2.);
+}
+
+common::Time NodeTime(const int index) {
+  return common::FromUniversal(0) + common::FromSeconds(0.1 * index);
+}
+
+// The input of the optimization problem, identical for both modes.
+struct PoseGraph {
+  std::vector<transform::Rigid2d> local_poses;
+  // Indices of the nodes which started each submap.
+  std::vector<int> submap_origins;
+  // Constraints which are known once a node was added, in order.
+  std::vector<std::vector<Constraint>> constraints_by_node;
+};
+
+PoseGraph GeneratePoseGraph() {
+  std::mt19937 prng(42);
+  std::normal_distribution<double> drift(0., 2e-3);
+  std::normal_distribution<double> noise(0., 1e-2);
+  PoseGraph pose_graph;
+  transform::Rigid2d accumulated_drift = transform::Rigid2d::Identity();
+  for (int j = 0; j != FLAGS_num_nodes; ++j) {
+    accumulated_drift =
+        transform::Rigid2d({drift(prng), drift(prng)}, drift(prng)) *
+        accumulated_drift;
+    pose_graph.local_poses.push_back(accumulated_drift * PoseOnLap(j));
+    if (j % kNodesPerSubmap == 0) {
+      pose_graph.submap_origins.push_back(j);
+    }
+    std::vector<Constraint> constraints;
+    const int submap_index = j / kNodesPerSubmap;
+    for (int i = std::max(0, submap_index - 1); i <= submap_index; ++i) {
+      const int origin = pose_graph.submap_origins[i];
+      constraints.push_back(Constraint{
+          mapping::SubmapId{0, i}, mapping::NodeId{0, j},
+          {transform::Embed3D(pose_graph.local_poses[origin].inverse() *
+                              pose_graph.local_poses[j]),
+           5e2, 1.6e3},
+          Constraint::INTRA_SUBMAP});
+    }
+    if (j >= FLAGS_nodes_per_lap && j % FLAGS_loop_closure_every_n_nodes == 0) {
+      // Match against the submap of the previous lap at the same place.
+      const int i = (j - FLAGS_nodes_per_lap) / kNodesPerSubmap;
+      const int origin = pose_graph.submap_origins[i];
+      const transform::Rigid2d noisy_relative_pose =
+          transform::Rigid2d({noise(prng), noise(prng)}, noise(prng)) *
+          PoseOnLap(origin).inverse() * PoseOnLap(j);
+      constraints.push_back(Constraint{
+          mapping::SubmapId{0, i}, mapping::NodeId{0, j},
+          {transform::Embed3D(noisy_relative_pose), 1.1e4, 1e5},
+          Constraint::INTER_SUBMAP});
+    }
+    pose_graph.constraints_by_node.push_back(constraints);
+  }
+  return pose_graph;
+}
+
+struct Result {
+  std::vector<double> solve_seconds;
+  std::vector<transform::Rigid2d> node_poses;
+};
+
+// Adds the nodes of 'pose_graph' one by one and solves every
+// 'FLAGS_optimize_every_n_nodes' nodes and after the last one.
+Result Benchmark(const PoseGraph& pose_graph, const bool incremental_problem) {
+  OptimizationProblem optimization_problem(LoadOptions(incremental_problem));
+  const std::set<int> kFrozen;
+  std::vector<Constraint> constraints;
+  Result result;
+  for (int j = 0; j != FLAGS_num_nodes; ++j) {
+    const transform::Rigid2d& local_pose = pose_graph.local_poses[j];
+    const int submap_index = j / kNodesPerSubmap;
+    if (j % kNodesPerSubmap == 0) {
+      // New submaps are placed relative to the last optimized one, like
+      // the SparsePoseGraph does.
+      transform::Rigid2d global_pose = local_pose;
+      if (submap_index > 0) {
+        global_pose =
+            optimization_problem.submap_data().at(0).at(submap_index - 1).pose *
+            pose_graph.local_poses[pose_graph.submap_origins[submap_index - 1]]
+                .inverse() *
+            local_pose;
+      }
+      optimization_problem.AddSubmap(0, global_pose);
+    }
+    const int origin = pose_graph.submap_origins[submap_index];
+    const transform::Rigid2d global_pose =
+        optimization_problem.submap_data().at(0).at(submap_index).pose *
+        pose_graph.local_poses[origin].inverse() * local_pose;
+    optimization_problem.AddOdometerData(
+        0, sensor::OdometryData{NodeTime(j), transform::Embed3D(local_pose)});
+    optimization_problem.AddTrajectoryNode(0, NodeTime(j), local_pose,
+                                           global_pose,
+                                           Eigen::Quaterniond::Identity());
+    constraints.insert(constraints.end(),
+                       pose_graph.constraints_by_node[j].begin(),
+                       pose_graph.constraints_by_node[j].end());
+    if ((j + 1) % FLAGS_optimize_every_n_nodes == 0 ||
+        j + 1 == FLAGS_num_nodes) {
+      const auto start = std::chrono::steady_clock::now();
+      optimization_problem.Solve(constraints, kFrozen);
+      result.solve_seconds.push_back(SecondsSince(start));
+    }
+  }
+  for (const auto& node : optimization_problem.node_data().at(0)) {
+    result.node_poses.push_back(node.second.pose);
+  }
+  return result;
+}
+
+void PrintResult(const string& name, const Result& result) {
+  double total_seconds = 0.;
+  for (const double seconds : result.solve_seconds) {
+    total_seconds += seconds;
+  }
+  std::cout << "  " << name << ": "
+            << 1e3 * total_seconds / result.solve_seconds.size()
+            << " ms per solve on average, "
+            << 1e3 * result.solve_seconds.back() << " ms for the last solve\n";
+}
+
+void Run() {
+  CHECK_GT(FLAGS_num_nodes, 0);
+  CHECK_GT(FLAGS_optimize_every_n_nodes, 0);
+  CHECK_GE(FLAGS_nodes_per_lap, kNodesPerSubmap);
+  CHECK_GT(FLAGS_loop_closure_every_n_nodes, 0);
+  const PoseGraph pose_graph = GeneratePoseGraph();
+  int num_constraints = 0;
+  for (const auto& constraints : pose_graph.constraints_by_node) {
+    num_constraints += constraints.size();
+  }
+  const Result rebuilt_result = Benchmark(pose_graph, false);
+  const Result incremental_result = Benchmark(pose_graph, true);
+
+  // The problems only differ in the state Ceres starts from, so the results
+  // should be close.
+  double max_translation_difference = 0.;
+  for (size_t j = 0; j != rebuilt_result.node_poses.size(); ++j) {
+    max_translation_difference = std::max(
+        max_translation_difference,
+        (rebuilt_result.node_poses[j].translation() -
+         incremental_result.node_poses[j].translation())
+            .norm());
+  }
+  std::cout << FLAGS_num_nodes << " nodes, " << pose_graph.submap_origins.size()
+            << " submaps, " << num_constraints << " constraints, "
+            << rebuilt_result.solve_seconds.size() << " solves\n";
+  PrintResult("Problem rebuilt for every solve", rebuilt_result);
+  PrintResult("incremental_problem", incremental_result);
+  std::cout << "  Node poses differ by at most " << max_translation_difference
+            << " m\n";
+}
+
+}  // namespace
+}  // namespace sparse_pose_graph
+}  // namespace mapping_2d
+}  // namespace cartographer
+
+int main(int argc, char** argv) {
+  google::InitGoogleLogging(argv[0]);
+  FLAGS_logtostderr = true;
+  google::SetUsageMessage(
+      "\n\n"
+      "Benchmarks solving the 2D pose graph with and without keeping the "
+      "Ceres\nproblem between solves.\n");
+  google::ParseCommandLineFlags(&argc, &argv, true);
+  ::cartographer::mapping_2d::sparse_pose_graph::Run();
+}
@@ -0,0 +1,243 @@
+/*
+ * Copyright 2017 The Cartographer Authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Measures how readers of the SparsePoseGraph, as visualization and pose
+// publishers are, contend with mapping. A robot drives laps through a
+// simulated hall while reader threads either copy the pose graph through the
+// copying accessors or take shared snapshots.
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "Eigen/Core"
+#include "cartographer/common/config.h"
+#include "cartographer/common/configuration_file_resolver.h"
+#include "cartographer/common/lua_parameter_dictionary.h"
+#include "cartographer/common/make_unique.h"
+#include "cartographer/common/thread_pool.h"
+#include "cartographer/common/time.h"
+#include "cartographer/mapping/sparse_pose_graph.h"
+#include "cartographer/mapping_2d/sparse_pose_graph.h"
+#include "cartographer/mapping_2d/submaps.h"
+#include "cartographer/sensor/range_data.h"
+#include "cartographer/transform/rigid_transform.h"
+#include "cartographer/transform/transform.h"
+#include "gflags/gflags.h"
+#include "glog/logging.h"
+
+DEFINE_int32(num_scans, 1000, "Number of scans to add to the pose graph.");
+DEFINE_int32(num_readers, 2, "Number of reader threads.");
+DEFINE_int32(reader_period_ms, 10,
+             "Milliseconds each reader waits between reads.");
+DEFINE_int32(num_threads, 4, "Number of threads of the background pool.");
+
+namespace cartographer {
+namespace mapping_2d {
+namespace {
+
+double SecondsSince(const std::chrono::steady_clock::time_point start) {
+  const std::chrono::duration<double> elapsed =
+      std::chrono::steady_clock::now() - start;
+  return elapsed.count();
+}
+
+std::unique_ptr<common::LuaParameterDictionary> LoadOptions() {
+  const string kCode = R"text(
+      include "sparse_pose_graph.lua"
+      include "trajectory_builder_2d.lua"
+      SPARSE_POSE_GRAPH.constraint_builder.log_matches = false
+      SPARSE_POSE_GRAPH.optimization_problem.log_solver_summary = false
+      return {
+        sparse_pose_graph = SPARSE_POSE_GRAPH,
+        submaps = TRAJECTORY_BUILDER_2D.submaps,
+      })text";
+  return common::make_unique<common::LuaParameterDictionary>(
+      kCode, common::make_unique<common::ConfigurationFileResolver>(
+                 std::vector<string>{string(common::kSourceDirectory) +
+                                     "/configuration_files"}));
+}
+
+// Returns the pose on the 'index'th scan of laps around a 16 m x 8 m ellipse.
+transform::Rigid2d PoseOnLap(const int index) {
+  const double angle = 2. * M_PI * index / 200.;
+  return transform::Rigid2d({8. * std::cos(angle), 4. * std::sin(angle)},
+                            angle + M_PI / 2.);
+}
+
+// Returns a scan of a 40 m x 20 m hall with a pillar in each quadrant taken
+// at 'pose', in the frame of 'pose'.
+sensor::PointCloud SimulateScan(const transform::Rigid2d& pose) {
+  const std::vector<Eigen::Vector2d> pillars = {
+      {-10., -5.}, {-10., 5.}, {10., -5.}, {12., 5.}};
+  sensor::PointCloud point_cloud;
+  for (int i = 0; i != 720; ++i) {
+    // Rays are offset by half a step so that none is parallel to a wall.
+    const double angle = 2. * M_PI * (i + 0.5) / 720.;
+    const Eigen::Vector2d direction =
+        pose.rotation() * Eigen::Vector2d(std::cos(angle), std::sin(angle));
+    // Distance to the first wall in 'direction'.
+    const Eigen::Array2d distances =
+        ((direction.array() > 0.)
+             .select(Eigen::Array2d(20., 10.), Eigen::Array2d(-20., -10.)) -
+         pose.translation().array()) /
+        direction.array();
+    double range = distances.minCoeff();
+    // Pillars are 1 m wide cylinders.
+    for (const Eigen::Vector2d& pillar : pillars) {
+      const Eigen::Vector2d to_pillar = pillar - pose.translation();
+      const double along = to_pillar.dot(direction);
+      const double across_squared = to_pillar.squaredNorm() - along * along;
+      if (along > 0. && across_squared < 0.25) {
+        range = std::min(range, along - std::sqrt(0.25 - across_squared));
+      }
+    }
+    const Eigen::Vector2d point = range * Eigen::Vector2d(std::cos(angle),
+                                                          std::sin(angle));
+    point_cloud.emplace_back(point.x(), point.y(), 0.f);
+  }
+  return point_cloud;
+}
+
+struct Result {
+  double max_add_scan_seconds = 0.;
+  double total_add_scan_seconds = 0.;
+  int num_reads = 0;
+  double total_read_seconds = 0.;
+};
+
+// Maps 'FLAGS_num_scans' scans while 'read' is called by the readers.
+template <typename ReadFunction>
+Result RunMapping(const ReadFunction& read) {
+  auto options = LoadOptions();
+  ActiveSubmaps active_submaps(
+      CreateSubmapsOptions(options->GetDictionary("submaps").get()));
+  common::ThreadPool thread_pool(FLAGS_num_threads);
+  SparsePoseGraph sparse_pose_graph(
+      mapping::CreateSparsePoseGraphOptions(
+          options->GetDictionary("sparse_pose_graph").get()),
+      &thread_pool);
+
+  Result result;
+  std::atomic<bool> done(false);
+  std::vector<Result> reader_results(FLAGS_num_readers);
+  std::vector<std::thread> readers;
+  for (int i = 0; i != FLAGS_num_readers; ++i) {
+    readers.emplace_back([&, i]() {
+      while (!done) {
+        const auto start = std::chrono::steady_clock::now();
+        read(&sparse_pose_graph);
+        reader_results[i].total_read_seconds += SecondsSince(start);
+        ++reader_results[i].num_reads;
+        std::this_thread::sleep_for(
+            std::chrono::milliseconds(FLAGS_reader_period_ms));
+      }
+    });
+  }
+
+  for (int i = 0; i != FLAGS_num_scans; ++i) {
+    const transform::Rigid2d pose = PoseOnLap(i);
+    const sensor::RangeData range_data{
+        Eigen::Vector3f::Zero(), SimulateScan(pose), {}};
+    active_submaps.InsertRangeData(sensor::TransformRangeData(
+        range_data, transform::Embed3D(pose.cast<float>())));
+    std::vector<std::shared_ptr<const Submap>> insertion_submaps;
+    for (const auto& submap : active_submaps.submaps()) {
+      insertion_submaps.push_back(submap);
+    }
+    const auto start = std::chrono::steady_clock::now();
+    sparse_pose_graph.AddScan(
+        std::make_shared<const mapping::TrajectoryNode::Data>(
+            mapping::TrajectoryNode::Data{
+                common::FromUniversal(0) + common::FromSeconds(0.1 * i),
+                Eigen::Quaterniond::Identity(),
+                range_data.returns,
+                {},
+                {},
+                {}}),
+        transform::Embed3D(pose), 0 /* trajectory_id */, insertion_submaps);
+    const double seconds = SecondsSince(start);
+    result.total_add_scan_seconds += seconds;
+    result.max_add_scan_seconds =
+        std::max(result.max_add_scan_seconds, seconds);
+  }
+  done = true;
+  for (std::thread& reader : readers) {
+    reader.join();
+  }
+  sparse_pose_graph.RunFinalOptimization();
+
+  for (const Result& reader_result : reader_results) {
+    result.num_reads += reader_result.num_reads;
+    result.total_read_seconds += reader_result.total_read_seconds;
+  }
+  return result;
+}
+
+void PrintResult(const string& name, const Result& result) {
+  std::cout << name << ":\n"
+            << "  AddScan(): "
+            << 1e3 * result.total_add_scan_seconds / FLAGS_num_scans
+            << " ms on average, " << 1e3 * result.max_add_scan_seconds
+            << " ms at most\n"
+            << "  " << result.num_reads << " reads: "
+            << 1e3 * result.total_read_seconds /
+                   std::max(result.num_reads, 1)
+            << " ms per read\n";
+}
+
+void Run() {
+  CHECK_GT(FLAGS_num_scans, 0);
+  CHECK_GE(FLAGS_num_readers, 0);
+  // Keeps the reads from being optimized away. Readers add to it concurrently.
+  std::atomic<size_t> checksum(0);
+  const Result copying_result =
+      RunMapping([&checksum](mapping::SparsePoseGraph* sparse_pose_graph) {
+        checksum += sparse_pose_graph->GetAllSubmapData().size() +
+                    sparse_pose_graph->GetTrajectoryNodes().size() +
+                    sparse_pose_graph->constraints().size();
+      });
+  const Result snapshot_result =
+      RunMapping([&checksum](mapping::SparsePoseGraph* sparse_pose_graph) {
+        const auto snapshot = sparse_pose_graph->GetSnapshot();
+        checksum += snapshot->submap_data.size() +
+                    snapshot->trajectory_nodes.size() +
+                    snapshot->constraints.size();
+      });
+  std::cout << FLAGS_num_scans << " scans with " << FLAGS_num_readers
+            << " readers (checksum " << checksum << ")\n";
+  PrintResult("copying accessors", copying_result);
+  PrintResult("GetSnapshot()", snapshot_result);
+}
+
+}  // namespace
+}  // namespace mapping_2d
+}  // namespace cartographer
+
+int main(int argc, char** argv) {
+  google::InitGoogleLogging(argv[0]);
+  FLAGS_logtostderr = true;
+  google::SetUsageMessage(
+      "\n\n"
+      "Benchmarks readers of the SparsePoseGraph concurrently with mapping.\n");
+  google::ParseCommandLineFlags(&argc, &argv, true);
+  ::cartographer::mapping_2d::Run();
+}
@@ -16,14 +16,20 @@
 
 #include "cartographer/mapping_2d/sparse_pose_graph.h"
 
+#include <algorithm>
+#include <atomic>
 #include <cmath>
 #include <memory>
 #include <random>
+#include <string>
+#include <thread>
 
 #include "cartographer/common/lua_parameter_dictionary_test_helpers.h"
 #include "cartographer/common/make_unique.h"
+#include "cartographer/common/mutex.h"
 #include "cartographer/common/thread_pool.h"
 #include "cartographer/common/time.h"
+#include "cartographer/mapping/pose_graph_trimmer.h"
 #include "cartographer/mapping_2d/range_data_inserter.h"
 #include "cartographer/mapping_2d/submaps.h"
 #include "cartographer/transform/rigid_transform.h"
@@ -35,7 +41,8 @@ namespace cartographer {
 namespace mapping_2d {
 namespace {
 
-class SparsePoseGraphTest : public ::testing::Test {
+// The parameter selects whether the Ceres problem is kept between solves.
+class SparsePoseGraphTest : public ::testing::TestWithParam<bool> {
  protected:
   SparsePoseGraphTest() : thread_pool_(1) {
     // Builds a wavy, irregularly circular point cloud that is unique
@@ -52,10 +59,12 @@ class SparsePoseGraphTest : public ::testing::Test {
           return {
             resolution = 0.05,
             num_range_data = 1,
+            quantize_finished_submaps = false,
             range_data_inserter = {
               insert_free_space = true,
               hit_probability = 0.53,
               miss_probability = 0.495,
+              num_threads = 1,
             },
           })text");
       active_submaps_ = common::make_unique<ActiveSubmaps>(
@@ -63,7 +72,9 @@ class SparsePoseGraphTest : public ::testing::Test {
     }
 
     {
-      auto parameter_dictionary = common::MakeDictionary(R"text(
+      const std::string incremental_problem = GetParam() ? "true" : "false";
+      auto parameter_dictionary = common::MakeDictionary(
+          R"text(
           return {
             optimize_every_n_scans = 1000,
             constraint_builder = {
@@ -74,15 +85,19 @@ class SparsePoseGraphTest : public ::testing::Test {
               loop_closure_translation_weight = 1.,
               loop_closure_rotation_weight = 1.,
               log_matches = true,
+              precomputation_grid_cache_size_in_mb = 64,
+              serialize_precomputation_grids = false,
               fast_correlative_scan_matcher = {
                 linear_search_window = 3.,
                 angular_search_window = 0.1,
                 branch_and_bound_depth = 3,
+                parallel_branch_and_bound = false,
               },
               ceres_scan_matcher = {
                 occupied_space_weight = 20.,
                 translation_weight = 10.,
                 rotation_weight = 1.,
+                use_analytic_occupied_space_cost = false,
                 ceres_solver_options = {
                   use_nonmonotonic_steps = true,
                   max_num_iterations = 50,
@@ -97,6 +112,7 @@ class SparsePoseGraphTest : public ::testing::Test {
                 linear_xy_search_window = 4.,
                 linear_z_search_window = 4.,
                 angular_search_window = 0.1,
+                parallel_branch_and_bound = false,
               },
               ceres_scan_matcher_3d = {
                 occupied_space_weight_0 = 20.,
@@ -121,6 +137,8 @@ class SparsePoseGraphTest : public ::testing::Test {
               fixed_frame_pose_translation_weight = 1e1,
               fixed_frame_pose_rotation_weight = 1e2,
               log_solver_summary = true,
+              incremental_problem = )text" +
+          incremental_problem + R"text(,
               ceres_solver_options = {
                 use_nonmonotonic_steps = false,
                 max_num_iterations = 200,
@@ -132,9 +150,10 @@ class SparsePoseGraphTest : public ::testing::Test {
             log_residual_histograms = true,
             global_constraint_search_after_n_seconds = 10.0,
           })text");
+      sparse_pose_graph_options_ =
+          mapping::CreateSparsePoseGraphOptions(parameter_dictionary.get());
       sparse_pose_graph_ = common::make_unique<SparsePoseGraph>(
-          mapping::CreateSparsePoseGraphOptions(parameter_dictionary.get()),
-          &thread_pool_);
+          sparse_pose_graph_options_, &thread_pool_);
     }
 
     current_pose_ = transform::Rigid2d::Identity();
@@ -172,20 +191,67 @@ class SparsePoseGraphTest : public ::testing::Test {
     MoveRelativeWithNoise(movement, transform::Rigid2d::Identity());
   }
 
+  // Returns whether a loop closure was found between the node with
+  // 'node_index' and a submap in ['begin_submap_index', 'end_submap_index').
+  bool HasInterSubmapConstraint(const int node_index,
+                                const int begin_submap_index,
+                                const int end_submap_index) {
+    const auto snapshot = sparse_pose_graph_->GetSnapshot();
+    return std::any_of(
+        snapshot->constraints.begin(), snapshot->constraints.end(),
+        [=](const mapping::SparsePoseGraph::Constraint& constraint) {
+          return constraint.tag ==
+                     mapping::SparsePoseGraph::Constraint::INTER_SUBMAP &&
+                 constraint.node_id.trajectory_id == 0 &&
+                 constraint.node_id.node_index == node_index &&
+                 constraint.submap_id.trajectory_id == 0 &&
+                 constraint.submap_id.submap_index >= begin_submap_index &&
+                 constraint.submap_id.submap_index < end_submap_index;
+        });
+  }
+
+  // Occupies the only thread of the 'thread_pool_' until ReleaseThreadPool()
+  // is called. Constraint computations and the optimizations started from the
+  // thread pool are held up in the meantime.
+  void BlockThreadPool() {
+    common::MutexLocker locker(&thread_pool_block_mutex_);
+    thread_pool_blocked_ = false;
+    thread_pool_released_ = false;
+    thread_pool_.Schedule([this]() {
+      {
+        // Waiters are only notified when the lock is released.
+        common::MutexLocker locker(&thread_pool_block_mutex_);
+        thread_pool_blocked_ = true;
+      }
+      common::MutexLocker locker(&thread_pool_block_mutex_);
+      locker.Await([this]() { return thread_pool_released_; });
+    });
+    locker.Await([this]() { return thread_pool_blocked_; });
+  }
+
+  void ReleaseThreadPool() {
+    common::MutexLocker locker(&thread_pool_block_mutex_);
+    thread_pool_released_ = true;
+  }
+
   sensor::PointCloud point_cloud_;
   std::unique_ptr<ActiveSubmaps> active_submaps_;
+  common::Mutex thread_pool_block_mutex_;
+  bool thread_pool_blocked_ = false;
+  bool thread_pool_released_ = false;
   common::ThreadPool thread_pool_;
+  mapping::proto::SparsePoseGraphOptions sparse_pose_graph_options_;
   std::unique_ptr<SparsePoseGraph> sparse_pose_graph_;
   transform::Rigid2d current_pose_;
 };
 
-TEST_F(SparsePoseGraphTest, EmptyMap) {
+TEST_P(SparsePoseGraphTest, EmptyMap) {
   sparse_pose_graph_->RunFinalOptimization();
   const auto nodes = sparse_pose_graph_->GetTrajectoryNodes();
   EXPECT_THAT(nodes.size(), ::testing::Eq(0u));
 }
 
-TEST_F(SparsePoseGraphTest, NoMovement) {
+TEST_P(SparsePoseGraphTest, NoMovement) {
   MoveRelative(transform::Rigid2d::Identity());
   MoveRelative(transform::Rigid2d::Identity());
   MoveRelative(transform::Rigid2d::Identity());
@@ -201,7 +267,89 @@ TEST_F(SparsePoseGraphTest, NoMovement) {
               transform::IsNearly(transform::Rigid3d::Identity(), 1e-2));
 }
 
-TEST_F(SparsePoseGraphTest, NoOverlappingScans) {
+TEST_P(SparsePoseGraphTest, SnapshotIsSharedUntilChanged) {
+  MoveRelative(transform::Rigid2d::Identity());
+  sparse_pose_graph_->RunFinalOptimization();
+  const auto snapshot = sparse_pose_graph_->GetSnapshot();
+  EXPECT_EQ(snapshot, sparse_pose_graph_->GetSnapshot());
+  ASSERT_THAT(snapshot->trajectory_nodes.size(), ::testing::Eq(1u));
+  EXPECT_THAT(snapshot->trajectory_nodes[0].size(), ::testing::Eq(1u));
+  EXPECT_THAT(snapshot->submap_data.size(), ::testing::Eq(1u));
+
+  MoveRelative(transform::Rigid2d::Identity());
+  sparse_pose_graph_->RunFinalOptimization();
+  const auto new_snapshot = sparse_pose_graph_->GetSnapshot();
+  EXPECT_NE(snapshot, new_snapshot);
+  EXPECT_THAT(new_snapshot->trajectory_nodes[0].size(), ::testing::Eq(2u));
+  EXPECT_THAT(snapshot->trajectory_nodes[0].size(), ::testing::Eq(1u));
+  EXPECT_THAT(sparse_pose_graph_->GetTrajectoryNodes()[0].size(),
+              ::testing::Eq(2u));
+}
+
+TEST_P(SparsePoseGraphTest, SnapshotContainsConstraintsOfFinalOptimization) {
+  for (int i = 0; i != 5; ++i) {
+    MoveRelative(transform::Rigid2d({0., 0.4}, 0.));
+  }
+  const auto count_inter_submap_constraints =
+      [](const mapping::SparsePoseGraph::Snapshot& snapshot) {
+        return std::count_if(
+            snapshot.constraints.begin(), snapshot.constraints.end(),
+            [](const mapping::SparsePoseGraph::Constraint& constraint) {
+              return constraint.tag ==
+                     mapping::SparsePoseGraph::Constraint::INTER_SUBMAP;
+            });
+      };
+  const auto snapshot = sparse_pose_graph_->GetSnapshot();
+  EXPECT_THAT(count_inter_submap_constraints(*snapshot), ::testing::Eq(0));
+
+  sparse_pose_graph_->RunFinalOptimization();
+  const auto new_snapshot = sparse_pose_graph_->GetSnapshot();
+  EXPECT_NE(snapshot, new_snapshot);
+  EXPECT_THAT(count_inter_submap_constraints(*new_snapshot),
+              ::testing::Gt(0));
+  EXPECT_THAT(count_inter_submap_constraints(*snapshot), ::testing::Eq(0));
+}
+
+// With 'num_range_data' = 1, each submap holds two consecutive scans and is
+// finished by the second one.
+TEST_P(SparsePoseGraphTest, FindsConstraintsToSubmapsFinishedAfterSolve) {
+  MoveRelative(transform::Rigid2d::Identity());
+  sparse_pose_graph_->RunFinalOptimization();
+  // These submaps are finished after the optimization rebuilt the spatial
+  // index, so only their insertion as they finish makes them candidates.
+  const int begin_submap_index = sparse_pose_graph_->num_submaps(0);
+  MoveRelative(transform::Rigid2d({0., 5.}, 0.));
+  MoveRelative(transform::Rigid2d::Identity());
+  MoveRelative(transform::Rigid2d::Identity());
+  const int end_submap_index = sparse_pose_graph_->num_submaps(0) - 1;
+  MoveRelative(transform::Rigid2d({0., 5.}, 0.));
+  MoveRelative(transform::Rigid2d::Identity());
+  MoveRelative(transform::Rigid2d({0., -5.}, 0.));
+  const int node_index = 6;
+  sparse_pose_graph_->RunFinalOptimization();
+  ASSERT_THAT(sparse_pose_graph_->GetTrajectoryNodes()[0].size(),
+              ::testing::Eq(node_index + 1u));
+  EXPECT_TRUE(HasInterSubmapConstraint(node_index, begin_submap_index,
+                                       end_submap_index));
+}
+
+TEST_P(SparsePoseGraphTest, FindsConstraintsToScansBeforeFirstSolve) {
+  // No optimization ran yet, so these nodes were never in a rebuilt spatial
+  // index. They have to be found when the submaps of the revisit finish.
+  MoveRelative(transform::Rigid2d::Identity());
+  MoveRelative(transform::Rigid2d::Identity());
+  MoveRelative(transform::Rigid2d({0., 5.}, 0.));
+  MoveRelative(transform::Rigid2d::Identity());
+  const int begin_submap_index = sparse_pose_graph_->num_submaps(0);
+  MoveRelative(transform::Rigid2d({0., -5.}, 0.));
+  MoveRelative(transform::Rigid2d::Identity());
+  MoveRelative(transform::Rigid2d::Identity());
+  sparse_pose_graph_->RunFinalOptimization();
+  EXPECT_TRUE(HasInterSubmapConstraint(0, begin_submap_index,
+                                       sparse_pose_graph_->num_submaps(0)));
+}
+
+TEST_P(SparsePoseGraphTest, NoOverlappingScans) {
   std::mt19937 rng(0);
   std::uniform_real_distribution<double> distribution(-1., 1.);
   std::vector<transform::Rigid2d> poses;
@@ -219,7 +367,7 @@ TEST_F(SparsePoseGraphTest, NoOverlappingScans) {
   }
 }
 
-TEST_F(SparsePoseGraphTest, ConsecutivelyOverlappingScans) {
+TEST_P(SparsePoseGraphTest, ConsecutivelyOverlappingScans) {
   std::mt19937 rng(0);
   std::uniform_real_distribution<double> distribution(-1., 1.);
   std::vector<transform::Rigid2d> poses;
@@ -237,7 +385,7 @@ TEST_F(SparsePoseGraphTest, ConsecutivelyOverlappingScans) {
   }
 }
 
-TEST_F(SparsePoseGraphTest, OverlappingScans) {
+TEST_P(SparsePoseGraphTest, OverlappingScans) {
   std::mt19937 rng(0);
   std::uniform_real_distribution<double> distribution(-1., 1.);
   std::vector<transform::Rigid2d> ground_truth;
@@ -269,6 +417,149 @@ TEST_F(SparsePoseGraphTest, OverlappingScans) {
               ::testing::Lt(error_before.translation().norm()));
 }
 
+TEST_P(SparsePoseGraphTest, SolvesAfterTrimming) {
+  // Optimize and trim every few scans, keeping only the last 3 submaps. Each
+  // scan finishes a submap, so trimming also removes submaps that were last
+  // optimized, which then must no longer be needed.
+  mapping::proto::SparsePoseGraphOptions options = sparse_pose_graph_options_;
+  options.set_optimize_every_n_scans(2);
+  sparse_pose_graph_ =
+      common::make_unique<SparsePoseGraph>(options, &thread_pool_);
+  sparse_pose_graph_->AddTrimmer(
+      common::make_unique<mapping::PureLocalizationTrimmer>(0, 3));
+  std::vector<transform::Rigid2d> poses;
+  for (int i = 0; i != 12; ++i) {
+    MoveRelative(transform::Rigid2d({0., 0.4}, 0.));
+    poses.emplace_back(current_pose_);
+  }
+  sparse_pose_graph_->RunFinalOptimization();
+  const auto submap_data = sparse_pose_graph_->GetAllSubmapData();
+  ASSERT_THAT(submap_data.size(), ::testing::Eq(1u));
+  EXPECT_EQ(submap_data[0][0].submap, nullptr);
+  EXPECT_NE(submap_data[0].back().submap, nullptr);
+
+  // The solves after trimming, incremental ones included, must have worked on
+  // the remaining nodes.
+  for (int i = 0; i != 4; ++i) {
+    MoveRelative(transform::Rigid2d({0., 0.4}, 0.));
+    poses.emplace_back(current_pose_);
+  }
+  sparse_pose_graph_->RunFinalOptimization();
+  const auto nodes = sparse_pose_graph_->GetTrajectoryNodes();
+  ASSERT_THAT(nodes.size(), ::testing::Eq(1u));
+  ASSERT_THAT(nodes[0].size(), ::testing::Eq(poses.size()));
+  EXPECT_TRUE(nodes[0].front().trimmed());
+  EXPECT_FALSE(nodes[0].back().trimmed());
+  for (size_t i = 0; i != poses.size(); ++i) {
+    if (!nodes[0][i].trimmed()) {
+      EXPECT_THAT(poses[i],
+                  IsNearly(transform::Project2D(nodes[0][i].pose), 1e-2))
+          << i;
+    }
+  }
+}
+
+TEST_P(SparsePoseGraphTest, RecordsWorkQueueStatistics) {
+  EXPECT_EQ(sparse_pose_graph_->GetWorkQueueLatencyHistogram().ToString(1),
+            "Count: 0");
+  mapping::proto::SparsePoseGraphOptions options = sparse_pose_graph_options_;
+  options.set_optimize_every_n_scans(2);
+  sparse_pose_graph_ =
+      common::make_unique<SparsePoseGraph>(options, &thread_pool_);
+  for (int i = 0; i != 6; ++i) {
+    MoveRelative(transform::Rigid2d({0., 0.4}, 0.));
+  }
+  sparse_pose_graph_->RunFinalOptimization();
+  EXPECT_NE(sparse_pose_graph_->GetWorkQueueLatencyHistogram().ToString(1),
+            "Count: 0");
+  EXPECT_NE(sparse_pose_graph_->GetWorkQueueSizeHistogram().ToString(1),
+            "Count: 0");
+}
+
+TEST_P(SparsePoseGraphTest, AddsScansWhileOptimizationIsPending) {
+  mapping::proto::SparsePoseGraphOptions options = sparse_pose_graph_options_;
+  options.set_optimize_every_n_scans(2);
+  sparse_pose_graph_ =
+      common::make_unique<SparsePoseGraph>(options, &thread_pool_);
+  BlockThreadPool();
+  // The first optimization is requested after 3 scans and cannot start, so
+  // all later scans are added as queued work items.
+  std::vector<transform::Rigid2d> poses;
+  std::thread add_scans([this, &poses]() {
+    for (int i = 0; i != 10; ++i) {
+      MoveRelative(transform::Rigid2d({0., 0.4}, 0.));
+      poses.emplace_back(current_pose_);
+    }
+  });
+  add_scans.join();
+  EXPECT_THAT(sparse_pose_graph_->GetTrajectoryNodes()[0].size(),
+              ::testing::Eq(10u));
+  ReleaseThreadPool();
+  sparse_pose_graph_->RunFinalOptimization();
+  const auto nodes = sparse_pose_graph_->GetTrajectoryNodes();
+  ASSERT_THAT(nodes.size(), ::testing::Eq(1u));
+  ASSERT_THAT(nodes[0].size(), ::testing::Eq(poses.size()));
+  for (size_t i = 0; i != poses.size(); ++i) {
+    EXPECT_THAT(poses[i],
+                IsNearly(transform::Project2D(nodes[0][i].pose), 1e-2))
+        << i;
+  }
+}
+
+TEST_P(SparsePoseGraphTest, RunsFinalOptimizationWhileAddingScans) {
+  // Every scan requests an optimization from the thread pool, which must not
+  // prepare a solve while a final optimization does and vice versa.
+  mapping::proto::SparsePoseGraphOptions options = sparse_pose_graph_options_;
+  options.set_optimize_every_n_scans(1);
+  sparse_pose_graph_ =
+      common::make_unique<SparsePoseGraph>(options, &thread_pool_);
+  std::vector<transform::Rigid2d> poses;
+  std::atomic<bool> done(false);
+  std::thread add_scans([this, &poses, &done]() {
+    for (int i = 0; i != 20; ++i) {
+      MoveRelative(transform::Rigid2d({0., 0.4}, 0.));
+      poses.emplace_back(current_pose_);
+    }
+    done = true;
+  });
+  while (!done) {
+    sparse_pose_graph_->RunFinalOptimization();
+  }
+  add_scans.join();
+  sparse_pose_graph_->RunFinalOptimization();
+  const auto nodes = sparse_pose_graph_->GetTrajectoryNodes();
+  ASSERT_THAT(nodes.size(), ::testing::Eq(1u));
+  ASSERT_THAT(nodes[0].size(), ::testing::Eq(poses.size()));
+  for (size_t i = 0; i != poses.size(); ++i) {
+    EXPECT_THAT(poses[i],
+                IsNearly(transform::Project2D(nodes[0][i].pose), 1e-2))
+        << i;
+  }
+}
+
+TEST_P(SparsePoseGraphTest, FinalOptimizationWaitsForAllComputations) {
+  BlockThreadPool();
+  MoveRelative(transform::Rigid2d::Identity());
+  MoveRelative(transform::Rigid2d::Identity());
+  MoveRelative(transform::Rigid2d({0., 5.}, 0.));
+  MoveRelative(transform::Rigid2d::Identity());
+  const int begin_submap_index = sparse_pose_graph_->num_submaps(0);
+  MoveRelative(transform::Rigid2d({0., -5.}, 0.));
+  MoveRelative(transform::Rigid2d::Identity());
+  MoveRelative(transform::Rigid2d::Identity());
+  // None of the constraints can be computed before the thread pool is
+  // released, which happens while the final optimization is waiting.
+  std::thread run_final_optimization(
+      [this]() { sparse_pose_graph_->RunFinalOptimization(); });
+  ReleaseThreadPool();
+  run_final_optimization.join();
+  EXPECT_TRUE(HasInterSubmapConstraint(0, begin_submap_index,
+                                       sparse_pose_graph_->num_submaps(0)));
+}
+
+INSTANTIATE_TEST_CASE_P(IncrementalProblem, SparsePoseGraphTest,
+                        ::testing::Bool());
+
 }  // namespace
 }  // namespace mapping_2d
 }  // namespace cartographer
@@ -58,6 +58,8 @@ proto::SubmapsOptions CreateSubmapsOptions(
   *options.mutable_range_data_inserter_options() =
       CreateRangeDataInserterOptions(
           parameter_dictionary->GetDictionary("range_data_inserter").get());
+  options.set_quantize_finished_submaps(
+      parameter_dictionary->GetBool("quantize_finished_submaps"));
   CHECK_GT(options.num_range_data(), 0);
   return options;
 }
@@ -137,9 +139,15 @@ void Submap::InsertRangeData(const sensor::RangeData& range_data,
   SetNumRangeData(num_range_data() + 1);
 }
 
-void Submap::Finish() {
+void Submap::Finish(const bool quantize) {
   CHECK(!finished_);
+  const size_t num_bytes = probability_grid_.num_bytes();
   probability_grid_ = ComputeCroppedProbabilityGrid(probability_grid_);
+  if (quantize) {
+    probability_grid_.Quantize();
+  }
+  VLOG(1) << "Finished submap using " << probability_grid_.num_bytes()
+          << " bytes, down from " << num_bytes << " bytes.";
   finished_ = true;
 }
 
@@ -168,7 +176,7 @@ int ActiveSubmaps::matching_index() const { return matching_submap_index_; }
 
 void ActiveSubmaps::FinishSubmap() {
   Submap* submap = submaps_.front().get();
-  submap->Finish();
+  submap->Finish(options_.quantize_finished_submaps());
   ++matching_submap_index_;
   submaps_.erase(submaps_.begin());
 }
@@ -60,7 +60,10 @@ class Submap : public mapping::Submap {
   // submap must not be finished yet.
   void InsertRangeData(const sensor::RangeData& range_data,
                        const RangeDataInserter& range_data_inserter);
-  void Finish();
+
+  // Crops the submap to its known cells and, if 'quantize' is true, converts
+  // it to 8 bits per cell. No range data can be inserted afterwards.
+  void Finish(bool quantize);
 
  private:
   ProbabilityGrid probability_grid_;
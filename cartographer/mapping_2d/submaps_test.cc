@@ -43,7 +43,9 @@ TEST(SubmapsTest, TheRightNumberOfScansAreInserted) {
       "insert_free_space = true, "
       "hit_probability = 0.53, "
       "miss_probability = 0.495, "
+      "num_threads = 1, "
       "},"
+      "quantize_finished_submaps = true, "
       "}");
   ActiveSubmaps submaps{CreateSubmapsOptions(parameter_dictionary.get())};
   std::set<std::shared_ptr<Submap>> all_submaps;
@@ -62,6 +64,7 @@ TEST(SubmapsTest, TheRightNumberOfScansAreInserted) {
     if (submap->num_range_data() == kNumRangeData * 2) {
       ++correct_num_scans;
     }
+    EXPECT_EQ(submap->finished(), submap->probability_grid().quantized());
   }
   // Submaps should not be left without the right number of scans in them.
   EXPECT_EQ(correct_num_scans, all_submaps.size() - 2);
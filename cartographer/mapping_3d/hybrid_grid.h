@@ -17,9 +17,11 @@
 #ifndef CARTOGRAPHER_MAPPING_3D_HYBRID_GRID_H_
 #define CARTOGRAPHER_MAPPING_3D_HYBRID_GRID_H_
 
+#include <algorithm>
 #include <array>
 #include <cmath>
 #include <limits>
+#include <memory>
 #include <utility>
 #include <vector>
 
@@ -94,6 +96,13 @@ class FlatGrid {
     return &cells_[ToFlatIndex(index, kBits)];
   }
 
+  // Returns a pointer to the value stored at 'index'. Values are stored
+  // z-major, so the neighbors in x, y and z are 1, 'grid_size()' and
+  // 'grid_size()' squared values further.
+  const ValueType* FindValue(const Eigen::Array3i& index) const {
+    return &cells_[ToFlatIndex(index, kBits)];
+  }
+
   // An iterator for iterating over all values not comparing equal to the
   // default constructed value.
   class Iterator {
@@ -137,13 +146,75 @@ class FlatGrid {
   std::array<ValueType, 1 << (3 * kBits)> cells_;
 };
 
+// Allocates default constructed blocks of type 'T' from contiguous chunks of
+// memory. Blocks are only destroyed, and their memory released, together with
+// the pool, so blocks allocated one after another are close in memory and a
+// grid is freed with one deallocation per chunk instead of one per block.
+template <typename T>
+class BlockPool {
+ public:
+  BlockPool()
+      : next_(nullptr),
+        end_(nullptr),
+        next_chunk_size_(std::min(kMinChunkSize, MaxChunkSize())),
+        num_blocks_(0),
+        capacity_(0) {}
+
+  BlockPool(const BlockPool&) = delete;
+  BlockPool& operator=(const BlockPool&) = delete;
+
+  // Returns a new default constructed block owned by this pool.
+  T* Allocate() {
+    if (next_ == end_) {
+      // Chunks double in size, so small grids do not waste much memory.
+      chunks_.emplace_back(new T[next_chunk_size_]());
+      next_ = chunks_.back().get();
+      end_ = next_ + next_chunk_size_;
+      capacity_ += next_chunk_size_;
+      next_chunk_size_ = std::min(2 * next_chunk_size_, MaxChunkSize());
+    }
+    ++num_blocks_;
+    return next_++;
+  }
+
+  // Returns the number of allocated blocks.
+  size_t num_blocks() const { return num_blocks_; }
+
+  // Returns the number of bytes of all chunks, including unused blocks.
+  size_t num_bytes() const { return capacity_ * sizeof(T); }
+
+ private:
+  static constexpr size_t kMinChunkSize = 8;
+  static constexpr size_t kMaxChunkBytes = 256 * 1024;
+
+  static constexpr size_t MaxChunkSize() {
+    return sizeof(T) < kMaxChunkBytes ? kMaxChunkBytes / sizeof(T) : 1;
+  }
+
+  std::vector<std::unique_ptr<T[]>> chunks_;
+  // Unused blocks of the last chunk.
+  T* next_;
+  T* end_;
+  size_t next_chunk_size_;
+  size_t num_blocks_;
+  size_t capacity_;
+};
+
 // A grid consisting of '2^kBits' x '2^kBits' x '2^kBits' grids of type
-// 'WrappedGrid'. Wrapped grids are constructed on first access via
-// 'mutable_value()'.
+// 'WrappedGrid'. Wrapped grids are allocated from the 'block_pool' on first
+// access via 'mutable_value()'.
 template <typename WrappedGrid, int kBits>
 class NestedGrid {
  public:
   using ValueType = typename WrappedGrid::ValueType;
+  using Pool = BlockPool<WrappedGrid>;
+
+  explicit NestedGrid(Pool* const block_pool) : block_pool_(block_pool) {
+    meta_cells_.fill(nullptr);
+  }
+
+  NestedGrid(const NestedGrid&) = delete;
+  NestedGrid& operator=(const NestedGrid&) = delete;
 
   // Returns the number of voxels per dimension.
   static int grid_size() { return WrappedGrid::grid_size() << kBits; }
@@ -153,7 +224,7 @@ class NestedGrid {
   ValueType value(const Eigen::Array3i& index) const {
     const Eigen::Array3i meta_index = GetMetaIndex(index);
     const WrappedGrid* const meta_cell =
-        meta_cells_[ToFlatIndex(meta_index, kBits)].get();
+        meta_cells_[ToFlatIndex(meta_index, kBits)];
     if (meta_cell == nullptr) {
       return ValueType();
     }
@@ -162,14 +233,25 @@ class NestedGrid {
     return meta_cell->value(inner_index);
   }
 
+  // Returns a pointer to the value stored at 'index' in the innermost grid, or
+  // nullptr if the wrapped grid containing it was not yet constructed.
+  const ValueType* FindValue(const Eigen::Array3i& index) const {
+    const Eigen::Array3i meta_index = GetMetaIndex(index);
+    const WrappedGrid* const meta_cell =
+        meta_cells_[ToFlatIndex(meta_index, kBits)];
+    if (meta_cell == nullptr) {
+      return nullptr;
+    }
+    return meta_cell->FindValue(index - meta_index * WrappedGrid::grid_size());
+  }
+
   // Returns a pointer to the value at 'index' to allow changing it. If
-  // necessary a new wrapped grid is constructed to contain that value.
+  // necessary a new wrapped grid is allocated to contain that value.
   ValueType* mutable_value(const Eigen::Array3i& index) {
     const Eigen::Array3i meta_index = GetMetaIndex(index);
-    std::unique_ptr<WrappedGrid>& meta_cell =
-        meta_cells_[ToFlatIndex(meta_index, kBits)];
+    WrappedGrid*& meta_cell = meta_cells_[ToFlatIndex(meta_index, kBits)];
     if (meta_cell == nullptr) {
-      meta_cell = common::make_unique<WrappedGrid>();
+      meta_cell = block_pool_->Allocate();
     }
     const Eigen::Array3i inner_index =
         index - meta_index * WrappedGrid::grid_size();
@@ -225,8 +307,8 @@ class NestedGrid {
       }
     }
 
-    const std::unique_ptr<WrappedGrid>* current_;
-    const std::unique_ptr<WrappedGrid>* end_;
+    WrappedGrid* const* current_;
+    WrappedGrid* const* end_;
     typename WrappedGrid::Iterator nested_iterator_;
   };
 
@@ -240,25 +322,47 @@ class NestedGrid {
     return meta_index;
   }
 
-  std::array<std::unique_ptr<WrappedGrid>, 1 << (3 * kBits)> meta_cells_;
+  // Owns the wrapped grids.
+  Pool* const block_pool_;
+  std::array<WrappedGrid*, 1 << (3 * kBits)> meta_cells_;
 };
 
 // A grid consisting of 2x2x2 grids of type 'WrappedGrid' initially. Wrapped
 // grids are constructed on first access via 'mutable_value()'. If necessary,
 // the grid grows to twice the size in each dimension. The range of indices is
 // (almost) symmetric around the origin, i.e. negative indices are allowed.
+// The innermost grids of all wrapped grids are allocated from a BlockPool
+// owned by this grid.
 template <typename WrappedGrid>
 class DynamicGrid {
  public:
   using ValueType = typename WrappedGrid::ValueType;
 
-  DynamicGrid() : bits_(1), meta_cells_(8) {}
+  DynamicGrid()
+      : bits_(1),
+        meta_cells_(8),
+        block_pool_(common::make_unique<typename WrappedGrid::Pool>()) {}
   DynamicGrid(DynamicGrid&&) = default;
   DynamicGrid& operator=(DynamicGrid&&) = default;
 
   // Returns the current number of voxels per dimension.
   int grid_size() const { return WrappedGrid::grid_size() << bits_; }
 
+  // Returns the number of allocated innermost grids.
+  size_t num_blocks() const { return block_pool_->num_blocks(); }
+
+  // Returns the number of bytes allocated for this grid.
+  size_t num_bytes() const {
+    size_t num_bytes = block_pool_->num_bytes() +
+                       meta_cells_.size() * sizeof(meta_cells_[0]);
+    for (const auto& meta_cell : meta_cells_) {
+      if (meta_cell != nullptr) {
+        num_bytes += sizeof(WrappedGrid);
+      }
+    }
+    return num_bytes;
+  }
+
   // Returns the value stored at 'index'.
   ValueType value(const Eigen::Array3i& index) const {
     const Eigen::Array3i shifted_index = index + (grid_size() >> 1);
@@ -278,6 +382,23 @@ class DynamicGrid {
     return meta_cell->value(inner_index);
   }
 
+  // Returns a pointer to the value stored at 'index' in the innermost grid, or
+  // nullptr if no grid containing it was constructed yet.
+  const ValueType* FindValue(const Eigen::Array3i& index) const {
+    const Eigen::Array3i shifted_index = index + (grid_size() >> 1);
+    if ((shifted_index.cast<unsigned int>() >= grid_size()).any()) {
+      return nullptr;
+    }
+    const Eigen::Array3i meta_index = GetMetaIndex(shifted_index);
+    const WrappedGrid* const meta_cell =
+        meta_cells_[ToFlatIndex(meta_index, bits_)].get();
+    if (meta_cell == nullptr) {
+      return nullptr;
+    }
+    return meta_cell->FindValue(shifted_index -
+                                meta_index * WrappedGrid::grid_size());
+  }
+
   // Returns a pointer to the value at 'index' to allow changing it, dynamically
   // growing the DynamicGrid and constructing new WrappedGrids as needed.
   ValueType* mutable_value(const Eigen::Array3i& index) {
@@ -292,7 +413,7 @@ class DynamicGrid {
     std::unique_ptr<WrappedGrid>& meta_cell =
         meta_cells_[ToFlatIndex(meta_index, bits_)];
     if (meta_cell == nullptr) {
-      meta_cell = common::make_unique<WrappedGrid>();
+      meta_cell = common::make_unique<WrappedGrid>(block_pool_.get());
     }
     const Eigen::Array3i inner_index =
         shifted_index - meta_index * WrappedGrid::grid_size();
@@ -404,10 +525,55 @@ class DynamicGrid {
 
   int bits_;
   std::vector<std::unique_ptr<WrappedGrid>> meta_cells_;
+  // Behind a pointer, so that its address does not change when moving.
+  std::unique_ptr<typename WrappedGrid::Pool> block_pool_;
 };
 
+// Number of bits per dimension of the innermost FlatGrids of a Grid.
+constexpr int kFlatGridBits = 3;
+
+// Returns the Morton code of 'index', i.e. the interleaved bits of its
+// coordinates. Sorting by it makes the cells of each FlatGrid consecutive and
+// keeps neighboring FlatGrids close.
+inline uint64 GetMortonCode(const Eigen::Array3i& index) {
+  // Offset by a multiple of the FlatGrid size to make all coordinates positive
+  // 21-bit numbers, which is far more than the DynamicGrid can grow to.
+  constexpr int kOffset = 1 << 20;
+  const auto spread = [](const int coordinate) {
+    DCHECK_GE(coordinate + kOffset, 0);
+    DCHECK_LT(coordinate + kOffset, 1 << 21);
+    uint64 bits = static_cast<uint64>(coordinate + kOffset);
+    bits = (bits | (bits << 32)) & 0x1f00000000ffffULL;
+    bits = (bits | (bits << 16)) & 0x1f0000ff0000ffULL;
+    bits = (bits | (bits << 8)) & 0x100f00f00f00f00fULL;
+    bits = (bits | (bits << 4)) & 0x10c30c30c30c30c3ULL;
+    bits = (bits | (bits << 2)) & 0x1249249249249249ULL;
+    return bits;
+  };
+  return spread(index.x()) | (spread(index.y()) << 1) |
+         (spread(index.z()) << 2);
+}
+
+// Sorts 'cell_indices' by their Morton codes, so that batched lookups of them
+// descend the grid only once per FlatGrid.
+inline void SortByMortonCode(std::vector<Eigen::Array3i>* const cell_indices) {
+  std::vector<std::pair<uint64, Eigen::Array3i>> keyed_cell_indices;
+  keyed_cell_indices.reserve(cell_indices->size());
+  for (const Eigen::Array3i& cell_index : *cell_indices) {
+    keyed_cell_indices.emplace_back(GetMortonCode(cell_index), cell_index);
+  }
+  std::sort(keyed_cell_indices.begin(), keyed_cell_indices.end(),
+            [](const std::pair<uint64, Eigen::Array3i>& lhs,
+               const std::pair<uint64, Eigen::Array3i>& rhs) {
+              return lhs.first < rhs.first;
+            });
+  for (size_t i = 0; i != keyed_cell_indices.size(); ++i) {
+    (*cell_indices)[i] = keyed_cell_indices[i].second;
+  }
+}
+
 template <typename ValueType>
-using Grid = DynamicGrid<NestedGrid<FlatGrid<ValueType, 3>, 3>>;
+using Grid = DynamicGrid<NestedGrid<FlatGrid<ValueType, kFlatGridBits>, 3>>;
 
 // Represents a 3D grid as a wide, shallow tree.
 template <typename ValueType>
@@ -445,6 +611,78 @@ class HybridGridBase : public Grid<ValueType> {
     return index.matrix().cast<float>() * resolution_;
   }
 
+  // Returns the values of the 2x2x2 cells starting at 'index', in the order of
+  // GetOctant(). Usually all of them are in the same FlatGrid, which then is
+  // looked up only once.
+  std::array<ValueType, 8> GetOctantValues(const Eigen::Array3i& index) const {
+    std::array<ValueType, 8> values;
+    // Unless 'index' is in the last row of its FlatGrid in any dimension, see
+    // GetBlockOrigin().
+    if ((index.x() & kMask) != kMask && (index.y() & kMask) != kMask &&
+        (index.z() & kMask) != kMask) {
+      const ValueType* const value = this->FindValue(index);
+      if (value == nullptr) {
+        values.fill(ValueType());
+        return values;
+      }
+      constexpr int kStrideY = 1 << kFlatGridBits;
+      constexpr int kStrideZ = kStrideY << kFlatGridBits;
+      for (int i = 0; i != 8; ++i) {
+        values[i] = value[(i & 1) + (i & 2 ? kStrideY : 0) +
+                          (i & 4 ? kStrideZ : 0)];
+      }
+      return values;
+    }
+    for (int i = 0; i != 8; ++i) {
+      values[i] = this->value(index + GetOctant(i));
+    }
+    return values;
+  }
+
+  // Returns the values of the cells at 'cell_indices'. Recently used
+  // FlatGrids are remembered, so that cells in the same FlatGrid as one of
+  // the preceding cells skip descending the grid. For spatially coherent
+  // cells, e.g. the points of a scan in measurement order, this is faster
+  // than calling value() for each.
+  std::vector<ValueType> GetValues(
+      const std::vector<Eigen::Array3i>& cell_indices) const {
+    std::vector<ValueType> values;
+    values.reserve(cell_indices.size());
+    BlockCache<const ValueType> block_cache;
+    for (const Eigen::Array3i& cell_index : cell_indices) {
+      const Eigen::Array3i block_origin = GetBlockOrigin(cell_index);
+      const ValueType** block = block_cache.Find(block_origin);
+      if (block == nullptr) {
+        block = block_cache.Insert(block_origin, this->FindValue(block_origin));
+      }
+      values.push_back(*block == nullptr
+                           ? ValueType()
+                           : (*block)[ToFlatIndex(cell_index - block_origin,
+                                                  kFlatGridBits)]);
+    }
+    return values;
+  }
+
+  // Like GetValues(), but returns pointers to the values to allow changing
+  // them, constructing grids as needed like mutable_value().
+  std::vector<ValueType*> GetMutableValues(
+      const std::vector<Eigen::Array3i>& cell_indices) {
+    std::vector<ValueType*> values;
+    values.reserve(cell_indices.size());
+    BlockCache<ValueType> block_cache;
+    for (const Eigen::Array3i& cell_index : cell_indices) {
+      const Eigen::Array3i block_origin = GetBlockOrigin(cell_index);
+      ValueType** block = block_cache.Find(block_origin);
+      if (block == nullptr) {
+        block =
+            block_cache.Insert(block_origin, this->mutable_value(block_origin));
+      }
+      values.push_back(
+          &(*block)[ToFlatIndex(cell_index - block_origin, kFlatGridBits)]);
+    }
+    return values;
+  }
+
   // Iterator functions for range-based for loops.
   Iterator begin() const { return Iterator(*this); }
 
@@ -455,6 +693,62 @@ class HybridGridBase : public Grid<ValueType> {
   }
 
  private:
+  static constexpr int kMask = (1 << kFlatGridBits) - 1;
+
+  // A direct-mapped cache of pointers to the first values of FlatGrids. It has
+  // enough entries that interleaved sequences of coherent cells, like the
+  // points of the different beams of a laser scanner, mostly hit.
+  template <typename BlockValueType>
+  class BlockCache {
+   public:
+    BlockCache() {
+      // Not the origin of any FlatGrid, so nothing is found initially.
+      origins_.fill(Eigen::Array3i::Ones());
+    }
+
+    // Returns the cached pointer for the FlatGrid at 'block_origin', or
+    // nullptr if it is not cached.
+    BlockValueType** Find(const Eigen::Array3i& block_origin) {
+      const int entry = GetEntry(block_origin);
+      if ((origins_[entry] != block_origin).any()) {
+        return nullptr;
+      }
+      return &blocks_[entry];
+    }
+
+    // Caches 'block' for the FlatGrid at 'block_origin'.
+    BlockValueType** Insert(const Eigen::Array3i& block_origin,
+                            BlockValueType* const block) {
+      const int entry = GetEntry(block_origin);
+      origins_[entry] = block_origin;
+      blocks_[entry] = block;
+      return &blocks_[entry];
+    }
+
+   private:
+    static constexpr int kNumEntryBits = 8;
+    static constexpr int kNumEntries = 1 << kNumEntryBits;
+
+    static int GetEntry(const Eigen::Array3i& block_origin) {
+      const uint32 hash =
+          (static_cast<uint32>(block_origin.x()) * 0x9e3779b1u) ^
+          (static_cast<uint32>(block_origin.y()) * 0x85ebca77u) ^
+          (static_cast<uint32>(block_origin.z()) * 0xc2b2ae3du);
+      return hash >> (32 - kNumEntryBits);
+    }
+
+    std::array<Eigen::Array3i, kNumEntries> origins_;
+    std::array<BlockValueType*, kNumEntries> blocks_;
+  };
+
+  // Returns the index of the first cell of the FlatGrid containing 'index'.
+  // The grid is shifted by a multiple of the FlatGrid size, so the lowest bits
+  // of 'index' are the index inside its FlatGrid.
+  static Eigen::Array3i GetBlockOrigin(const Eigen::Array3i& index) {
+    return Eigen::Array3i(index.x() & ~kMask, index.y() & ~kMask,
+                          index.z() & ~kMask);
+  }
+
   // Edge length of each voxel.
   const float resolution_;
 };
@@ -503,14 +797,17 @@ class HybridGrid : public HybridGridBase<uint16> {
   bool ApplyLookupTable(const Eigen::Array3i& index,
                         const std::vector<uint16>& table) {
     DCHECK_EQ(table.size(), mapping::kUpdateMarker);
-    uint16* const cell = mutable_value(index);
-    if (*cell >= mapping::kUpdateMarker) {
-      return false;
+    return ApplyLookupTableToCell(mutable_value(index), table);
+  }
+
+  // Like ApplyLookupTable() for each of 'cell_indices', but using
+  // GetMutableValues() to look up the cells.
+  void ApplyLookupTable(const std::vector<Eigen::Array3i>& cell_indices,
+                        const std::vector<uint16>& table) {
+    DCHECK_EQ(table.size(), mapping::kUpdateMarker);
+    for (uint16* const cell : GetMutableValues(cell_indices)) {
+      ApplyLookupTableToCell(cell, table);
     }
-    update_indices_.push_back(cell);
-    *cell = table[*cell];
-    DCHECK_GE(*cell, mapping::kUpdateMarker);
-    return true;
   }
 
   // Returns the probability of the cell with 'index'.
@@ -536,6 +833,17 @@ class HybridGrid : public HybridGridBase<uint16> {
   }
 
  private:
+  bool ApplyLookupTableToCell(uint16* const cell,
+                              const std::vector<uint16>& table) {
+    if (*cell >= mapping::kUpdateMarker) {
+      return false;
+    }
+    update_indices_.push_back(cell);
+    *cell = table[*cell];
+    DCHECK_GE(*cell, mapping::kUpdateMarker);
+    return true;
+  }
+
   // Markers at changed cells.
   std::vector<ValueType*> update_indices_;
 };
@@ -0,0 +1,255 @@
+/*
+ * Copyright 2016 The Cartographer Authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Measures memory usage, insertion, iteration and lookup throughput of a
+// HybridGrid filled with points on the surfaces of a building-sized box, as a
+// high resolution 3D submap would be. Lookups of simulated scans of the box
+// compare individual lookups with batched ones.
+
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <vector>
+
+#include "Eigen/Core"
+#include "cartographer/common/make_unique.h"
+#include "cartographer/mapping_3d/hybrid_grid.h"
+#include "gflags/gflags.h"
+#include "glog/logging.h"
+
+DEFINE_int32(num_points, 2000000, "Number of points to insert.");
+DEFINE_double(resolution, 0.1, "Resolution of the grid in meters.");
+DEFINE_int32(num_lookups, 10000000, "Number of lookups to time.");
+DEFINE_int32(num_scans, 20, "Number of simulated scans to look up.");
+
+namespace cartographer {
+namespace mapping_3d {
+namespace {
+
+double SecondsSince(const std::chrono::steady_clock::time_point start) {
+  const std::chrono::duration<double> elapsed =
+      std::chrono::steady_clock::now() - start;
+  return elapsed.count();
+}
+
+// Returns a point on the floor, the ceiling or one of the walls of a 60 m x
+// 60 m x 8 m box, or in between for some clutter.
+Eigen::Vector3f SamplePoint(std::mt19937* const prng) {
+  std::uniform_real_distribution<float> horizontal(-30.f, 30.f);
+  std::uniform_real_distribution<float> vertical(0.f, 8.f);
+  std::uniform_int_distribution<int> surface(0, 6);
+  switch (surface(*prng)) {
+    case 0:
+      return Eigen::Vector3f(horizontal(*prng), horizontal(*prng), 0.f);
+    case 1:
+      return Eigen::Vector3f(horizontal(*prng), horizontal(*prng), 8.f);
+    case 2:
+      return Eigen::Vector3f(-30.f, horizontal(*prng), vertical(*prng));
+    case 3:
+      return Eigen::Vector3f(30.f, horizontal(*prng), vertical(*prng));
+    case 4:
+      return Eigen::Vector3f(horizontal(*prng), -30.f, vertical(*prng));
+    case 5:
+      return Eigen::Vector3f(horizontal(*prng), 30.f, vertical(*prng));
+  }
+  return Eigen::Vector3f(horizontal(*prng), horizontal(*prng),
+                         vertical(*prng));
+}
+
+// Returns the cells hit by a 16 beam laser scanner at 'origin' with 0.2 degree
+// horizontal resolution scanning the box, in the order the points are
+// measured.
+std::vector<Eigen::Array3i> SimulateScan(const HybridGrid& hybrid_grid,
+                                         const Eigen::Vector3f& origin) {
+  const Eigen::Array3f box_min(-30.f, -30.f, 0.f);
+  const Eigen::Array3f box_max(30.f, 30.f, 8.f);
+  std::vector<Eigen::Array3i> cell_indices;
+  for (int azimuth_step = 0; azimuth_step != 1800; ++azimuth_step) {
+    // Rays are offset by half a step so that none is parallel to a wall.
+    const float azimuth = (azimuth_step + 0.5f) * 2.f * M_PI / 1800.f;
+    for (int beam = 0; beam != 16; ++beam) {
+      const float elevation = (-15.f + 2.f * beam) * M_PI / 180.f;
+      const Eigen::Array3f direction(std::cos(elevation) * std::cos(azimuth),
+                                     std::cos(elevation) * std::sin(azimuth),
+                                     std::sin(elevation));
+      // Distance to the first wall, floor or ceiling in 'direction'.
+      const Eigen::Array3f distances =
+          ((direction > 0.f).select(box_max, box_min) - origin.array()) /
+          direction;
+      const float range = distances.minCoeff();
+      cell_indices.push_back(hybrid_grid.GetCellIndex(
+          origin + (range * direction).matrix()));
+    }
+  }
+  return cell_indices;
+}
+
+// Compares looking up the cells of simulated scans one by one and batched, in
+// measurement order and sorted by Morton code.
+void BenchmarkScanLookups(HybridGrid* const hybrid_grid) {
+  std::mt19937 prng(42);
+  std::uniform_real_distribution<float> horizontal(-20.f, 20.f);
+  std::vector<std::vector<Eigen::Array3i>> scans;
+  int num_points = 0;
+  for (int i = 0; i != FLAGS_num_scans; ++i) {
+    scans.push_back(SimulateScan(
+        *hybrid_grid,
+        Eigen::Vector3f(horizontal(prng), horizontal(prng), 1.5f)));
+    num_points += scans.back().size();
+  }
+
+  int64 value_sum = 0;
+  auto start = std::chrono::steady_clock::now();
+  for (const std::vector<Eigen::Array3i>& scan : scans) {
+    for (const Eigen::Array3i& cell_index : scan) {
+      value_sum += hybrid_grid->value(cell_index);
+    }
+  }
+  const double single_seconds = SecondsSince(start);
+
+  start = std::chrono::steady_clock::now();
+  for (const std::vector<Eigen::Array3i>& scan : scans) {
+    for (const uint16 value : hybrid_grid->GetValues(scan)) {
+      value_sum += value;
+    }
+  }
+  const double batched_seconds = SecondsSince(start);
+
+  start = std::chrono::steady_clock::now();
+  for (std::vector<Eigen::Array3i> scan : scans) {
+    SortByMortonCode(&scan);
+    for (const uint16 value : hybrid_grid->GetValues(scan)) {
+      value_sum += value;
+    }
+  }
+  const double sorted_seconds = SecondsSince(start);
+
+  start = std::chrono::steady_clock::now();
+  for (const std::vector<Eigen::Array3i>& scan : scans) {
+    for (const Eigen::Array3i& cell_index : scan) {
+      value_sum += ++*hybrid_grid->mutable_value(cell_index);
+    }
+  }
+  const double single_mutable_seconds = SecondsSince(start);
+
+  start = std::chrono::steady_clock::now();
+  for (const std::vector<Eigen::Array3i>& scan : scans) {
+    for (uint16* const value : hybrid_grid->GetMutableValues(scan)) {
+      value_sum += ++*value;
+    }
+  }
+  const double batched_mutable_seconds = SecondsSince(start);
+
+  std::cout << "scan lookups of " << num_points << " points (checksum "
+            << value_sum << ")\n"
+            << "  value(): " << 1e9 * single_seconds / num_points
+            << " ns per point\n"
+            << "  GetValues(): " << 1e9 * batched_seconds / num_points
+            << " ns per point\n"
+            << "  SortByMortonCode() and GetValues(): "
+            << 1e9 * sorted_seconds / num_points << " ns per point\n"
+            << "  mutable_value(): " << 1e9 * single_mutable_seconds / num_points
+            << " ns per point\n"
+            << "  GetMutableValues(): "
+            << 1e9 * batched_mutable_seconds / num_points << " ns per point\n";
+}
+
+void Run() {
+  CHECK_GT(FLAGS_num_points, 0);
+  CHECK_GT(FLAGS_num_lookups, 0);
+  std::mt19937 prng(42);
+  std::vector<Eigen::Array3i> cell_indices;
+  cell_indices.reserve(FLAGS_num_points);
+  auto hybrid_grid = common::make_unique<HybridGrid>(FLAGS_resolution);
+  for (int i = 0; i != FLAGS_num_points; ++i) {
+    cell_indices.push_back(hybrid_grid->GetCellIndex(SamplePoint(&prng)));
+  }
+
+  auto start = std::chrono::steady_clock::now();
+  for (const Eigen::Array3i& cell_index : cell_indices) {
+    hybrid_grid->SetProbability(cell_index, 0.6f);
+  }
+  const double insertion_seconds = SecondsSince(start);
+
+  start = std::chrono::steady_clock::now();
+  int num_cells = 0;
+  int64 value_sum = 0;
+  for (HybridGrid::Iterator it(*hybrid_grid); !it.Done(); it.Next()) {
+    ++num_cells;
+    value_sum += it.GetValue();
+  }
+  const double iteration_seconds = SecondsSince(start);
+
+  // Look up cells near the inserted points in random order.
+  std::uniform_int_distribution<int> point_distribution(
+      0, cell_indices.size() - 1);
+  std::uniform_int_distribution<int> offset_distribution(-2, 2);
+  std::vector<Eigen::Array3i> lookups;
+  lookups.reserve(FLAGS_num_lookups);
+  for (int i = 0; i != FLAGS_num_lookups; ++i) {
+    lookups.push_back(cell_indices[point_distribution(prng)] +
+                      Eigen::Array3i(offset_distribution(prng),
+                                     offset_distribution(prng),
+                                     offset_distribution(prng)));
+  }
+  start = std::chrono::steady_clock::now();
+  for (const Eigen::Array3i& lookup : lookups) {
+    value_sum += hybrid_grid->value(lookup);
+  }
+  const double lookup_seconds = SecondsSince(start);
+  start = std::chrono::steady_clock::now();
+  for (const Eigen::Array3i& lookup : lookups) {
+    value_sum += hybrid_grid->GetOctantValues(lookup)[7];
+  }
+  const double octant_lookup_seconds = SecondsSince(start);
+  const size_t num_blocks = hybrid_grid->num_blocks();
+  const size_t num_bytes = hybrid_grid->num_bytes();
+  BenchmarkScanLookups(hybrid_grid.get());
+
+  start = std::chrono::steady_clock::now();
+  hybrid_grid.reset();
+  const double destruction_seconds = SecondsSince(start);
+
+  std::cout << num_cells << " cells (checksum " << value_sum << ") in "
+            << num_blocks << " blocks using " << num_bytes / 1024
+            << " KiB\n"
+            << "insertion: " << 1e9 * insertion_seconds / FLAGS_num_points
+            << " ns per point\n"
+            << "iteration: " << 1e9 * iteration_seconds / num_cells
+            << " ns per cell\n"
+            << "lookup: " << 1e9 * lookup_seconds / FLAGS_num_lookups
+            << " ns per cell\n"
+            << "octant lookup: "
+            << 1e9 * octant_lookup_seconds / FLAGS_num_lookups
+            << " ns per 2x2x2 cells\n"
+            << "destruction: " << 1e3 * destruction_seconds << " ms\n";
+}
+
+}  // namespace
+}  // namespace mapping_3d
+}  // namespace cartographer
+
+int main(int argc, char** argv) {
+  google::InitGoogleLogging(argv[0]);
+  FLAGS_logtostderr = true;
+  google::SetUsageMessage(
+      "\n\n"
+      "Benchmarks memory usage and throughput of the HybridGrid.\n");
+  google::ParseCommandLineFlags(&argc, &argv, true);
+  ::cartographer::mapping_3d::Run();
+}
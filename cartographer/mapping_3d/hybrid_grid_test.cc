@@ -16,9 +16,12 @@
 
 #include "cartographer/mapping_3d/hybrid_grid.h"
 
+#include <array>
 #include <map>
 #include <random>
+#include <set>
 #include <tuple>
+#include <vector>
 
 #include "gmock/gmock.h"
 
@@ -125,6 +128,185 @@ TEST(HybridGridTest, GetCenterOfCell) {
   EXPECT_THAT(hybrid_grid.GetCellIndex(center), AllCwiseEqual(index));
 }
 
+TEST(HybridGridTest, GetOctantValues) {
+  HybridGrid hybrid_grid(1.f);
+  std::mt19937 rng(42);
+  std::uniform_real_distribution<float> value_distribution(
+      mapping::kMinProbability, mapping::kMaxProbability);
+  // Cover several FlatGrids, leaving some of them unallocated.
+  for (int z = -10; z != 4; ++z) {
+    for (int y = -10; y != 10; ++y) {
+      for (int x = -10; x != 10; ++x) {
+        hybrid_grid.SetProbability(Eigen::Array3i(x, y, z),
+                                   value_distribution(rng));
+      }
+    }
+  }
+  for (int z = -20; z != 20; ++z) {
+    for (int y = -12; y != 12; ++y) {
+      for (int x = -12; x != 12; ++x) {
+        const Eigen::Array3i index(x, y, z);
+        const std::array<uint16, 8> values =
+            hybrid_grid.GetOctantValues(index);
+        for (int i = 0; i != 8; ++i) {
+          EXPECT_EQ(hybrid_grid.value(index + HybridGrid::GetOctant(i)),
+                    values[i]);
+        }
+      }
+    }
+  }
+}
+
+TEST(HybridGridTest, AllocatesBlocksFromPool) {
+  HybridGrid hybrid_grid(1.f);
+  EXPECT_EQ(0, hybrid_grid.num_blocks());
+  hybrid_grid.SetProbability(Eigen::Array3i(0, 0, 0), 0.6f);
+  hybrid_grid.SetProbability(Eigen::Array3i(1, 2, 3), 0.6f);
+  EXPECT_EQ(1, hybrid_grid.num_blocks());
+  hybrid_grid.SetProbability(Eigen::Array3i(-1, 0, 0), 0.6f);
+  hybrid_grid.SetProbability(Eigen::Array3i(200, -300, 100), 0.6f);
+  EXPECT_EQ(3, hybrid_grid.num_blocks());
+  EXPECT_LE(3 * 512 * sizeof(uint16), hybrid_grid.num_bytes());
+
+  // Moving keeps the blocks valid.
+  HybridGrid moved_hybrid_grid = std::move(hybrid_grid);
+  EXPECT_EQ(3, moved_hybrid_grid.num_blocks());
+  moved_hybrid_grid.SetProbability(Eigen::Array3i(500, 0, 0), 0.6f);
+  EXPECT_NEAR(0.6f, moved_hybrid_grid.GetProbability(Eigen::Array3i(-1, 0, 0)),
+              1e-4);
+  EXPECT_NEAR(0.6f,
+              moved_hybrid_grid.GetProbability(Eigen::Array3i(200, -300, 100)),
+              1e-4);
+  EXPECT_EQ(4, moved_hybrid_grid.num_blocks());
+}
+
+TEST(BlockPoolTest, AllocatesDefaultConstructedBlocks) {
+  BlockPool<std::array<int, 3>> block_pool;
+  std::vector<std::array<int, 3>*> blocks;
+  for (int i = 0; i != 1000; ++i) {
+    blocks.push_back(block_pool.Allocate());
+    for (const int value : *blocks.back()) {
+      EXPECT_EQ(0, value);
+    }
+    blocks.back()->fill(i);
+  }
+  EXPECT_EQ(1000, block_pool.num_blocks());
+  EXPECT_LE(1000 * sizeof(std::array<int, 3>), block_pool.num_bytes());
+  for (int i = 0; i != 1000; ++i) {
+    EXPECT_EQ(i, (*blocks[i])[2]);
+  }
+}
+
+// Returns cells along a random walk through and beyond a filled region, with
+// occasional jumps.
+std::vector<Eigen::Array3i> GenerateCellIndices(std::mt19937* const rng) {
+  std::uniform_int_distribution<int> step_distribution(-1, 1);
+  std::uniform_int_distribution<int> jump_distribution(-60, 60);
+  std::vector<Eigen::Array3i> cell_indices;
+  Eigen::Array3i cell_index = Eigen::Array3i::Zero();
+  for (int i = 0; i != 5000; ++i) {
+    if (i % 100 == 0) {
+      cell_index = Eigen::Array3i(jump_distribution(*rng),
+                                  jump_distribution(*rng),
+                                  jump_distribution(*rng));
+    }
+    cell_index += Eigen::Array3i(step_distribution(*rng),
+                                 step_distribution(*rng),
+                                 step_distribution(*rng));
+    cell_indices.push_back(cell_index);
+  }
+  return cell_indices;
+}
+
+TEST(HybridGridTest, BatchedLookups) {
+  std::mt19937 rng(42);
+  HybridGrid hybrid_grid(1.f);
+  std::uniform_real_distribution<float> value_distribution(
+      mapping::kMinProbability, mapping::kMaxProbability);
+  for (int z = -20; z != 20; ++z) {
+    for (int y = -20; y != 20; ++y) {
+      for (int x = -20; x != 20; ++x) {
+        hybrid_grid.SetProbability(Eigen::Array3i(x, y, z),
+                                   value_distribution(rng));
+      }
+    }
+  }
+  const std::vector<Eigen::Array3i> cell_indices = GenerateCellIndices(&rng);
+
+  const std::vector<uint16> values = hybrid_grid.GetValues(cell_indices);
+  ASSERT_EQ(cell_indices.size(), values.size());
+  for (size_t i = 0; i != cell_indices.size(); ++i) {
+    EXPECT_EQ(hybrid_grid.value(cell_indices[i]), values[i]);
+  }
+
+  const std::vector<uint16*> mutable_values =
+      hybrid_grid.GetMutableValues(cell_indices);
+  ASSERT_EQ(cell_indices.size(), mutable_values.size());
+  for (size_t i = 0; i != cell_indices.size(); ++i) {
+    EXPECT_EQ(hybrid_grid.mutable_value(cell_indices[i]), mutable_values[i]);
+  }
+}
+
+TEST(HybridGridTest, BatchedApplyLookupTable) {
+  std::mt19937 rng(42);
+  const std::vector<Eigen::Array3i> cell_indices = GenerateCellIndices(&rng);
+  const std::vector<uint16> table =
+      mapping::ComputeLookupTableToApplyOdds(mapping::Odds(0.7f));
+  HybridGrid expected_hybrid_grid(1.f);
+  HybridGrid hybrid_grid(1.f);
+  for (int i = 0; i != 2; ++i) {
+    for (const Eigen::Array3i& cell_index : cell_indices) {
+      expected_hybrid_grid.ApplyLookupTable(cell_index, table);
+    }
+    expected_hybrid_grid.FinishUpdate();
+    hybrid_grid.ApplyLookupTable(cell_indices, table);
+    hybrid_grid.FinishUpdate();
+  }
+  for (const Eigen::Array3i& cell_index : cell_indices) {
+    EXPECT_EQ(expected_hybrid_grid.value(cell_index),
+              hybrid_grid.value(cell_index));
+  }
+}
+
+TEST(HybridGridTest, SortByMortonCode) {
+  std::mt19937 rng(42);
+  std::uniform_int_distribution<int> xyz_distribution(-100, 100);
+  std::vector<Eigen::Array3i> cell_indices;
+  for (int i = 0; i != 10000; ++i) {
+    cell_indices.emplace_back(xyz_distribution(rng), xyz_distribution(rng),
+                              xyz_distribution(rng));
+  }
+  std::vector<Eigen::Array3i> sorted_cell_indices = cell_indices;
+  SortByMortonCode(&sorted_cell_indices);
+
+  const auto to_tuple = [](const Eigen::Array3i& index) {
+    return std::make_tuple(index.x(), index.y(), index.z());
+  };
+  std::multiset<std::tuple<int, int, int>> expected;
+  std::multiset<std::tuple<int, int, int>> actual;
+  for (size_t i = 0; i != cell_indices.size(); ++i) {
+    expected.insert(to_tuple(cell_indices[i]));
+    actual.insert(to_tuple(sorted_cell_indices[i]));
+  }
+  EXPECT_EQ(expected, actual);
+
+  // The cells of each FlatGrid are consecutive.
+  const auto to_block = [](const Eigen::Array3i& index) {
+    return std::make_tuple(index.x() >> kFlatGridBits,
+                           index.y() >> kFlatGridBits,
+                           index.z() >> kFlatGridBits);
+  };
+  std::set<std::tuple<int, int, int>> finished_blocks;
+  for (size_t i = 1; i != sorted_cell_indices.size(); ++i) {
+    const auto previous_block = to_block(sorted_cell_indices[i - 1]);
+    const auto block = to_block(sorted_cell_indices[i]);
+    if (block != previous_block) {
+      finished_blocks.insert(previous_block);
+      EXPECT_EQ(0, finished_blocks.count(block));
+    }
+  }
+}
+
 class RandomHybridGridTest : public ::testing::Test {
  public:
   RandomHybridGridTest() : hybrid_grid_(2.f), values_() {
@@ -16,6 +16,10 @@
 
 #include "cartographer/mapping_3d/range_data_inserter.h"
 
+#include <algorithm>
+#include <limits>
+#include <vector>
+
 #include "Eigen/Core"
 #include "cartographer/mapping/probability_values.h"
 #include "glog/logging.h"
@@ -25,31 +29,77 @@ namespace mapping_3d {
 
 namespace {
 
+// Bounds the memory reserved up front for the misses of all rays.
+constexpr int kMaxReservedMissesPerRay = 16;
+
+// Appends to 'miss_cells' the cells the ray from 'hit' to 'origin' passes
+// through after leaving 'hit_cell', up to 'num_free_space_voxels' of them and
+// ending with 'origin_cell'. Points are given in units of cells, so that cell
+// boundaries are at half-integers. Cells are visited in the order the ray
+// enters them as in J. Amanatides and A. Woo, "A Fast Voxel Traversal
+// Algorithm for Ray Tracing", so each cell the ray passes through is visited
+// exactly once.
+void AppendMissCells(const Eigen::Array3f& origin,
+                     const Eigen::Array3i& origin_cell,
+                     const Eigen::Array3f& hit, const Eigen::Array3i& hit_cell,
+                     const int num_free_space_voxels,
+                     std::vector<Eigen::Array3i>* const miss_cells) {
+  const Eigen::Array3f direction = origin - hit;
+  // For each dimension, the direction of the steps, the ray parameter at which
+  // the ray crosses the next cell boundary and the increment of the ray
+  // parameter from one boundary to the next.
+  Eigen::Array3i step;
+  Eigen::Array3f next_boundary;
+  Eigen::Array3f boundary_distance;
+  for (int i = 0; i != 3; ++i) {
+    if (direction[i] == 0.f) {
+      step[i] = 0;
+      next_boundary[i] = std::numeric_limits<float>::infinity();
+      boundary_distance[i] = std::numeric_limits<float>::infinity();
+      continue;
+    }
+    step[i] = direction[i] > 0.f ? 1 : -1;
+    next_boundary[i] =
+        (hit_cell[i] + 0.5f * step[i] - hit[i]) / direction[i];
+    boundary_distance[i] = step[i] / direction[i];
+  }
+  Eigen::Array3i cell = hit_cell;
+  for (int i = 0; i != num_free_space_voxels && (cell != origin_cell).any();
+       ++i) {
+    int dimension;
+    // Rounding can make the cell containing 'origin' differ from
+    // 'origin_cell', in which case we stop at 'origin'.
+    if (next_boundary.minCoeff(&dimension) > 1.f) {
+      break;
+    }
+    cell[dimension] += step[dimension];
+    next_boundary[dimension] += boundary_distance[dimension];
+    miss_cells->push_back(cell);
+  }
+}
+
 void InsertMissesIntoGrid(const std::vector<uint16>& miss_table,
                           const Eigen::Vector3f& origin,
                           const sensor::PointCloud& returns,
                           HybridGrid* hybrid_grid,
                           const int num_free_space_voxels) {
   const Eigen::Array3i origin_cell = hybrid_grid->GetCellIndex(origin);
+  const Eigen::Array3f scaled_origin =
+      origin.array() / hybrid_grid->resolution();
+  // Consecutive cells along a ray are mostly in the same FlatGrid, so they are
+  // looked up as one batch.
+  std::vector<Eigen::Array3i> miss_cells;
+  miss_cells.reserve(returns.size() *
+                     std::min(num_free_space_voxels, kMaxReservedMissesPerRay));
   for (const Eigen::Vector3f& hit : returns) {
-    const Eigen::Array3i hit_cell = hybrid_grid->GetCellIndex(hit);
-
-    const Eigen::Array3i delta = hit_cell - origin_cell;
-    const int num_samples = delta.cwiseAbs().maxCoeff();
-    CHECK_LT(num_samples, 1 << 15);
-    // 'num_samples' is the number of samples we equi-distantly place on the
-    // line between 'origin' and 'hit'. (including a fractional part for sub-
-    // voxels) It is chosen so that between two samples we change from one voxel
-    // to the next on the fastest changing dimension.
-    //
-    // Only the last 'num_free_space_voxels' are updated for performance.
-    for (int position = std::max(0, num_samples - num_free_space_voxels);
-         position < num_samples; ++position) {
-      const Eigen::Array3i miss_cell =
-          origin_cell + delta * position / num_samples;
-      hybrid_grid->ApplyLookupTable(miss_cell, miss_table);
-    }
+    // Only the last 'num_free_space_voxels' before the 'hit' are updated for
+    // performance, so we traverse the ray backwards starting at the 'hit'.
+    AppendMissCells(scaled_origin, origin_cell,
+                    hit.array() / hybrid_grid->resolution(),
+                    hybrid_grid->GetCellIndex(hit), num_free_space_voxels,
+                    &miss_cells);
   }
+  hybrid_grid->ApplyLookupTable(miss_cells, miss_table);
 }
 
 }  // namespace
@@ -80,10 +130,12 @@ void RangeDataInserter::Insert(const sensor::RangeData& range_data,
                                HybridGrid* hybrid_grid) const {
   CHECK_NOTNULL(hybrid_grid);
 
+  std::vector<Eigen::Array3i> hit_cells;
+  hit_cells.reserve(range_data.returns.size());
   for (const Eigen::Vector3f& hit : range_data.returns) {
-    const Eigen::Array3i hit_cell = hybrid_grid->GetCellIndex(hit);
-    hybrid_grid->ApplyLookupTable(hit_cell, hit_table_);
+    hit_cells.push_back(hybrid_grid->GetCellIndex(hit));
   }
+  hybrid_grid->ApplyLookupTable(hit_cells, hit_table_);
 
   // By not starting a new update after hits are inserted, we give hits priority
   // (i.e. no hits will be ignored because of a miss in the same cell).
@@ -17,9 +17,12 @@
 #include "cartographer/mapping_3d/range_data_inserter.h"
 
 #include <memory>
+#include <set>
+#include <tuple>
 #include <vector>
 
 #include "cartographer/common/lua_parameter_dictionary_test_helpers.h"
+#include "cartographer/common/math.h"
 #include "gmock/gmock.h"
 
 namespace cartographer {
@@ -47,6 +50,11 @@ class RangeDataInserterTest : public ::testing::Test {
                                  &hybrid_grid_);
   }
 
+  void InsertRay(const Eigen::Vector3f& origin, const Eigen::Vector3f& hit) {
+    range_data_inserter_->Insert(sensor::RangeData{origin, {hit}, {}},
+                                 &hybrid_grid_);
+  }
+
   float GetProbability(float x, float y, float z) const {
     return hybrid_grid_.GetProbability(
         hybrid_grid_.GetCellIndex(Eigen::Vector3f(x, y, z)));
@@ -102,6 +110,40 @@ TEST_F(RangeDataInserterTest, ProbabilityProgression) {
   EXPECT_NEAR(mapping::kMinProbability, GetProbability(0.f, 0.f, -3.f), 1e-3);
 }
 
+TEST_F(RangeDataInserterTest, InsertsEachCellAlongTheRay) {
+  const Eigen::Vector3f origin(0.1f, 0.2f, 0.3f);
+  const Eigen::Vector3f hit(6.3f, 2.9f, -3.4f);
+  InsertRay(origin, hit);
+  // Densely sample the ray to find the cells it passes through.
+  std::set<std::tuple<int, int, int>> miss_cells;
+  for (float t = 0.f; t < 1.f; t += 1e-4f) {
+    const Eigen::Vector3f point = origin + t * (hit - origin);
+    const Eigen::Array3i cell(common::RoundToInt(point.x()),
+                              common::RoundToInt(point.y()),
+                              common::RoundToInt(point.z()));
+    miss_cells.emplace(cell.x(), cell.y(), cell.z());
+  }
+  EXPECT_NEAR(options().hit_probability(),
+              GetProbability(hit.x(), hit.y(), hit.z()), 1e-4);
+  miss_cells.erase(std::make_tuple(6, 3, -3));
+  for (int z = -5; z <= 2; ++z) {
+    for (int y = -1; y <= 5; ++y) {
+      for (int x = -1; x <= 8; ++x) {
+        if (x == 6 && y == 3 && z == -3) {
+          continue;
+        }
+        if (miss_cells.count(std::make_tuple(x, y, z)) == 0) {
+          EXPECT_FALSE(IsKnown(x, y, z)) << x << " " << y << " " << z;
+        } else {
+          EXPECT_NEAR(options().miss_probability(), GetProbability(x, y, z),
+                      1e-4)
+              << x << " " << y << " " << z;
+        }
+      }
+    }
+  }
+}
+
 }  // namespace
 }  // namespace mapping_3d
 }  // namespace cartographer
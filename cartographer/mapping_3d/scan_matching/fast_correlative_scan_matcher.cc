@@ -27,6 +27,7 @@
 #include "cartographer/mapping_3d/scan_matching/low_resolution_matcher.h"
 #include "cartographer/mapping_3d/scan_matching/precomputation_grid.h"
 #include "cartographer/mapping_3d/scan_matching/proto/fast_correlative_scan_matcher_options.pb.h"
+#include "cartographer/mapping_3d/scan_matching/scoring_kernels.h"
 #include "cartographer/transform/transform.h"
 #include "glog/logging.h"
 
@@ -52,6 +53,8 @@ CreateFastCorrelativeScanMatcherOptions(
       parameter_dictionary->GetDouble("linear_z_search_window"));
   options.set_angular_search_window(
       parameter_dictionary->GetDouble("angular_search_window"));
+  options.set_parallel_branch_and_bound(
+      parameter_dictionary->GetBool("parallel_branch_and_bound"));
   return options;
 }
 
@@ -59,11 +62,14 @@ class PrecomputationGridStack {
  public:
   PrecomputationGridStack(
       const HybridGrid& hybrid_grid,
-      const proto::FastCorrelativeScanMatcherOptions& options) {
+      const proto::FastCorrelativeScanMatcherOptions& options,
+      common::ThreadPool* const thread_pool) {
     CHECK_GE(options.branch_and_bound_depth(), 1);
     CHECK_GE(options.full_resolution_depth(), 1);
     precomputation_grids_.reserve(options.branch_and_bound_depth());
-    precomputation_grids_.push_back(ConvertToPrecomputationGrid(hybrid_grid));
+    auto precomputation_grid = common::make_unique<PrecomputationGrid>(
+        ConvertToPrecomputationGrid(hybrid_grid));
+    precomputation_grids_.emplace_back(*precomputation_grid);
     Eigen::Array3i last_width = Eigen::Array3i::Ones();
     for (int depth = 1; depth != options.branch_and_bound_depth(); ++depth) {
       const bool half_resolution = depth >= options.full_resolution_depth();
@@ -74,26 +80,41 @@ class PrecomputationGridStack {
           (next_width - last_width +
            (full_voxels_per_high_resolution_voxel - 1)) /
           full_voxels_per_high_resolution_voxel;
-      precomputation_grids_.push_back(
-          PrecomputeGrid(precomputation_grids_.back(), half_resolution, shift));
+      precomputation_grid = common::make_unique<PrecomputationGrid>(
+          PrecomputeGrid(*precomputation_grid, half_resolution, shift,
+                         thread_pool));
+      precomputation_grids_.emplace_back(*precomputation_grid);
       last_width = next_width;
     }
   }
 
-  const PrecomputationGrid& Get(int depth) const {
+  const PagedPrecomputationGrid& Get(int depth) const {
     return precomputation_grids_.at(depth);
   }
 
   int max_depth() const { return precomputation_grids_.size() - 1; }
 
+  int64 size_in_bytes() const {
+    int64 result = 0;
+    for (const PagedPrecomputationGrid& precomputation_grid :
+         precomputation_grids_) {
+      result += precomputation_grid.size_in_bytes();
+    }
+    return result;
+  }
+
  private:
-  std::vector<PrecomputationGrid> precomputation_grids_;
+  // The PrecomputationGrids themselves are only kept until the next depth is
+  // computed from them.
+  std::vector<PagedPrecomputationGrid> precomputation_grids_;
 };
 
 struct DiscreteScan {
   transform::Rigid3f pose;
-  // Contains a vector of discretized scans for each 'depth'.
-  std::vector<std::vector<Eigen::Array3i>> cell_indices_per_depth;
+  // Points to the 'num_cell_indices' cell indices of the discretized scan for
+  // each 'depth'. All full resolution depths point to the same cell indices.
+  std::vector<const Eigen::Array3i*> cell_indices_per_depth;
+  int num_cell_indices;
   float rotational_score;
 };
 
@@ -138,23 +159,38 @@ std::vector<std::pair<Eigen::VectorXf, float>> HistogramsAtAnglesFromNodes(
   return histograms_at_angles;
 }
 
+// Raises 'best_score' to 'score' unless it is already at least as high.
+void UpdateBestScore(const float score, std::atomic<float>* const best_score) {
+  float current_best_score = best_score->load();
+  while (score > current_best_score &&
+         !best_score->compare_exchange_weak(current_best_score, score)) {
+  }
+}
+
 }  // namespace
 
 FastCorrelativeScanMatcher::FastCorrelativeScanMatcher(
     const HybridGrid& hybrid_grid,
     const HybridGrid* const low_resolution_hybrid_grid,
     const std::vector<mapping::TrajectoryNode>& nodes,
-    const proto::FastCorrelativeScanMatcherOptions& options)
+    const proto::FastCorrelativeScanMatcherOptions& options,
+    common::ThreadPool* const thread_pool)
     : options_(options),
       resolution_(hybrid_grid.resolution()),
       width_in_voxels_(hybrid_grid.grid_size()),
       precomputation_grid_stack_(
-          common::make_unique<PrecomputationGridStack>(hybrid_grid, options)),
+          common::make_unique<PrecomputationGridStack>(hybrid_grid, options,
+                                                       thread_pool)),
       low_resolution_hybrid_grid_(low_resolution_hybrid_grid),
-      rotational_scan_matcher_(HistogramsAtAnglesFromNodes(nodes)) {}
+      rotational_scan_matcher_(HistogramsAtAnglesFromNodes(nodes)),
+      thread_pool_(thread_pool) {}
 
 FastCorrelativeScanMatcher::~FastCorrelativeScanMatcher() {}
 
+int64 FastCorrelativeScanMatcher::size_in_bytes() const {
+  return precomputation_grid_stack_->size_in_bytes();
+}
+
 bool FastCorrelativeScanMatcher::Match(
     const transform::Rigid3d& initial_pose_estimate,
     const mapping::TrajectoryNode::Data& constant_data, const float min_score,
@@ -212,16 +248,22 @@ bool FastCorrelativeScanMatcher::MatchWithSearchParameters(
   CHECK_NOTNULL(score);
   CHECK_NOTNULL(pose_estimate);
 
+  std::vector<Eigen::Array3i> cell_indices;
   const std::vector<DiscreteScan> discrete_scans = GenerateDiscreteScans(
       search_parameters, point_cloud, rotational_scan_matcher_histogram,
-      gravity_alignment, initial_pose_estimate.cast<float>());
+      gravity_alignment, initial_pose_estimate.cast<float>(), &cell_indices);
 
   const std::vector<Candidate> lowest_resolution_candidates =
       ComputeLowestResolutionCandidates(search_parameters, discrete_scans);
 
-  const Candidate best_candidate = BranchAndBound(
-      search_parameters, discrete_scans, lowest_resolution_candidates,
-      precomputation_grid_stack_->max_depth(), min_score);
+  const Candidate best_candidate =
+      options_.parallel_branch_and_bound() && thread_pool_ != nullptr
+          ? ParallelBranchAndBound(search_parameters, discrete_scans,
+                                   lowest_resolution_candidates, min_score)
+          : BranchAndBound(search_parameters, discrete_scans,
+                           lowest_resolution_candidates,
+                           precomputation_grid_stack_->max_depth(), min_score,
+                           nullptr /* best_score */);
   if (best_candidate.score > min_score) {
     *score = best_candidate.score;
     *pose_estimate =
@@ -234,26 +276,32 @@ bool FastCorrelativeScanMatcher::MatchWithSearchParameters(
   return false;
 }
 
+int FastCorrelativeScanMatcher::GetNumDistinctDepths() const {
+  const int full_resolution_depth = std::min(options_.full_resolution_depth(),
+                                             options_.branch_and_bound_depth());
+  CHECK_GE(full_resolution_depth, 1);
+  return 1 + options_.branch_and_bound_depth() - full_resolution_depth;
+}
+
 DiscreteScan FastCorrelativeScanMatcher::DiscretizeScan(
     const FastCorrelativeScanMatcher::SearchParameters& search_parameters,
     const sensor::PointCloud& point_cloud, const transform::Rigid3f& pose,
-    const float rotational_score) const {
-  std::vector<std::vector<Eigen::Array3i>> cell_indices_per_depth;
-  const PrecomputationGrid& original_grid = precomputation_grid_stack_->Get(0);
-  std::vector<Eigen::Array3i> full_resolution_cell_indices;
-  for (const Eigen::Vector3f& point :
-       sensor::TransformPointCloud(point_cloud, pose)) {
-    full_resolution_cell_indices.push_back(original_grid.GetCellIndex(point));
+    const float rotational_score, Eigen::Array3i* const cell_indices) const {
+  const int num_cell_indices = point_cloud.size();
+  std::vector<const Eigen::Array3i*> cell_indices_per_depth;
+  Eigen::Array3i* const full_resolution_cell_indices = cell_indices;
+  for (int i = 0; i != num_cell_indices; ++i) {
+    const Eigen::Array3f index = (pose * point_cloud[i]).array() / resolution_;
+    full_resolution_cell_indices[i] = Eigen::Array3i(
+        common::RoundToInt(index.x()), common::RoundToInt(index.y()),
+        common::RoundToInt(index.z()));
   }
-  const int full_resolution_depth = std::min(options_.full_resolution_depth(),
-                                             options_.branch_and_bound_depth());
-  CHECK_GE(full_resolution_depth, 1);
+  const int low_resolution_depth = GetNumDistinctDepths() - 1;
+  const int full_resolution_depth =
+      options_.branch_and_bound_depth() - low_resolution_depth;
   for (int i = 0; i != full_resolution_depth; ++i) {
     cell_indices_per_depth.push_back(full_resolution_cell_indices);
   }
-  const int low_resolution_depth =
-      options_.branch_and_bound_depth() - full_resolution_depth;
-  CHECK_GE(low_resolution_depth, 0);
   const Eigen::Array3i search_window_start(
       -search_parameters.linear_xy_window_size,
       -search_parameters.linear_xy_window_size,
@@ -264,18 +312,22 @@ DiscreteScan FastCorrelativeScanMatcher::DiscretizeScan(
         search_window_start[0] >> reduction_exponent,
         search_window_start[1] >> reduction_exponent,
         search_window_start[2] >> reduction_exponent);
-    cell_indices_per_depth.emplace_back();
-    for (const Eigen::Array3i& cell_index : full_resolution_cell_indices) {
-      const Eigen::Array3i cell_at_start = cell_index + search_window_start;
+    Eigen::Array3i* const low_resolution_cell_indices =
+        cell_indices + (i + 1) * num_cell_indices;
+    for (int j = 0; j != num_cell_indices; ++j) {
+      const Eigen::Array3i cell_at_start =
+          full_resolution_cell_indices[j] + search_window_start;
       const Eigen::Array3i low_resolution_cell_at_start(
           cell_at_start[0] >> reduction_exponent,
           cell_at_start[1] >> reduction_exponent,
           cell_at_start[2] >> reduction_exponent);
-      cell_indices_per_depth.back().push_back(
-          low_resolution_cell_at_start - low_resolution_search_window_start);
+      low_resolution_cell_indices[j] =
+          low_resolution_cell_at_start - low_resolution_search_window_start;
     }
+    cell_indices_per_depth.push_back(low_resolution_cell_indices);
   }
-  return DiscreteScan{pose, cell_indices_per_depth, rotational_score};
+  return DiscreteScan{pose, cell_indices_per_depth, num_cell_indices,
+                      rotational_score};
 }
 
 std::vector<DiscreteScan> FastCorrelativeScanMatcher::GenerateDiscreteScans(
@@ -283,8 +335,8 @@ std::vector<DiscreteScan> FastCorrelativeScanMatcher::GenerateDiscreteScans(
     const sensor::PointCloud& point_cloud,
     const Eigen::VectorXf& rotational_scan_matcher_histogram,
     const Eigen::Quaterniond& gravity_alignment,
-    const transform::Rigid3f& initial_pose) const {
-  std::vector<DiscreteScan> result;
+    const transform::Rigid3f& initial_pose,
+    std::vector<Eigen::Array3i>* const cell_indices) const {
   // We set this value to something on the order of resolution to make sure that
   // the std::acos() below is defined.
   float max_scan_range = 3.f * resolution_;
@@ -309,21 +361,34 @@ std::vector<DiscreteScan> FastCorrelativeScanMatcher::GenerateDiscreteScans(
       transform::GetYaw(initial_pose.rotation() *
                         gravity_alignment.inverse().cast<float>()),
       angles);
+  std::vector<int> angle_indices;
   for (size_t i = 0; i != angles.size(); ++i) {
-    if (scores[i] < options_.min_rotational_score()) {
-      continue;
+    if (scores[i] >= options_.min_rotational_score()) {
+      angle_indices.push_back(i);
     }
-    const Eigen::Vector3f angle_axis(0.f, 0.f, angles[i]);
-    // It's important to apply the 'angle_axis' rotation between the translation
-    // and rotation of the 'initial_pose', so that the rotation is around the
-    // origin of the range data, and yaw is in map frame.
-    const transform::Rigid3f pose(
-        initial_pose.translation(),
-        transform::AngleAxisVectorToRotationQuaternion(angle_axis) *
-            initial_pose.rotation());
-    result.push_back(
-        DiscretizeScan(search_parameters, point_cloud, pose, scores[i]));
   }
+  // The cell indices of all discrete scans are allocated at once, each scan
+  // using 'num_cell_indices_per_scan' of them.
+  const size_t num_cell_indices_per_scan =
+      point_cloud.size() * GetNumDistinctDepths();
+  cell_indices->resize(angle_indices.size() * num_cell_indices_per_scan);
+  std::vector<DiscreteScan> result(angle_indices.size());
+  common::ParallelFor(
+      options_.parallel_branch_and_bound() ? thread_pool_ : nullptr,
+      angle_indices.size(), [&](const int index) {
+        const int angle_index = angle_indices[index];
+        const Eigen::Vector3f angle_axis(0.f, 0.f, angles[angle_index]);
+        // It's important to apply the 'angle_axis' rotation between the
+        // translation and rotation of the 'initial_pose', so that the rotation
+        // is around the origin of the range data, and yaw is in map frame.
+        const transform::Rigid3f pose(
+            initial_pose.translation(),
+            transform::AngleAxisVectorToRotationQuaternion(angle_axis) *
+                initial_pose.rotation());
+        result[index] = DiscretizeScan(
+            search_parameters, point_cloud, pose, scores[angle_index],
+            cell_indices->data() + index * num_cell_indices_per_scan);
+      });
   return result;
 }
 
@@ -365,23 +430,27 @@ FastCorrelativeScanMatcher::GenerateLowestResolutionCandidates(
 void FastCorrelativeScanMatcher::ScoreCandidates(
     const int depth, const std::vector<DiscreteScan>& discrete_scans,
     std::vector<Candidate>* const candidates) const {
+  if (candidates->empty()) {
+    return;
+  }
+  // All discrete scans are of the same point cloud.
+  const ScoringFunction scoring_function = GetScoringFunction(
+      GetFastestScoringKernel(discrete_scans.front().num_cell_indices));
+  const ScoringGrid scoring_grid =
+      precomputation_grid_stack_->Get(depth).scoring_grid();
   const int reduction_exponent =
       std::max(0, depth - options_.full_resolution_depth() + 1);
   for (Candidate& candidate : *candidates) {
-    int sum = 0;
     const DiscreteScan& discrete_scan = discrete_scans[candidate.scan_index];
     const Eigen::Array3i offset(candidate.offset[0] >> reduction_exponent,
                                 candidate.offset[1] >> reduction_exponent,
                                 candidate.offset[2] >> reduction_exponent);
     CHECK_LT(depth, discrete_scan.cell_indices_per_depth.size());
-    for (const Eigen::Array3i& cell_index :
-         discrete_scan.cell_indices_per_depth[depth]) {
-      const Eigen::Array3i proposed_cell_index = cell_index + offset;
-      sum += precomputation_grid_stack_->Get(depth).value(proposed_cell_index);
-    }
+    const int sum = scoring_function(
+        scoring_grid, discrete_scan.cell_indices_per_depth[depth],
+        discrete_scan.num_cell_indices, offset);
     candidate.score = PrecomputationGrid::ToProbability(
-        sum /
-        static_cast<float>(discrete_scan.cell_indices_per_depth[depth].size()));
+        sum / static_cast<float>(discrete_scan.num_cell_indices));
   }
   std::sort(candidates->begin(), candidates->end(), std::greater<Candidate>());
 }
@@ -410,10 +479,16 @@ Candidate FastCorrelativeScanMatcher::BranchAndBound(
     const FastCorrelativeScanMatcher::SearchParameters& search_parameters,
     const std::vector<DiscreteScan>& discrete_scans,
     const std::vector<Candidate>& candidates, const int candidate_depth,
-    float min_score) const {
+    float min_score, std::atomic<float>* const best_score) const {
+  // Candidates as good as one found by a concurrent search are kept, so that
+  // ties are resolved as in the sequential search.
+  const auto can_improve = [min_score, best_score](const float score) {
+    return score > min_score &&
+           (best_score == nullptr || score >= best_score->load());
+  };
   if (candidate_depth == 0) {
     for (const Candidate& candidate : candidates) {
-      if (candidate.score <= min_score) {
+      if (!can_improve(candidate.score)) {
         // Return if the candidate is bad because the following candidate will
         // not have better score.
         return Candidate::Unsuccessful();
@@ -436,7 +511,7 @@ Candidate FastCorrelativeScanMatcher::BranchAndBound(
   Candidate best_high_resolution_candidate = Candidate::Unsuccessful();
   best_high_resolution_candidate.score = min_score;
   for (const Candidate& candidate : candidates) {
-    if (candidate.score <= min_score) {
+    if (!can_improve(candidate.score)) {
       break;
     }
     std::vector<Candidate> higher_resolution_candidates;
@@ -466,11 +541,42 @@ Candidate FastCorrelativeScanMatcher::BranchAndBound(
         best_high_resolution_candidate,
         BranchAndBound(search_parameters, discrete_scans,
                        higher_resolution_candidates, candidate_depth - 1,
-                       best_high_resolution_candidate.score));
+                       best_high_resolution_candidate.score, best_score));
+    if (best_score != nullptr) {
+      UpdateBestScore(best_high_resolution_candidate.score, best_score);
+    }
   }
   return best_high_resolution_candidate;
 }
 
+Candidate FastCorrelativeScanMatcher::ParallelBranchAndBound(
+    const FastCorrelativeScanMatcher::SearchParameters& search_parameters,
+    const std::vector<DiscreteScan>& discrete_scans,
+    const std::vector<Candidate>& candidates, const float min_score) const {
+  // The candidates are sorted, so only a prefix can beat 'min_score'.
+  const int num_tasks =
+      std::find_if(candidates.begin(), candidates.end(),
+                   [min_score](const Candidate& candidate) {
+                     return candidate.score <= min_score;
+                   }) -
+      candidates.begin();
+  std::atomic<float> best_score(min_score);
+  std::vector<Candidate> best_candidates(num_tasks,
+                                         Candidate::Unsuccessful());
+  common::ParallelFor(thread_pool_, num_tasks, [&](const int index) {
+    best_candidates[index] = BranchAndBound(
+        search_parameters, discrete_scans, {candidates[index]},
+        precomputation_grid_stack_->max_depth(), min_score, &best_score);
+  });
+  // On ties, the first candidate wins as it would in the sequential search.
+  Candidate best_candidate = Candidate::Unsuccessful();
+  best_candidate.score = min_score;
+  for (const Candidate& candidate : best_candidates) {
+    best_candidate = std::max(best_candidate, candidate);
+  }
+  return best_candidate;
+}
+
 }  // namespace scan_matching
 }  // namespace mapping_3d
 }  // namespace cartographer
@@ -20,11 +20,13 @@
 #ifndef CARTOGRAPHER_MAPPING_3D_SCAN_MATCHING_FAST_CORRELATIVE_SCAN_MATCHER_H_
 #define CARTOGRAPHER_MAPPING_3D_SCAN_MATCHING_FAST_CORRELATIVE_SCAN_MATCHER_H_
 
+#include <atomic>
 #include <memory>
 #include <vector>
 
 #include "Eigen/Core"
 #include "cartographer/common/port.h"
+#include "cartographer/common/thread_pool.h"
 #include "cartographer/mapping/trajectory_node.h"
 #include "cartographer/mapping_2d/scan_matching/fast_correlative_scan_matcher.h"
 #include "cartographer/mapping_3d/hybrid_grid.h"
@@ -49,11 +51,16 @@ using MatchingFunction = std::function<float(const transform::Rigid3f&)>;
 
 class FastCorrelativeScanMatcher {
  public:
+  // If 'options.parallel_branch_and_bound()' is set and 'thread_pool' is not
+  // nullptr, the branch-and-bound search is split into tasks on 'thread_pool'.
+  // The result is the same as for the sequential search. The precomputation
+  // grids are computed in parallel whenever 'thread_pool' is not nullptr.
   FastCorrelativeScanMatcher(
       const HybridGrid& hybrid_grid,
       const HybridGrid* low_resolution_hybrid_grid,
       const std::vector<mapping::TrajectoryNode>& nodes,
-      const proto::FastCorrelativeScanMatcherOptions& options);
+      const proto::FastCorrelativeScanMatcherOptions& options,
+      common::ThreadPool* thread_pool);
   ~FastCorrelativeScanMatcher();
 
   FastCorrelativeScanMatcher(const FastCorrelativeScanMatcher&) = delete;
@@ -81,6 +88,9 @@ class FastCorrelativeScanMatcher {
                        float* rotational_score,
                        float* low_resolution_score) const;
 
+  // Returns the memory used by the precomputation grids.
+  int64 size_in_bytes() const;
+
  private:
   struct SearchParameters {
     const int linear_xy_window_size;     // voxels
@@ -97,16 +107,25 @@ class FastCorrelativeScanMatcher {
       const Eigen::Quaterniond& gravity_alignment, float min_score,
       float* score, transform::Rigid3d* pose_estimate, float* rotational_score,
       float* low_resolution_score) const;
+  // Returns the number of depths with distinct cell indices, i.e. one for all
+  // full resolution depths plus the number of low resolution depths.
+  int GetNumDistinctDepths() const;
+  // Writes 'GetNumDistinctDepths()' times 'point_cloud.size()' cell indices
+  // starting at 'cell_indices' which the returned scan points to.
   DiscreteScan DiscretizeScan(const SearchParameters& search_parameters,
                               const sensor::PointCloud& point_cloud,
                               const transform::Rigid3f& pose,
-                              float rotational_score) const;
+                              float rotational_score,
+                              Eigen::Array3i* cell_indices) const;
+  // The returned scans point into 'cell_indices' which is resized to hold the
+  // cell indices of all of them.
   std::vector<DiscreteScan> GenerateDiscreteScans(
       const SearchParameters& search_parameters,
       const sensor::PointCloud& point_cloud,
       const Eigen::VectorXf& rotational_scan_matcher_histogram,
       const Eigen::Quaterniond& gravity_alignment,
-      const transform::Rigid3f& initial_pose) const;
+      const transform::Rigid3f& initial_pose,
+      std::vector<Eigen::Array3i>* cell_indices) const;
   std::vector<Candidate> GenerateLowestResolutionCandidates(
       const SearchParameters& search_parameters, int num_discrete_scans) const;
   void ScoreCandidates(int depth,
@@ -115,10 +134,21 @@ class FastCorrelativeScanMatcher {
   std::vector<Candidate> ComputeLowestResolutionCandidates(
       const SearchParameters& search_parameters,
       const std::vector<DiscreteScan>& discrete_scans) const;
+  // Returns the best candidate with a score above 'min_score' which passes the
+  // low resolution matcher, or an unsuccessful candidate. If 'best_score' is
+  // not nullptr, it is the score of the best candidate found by any concurrent
+  // search. It is used for pruning and raised for each better candidate found.
   Candidate BranchAndBound(const SearchParameters& search_parameters,
                            const std::vector<DiscreteScan>& discrete_scans,
                            const std::vector<Candidate>& candidates,
-                           int candidate_depth, float min_score) const;
+                           int candidate_depth, float min_score,
+                           std::atomic<float>* best_score) const;
+  // Like BranchAndBound(), but searches below each of the 'candidates' in a
+  // separate task on 'thread_pool_'.
+  Candidate ParallelBranchAndBound(
+      const SearchParameters& search_parameters,
+      const std::vector<DiscreteScan>& discrete_scans,
+      const std::vector<Candidate>& candidates, float min_score) const;
   transform::Rigid3f GetPoseFromCandidate(
       const std::vector<DiscreteScan>& discrete_scans,
       const Candidate& candidate) const;
@@ -129,6 +159,7 @@ class FastCorrelativeScanMatcher {
   std::unique_ptr<PrecomputationGridStack> precomputation_grid_stack_;
   const HybridGrid* const low_resolution_hybrid_grid_;
   RotationalScanMatcher rotational_scan_matcher_;
+  common::ThreadPool* const thread_pool_;
 };
 
 }  // namespace scan_matching
@@ -37,7 +37,8 @@ class FastCorrelativeScanMatcherTest : public ::testing::Test {
  protected:
   FastCorrelativeScanMatcherTest()
       : range_data_inserter_(CreateRangeDataInserterTestOptions()),
-        options_(CreateFastCorrelativeScanMatcherTestOptions(5)) {}
+        options_(CreateFastCorrelativeScanMatcherTestOptions(5)),
+        thread_pool_(4) {}
 
   void SetUp() override {
     point_cloud_ = {
@@ -77,6 +78,7 @@ class FastCorrelativeScanMatcherTest : public ::testing::Test {
         "linear_xy_search_window = 0.8, "
         "linear_z_search_window = 0.8, "
         "angular_search_window = 0.3, "
+        "parallel_branch_and_bound = false, "
         "}");
     return CreateFastCorrelativeScanMatcherOptions(parameter_dictionary.get());
   }
@@ -109,7 +111,7 @@ class FastCorrelativeScanMatcherTest : public ::testing::Test {
             {{std::make_shared<const mapping::TrajectoryNode::Data>(
                   CreateConstantData(point_cloud_)),
               pose.cast<double>()}}),
-        options);
+        options, &thread_pool_);
   }
 
   mapping::TrajectoryNode::Data CreateConstantData(
@@ -129,6 +131,7 @@ class FastCorrelativeScanMatcherTest : public ::testing::Test {
   const proto::FastCorrelativeScanMatcherOptions options_;
   sensor::PointCloud point_cloud_;
   std::unique_ptr<HybridGrid> hybrid_grid_;
+  common::ThreadPool thread_pool_;
 };
 
 constexpr float kMinScore = 0.1f;
@@ -191,6 +194,42 @@ TEST_F(FastCorrelativeScanMatcherTest, CorrectPoseForMatchFullSubmap) {
       << low_resolution_score;
 }
 
+TEST_F(FastCorrelativeScanMatcherTest, ParallelSearchFindsSamePose) {
+  proto::FastCorrelativeScanMatcherOptions parallel_options = options_;
+  parallel_options.set_parallel_branch_and_bound(true);
+  for (int i = 0; i != 3; ++i) {
+    const auto expected_pose = GetRandomPose();
+    // Each matcher refers to 'hybrid_grid_', so it is used before the next
+    // one is created.
+    float score = 0.f;
+    transform::Rigid3d pose_estimate;
+    float rotational_score = 0.f;
+    float low_resolution_score = 0.f;
+    EXPECT_TRUE(GetFastCorrelativeScanMatcher(options_, expected_pose)
+                    ->MatchFullSubmap(Eigen::Quaterniond::Identity(),
+                                      CreateConstantData(point_cloud_),
+                                      kMinScore, &score, &pose_estimate,
+                                      &rotational_score,
+                                      &low_resolution_score));
+    float parallel_score = 0.f;
+    transform::Rigid3d parallel_pose_estimate;
+    float parallel_rotational_score = 0.f;
+    float parallel_low_resolution_score = 0.f;
+    EXPECT_TRUE(GetFastCorrelativeScanMatcher(parallel_options, expected_pose)
+                    ->MatchFullSubmap(Eigen::Quaterniond::Identity(),
+                                      CreateConstantData(point_cloud_),
+                                      kMinScore, &parallel_score,
+                                      &parallel_pose_estimate,
+                                      &parallel_rotational_score,
+                                      &parallel_low_resolution_score));
+    EXPECT_EQ(score, parallel_score);
+    EXPECT_EQ(rotational_score, parallel_rotational_score);
+    EXPECT_EQ(low_resolution_score, parallel_low_resolution_score);
+    EXPECT_EQ(transform::ToProto(pose_estimate).DebugString(),
+              transform::ToProto(parallel_pose_estimate).DebugString());
+  }
+}
+
 }  // namespace
 }  // namespace scan_matching
 }  // namespace mapping_3d
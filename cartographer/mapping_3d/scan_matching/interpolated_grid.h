@@ -17,8 +17,10 @@
 #ifndef CARTOGRAPHER_MAPPING_3D_SCAN_MATCHING_INTERPOLATED_GRID_H_
 #define CARTOGRAPHER_MAPPING_3D_SCAN_MATCHING_INTERPOLATED_GRID_H_
 
+#include <array>
 #include <cmath>
 
+#include "Eigen/Core"
 #include "cartographer/mapping_3d/hybrid_grid.h"
 
 namespace cartographer {
@@ -31,7 +33,8 @@ namespace scan_matching {
 //
 // This class is templated to work with the autodiff that Ceres provides.
 // For this reason, it is also important that the interpolation scheme be
-// continuously differentiable.
+// continuously differentiable. GetProbabilityAndGradient() computes the same
+// interpolation with analytic derivatives.
 class InterpolatedGrid {
  public:
   explicit InterpolatedGrid(const HybridGrid& hybrid_grid)
@@ -52,23 +55,15 @@ class InterpolatedGrid {
     double x1, y1, z1, x2, y2, z2;
     ComputeInterpolationDataPoints(x, y, z, &x1, &y1, &z1, &x2, &y2, &z2);
 
-    const Eigen::Array3i index1 =
-        hybrid_grid_.GetCellIndex(Eigen::Vector3f(x1, y1, z1));
-    const double q111 = hybrid_grid_.GetProbability(index1);
-    const double q112 =
-        hybrid_grid_.GetProbability(index1 + Eigen::Array3i(0, 0, 1));
-    const double q121 =
-        hybrid_grid_.GetProbability(index1 + Eigen::Array3i(0, 1, 0));
-    const double q122 =
-        hybrid_grid_.GetProbability(index1 + Eigen::Array3i(0, 1, 1));
-    const double q211 =
-        hybrid_grid_.GetProbability(index1 + Eigen::Array3i(1, 0, 0));
-    const double q212 =
-        hybrid_grid_.GetProbability(index1 + Eigen::Array3i(1, 0, 1));
-    const double q221 =
-        hybrid_grid_.GetProbability(index1 + Eigen::Array3i(1, 1, 0));
-    const double q222 =
-        hybrid_grid_.GetProbability(index1 + Eigen::Array3i(1, 1, 1));
+    const std::array<double, 8> q = GetOctantProbabilities(x1, y1, z1);
+    const double q111 = q[0];
+    const double q112 = q[4];
+    const double q121 = q[2];
+    const double q122 = q[6];
+    const double q211 = q[1];
+    const double q212 = q[5];
+    const double q221 = q[3];
+    const double q222 = q[7];
 
     const T normalized_x = (x - x1) / (x2 - x1);
     const T normalized_y = (y - y1) / (y2 - y1);
@@ -102,7 +97,64 @@ class InterpolatedGrid {
            q1;
   }
 
+  // Returns the same interpolated probability at (x, y, z) as
+  // GetProbability() and fills in its 'gradient'.
+  double GetProbabilityAndGradient(const double x, const double y,
+                                   const double z,
+                                   Eigen::Vector3d* const gradient) const {
+    double x1, y1, z1, x2, y2, z2;
+    ComputeInterpolationDataPoints(x, y, z, &x1, &y1, &z1, &x2, &y2, &z2);
+    const std::array<double, 8> q = GetOctantProbabilities(x1, y1, z1);
+
+    // Weights and their derivatives of the upper voxel in each dimension.
+    // The weight of the lower voxel is 1 - s.
+    const Eigen::Array3d normalized((x - x1) / (x2 - x1), (y - y1) / (y2 - y1),
+                                    (z - z1) / (z2 - z1));
+    const Eigen::Array3d s =
+        normalized.square() * 3. - normalized.cube() * 2.;
+    const Eigen::Array3d ds =
+        (normalized - normalized.square()) * 6. /
+        Eigen::Array3d(x2 - x1, y2 - y1, z2 - z1);
+
+    // Interpolate in z, then y, then x as in GetProbability().
+    const double q11 = q[0] + (q[4] - q[0]) * s.z();
+    const double q12 = q[2] + (q[6] - q[2]) * s.z();
+    const double q21 = q[1] + (q[5] - q[1]) * s.z();
+    const double q22 = q[3] + (q[7] - q[3]) * s.z();
+    const double q1 = q11 + (q12 - q11) * s.y();
+    const double q2 = q21 + (q22 - q21) * s.y();
+
+    const double dq11_dz = (q[4] - q[0]) * ds.z();
+    const double dq12_dz = (q[6] - q[2]) * ds.z();
+    const double dq21_dz = (q[5] - q[1]) * ds.z();
+    const double dq22_dz = (q[7] - q[3]) * ds.z();
+    const double dq1_dz = dq11_dz + (dq12_dz - dq11_dz) * s.y();
+    const double dq2_dz = dq21_dz + (dq22_dz - dq21_dz) * s.y();
+    const double dq1_dy = (q12 - q11) * ds.y();
+    const double dq2_dy = (q22 - q21) * ds.y();
+
+    gradient->x() = (q2 - q1) * ds.x();
+    gradient->y() = dq1_dy + (dq2_dy - dq1_dy) * s.x();
+    gradient->z() = dq1_dz + (dq2_dz - dq1_dz) * s.x();
+    return q1 + (q2 - q1) * s.x();
+  }
+
  private:
+  // Returns the probabilities of the 2x2x2 voxels with the lower corner at
+  // the voxel centered at (x1, y1, z1), in the order of
+  // HybridGrid::GetOctant().
+  std::array<double, 8> GetOctantProbabilities(const double x1,
+                                               const double y1,
+                                               const double z1) const {
+    const std::array<uint16, 8> values = hybrid_grid_.GetOctantValues(
+        hybrid_grid_.GetCellIndex(Eigen::Vector3f(x1, y1, z1)));
+    std::array<double, 8> probabilities;
+    for (int i = 0; i != 8; ++i) {
+      probabilities[i] = mapping::ValueToProbability(values[i]);
+    }
+    return probabilities;
+  }
+
   template <typename T>
   void ComputeInterpolationDataPoints(const T& x, const T& y, const T& z,
                                       double* x1, double* y1, double* z1,
@@ -0,0 +1,83 @@
+/*
+ * Copyright 2016 The Cartographer Authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "cartographer/mapping_3d/scan_matching/occupied_space_cost_function.h"
+
+#include "Eigen/Core"
+
+namespace cartographer {
+namespace mapping_3d {
+namespace scan_matching {
+
+OccupiedSpaceCostFunction::OccupiedSpaceCostFunction(
+    const double scaling_factor, const sensor::PointCloud& point_cloud,
+    const HybridGrid& hybrid_grid)
+    : scaling_factor_(scaling_factor),
+      point_cloud_(point_cloud),
+      interpolated_grid_(hybrid_grid) {
+  set_num_residuals(point_cloud_.size());
+  mutable_parameter_block_sizes()->push_back(3);
+  mutable_parameter_block_sizes()->push_back(4);
+}
+
+bool OccupiedSpaceCostFunction::Evaluate(double const* const* parameters,
+                                         double* const residuals,
+                                         double** const jacobians) const {
+  const Eigen::Map<const Eigen::Vector3d> translation(parameters[0]);
+  const double w = parameters[1][0];
+  const Eigen::Vector3d u(parameters[1][1], parameters[1][2],
+                          parameters[1][3]);
+  // Eigen rotates 'v' by computing v + 2w (u x v) + 2 u x (u x v). Ceres
+  // differentiates this expression for unnormalized quaternions, which is
+  // linear in 'v', so we do the same.
+  Eigen::Matrix3d u_cross;
+  u_cross << 0., -u.z(), u.y(), u.z(), 0., -u.x(), -u.y(), u.x(), 0.;
+  const Eigen::Matrix3d rotation = Eigen::Matrix3d::Identity() +
+                                   2. * w * u_cross + 2. * u_cross * u_cross;
+  double* const translation_jacobian =
+      jacobians != nullptr ? jacobians[0] : nullptr;
+  double* const rotation_jacobian =
+      jacobians != nullptr ? jacobians[1] : nullptr;
+
+  for (size_t i = 0; i < point_cloud_.size(); ++i) {
+    const Eigen::Vector3d point = point_cloud_[i].cast<double>();
+    const Eigen::Vector3d world = rotation * point + translation;
+    Eigen::Vector3d gradient;
+    const double probability = interpolated_grid_.GetProbabilityAndGradient(
+        world.x(), world.y(), world.z(), &gradient);
+    residuals[i] = scaling_factor_ * (1. - probability);
+    if (translation_jacobian != nullptr) {
+      Eigen::Map<Eigen::Vector3d>(translation_jacobian + 3 * i) =
+          -scaling_factor_ * gradient;
+    }
+    if (rotation_jacobian != nullptr) {
+      const Eigen::Vector3d dresidual_du =
+          -2. * scaling_factor_ *
+          (w * point.cross(gradient) + u.dot(point) * gradient +
+           gradient.dot(u) * point - 2. * gradient.dot(point) * u);
+      double* const row = rotation_jacobian + 4 * i;
+      row[0] = -2. * scaling_factor_ * gradient.dot(u.cross(point));
+      row[1] = dresidual_du.x();
+      row[2] = dresidual_du.y();
+      row[3] = dresidual_du.z();
+    }
+  }
+  return true;
+}
+
+}  // namespace scan_matching
+}  // namespace mapping_3d
+}  // namespace cartographer
@@ -0,0 +1,124 @@
+/*
+ * Copyright 2016 The Cartographer Authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "cartographer/mapping_3d/scan_matching/occupied_space_cost_function.h"
+
+#include <random>
+#include <vector>
+
+#include "Eigen/Geometry"
+#include "cartographer/mapping/probability_values.h"
+#include "cartographer/mapping_3d/hybrid_grid.h"
+#include "cartographer/mapping_3d/scan_matching/occupied_space_cost_functor.h"
+#include "cartographer/sensor/point_cloud.h"
+#include "gtest/gtest.h"
+
+namespace cartographer {
+namespace mapping_3d {
+namespace scan_matching {
+namespace {
+
+constexpr double kScalingFactor = 2.5;
+
+// Evaluates 'cost_function' at 'translation' and 'rotation' and returns
+// residuals and the row-major Jacobians.
+void Evaluate(const ceres::CostFunction& cost_function,
+              const double* translation, const double* rotation,
+              std::vector<double>* const residuals,
+              std::vector<double>* const translation_jacobian,
+              std::vector<double>* const rotation_jacobian) {
+  residuals->resize(cost_function.num_residuals());
+  translation_jacobian->resize(3 * cost_function.num_residuals());
+  rotation_jacobian->resize(4 * cost_function.num_residuals());
+  const double* parameters[] = {translation, rotation};
+  double* jacobians[] = {translation_jacobian->data(),
+                         rotation_jacobian->data()};
+  ASSERT_TRUE(
+      cost_function.Evaluate(parameters, residuals->data(), jacobians));
+}
+
+void ExpectNear(const std::vector<double>& expected,
+                const std::vector<double>& actual, const double tolerance) {
+  ASSERT_EQ(expected.size(), actual.size());
+  for (size_t i = 0; i != expected.size(); ++i) {
+    EXPECT_NEAR(expected[i], actual[i], tolerance) << i;
+  }
+}
+
+TEST(OccupiedSpaceCostFunctionTest, MatchesAutoDiff) {
+  std::mt19937 prng(42);
+  HybridGrid hybrid_grid(0.1f);
+  std::uniform_real_distribution<float> probability_distribution(
+      mapping::kMinProbability, mapping::kMaxProbability);
+  for (int z = -10; z != 10; ++z) {
+    for (int y = -20; y != 20; ++y) {
+      for (int x = -20; x != 20; ++x) {
+        hybrid_grid.SetProbability(Eigen::Array3i(x, y, z),
+                                   probability_distribution(prng));
+      }
+    }
+  }
+  // Points inside the known region, near its border and outside of it.
+  sensor::PointCloud point_cloud;
+  std::uniform_real_distribution<float> point_distribution(-2.5f, 2.5f);
+  for (int i = 0; i != 500; ++i) {
+    point_cloud.emplace_back(point_distribution(prng),
+                             point_distribution(prng),
+                             0.5f * point_distribution(prng));
+  }
+
+  const ceres::AutoDiffCostFunction<OccupiedSpaceCostFunctor, ceres::DYNAMIC,
+                                    3, 4>
+      autodiff_cost_function(new OccupiedSpaceCostFunctor(
+                                 kScalingFactor, point_cloud, hybrid_grid),
+                             point_cloud.size());
+  const OccupiedSpaceCostFunction analytic_cost_function(
+      kScalingFactor, point_cloud, hybrid_grid);
+  std::uniform_real_distribution<double> translation_distribution(-0.3, 0.3);
+  std::normal_distribution<double> rotation_distribution;
+  for (int i = 0; i != 10; ++i) {
+    const double translation[3] = {translation_distribution(prng),
+                                   translation_distribution(prng),
+                                   translation_distribution(prng)};
+    const Eigen::Quaterniond quaternion =
+        Eigen::Quaterniond(rotation_distribution(prng),
+                           rotation_distribution(prng),
+                           rotation_distribution(prng),
+                           rotation_distribution(prng))
+            .normalized();
+    const double rotation[4] = {quaternion.w(), quaternion.x(),
+                                quaternion.y(), quaternion.z()};
+    std::vector<double> expected_residuals;
+    std::vector<double> expected_translation_jacobian;
+    std::vector<double> expected_rotation_jacobian;
+    Evaluate(autodiff_cost_function, translation, rotation,
+             &expected_residuals, &expected_translation_jacobian,
+             &expected_rotation_jacobian);
+    std::vector<double> residuals;
+    std::vector<double> translation_jacobian;
+    std::vector<double> rotation_jacobian;
+    Evaluate(analytic_cost_function, translation, rotation, &residuals,
+             &translation_jacobian, &rotation_jacobian);
+    ExpectNear(expected_residuals, residuals, 1e-9);
+    ExpectNear(expected_translation_jacobian, translation_jacobian, 1e-6);
+    ExpectNear(expected_rotation_jacobian, rotation_jacobian, 1e-6);
+  }
+}
+
+}  // namespace
+}  // namespace scan_matching
+}  // namespace mapping_3d
+}  // namespace cartographer
@@ -17,8 +17,12 @@
 #include "cartographer/mapping_3d/scan_matching/precomputation_grid.h"
 
 #include <algorithm>
+#include <limits>
+#include <memory>
+#include <vector>
 
 #include "Eigen/Core"
+#include "cartographer/common/make_unique.h"
 #include "cartographer/common/math.h"
 #include "cartographer/mapping/probability_values.h"
 #include "glog/logging.h"
@@ -45,8 +49,109 @@ Eigen::Array3i CellIndexAtHalfResolution(const Eigen::Array3i& cell_index) {
       DivideByTwoRoundingTowardsNegativeInfinity(cell_index[2]));
 }
 
+// Returns the index of the first cell of the FlatGrid containing 'index'.
+Eigen::Array3i GetFlatGridOrigin(const Eigen::Array3i& index) {
+  constexpr int kMask = (1 << kFlatGridBits) - 1;
+  return Eigen::Array3i(index.x() & ~kMask, index.y() & ~kMask,
+                        index.z() & ~kMask);
+}
+
+// Returns which of 'num_tasks' tasks computes the cells with z coordinate 'z'.
+// The tasks take turns by layers of FlatGrids, so that every FlatGrid is
+// written by a single task and the work is spread evenly.
+int GetTaskIndex(const int z, const int num_tasks) {
+  const int layer = z >> kFlatGridBits;
+  return (layer % num_tasks + num_tasks) % num_tasks;
+}
+
+// Returns true if the voxel at 'cell_index' contributes to any cell computed by
+// the task 'task_index'. These are in at most two layers of FlatGrids.
+bool ContributesToTask(const Eigen::Array3i& cell_index,
+                       const bool half_resolution, const Eigen::Array3i& shift,
+                       const int task_index, const int num_tasks) {
+  int first_z = cell_index.z();
+  int second_z = cell_index.z() - shift.z();
+  if (half_resolution) {
+    first_z = DivideByTwoRoundingTowardsNegativeInfinity(first_z);
+    second_z = DivideByTwoRoundingTowardsNegativeInfinity(second_z);
+  }
+  return GetTaskIndex(first_z, num_tasks) == task_index ||
+         GetTaskIndex(second_z, num_tasks) == task_index;
+}
+
+// Updates the 8 cells of 'result' which the voxel at 'cell_index' with 'value'
+// contributes to, as far as they are computed by the task 'task_index'. If
+// 'flat_grid_origins' is not nullptr, the origins of FlatGrids newly allocated
+// in 'result' are appended to it.
+void UpdateOctants(const Eigen::Array3i& cell_index, const uint8 value,
+                   const bool half_resolution, const Eigen::Array3i& shift,
+                   const int task_index, const int num_tasks,
+                   PrecomputationGrid* const result,
+                   std::vector<Eigen::Array3i>* const flat_grid_origins) {
+  for (int i = 0; i != 8; ++i) {
+    // We use this value to update 8 values in the resulting grid, at
+    // position (x - {0, 'shift'}, y - {0, 'shift'}, z - {0, 'shift'}).
+    // If 'shift' is 2 ** (depth - 1), where depth 0 is the original grid,
+    // this results in precomputation grids analogous to the 2D case.
+    const Eigen::Array3i shifted_cell_index =
+        cell_index - shift * PrecomputationGrid::GetOctant(i);
+    const Eigen::Array3i result_cell_index =
+        half_resolution ? CellIndexAtHalfResolution(shifted_cell_index)
+                        : shifted_cell_index;
+    if (num_tasks != 1 &&
+        GetTaskIndex(result_cell_index.z(), num_tasks) != task_index) {
+      continue;
+    }
+    const size_t num_blocks = result->num_blocks();
+    auto* const cell_value = result->mutable_value(result_cell_index);
+    *cell_value = std::max(value, *cell_value);
+    if (flat_grid_origins != nullptr && result->num_blocks() != num_blocks) {
+      flat_grid_origins->push_back(GetFlatGridOrigin(result_cell_index));
+    }
+  }
+}
+
 }  // namespace
 
+PagedPrecomputationGrid::PagedPrecomputationGrid(
+    const PrecomputationGrid& grid)
+    : origin_(Eigen::Array3i::Zero()), num_blocks_(Eigen::Array3i::Zero()) {
+  // The iterator visits the values of each FlatGrid one after another.
+  std::vector<Eigen::Array3i> flat_grid_origins;
+  for (auto it = PrecomputationGrid::Iterator(grid); !it.Done(); it.Next()) {
+    const Eigen::Array3i origin = GetFlatGridOrigin(it.GetCellIndex());
+    if (flat_grid_origins.empty() ||
+        (origin != flat_grid_origins.back()).any()) {
+      flat_grid_origins.push_back(origin);
+    }
+  }
+  cells_.resize(kNumCellsPerScoringBlock, 0);
+  if (!flat_grid_origins.empty()) {
+    Eigen::Array3i max_origin = flat_grid_origins.front();
+    origin_ = flat_grid_origins.front();
+    for (const Eigen::Array3i& origin : flat_grid_origins) {
+      origin_ = origin_.min(origin);
+      max_origin = max_origin.max(origin);
+    }
+    num_blocks_ = (max_origin - origin_) / (1 << kFlatGridBits) + 1;
+    block_offsets_.resize(num_blocks_.prod(), 0);
+    cells_.reserve((flat_grid_origins.size() + 1) * kNumCellsPerScoringBlock +
+                   kScoringGridPadding);
+    for (const Eigen::Array3i& origin : flat_grid_origins) {
+      const Eigen::Array3i block = (origin - origin_) / (1 << kFlatGridBits);
+      CHECK_LE(cells_.size(), std::numeric_limits<int32>::max());
+      block_offsets_[block.x() +
+                     num_blocks_.x() *
+                         (block.y() + num_blocks_.y() * block.z())] =
+          cells_.size();
+      // Values of a FlatGrid are contiguous, starting at its origin.
+      const uint8* const values = grid.FindValue(origin);
+      cells_.insert(cells_.end(), values, values + kNumCellsPerScoringBlock);
+    }
+  }
+  cells_.resize(cells_.size() + kScoringGridPadding, 0);
+}
+
 PrecomputationGrid ConvertToPrecomputationGrid(const HybridGrid& hybrid_grid) {
   PrecomputationGrid result(hybrid_grid.resolution());
   for (auto it = HybridGrid::Iterator(hybrid_grid); !it.Done(); it.Next()) {
@@ -63,19 +168,43 @@ PrecomputationGrid ConvertToPrecomputationGrid(const HybridGrid& hybrid_grid) {
 
 PrecomputationGrid PrecomputeGrid(const PrecomputationGrid& grid,
                                   const bool half_resolution,
-                                  const Eigen::Array3i& shift) {
+                                  const Eigen::Array3i& shift,
+                                  common::ThreadPool* const thread_pool) {
   PrecomputationGrid result(grid.resolution());
-  for (auto it = PrecomputationGrid::Iterator(grid); !it.Done(); it.Next()) {
-    for (int i = 0; i != 8; ++i) {
-      // We use this value to update 8 values in the resulting grid, at
-      // position (x - {0, 'shift'}, y - {0, 'shift'}, z - {0, 'shift'}).
-      // If 'shift' is 2 ** (depth - 1), where depth 0 is the original grid,
-      // this results in precomputation grids analogous to the 2D case.
-      const Eigen::Array3i cell_index =
-          it.GetCellIndex() - shift * PrecomputationGrid::GetOctant(i);
-      auto* const cell_value = result.mutable_value(
-          half_resolution ? CellIndexAtHalfResolution(cell_index) : cell_index);
-      *cell_value = std::max(it.GetValue(), *cell_value);
+  if (thread_pool == nullptr) {
+    for (auto it = PrecomputationGrid::Iterator(grid); !it.Done(); it.Next()) {
+      UpdateOctants(it.GetCellIndex(), it.GetValue(), half_resolution, shift,
+                    0 /* task_index */, 1 /* num_tasks */, &result,
+                    nullptr /* flat_grid_origins */);
+    }
+    return result;
+  }
+
+  // Each task computes its layers of FlatGrids into a grid of its own. Every
+  // task iterates over all of 'grid', which is cheap compared to the updates.
+  const int num_tasks = thread_pool->num_threads() + 1;
+  std::vector<std::unique_ptr<PrecomputationGrid>> partial_results(num_tasks);
+  std::vector<std::vector<Eigen::Array3i>> flat_grid_origins(num_tasks);
+  common::ParallelFor(thread_pool, num_tasks, [&](const int task_index) {
+    partial_results[task_index] =
+        common::make_unique<PrecomputationGrid>(grid.resolution());
+    for (auto it = PrecomputationGrid::Iterator(grid); !it.Done(); it.Next()) {
+      const Eigen::Array3i cell_index = it.GetCellIndex();
+      if (ContributesToTask(cell_index, half_resolution, shift, task_index,
+                            num_tasks)) {
+        UpdateOctants(cell_index, it.GetValue(), half_resolution, shift,
+                      task_index, num_tasks, partial_results[task_index].get(),
+                      &flat_grid_origins[task_index]);
+      }
+    }
+  });
+  // The tasks wrote disjoint FlatGrids, so these are copied as a whole. Values
+  // of a FlatGrid are contiguous, starting at its origin.
+  constexpr int kNumCellsPerFlatGrid = 1 << (3 * kFlatGridBits);
+  for (int task_index = 0; task_index != num_tasks; ++task_index) {
+    for (const Eigen::Array3i& origin : flat_grid_origins[task_index]) {
+      std::copy_n(partial_results[task_index]->FindValue(origin),
+                  kNumCellsPerFlatGrid, result.mutable_value(origin));
     }
   }
   return result;
@@ -17,7 +17,13 @@
 #ifndef CARTOGRAPHER_MAPPING_3D_SCAN_MATCHING_PRECOMPUTATION_GRID_H_
 #define CARTOGRAPHER_MAPPING_3D_SCAN_MATCHING_PRECOMPUTATION_GRID_H_
 
+#include <vector>
+
+#include "Eigen/Core"
+#include "cartographer/common/port.h"
+#include "cartographer/common/thread_pool.h"
 #include "cartographer/mapping_3d/hybrid_grid.h"
+#include "cartographer/mapping_3d/scan_matching/scoring_kernels.h"
 
 namespace cartographer {
 namespace mapping_3d {
@@ -36,6 +42,32 @@ class PrecomputationGrid : public HybridGridBase<uint8> {
   }
 };
 
+// A read-only copy of a PrecomputationGrid for scoring. It is cropped to the
+// box of FlatGrids containing values, and a table of all blocks in the box
+// points to their values, so that a lookup is one index computation and two
+// loads instead of descending the tree of the PrecomputationGrid.
+class PagedPrecomputationGrid {
+ public:
+  explicit PagedPrecomputationGrid(const PrecomputationGrid& grid);
+
+  ScoringGrid scoring_grid() const {
+    return ScoringGrid{block_offsets_.data(), cells_.data(), origin_,
+                       num_blocks_};
+  }
+
+  // Returns the memory used by this grid.
+  int64 size_in_bytes() const {
+    return block_offsets_.size() * sizeof(int32) + cells_.size();
+  }
+
+ private:
+  Eigen::Array3i origin_;
+  Eigen::Array3i num_blocks_;
+  std::vector<int32> block_offsets_;
+  // A block of zeros, the blocks containing values and the padding.
+  std::vector<uint8> cells_;
+};
+
 // Converts a HybridGrid to a PrecomputationGrid representing the same data,
 // but only using 8 bit instead of 2 x 16 bit.
 PrecomputationGrid ConvertToPrecomputationGrid(const HybridGrid& hybrid_grid);
@@ -46,9 +78,12 @@ PrecomputationGrid ConvertToPrecomputationGrid(const HybridGrid& hybrid_grid);
 // If 'shift' is 2 ** (depth - 1), where depth 0 is the original grid, and this
 // is using the precomputed grid of one depth before, this results in
 // precomputation grids analogous to the 2D case.
+// If 'thread_pool' is not nullptr, the grid is split into layers of FlatGrids
+// which are computed in parallel. The result is the same either way.
 PrecomputationGrid PrecomputeGrid(const PrecomputationGrid& grid,
                                   bool half_resolution,
-                                  const Eigen::Array3i& shift);
+                                  const Eigen::Array3i& shift,
+                                  common::ThreadPool* thread_pool);
 
 }  // namespace scan_matching
 }  // namespace mapping_3d
@@ -0,0 +1,149 @@
+/*
+ * Copyright 2017 The Cartographer Authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Measures how long building the precomputation grids of a 3D
+// FastCorrelativeScanMatcher takes for a submap of points on the surfaces of
+// a room, with and without a thread pool.
+
+#include <chrono>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <vector>
+
+#include "Eigen/Core"
+#include "cartographer/common/make_unique.h"
+#include "cartographer/common/thread_pool.h"
+#include "cartographer/common/time.h"
+#include "cartographer/mapping/trajectory_node.h"
+#include "cartographer/mapping_3d/hybrid_grid.h"
+#include "cartographer/mapping_3d/scan_matching/fast_correlative_scan_matcher.h"
+#include "gflags/gflags.h"
+#include "glog/logging.h"
+
+DEFINE_int32(num_points, 1000000, "Number of points to insert.");
+DEFINE_double(resolution, 0.1, "Resolution of the submap in meters.");
+DEFINE_int32(branch_and_bound_depth, 8, "Number of precomputation grids.");
+DEFINE_int32(full_resolution_depth, 3,
+             "Number of full resolution precomputation grids.");
+DEFINE_int32(num_threads, 4, "Number of threads of the thread pool.");
+DEFINE_int32(num_submaps, 5, "Number of times the matcher is built.");
+
+namespace cartographer {
+namespace mapping_3d {
+namespace scan_matching {
+namespace {
+
+double SecondsSince(const std::chrono::steady_clock::time_point start) {
+  const std::chrono::duration<double> elapsed =
+      std::chrono::steady_clock::now() - start;
+  return elapsed.count();
+}
+
+// Returns a point on the floor, the ceiling or one of the walls of a 40 m x
+// 40 m x 6 m room, or in between for some clutter.
+Eigen::Vector3f SamplePoint(std::mt19937* const prng) {
+  std::uniform_real_distribution<float> horizontal(-20.f, 20.f);
+  std::uniform_real_distribution<float> vertical(0.f, 6.f);
+  std::uniform_int_distribution<int> surface(0, 6);
+  switch (surface(*prng)) {
+    case 0:
+      return Eigen::Vector3f(horizontal(*prng), horizontal(*prng), 0.f);
+    case 1:
+      return Eigen::Vector3f(horizontal(*prng), horizontal(*prng), 6.f);
+    case 2:
+      return Eigen::Vector3f(-20.f, horizontal(*prng), vertical(*prng));
+    case 3:
+      return Eigen::Vector3f(20.f, horizontal(*prng), vertical(*prng));
+    case 4:
+      return Eigen::Vector3f(horizontal(*prng), -20.f, vertical(*prng));
+    case 5:
+      return Eigen::Vector3f(horizontal(*prng), 20.f, vertical(*prng));
+  }
+  return Eigen::Vector3f(horizontal(*prng), horizontal(*prng),
+                         vertical(*prng));
+}
+
+// Returns the average seconds to build the matcher for 'hybrid_grid'.
+double BenchmarkBuild(const HybridGrid& hybrid_grid,
+                      const proto::FastCorrelativeScanMatcherOptions& options,
+                      common::ThreadPool* const thread_pool,
+                      int64* const size_in_bytes) {
+  // The rotational scan matcher needs the histogram of at least one node.
+  const std::vector<mapping::TrajectoryNode> nodes = {
+      {std::make_shared<const mapping::TrajectoryNode::Data>(
+           mapping::TrajectoryNode::Data{common::FromUniversal(0),
+                                         Eigen::Quaterniond::Identity(),
+                                         {},
+                                         {},
+                                         {},
+                                         Eigen::VectorXf::Zero(120)}),
+       transform::Rigid3d::Identity()}};
+  const auto start = std::chrono::steady_clock::now();
+  for (int i = 0; i != FLAGS_num_submaps; ++i) {
+    const FastCorrelativeScanMatcher fast_correlative_scan_matcher(
+        hybrid_grid, &hybrid_grid, nodes, options, thread_pool);
+    *size_in_bytes = fast_correlative_scan_matcher.size_in_bytes();
+  }
+  return SecondsSince(start) / FLAGS_num_submaps;
+}
+
+void Run() {
+  CHECK_GT(FLAGS_num_points, 0);
+  CHECK_GT(FLAGS_num_submaps, 0);
+  std::mt19937 prng(42);
+  HybridGrid hybrid_grid(FLAGS_resolution);
+  for (int i = 0; i != FLAGS_num_points; ++i) {
+    hybrid_grid.SetProbability(hybrid_grid.GetCellIndex(SamplePoint(&prng)),
+                               0.6f);
+  }
+
+  proto::FastCorrelativeScanMatcherOptions options;
+  options.set_branch_and_bound_depth(FLAGS_branch_and_bound_depth);
+  options.set_full_resolution_depth(FLAGS_full_resolution_depth);
+  int64 sequential_size_in_bytes = 0;
+  const double sequential_seconds = BenchmarkBuild(
+      hybrid_grid, options, nullptr /* thread_pool */,
+      &sequential_size_in_bytes);
+  common::ThreadPool thread_pool(FLAGS_num_threads);
+  int64 parallel_size_in_bytes = 0;
+  const double parallel_seconds = BenchmarkBuild(
+      hybrid_grid, options, &thread_pool, &parallel_size_in_bytes);
+  CHECK_EQ(sequential_size_in_bytes, parallel_size_in_bytes);
+
+  std::cout << "submap of " << hybrid_grid.num_blocks() << " blocks, "
+            << FLAGS_branch_and_bound_depth << " precomputation grids using "
+            << sequential_size_in_bytes / (1024 * 1024) << " MiB\n"
+            << "  without thread pool: " << 1e3 * sequential_seconds
+            << " ms per submap\n"
+            << "  with " << FLAGS_num_threads
+            << " threads: " << 1e3 * parallel_seconds << " ms per submap\n";
+}
+
+}  // namespace
+}  // namespace scan_matching
+}  // namespace mapping_3d
+}  // namespace cartographer
+
+int main(int argc, char** argv) {
+  google::InitGoogleLogging(argv[0]);
+  FLAGS_logtostderr = true;
+  google::SetUsageMessage(
+      "\n\n"
+      "Benchmarks building the precomputation grids of 3D submaps.\n");
+  google::ParseCommandLineFlags(&argc, &argv, true);
+  ::cartographer::mapping_3d::scan_matching::Run();
+}
@@ -20,6 +20,7 @@
 #include <tuple>
 #include <vector>
 
+#include "cartographer/common/thread_pool.h"
 #include "cartographer/mapping_3d/hybrid_grid.h"
 #include "gmock/gmock.h"
 
@@ -50,7 +51,8 @@ TEST(PrecomputedGridGeneratorTest, TestAgainstNaiveAlgorithm) {
     } else {
       precomputed_grids.push_back(
           PrecomputeGrid(precomputed_grids.back(), false,
-                         (1 << (depth - 1)) * Eigen::Array3i::Ones()));
+                         (1 << (depth - 1)) * Eigen::Array3i::Ones(),
+                         nullptr /* thread_pool */));
     }
     const int width = 1 << depth;
     for (int i = 0; i < 100; ++i) {
@@ -76,6 +78,42 @@ TEST(PrecomputedGridGeneratorTest, TestAgainstNaiveAlgorithm) {
   }
 }
 
+TEST(PrecomputedGridGeneratorTest, ParallelMatchesSequential) {
+  HybridGrid hybrid_grid(0.1f);
+  std::mt19937 rng(4711);
+  std::uniform_int_distribution<int> coordinate_distribution(-100, 99);
+  std::uniform_real_distribution<float> value_distribution(
+      mapping::kMinProbability, mapping::kMaxProbability);
+  for (int i = 0; i < 10000; ++i) {
+    hybrid_grid.SetProbability(
+        Eigen::Array3i(coordinate_distribution(rng),
+                       coordinate_distribution(rng),
+                       coordinate_distribution(rng)),
+        value_distribution(rng));
+  }
+  const PrecomputationGrid grid = ConvertToPrecomputationGrid(hybrid_grid);
+  common::ThreadPool thread_pool(3);
+  for (const bool half_resolution : {false, true}) {
+    const Eigen::Array3i shift(3, 1, 5);
+    const PrecomputationGrid sequential_grid = PrecomputeGrid(
+        grid, half_resolution, shift, nullptr /* thread_pool */);
+    const PrecomputationGrid parallel_grid =
+        PrecomputeGrid(grid, half_resolution, shift, &thread_pool);
+    EXPECT_EQ(sequential_grid.num_blocks(), parallel_grid.num_blocks());
+    int num_cells = 0;
+    for (auto it = PrecomputationGrid::Iterator(sequential_grid); !it.Done();
+         it.Next()) {
+      EXPECT_EQ(it.GetValue(), parallel_grid.value(it.GetCellIndex()));
+      ++num_cells;
+    }
+    for (auto it = PrecomputationGrid::Iterator(parallel_grid); !it.Done();
+         it.Next()) {
+      --num_cells;
+    }
+    EXPECT_EQ(0, num_cells);
+  }
+}
+
 }  // namespace
 }  // namespace scan_matching
 }  // namespace mapping_3d
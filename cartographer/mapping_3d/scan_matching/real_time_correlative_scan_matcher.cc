@@ -17,9 +17,11 @@
 #include "cartographer/mapping_3d/scan_matching/real_time_correlative_scan_matcher.h"
 
 #include <cmath>
+#include <vector>
 
 #include "Eigen/Geometry"
 #include "cartographer/common/math.h"
+#include "cartographer/mapping/probability_values.h"
 #include "cartographer/transform/transform.h"
 #include "glog/logging.h"
 
@@ -99,9 +101,14 @@ float RealTimeCorrelativeScanMatcher::ScoreCandidate(
     const HybridGrid& hybrid_grid,
     const sensor::PointCloud& transformed_point_cloud,
     const transform::Rigid3f& transform) const {
-  float score = 0.f;
+  std::vector<Eigen::Array3i> cell_indices;
+  cell_indices.reserve(transformed_point_cloud.size());
   for (const Eigen::Vector3f& point : transformed_point_cloud) {
-    score += hybrid_grid.GetProbability(hybrid_grid.GetCellIndex(point));
+    cell_indices.push_back(hybrid_grid.GetCellIndex(point));
+  }
+  float score = 0.f;
+  for (const uint16 value : hybrid_grid.GetValues(cell_indices)) {
+    score += mapping::ValueToProbability(value);
   }
   score /= static_cast<float>(transformed_point_cloud.size());
   const float angle = transform::GetAngle(transform);
@@ -16,7 +16,9 @@
 
 #include "cartographer/mapping_3d/scan_matching/rotational_scan_matcher.h"
 
-#include <map>
+#include <algorithm>
+#include <cmath>
+#include <limits>
 #include <vector>
 
 #include "cartographer/common/math.h"
@@ -49,27 +51,44 @@ void AddValueToHistogram(float angle, const float value,
   (*histogram)(bucket) += value;
 }
 
-Eigen::Vector3f ComputeCentroid(const sensor::PointCloud& slice) {
-  CHECK(!slice.empty());
+// A point of the point cloud passed to ComputeHistogram() which belongs to the
+// horizontal slice 'slice_index'. The 'angle' is around the centroid of the
+// slice and only set while sorting the slice.
+struct SlicePoint {
+  int slice_index;
+  int point_index;
+  float angle;
+};
+
+using SlicePointIterator = std::vector<SlicePoint>::iterator;
+
+Eigen::Vector3f ComputeCentroid(const sensor::PointCloud& point_cloud,
+                                const SlicePointIterator slice_begin,
+                                const SlicePointIterator slice_end) {
+  CHECK(slice_begin != slice_end);
   Eigen::Vector3f sum = Eigen::Vector3f::Zero();
-  for (const Eigen::Vector3f& point : slice) {
-    sum += point;
+  for (auto it = slice_begin; it != slice_end; ++it) {
+    sum += point_cloud[it->point_index];
   }
-  return sum / static_cast<float>(slice.size());
+  return sum / static_cast<float>(slice_end - slice_begin);
 }
 
-void AddPointCloudSliceToHistogram(const sensor::PointCloud& slice,
+void AddPointCloudSliceToHistogram(const sensor::PointCloud& point_cloud,
+                                   const SlicePointIterator slice_begin,
+                                   const SlicePointIterator slice_end,
                                    Eigen::VectorXf* const histogram) {
-  if (slice.empty()) {
+  if (slice_begin == slice_end) {
     return;
   }
   // We compute the angle of the ray from a point to the centroid of the whole
   // point cloud. If it is orthogonal to the angle we compute between points, we
   // will add the angle between points to the histogram with the maximum weight.
   // This is to reject, e.g., the angles observed on the ceiling and floor.
-  const Eigen::Vector3f centroid = ComputeCentroid(slice);
-  Eigen::Vector3f last_point = slice.front();
-  for (const Eigen::Vector3f& point : slice) {
+  const Eigen::Vector3f centroid =
+      ComputeCentroid(point_cloud, slice_begin, slice_end);
+  Eigen::Vector3f last_point = point_cloud[slice_begin->point_index];
+  for (auto it = slice_begin; it != slice_end; ++it) {
+    const Eigen::Vector3f& point = point_cloud[it->point_index];
     const Eigen::Vector2f delta = (point - last_point).head<2>();
     const Eigen::Vector2f direction = (point - centroid).head<2>();
     const float distance = delta.norm();
@@ -89,44 +108,52 @@ void AddPointCloudSliceToHistogram(const sensor::PointCloud& slice,
 
 // A function to sort the points in each slice by angle around the centroid.
 // This is because the returns from different rangefinders are interleaved in
-// the data.
-sensor::PointCloud SortSlice(const sensor::PointCloud& slice) {
-  struct SortableAnglePointPair {
-    bool operator<(const SortableAnglePointPair& rhs) const {
-      return angle < rhs.angle;
-    }
-
-    float angle;
-    Eigen::Vector3f point;
-  };
-  const Eigen::Vector3f centroid = ComputeCentroid(slice);
-  std::vector<SortableAnglePointPair> by_angle;
-  by_angle.reserve(slice.size());
-  for (const Eigen::Vector3f& point : slice) {
-    const Eigen::Vector2f delta = (point - centroid).head<2>();
+// the data. Points too close to the centroid are removed, the end of the
+// sorted slice is returned.
+SlicePointIterator SortSlice(const sensor::PointCloud& point_cloud,
+                             const SlicePointIterator slice_begin,
+                             const SlicePointIterator slice_end) {
+  const Eigen::Vector3f centroid =
+      ComputeCentroid(point_cloud, slice_begin, slice_end);
+  SlicePointIterator sorted_slice_end = slice_begin;
+  for (auto it = slice_begin; it != slice_end; ++it) {
+    const Eigen::Vector2f delta =
+        (point_cloud[it->point_index] - centroid).head<2>();
     if (delta.norm() < kMinDistance) {
       continue;
     }
-    by_angle.push_back(SortableAnglePointPair{common::atan2(delta), point});
+    *sorted_slice_end = *it;
+    sorted_slice_end->angle = common::atan2(delta);
+    ++sorted_slice_end;
   }
-  std::sort(by_angle.begin(), by_angle.end());
-  sensor::PointCloud result;
-  for (const auto& pair : by_angle) {
-    result.push_back(pair.point);
+  std::sort(slice_begin, sorted_slice_end,
+            [](const SlicePoint& lhs, const SlicePoint& rhs) {
+              return lhs.angle < rhs.angle;
+            });
+  return sorted_slice_end;
+}
+
+// Computes by how many buckets a histogram of 'histogram_size' buckets has to
+// be rotated for the given 'angle'. The result is 'full_buckets' in
+// [0, histogram_size) plus the 'fraction' of the next bucket in [0, 1).
+void ComputeBucketRotation(const float angle, const int histogram_size,
+                           int* const full_buckets, float* const fraction) {
+  const float rotate_by_buckets = -angle * histogram_size / M_PI;
+  *full_buckets = common::RoundToInt(rotate_by_buckets - 0.5f);
+  *fraction = rotate_by_buckets - *full_buckets;
+  *full_buckets %= histogram_size;
+  if (*full_buckets < 0) {
+    *full_buckets += histogram_size;
   }
-  return result;
 }
 
 // Rotates the given 'histogram' by the given 'angle'. This might lead to
 // rotations of a fractional bucket which is handled by linearly interpolating.
 Eigen::VectorXf RotateHistogram(const Eigen::VectorXf& histogram,
                                 const float angle) {
-  const float rotate_by_buckets = -angle * histogram.size() / M_PI;
-  int full_buckets = common::RoundToInt(rotate_by_buckets - 0.5f);
-  const float fraction = rotate_by_buckets - full_buckets;
-  while (full_buckets < 0) {
-    full_buckets += histogram.size();
-  }
+  int full_buckets;
+  float fraction;
+  ComputeBucketRotation(angle, histogram.size(), &full_buckets, &fraction);
   Eigen::VectorXf rotated_histogram_0 = Eigen::VectorXf::Zero(histogram.size());
   Eigen::VectorXf rotated_histogram_1 = Eigen::VectorXf::Zero(histogram.size());
   for (int i = 0; i != histogram.size(); ++i) {
@@ -138,17 +165,21 @@ Eigen::VectorXf RotateHistogram(const Eigen::VectorXf& histogram,
          (1.f - fraction) * rotated_histogram_0;
 }
 
-float MatchHistograms(const Eigen::VectorXf& submap_histogram,
-                      const Eigen::VectorXf& scan_histogram) {
-  // We compute the dot product of normalized histograms as a measure of
-  // similarity.
-  const float scan_histogram_norm = scan_histogram.norm();
-  const float submap_histogram_norm = submap_histogram.norm();
-  const float normalization = scan_histogram_norm * submap_histogram_norm;
-  if (normalization < 1e-3f) {
-    return 1.f;
+// Returns the circular cross-correlation of the histograms, i.e. the dot
+// product of 'submap_histogram' and 'scan_histogram' rotated by 'i' full
+// buckets for each bucket 'i'.
+Eigen::VectorXf CrossCorrelateHistograms(
+    const Eigen::VectorXf& submap_histogram,
+    const Eigen::VectorXf& scan_histogram) {
+  const int size = submap_histogram.size();
+  CHECK_EQ(size, scan_histogram.size());
+  Eigen::VectorXf cross_correlation(size);
+  for (int i = 0; i != size; ++i) {
+    cross_correlation[i] =
+        submap_histogram.head(size - i).dot(scan_histogram.tail(size - i)) +
+        submap_histogram.tail(i).dot(scan_histogram.head(i));
   }
-  return submap_histogram.dot(scan_histogram) / normalization;
+  return cross_correlation;
 }
 
 }  // namespace
@@ -156,12 +187,61 @@ float MatchHistograms(const Eigen::VectorXf& submap_histogram,
 Eigen::VectorXf RotationalScanMatcher::ComputeHistogram(
     const sensor::PointCloud& point_cloud, const int histogram_size) {
   Eigen::VectorXf histogram = Eigen::VectorXf::Zero(histogram_size);
-  std::map<int, sensor::PointCloud> slices;
+  if (point_cloud.empty()) {
+    return histogram;
+  }
+  // Points are grouped into slices by a counting sort which keeps the order of
+  // the points within each slice.
+  const auto get_slice_index = [](const Eigen::Vector3f& point) {
+    return common::RoundToInt(point.z() / kSliceHeight);
+  };
+  int min_slice_index = std::numeric_limits<int>::max();
+  int max_slice_index = std::numeric_limits<int>::min();
   for (const Eigen::Vector3f& point : point_cloud) {
-    slices[common::RoundToInt(point.z() / kSliceHeight)].push_back(point);
+    const int slice_index = get_slice_index(point);
+    min_slice_index = std::min(min_slice_index, slice_index);
+    max_slice_index = std::max(max_slice_index, slice_index);
   }
-  for (const auto& slice : slices) {
-    AddPointCloudSliceToHistogram(SortSlice(slice.second), &histogram);
+  std::vector<SlicePoint> slice_points(point_cloud.size());
+  if (static_cast<size_t>(max_slice_index - min_slice_index) <
+      point_cloud.size()) {
+    std::vector<int> slice_offsets(max_slice_index - min_slice_index + 1, 0);
+    for (const Eigen::Vector3f& point : point_cloud) {
+      ++slice_offsets[get_slice_index(point) - min_slice_index];
+    }
+    int offset = 0;
+    for (int& slice_offset : slice_offsets) {
+      const int num_points = slice_offset;
+      slice_offset = offset;
+      offset += num_points;
+    }
+    for (size_t i = 0; i != point_cloud.size(); ++i) {
+      const int slice_index = get_slice_index(point_cloud[i]);
+      slice_points[slice_offsets[slice_index - min_slice_index]++] =
+          SlicePoint{slice_index, static_cast<int>(i), 0.f};
+    }
+  } else {
+    // Slices are spread too far apart for counting, e.g. due to outliers.
+    for (size_t i = 0; i != point_cloud.size(); ++i) {
+      slice_points[i] = SlicePoint{get_slice_index(point_cloud[i]),
+                                   static_cast<int>(i), 0.f};
+    }
+    std::stable_sort(slice_points.begin(), slice_points.end(),
+                     [](const SlicePoint& lhs, const SlicePoint& rhs) {
+                       return lhs.slice_index < rhs.slice_index;
+                     });
+  }
+  auto slice_begin = slice_points.begin();
+  while (slice_begin != slice_points.end()) {
+    const int slice_index = slice_begin->slice_index;
+    const auto slice_end = std::find_if(
+        slice_begin, slice_points.end(), [slice_index](const SlicePoint& p) {
+          return p.slice_index != slice_index;
+        });
+    AddPointCloudSliceToHistogram(
+        point_cloud, slice_begin,
+        SortSlice(point_cloud, slice_begin, slice_end), &histogram);
+    slice_begin = slice_end;
   }
   return histogram;
 }
@@ -179,12 +259,39 @@ RotationalScanMatcher::RotationalScanMatcher(
 std::vector<float> RotationalScanMatcher::Match(
     const Eigen::VectorXf& histogram, const float initial_angle,
     const std::vector<float>& angles) const {
+  // Scores for all angles are interpolated from the scores at full bucket
+  // rotations. The norm of the interpolated scan histogram only depends on the
+  // fraction and the dot product of neighboring buckets.
+  const Eigen::VectorXf cross_correlation =
+      CrossCorrelateHistograms(histogram_, histogram);
+  const int size = histogram.size();
+  const float squared_norm = histogram.squaredNorm();
+  const float neighbor_correlation =
+      histogram.head(size - 1).dot(histogram.tail(size - 1)) +
+      histogram[size - 1] * histogram[0];
+  const float submap_histogram_norm = histogram_.norm();
   std::vector<float> result;
   result.reserve(angles.size());
   for (const float angle : angles) {
-    const Eigen::VectorXf scan_histogram =
-        RotateHistogram(histogram, initial_angle + angle);
-    result.push_back(MatchHistograms(histogram_, scan_histogram));
+    int full_buckets;
+    float fraction;
+    ComputeBucketRotation(initial_angle + angle, size, &full_buckets,
+                          &fraction);
+    const int next_full_buckets = (full_buckets + 1) % size;
+    // We compute the dot product of normalized histograms as a measure of
+    // similarity.
+    const float scan_histogram_norm = std::sqrt(std::max(
+        0.f, (common::Pow2(1.f - fraction) + common::Pow2(fraction)) *
+                     squared_norm +
+                 2.f * fraction * (1.f - fraction) * neighbor_correlation));
+    const float normalization = scan_histogram_norm * submap_histogram_norm;
+    if (normalization < 1e-3f) {
+      result.push_back(1.f);
+      continue;
+    }
+    result.push_back(((1.f - fraction) * cross_correlation[full_buckets] +
+                      fraction * cross_correlation[next_full_buckets]) /
+                     normalization);
   }
   return result;
 }
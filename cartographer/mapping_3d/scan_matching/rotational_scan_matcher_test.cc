@@ -17,6 +17,7 @@
 #include "cartographer/mapping_3d/scan_matching/rotational_scan_matcher.h"
 
 #include <cmath>
+#include <vector>
 
 #include "gtest/gtest.h"
 
@@ -65,6 +66,35 @@ TEST(RotationalScanMatcherTest, InterpolatesAsExpected) {
   }
 }
 
+TEST(RotationalScanMatcherTest, FindsHistogramRotatedByFullBuckets) {
+  constexpr int kNumBuckets = 12;
+  constexpr float kAnglePerBucket = M_PI / kNumBuckets;
+  Eigen::VectorXf histogram(kNumBuckets);
+  histogram << 1.f, 43.f, 0.5f, 0.3123f, 23.f, 42.f, 0.f, 7.f, 3.f, 11.f, 2.f,
+      5.f;
+  RotationalScanMatcher matcher({{histogram, 0.f}});
+  std::vector<float> angles;
+  for (int i = -2 * kNumBuckets; i <= 2 * kNumBuckets; ++i) {
+    angles.push_back(i * kAnglePerBucket);
+  }
+  for (int shift = 0; shift != kNumBuckets; ++shift) {
+    Eigen::VectorXf shifted_histogram(kNumBuckets);
+    for (int i = 0; i != kNumBuckets; ++i) {
+      shifted_histogram[(i + shift) % kNumBuckets] = histogram[i];
+    }
+    const auto scores = matcher.Match(shifted_histogram, 0.f, angles);
+    ASSERT_EQ(angles.size(), scores.size());
+    for (size_t i = 0; i != angles.size(); ++i) {
+      const int rotation = static_cast<int>(i) - 2 * kNumBuckets;
+      if ((rotation + shift) % kNumBuckets == 0) {
+        EXPECT_NEAR(1.f, scores[i], 1e-5);
+      } else {
+        EXPECT_GT(1.f - 1e-3f, scores[i]);
+      }
+    }
+  }
+}
+
 }  // namespace
 }  // namespace scan_matching
 }  // namespace mapping_3d
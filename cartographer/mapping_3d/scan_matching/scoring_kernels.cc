@@ -0,0 +1,211 @@
+/*
+ * Copyright 2017 The Cartographer Authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "cartographer/mapping_3d/scan_matching/scoring_kernels.h"
+
+#include "glog/logging.h"
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#define CARTOGRAPHER_X86_SCORING_KERNELS
+#include <immintrin.h>
+#endif
+
+namespace cartographer {
+namespace mapping_3d {
+namespace scan_matching {
+
+namespace {
+
+static_assert(sizeof(Eigen::Array3i) == 3 * sizeof(int),
+              "Kernels expect densely packed indices.");
+
+constexpr int kMask = (1 << kFlatGridBits) - 1;
+
+// Returns the value at 'cell', relative to the origin of 'grid'.
+inline int GetValue(const ScoringGrid& grid, const Eigen::Array3i& cell) {
+  if (static_cast<unsigned>(cell.x()) >=
+          static_cast<unsigned>(grid.num_blocks.x() << kFlatGridBits) ||
+      static_cast<unsigned>(cell.y()) >=
+          static_cast<unsigned>(grid.num_blocks.y() << kFlatGridBits) ||
+      static_cast<unsigned>(cell.z()) >=
+          static_cast<unsigned>(grid.num_blocks.z() << kFlatGridBits)) {
+    return 0;
+  }
+  const int block_index =
+      (cell.x() >> kFlatGridBits) +
+      grid.num_blocks.x() * ((cell.y() >> kFlatGridBits) +
+                             grid.num_blocks.y() * (cell.z() >> kFlatGridBits));
+  return grid.cells[grid.block_offsets[block_index] +
+                    ToFlatIndex(Eigen::Array3i(cell.x() & kMask,
+                                               cell.y() & kMask,
+                                               cell.z() & kMask),
+                                kFlatGridBits)];
+}
+
+int ScoreScalar(const ScoringGrid& grid, const Eigen::Array3i* cell_indices,
+                const int num_cell_indices, const Eigen::Array3i& offset) {
+  const Eigen::Array3i offset_from_origin = offset - grid.origin;
+  int sum = 0;
+  for (int i = 0; i != num_cell_indices; ++i) {
+    sum += GetValue(grid, cell_indices[i] + offset_from_origin);
+  }
+  return sum;
+}
+
+#ifdef CARTOGRAPHER_X86_SCORING_KERNELS
+
+// Processes 8 points at a time. The block offsets are gathered for the points
+// inside the grid, the others keep offset 0 of the block of zeros. Then 32
+// bits are gathered at each cell keeping the lowest byte. This relies on
+// 'kScoringGridPadding'.
+__attribute__((target("avx2"))) int ScoreAvx2(
+    const ScoringGrid& grid, const Eigen::Array3i* cell_indices,
+    const int num_cell_indices, const Eigen::Array3i& offset) {
+  const Eigen::Array3i offset_from_origin = offset - grid.origin;
+  const __m256i x_offset = _mm256_set1_epi32(offset_from_origin.x());
+  const __m256i y_offset = _mm256_set1_epi32(offset_from_origin.y());
+  const __m256i z_offset = _mm256_set1_epi32(offset_from_origin.z());
+  const __m256i num_x_cells =
+      _mm256_set1_epi32(grid.num_blocks.x() << kFlatGridBits);
+  const __m256i num_y_cells =
+      _mm256_set1_epi32(grid.num_blocks.y() << kFlatGridBits);
+  const __m256i num_z_cells =
+      _mm256_set1_epi32(grid.num_blocks.z() << kFlatGridBits);
+  const __m256i num_x_blocks = _mm256_set1_epi32(grid.num_blocks.x());
+  const __m256i num_y_blocks = _mm256_set1_epi32(grid.num_blocks.y());
+  const __m256i minus_one = _mm256_set1_epi32(-1);
+  const __m256i mask = _mm256_set1_epi32(kMask);
+  const __m256i low_byte = _mm256_set1_epi32(0xff);
+  const __m256i x_permutation = _mm256_setr_epi32(0, 3, 6, 1, 4, 7, 2, 5);
+  const __m256i y_permutation = _mm256_setr_epi32(1, 4, 7, 2, 5, 0, 3, 6);
+  const __m256i z_permutation = _mm256_setr_epi32(2, 5, 0, 3, 6, 1, 4, 7);
+  const __m256i* const coordinates =
+      reinterpret_cast<const __m256i*>(cell_indices);
+  const int* const cells = reinterpret_cast<const int*>(grid.cells);
+  __m256i sums = _mm256_setzero_si256();
+  int i = 0;
+  for (; i + 8 <= num_cell_indices; i += 8) {
+    // The 8 indices are 24 interleaved coordinates in 3 registers. Each
+    // coordinate is at distinct lanes of the registers, so blending them
+    // into one register and permuting it deinterleaves them.
+    const __m256i xyz0 = _mm256_loadu_si256(coordinates + 3 * i / 8);
+    const __m256i xyz1 = _mm256_loadu_si256(coordinates + 3 * i / 8 + 1);
+    const __m256i xyz2 = _mm256_loadu_si256(coordinates + 3 * i / 8 + 2);
+    const __m256i x = _mm256_add_epi32(
+        _mm256_permutevar8x32_epi32(
+            _mm256_blend_epi32(_mm256_blend_epi32(xyz0, xyz1, 0x92), xyz2,
+                               0x24),
+            x_permutation),
+        x_offset);
+    const __m256i y = _mm256_add_epi32(
+        _mm256_permutevar8x32_epi32(
+            _mm256_blend_epi32(_mm256_blend_epi32(xyz0, xyz1, 0x24), xyz2,
+                               0x49),
+            y_permutation),
+        y_offset);
+    const __m256i z = _mm256_add_epi32(
+        _mm256_permutevar8x32_epi32(
+            _mm256_blend_epi32(_mm256_blend_epi32(xyz0, xyz1, 0x49), xyz2,
+                               0x92),
+            z_permutation),
+        z_offset);
+    const __m256i in_bounds = _mm256_and_si256(
+        _mm256_and_si256(
+            _mm256_and_si256(_mm256_cmpgt_epi32(x, minus_one),
+                             _mm256_cmpgt_epi32(num_x_cells, x)),
+            _mm256_and_si256(_mm256_cmpgt_epi32(y, minus_one),
+                             _mm256_cmpgt_epi32(num_y_cells, y))),
+        _mm256_and_si256(_mm256_cmpgt_epi32(z, minus_one),
+                         _mm256_cmpgt_epi32(num_z_cells, z)));
+    const __m256i block_index = _mm256_add_epi32(
+        _mm256_srli_epi32(x, kFlatGridBits),
+        _mm256_mullo_epi32(
+            num_x_blocks,
+            _mm256_add_epi32(
+                _mm256_srli_epi32(y, kFlatGridBits),
+                _mm256_mullo_epi32(num_y_blocks,
+                                   _mm256_srli_epi32(z, kFlatGridBits)))));
+    const __m256i block_offset = _mm256_mask_i32gather_epi32(
+        _mm256_setzero_si256(), grid.block_offsets, block_index, in_bounds,
+        4 /* scale */);
+    const __m256i cell_in_block = _mm256_add_epi32(
+        _mm256_and_si256(x, mask),
+        _mm256_add_epi32(
+            _mm256_slli_epi32(_mm256_and_si256(y, mask), kFlatGridBits),
+            _mm256_slli_epi32(_mm256_and_si256(z, mask), 2 * kFlatGridBits)));
+    const __m256i values = _mm256_i32gather_epi32(
+        cells, _mm256_add_epi32(block_offset, cell_in_block), 1 /* scale */);
+    sums = _mm256_add_epi32(sums, _mm256_and_si256(values, low_byte));
+  }
+  const __m128i sums4 = _mm_add_epi32(_mm256_castsi256_si128(sums),
+                                      _mm256_extracti128_si256(sums, 1));
+  const __m128i sums2 = _mm_add_epi32(sums4, _mm_unpackhi_epi64(sums4, sums4));
+  const int sum = _mm_cvtsi128_si32(
+      _mm_add_epi32(sums2, _mm_shuffle_epi32(sums2, _MM_SHUFFLE(1, 1, 1, 1))));
+  return sum + ScoreScalar(grid, cell_indices + i, num_cell_indices - i,
+                           offset);
+}
+
+#endif  // CARTOGRAPHER_X86_SCORING_KERNELS
+
+}  // namespace
+
+bool IsScoringKernelSupported(const ScoringKernel kernel) {
+  switch (kernel) {
+    case ScoringKernel::kScalar:
+      return true;
+#ifdef CARTOGRAPHER_X86_SCORING_KERNELS
+    case ScoringKernel::kAvx2:
+      __builtin_cpu_init();
+      return __builtin_cpu_supports("avx2");
+#else
+    case ScoringKernel::kAvx2:
+      return false;
+#endif
+  }
+  LOG(FATAL) << "Unknown scoring kernel.";
+  return false;
+}
+
+ScoringKernel GetFastestScoringKernel(const int num_cell_indices) {
+  static const bool avx2_supported =
+      IsScoringKernelSupported(ScoringKernel::kAvx2);
+  if (avx2_supported && num_cell_indices >= kMinNumCellIndicesForAvx2) {
+    return ScoringKernel::kAvx2;
+  }
+  return ScoringKernel::kScalar;
+}
+
+ScoringFunction GetScoringFunction(const ScoringKernel kernel) {
+  CHECK(IsScoringKernelSupported(kernel));
+  switch (kernel) {
+    case ScoringKernel::kScalar:
+      return &ScoreScalar;
+#ifdef CARTOGRAPHER_X86_SCORING_KERNELS
+    case ScoringKernel::kAvx2:
+      return &ScoreAvx2;
+#else
+    default:
+      break;
+#endif
+  }
+  LOG(FATAL) << "Unsupported scoring kernel.";
+  return nullptr;
+}
+
+}  // namespace scan_matching
+}  // namespace mapping_3d
+}  // namespace cartographer
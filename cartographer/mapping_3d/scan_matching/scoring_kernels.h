@@ -0,0 +1,78 @@
+/*
+ * Copyright 2017 The Cartographer Authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef CARTOGRAPHER_MAPPING_3D_SCAN_MATCHING_SCORING_KERNELS_H_
+#define CARTOGRAPHER_MAPPING_3D_SCAN_MATCHING_SCORING_KERNELS_H_
+
+#include "Eigen/Core"
+#include "cartographer/common/port.h"
+#include "cartographer/mapping_3d/hybrid_grid.h"
+
+namespace cartographer {
+namespace mapping_3d {
+namespace scan_matching {
+
+// Number of values in each block of a 'ScoringGrid', the same as in a FlatGrid.
+constexpr int kNumCellsPerScoringBlock = 1 << (3 * kFlatGridBits);
+
+// Number of bytes after the last cell of a 'ScoringGrid' which kernels may
+// read. Values read there are never used.
+constexpr int kScoringGridPadding = 3;
+
+// A box of 'num_blocks' blocks of 2^kFlatGridBits voxels per dimension
+// starting at the cell 'origin', as used by 'PagedPrecomputationGrid'. Blocks
+// are numbered z-major, and 'block_offsets' contains the index of the first
+// value of each block in 'cells'. The values of a block are stored like those
+// of a FlatGrid. 'cells' starts with a block of zeros which blocks without
+// values point to, and must be followed by 'kScoringGridPadding' readable
+// bytes.
+struct ScoringGrid {
+  const int32* block_offsets;
+  const uint8* cells;
+  Eigen::Array3i origin;
+  Eigen::Array3i num_blocks;
+};
+
+// Implementations of the innermost loop of the fast correlative scan matcher.
+// All kernels compute exactly the same result.
+enum class ScoringKernel { kScalar, kAvx2 };
+
+// Returns the sum of the values of 'grid' at 'cell_indices[i] + offset' for
+// all 'i' < 'num_cell_indices'. Indices outside of 'grid' contribute 0.
+using ScoringFunction = int (*)(const ScoringGrid& grid,
+                                const Eigen::Array3i* cell_indices,
+                                int num_cell_indices,
+                                const Eigen::Array3i& offset);
+
+// Returns true if 'kernel' was compiled in and is supported by this CPU.
+bool IsScoringKernelSupported(ScoringKernel kernel);
+
+// Scans with fewer cell indices are scored faster by the scalar kernel: the
+// AVX2 kernel's setup and gather latency are only amortized over longer scans.
+constexpr int kMinNumCellIndicesForAvx2 = 16;
+
+// Returns the fastest kernel supported by this CPU for scoring
+// 'num_cell_indices' cell indices.
+ScoringKernel GetFastestScoringKernel(int num_cell_indices);
+
+// Returns the implementation of 'kernel' which must be supported.
+ScoringFunction GetScoringFunction(ScoringKernel kernel);
+
+}  // namespace scan_matching
+}  // namespace mapping_3d
+}  // namespace cartographer
+
+#endif  // CARTOGRAPHER_MAPPING_3D_SCAN_MATCHING_SCORING_KERNELS_H_
@@ -0,0 +1,176 @@
+/*
+ * Copyright 2017 The Cartographer Authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Compares scoring candidates of the 3D fast correlative scan matcher by
+// looking up the PrecomputationGrid with the scoring kernels on a
+// PagedPrecomputationGrid, for a submap of points on the surfaces of a room.
+
+#include <chrono>
+#include <iostream>
+#include <random>
+#include <vector>
+
+#include "Eigen/Core"
+#include "cartographer/mapping_3d/hybrid_grid.h"
+#include "cartographer/mapping_3d/scan_matching/precomputation_grid.h"
+#include "cartographer/mapping_3d/scan_matching/scoring_kernels.h"
+#include "gflags/gflags.h"
+#include "glog/logging.h"
+
+DEFINE_int32(num_points, 1000000, "Number of points to insert.");
+DEFINE_double(resolution, 0.1, "Resolution of the submap in meters.");
+DEFINE_int32(num_scan_points, 2000,
+             "Number of points in the discretized scan.");
+DEFINE_int32(search_window_cells, 10,
+             "Number of cells in each direction of the linear search window.");
+
+namespace cartographer {
+namespace mapping_3d {
+namespace scan_matching {
+namespace {
+
+double SecondsSince(const std::chrono::steady_clock::time_point start) {
+  const std::chrono::duration<double> elapsed =
+      std::chrono::steady_clock::now() - start;
+  return elapsed.count();
+}
+
+// Returns a point on the floor, the ceiling or one of the walls of a 40 m x
+// 40 m x 6 m room, or in between for some clutter.
+Eigen::Vector3f SamplePoint(std::mt19937* const prng) {
+  std::uniform_real_distribution<float> horizontal(-20.f, 20.f);
+  std::uniform_real_distribution<float> vertical(0.f, 6.f);
+  std::uniform_int_distribution<int> surface(0, 6);
+  switch (surface(*prng)) {
+    case 0:
+      return Eigen::Vector3f(horizontal(*prng), horizontal(*prng), 0.f);
+    case 1:
+      return Eigen::Vector3f(horizontal(*prng), horizontal(*prng), 6.f);
+    case 2:
+      return Eigen::Vector3f(-20.f, horizontal(*prng), vertical(*prng));
+    case 3:
+      return Eigen::Vector3f(20.f, horizontal(*prng), vertical(*prng));
+    case 4:
+      return Eigen::Vector3f(horizontal(*prng), -20.f, vertical(*prng));
+    case 5:
+      return Eigen::Vector3f(horizontal(*prng), 20.f, vertical(*prng));
+  }
+  return Eigen::Vector3f(horizontal(*prng), horizontal(*prng),
+                         vertical(*prng));
+}
+
+const char* ToString(const ScoringKernel kernel) {
+  switch (kernel) {
+    case ScoringKernel::kScalar:
+      return "scalar";
+    case ScoringKernel::kAvx2:
+      return "avx2";
+  }
+  return "unknown";
+}
+
+// Calls 'score' for all offsets of the search window and prints the time per
+// point.
+template <typename ScoreFunction>
+void Benchmark(const string& name, const ScoreFunction& score,
+               int64* const expected_total) {
+  const int window = FLAGS_search_window_cells;
+  const int num_candidates =
+      (2 * window + 1) * (2 * window + 1) * (2 * window + 1);
+  int64 total = 0;
+  const auto start = std::chrono::steady_clock::now();
+  for (int z = -window; z <= window; ++z) {
+    for (int y = -window; y <= window; ++y) {
+      for (int x = -window; x <= window; ++x) {
+        total += score(Eigen::Array3i(x, y, z));
+      }
+    }
+  }
+  const double seconds = SecondsSince(start);
+  if (*expected_total < 0) {
+    *expected_total = total;
+  }
+  CHECK_EQ(total, *expected_total) << name;
+  std::cout << name << ": " << num_candidates << " candidates in " << seconds
+            << " s, "
+            << 1e9 * seconds / (num_candidates * FLAGS_num_scan_points)
+            << " ns per point\n";
+}
+
+void Run() {
+  CHECK_GT(FLAGS_num_points, 0);
+  CHECK_GT(FLAGS_num_scan_points, 0);
+  std::mt19937 prng(42);
+  HybridGrid hybrid_grid(FLAGS_resolution);
+  for (int i = 0; i != FLAGS_num_points; ++i) {
+    hybrid_grid.SetProbability(hybrid_grid.GetCellIndex(SamplePoint(&prng)),
+                               0.6f);
+  }
+  const PrecomputationGrid precomputation_grid =
+      ConvertToPrecomputationGrid(hybrid_grid);
+  const PagedPrecomputationGrid paged_grid(precomputation_grid);
+  std::cout << "PrecomputationGrid: "
+            << precomputation_grid.num_bytes() / (1024 * 1024)
+            << " MiB, PagedPrecomputationGrid: "
+            << paged_grid.size_in_bytes() / (1024 * 1024) << " MiB\n";
+
+  // Points of a scan, in measurement order as they would be discretized.
+  std::vector<Eigen::Array3i> cell_indices;
+  for (int i = 0; i != FLAGS_num_scan_points; ++i) {
+    cell_indices.push_back(hybrid_grid.GetCellIndex(SamplePoint(&prng)));
+  }
+
+  int64 expected_total = -1;
+  Benchmark("PrecomputationGrid::value()",
+            [&](const Eigen::Array3i& offset) {
+              int sum = 0;
+              for (const Eigen::Array3i& cell_index : cell_indices) {
+                sum += precomputation_grid.value(cell_index + offset);
+              }
+              return sum;
+            },
+            &expected_total);
+  for (const ScoringKernel kernel :
+       {ScoringKernel::kScalar, ScoringKernel::kAvx2}) {
+    if (!IsScoringKernelSupported(kernel)) {
+      std::cout << ToString(kernel) << ": not supported\n";
+      continue;
+    }
+    const ScoringFunction scoring_function = GetScoringFunction(kernel);
+    const ScoringGrid scoring_grid = paged_grid.scoring_grid();
+    Benchmark(ToString(kernel),
+              [&](const Eigen::Array3i& offset) {
+                return scoring_function(scoring_grid, cell_indices.data(),
+                                        cell_indices.size(), offset);
+              },
+              &expected_total);
+  }
+}
+
+}  // namespace
+}  // namespace scan_matching
+}  // namespace mapping_3d
+}  // namespace cartographer
+
+int main(int argc, char** argv) {
+  google::InitGoogleLogging(argv[0]);
+  FLAGS_logtostderr = true;
+  google::SetUsageMessage(
+      "\n\n"
+      "Benchmarks the 3D fast correlative scan matcher scoring kernels.\n");
+  google::ParseCommandLineFlags(&argc, &argv, true);
+  ::cartographer::mapping_3d::scan_matching::Run();
+}
@@ -0,0 +1,111 @@
+/*
+ * Copyright 2017 The Cartographer Authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "cartographer/mapping_3d/scan_matching/scoring_kernels.h"
+
+#include <random>
+#include <vector>
+
+#include "cartographer/mapping/probability_values.h"
+#include "cartographer/mapping_3d/hybrid_grid.h"
+#include "cartographer/mapping_3d/scan_matching/precomputation_grid.h"
+#include "gtest/gtest.h"
+
+namespace cartographer {
+namespace mapping_3d {
+namespace scan_matching {
+namespace {
+
+TEST(ScoringKernelsTest, ScalarIsAlwaysSupported) {
+  EXPECT_TRUE(IsScoringKernelSupported(ScoringKernel::kScalar));
+  EXPECT_TRUE(IsScoringKernelSupported(GetFastestScoringKernel(1000)));
+}
+
+TEST(ScoringKernelsTest, ShortScansUseScalarKernel) {
+  EXPECT_EQ(ScoringKernel::kScalar,
+            GetFastestScoringKernel(kMinNumCellIndicesForAvx2 - 1));
+}
+
+TEST(ScoringKernelsTest, AllKernelsAgreeWithPrecomputationGrid) {
+  std::mt19937 prng(42);
+  HybridGrid hybrid_grid(0.1f);
+  std::uniform_int_distribution<int> coordinate_distribution(-30, 29);
+  std::uniform_real_distribution<float> value_distribution(
+      mapping::kMinProbability, mapping::kMaxProbability);
+  for (int i = 0; i != 2000; ++i) {
+    hybrid_grid.SetProbability(Eigen::Array3i(coordinate_distribution(prng),
+                                              coordinate_distribution(prng),
+                                              coordinate_distribution(prng)),
+                               value_distribution(prng));
+  }
+  const PrecomputationGrid precomputation_grid =
+      ConvertToPrecomputationGrid(hybrid_grid);
+  const PagedPrecomputationGrid paged_grid(precomputation_grid);
+
+  // Some of the points are outside of the grid.
+  std::uniform_int_distribution<int> index_distribution(-50, 49);
+  std::vector<Eigen::Array3i> cell_indices;
+  for (auto it = PrecomputationGrid::Iterator(precomputation_grid);
+       !it.Done() && cell_indices.size() != 500; it.Next()) {
+    cell_indices.push_back(it.GetCellIndex());
+  }
+  for (int i = 0; i != 502; ++i) {
+    cell_indices.emplace_back(index_distribution(prng),
+                              index_distribution(prng),
+                              index_distribution(prng));
+  }
+
+  for (const ScoringKernel kernel :
+       {ScoringKernel::kScalar, ScoringKernel::kAvx2}) {
+    if (!IsScoringKernelSupported(kernel)) {
+      continue;
+    }
+    const ScoringFunction scoring_function = GetScoringFunction(kernel);
+    for (const int num_cell_indices : {0, 1, 7, 8, 9, 1002}) {
+      for (const Eigen::Array3i& offset :
+           {Eigen::Array3i(0, 0, 0), Eigen::Array3i(-5, 3, 1),
+            Eigen::Array3i(40, -30, 7)}) {
+        int expected_sum = 0;
+        for (int i = 0; i != num_cell_indices; ++i) {
+          expected_sum += precomputation_grid.value(cell_indices[i] + offset);
+        }
+        EXPECT_EQ(expected_sum,
+                  scoring_function(paged_grid.scoring_grid(),
+                                   cell_indices.data(), num_cell_indices,
+                                   offset));
+      }
+    }
+  }
+}
+
+TEST(ScoringKernelsTest, EmptyGridScoresZero) {
+  const PagedPrecomputationGrid paged_grid((PrecomputationGrid(0.1f)));
+  const std::vector<Eigen::Array3i> cell_indices(16, Eigen::Array3i::Zero());
+  for (const ScoringKernel kernel :
+       {ScoringKernel::kScalar, ScoringKernel::kAvx2}) {
+    if (!IsScoringKernelSupported(kernel)) {
+      continue;
+    }
+    EXPECT_EQ(0, GetScoringFunction(kernel)(paged_grid.scoring_grid(),
+                                            cell_indices.data(), 16,
+                                            Eigen::Array3i::Zero()));
+  }
+}
+
+}  // namespace
+}  // namespace scan_matching
+}  // namespace mapping_3d
+}  // namespace cartographer
@@ -43,6 +43,9 @@ ConstraintBuilder::ConstraintBuilder(
     common::ThreadPool* const thread_pool)
     : options_(options),
       thread_pool_(thread_pool),
+      submap_scan_matcher_cache_(
+          static_cast<int64>(options.precomputation_grid_cache_size_in_mb()) *
+          1024 * 1024),
       sampler_(options.sampling_ratio()),
       ceres_scan_matcher_(options.ceres_scan_matcher_options_3d()) {}
 
@@ -58,7 +61,7 @@ void ConstraintBuilder::MaybeAddConstraint(
     const mapping::SubmapId& submap_id, const Submap* const submap,
     const mapping::NodeId& node_id,
     const mapping::TrajectoryNode::Data* const constant_data,
-    const std::vector<mapping::TrajectoryNode>& submap_nodes,
+    std::shared_ptr<const std::vector<mapping::TrajectoryNode>> submap_nodes,
     const transform::Rigid3d& initial_pose) {
   if (initial_pose.translation().norm() > options_.max_constraint_distance()) {
     return;
@@ -71,7 +74,8 @@ void ConstraintBuilder::MaybeAddConstraint(
     const int current_computation = current_computation_;
     ScheduleSubmapScanMatcherConstructionAndQueueWorkItem(
         submap_id, submap_nodes, submap, [=]() EXCLUDES(mutex_) {
-          ComputeConstraint(submap_id, node_id, false, /* match_full_submap */
+          ComputeConstraint(submap_id, submap, submap_nodes, node_id,
+                            false, /* match_full_submap */
                             constant_data, initial_pose, constraint);
           FinishComputation(current_computation);
         });
@@ -82,7 +86,7 @@ void ConstraintBuilder::MaybeAddGlobalConstraint(
     const mapping::SubmapId& submap_id, const Submap* const submap,
     const mapping::NodeId& node_id,
     const mapping::TrajectoryNode::Data* const constant_data,
-    const std::vector<mapping::TrajectoryNode>& submap_nodes,
+    std::shared_ptr<const std::vector<mapping::TrajectoryNode>> submap_nodes,
     const Eigen::Quaterniond& gravity_alignment) {
   common::MutexLocker locker(&mutex_);
   constraints_.emplace_back();
@@ -91,7 +95,8 @@ void ConstraintBuilder::MaybeAddGlobalConstraint(
   const int current_computation = current_computation_;
   ScheduleSubmapScanMatcherConstructionAndQueueWorkItem(
       submap_id, submap_nodes, submap, [=]() EXCLUDES(mutex_) {
-        ComputeConstraint(submap_id, node_id, true, /* match_full_submap */
+        ComputeConstraint(submap_id, submap, submap_nodes, node_id,
+                          true, /* match_full_submap */
                           constant_data,
                           transform::Rigid3d::Rotation(gravity_alignment),
                           constraint);
@@ -118,34 +123,33 @@ void ConstraintBuilder::WhenDone(
 
 void ConstraintBuilder::ScheduleSubmapScanMatcherConstructionAndQueueWorkItem(
     const mapping::SubmapId& submap_id,
-    const std::vector<mapping::TrajectoryNode>& submap_nodes,
+    const std::shared_ptr<const std::vector<mapping::TrajectoryNode>>&
+        submap_nodes,
     const Submap* const submap, const std::function<void()>& work_item) {
-  if (submap_scan_matchers_[submap_id].fast_correlative_scan_matcher !=
-      nullptr) {
+  if (submap_scan_matchers_.count(submap_id) != 0) {
     thread_pool_->Schedule(work_item);
   } else {
     submap_queued_work_items_[submap_id].push_back(work_item);
     if (submap_queued_work_items_[submap_id].size() == 1) {
-      thread_pool_->Schedule([=]() {
-        ConstructSubmapScanMatcher(submap_id, submap_nodes, submap);
-      });
+      // Building the scan matcher unblocks all work items queued on it, so it
+      // runs ahead of other matching work.
+      thread_pool_->Schedule(
+          [=]() {
+            ConstructSubmapScanMatcher(submap_id, submap_nodes, submap);
+          },
+          common::ThreadPool::Priority::kHigh);
     }
   }
 }
 
 void ConstraintBuilder::ConstructSubmapScanMatcher(
     const mapping::SubmapId& submap_id,
-    const std::vector<mapping::TrajectoryNode>& submap_nodes,
+    const std::shared_ptr<const std::vector<mapping::TrajectoryNode>>&
+        submap_nodes,
     const Submap* const submap) {
-  auto submap_scan_matcher =
-      common::make_unique<scan_matching::FastCorrelativeScanMatcher>(
-          submap->high_resolution_hybrid_grid(),
-          &submap->low_resolution_hybrid_grid(), submap_nodes,
-          options_.fast_correlative_scan_matcher_options_3d());
+  GetOrBuildSubmapScanMatcher(submap_id, submap_nodes, submap);
   common::MutexLocker locker(&mutex_);
-  submap_scan_matchers_[submap_id] = {&submap->high_resolution_hybrid_grid(),
-                                      &submap->low_resolution_hybrid_grid(),
-                                      std::move(submap_scan_matcher)};
+  submap_scan_matchers_.insert(submap_id);
   for (const std::function<void()>& work_item :
        submap_queued_work_items_[submap_id]) {
     thread_pool_->Schedule(work_item);
@@ -153,23 +157,37 @@ void ConstraintBuilder::ConstructSubmapScanMatcher(
   submap_queued_work_items_.erase(submap_id);
 }
 
-const ConstraintBuilder::SubmapScanMatcher*
-ConstraintBuilder::GetSubmapScanMatcher(const mapping::SubmapId& submap_id) {
-  common::MutexLocker locker(&mutex_);
-  const SubmapScanMatcher* submap_scan_matcher =
-      &submap_scan_matchers_[submap_id];
-  CHECK(submap_scan_matcher->fast_correlative_scan_matcher != nullptr);
-  return submap_scan_matcher;
+std::shared_ptr<const scan_matching::FastCorrelativeScanMatcher>
+ConstraintBuilder::GetOrBuildSubmapScanMatcher(
+    const mapping::SubmapId& submap_id,
+    const std::shared_ptr<const std::vector<mapping::TrajectoryNode>>&
+        submap_nodes,
+    const Submap* const submap) {
+  return submap_scan_matcher_cache_.GetOrCompute(
+      submap_id, [this, &submap_nodes, submap]() {
+        return std::make_shared<
+            const scan_matching::FastCorrelativeScanMatcher>(
+            submap->high_resolution_hybrid_grid(),
+            &submap->low_resolution_hybrid_grid(), *submap_nodes,
+            options_.fast_correlative_scan_matcher_options_3d(), thread_pool_);
+      });
 }
 
 void ConstraintBuilder::ComputeConstraint(
-    const mapping::SubmapId& submap_id, const mapping::NodeId& node_id,
-    bool match_full_submap,
+    const mapping::SubmapId& submap_id, const Submap* const submap,
+    const std::shared_ptr<const std::vector<mapping::TrajectoryNode>>&
+        submap_nodes,
+    const mapping::NodeId& node_id, bool match_full_submap,
     const mapping::TrajectoryNode::Data* const constant_data,
     const transform::Rigid3d& initial_pose,
     std::unique_ptr<OptimizationProblem::Constraint>* constraint) {
-  const SubmapScanMatcher* const submap_scan_matcher =
-      GetSubmapScanMatcher(submap_id);
+  {
+    common::MutexLocker locker(&mutex_);
+    CHECK_EQ(submap_scan_matchers_.count(submap_id), 1);
+  }
+  const std::shared_ptr<const scan_matching::FastCorrelativeScanMatcher>
+      fast_correlative_scan_matcher =
+          GetOrBuildSubmapScanMatcher(submap_id, submap_nodes, submap);
 
   // The 'constraint_transform' (submap i <- scan j) is computed from:
   // - a 'high_resolution_point_cloud' in scan j and
@@ -184,7 +202,7 @@ void ConstraintBuilder::ComputeConstraint(
   // 2. Prune if the score is too low.
   // 3. Refine.
   if (match_full_submap) {
-    if (submap_scan_matcher->fast_correlative_scan_matcher->MatchFullSubmap(
+    if (fast_correlative_scan_matcher->MatchFullSubmap(
             initial_pose.rotation(), *constant_data,
             options_.global_localization_min_score(), &score, &pose_estimate,
             &rotational_score, &low_resolution_score)) {
@@ -195,7 +213,7 @@ void ConstraintBuilder::ComputeConstraint(
       return;
     }
   } else {
-    if (submap_scan_matcher->fast_correlative_scan_matcher->Match(
+    if (fast_correlative_scan_matcher->Match(
             initial_pose, *constant_data, options_.min_score(), &score,
             &pose_estimate, &rotational_score, &low_resolution_score)) {
       // We've reported a successful local match.
@@ -218,9 +236,9 @@ void ConstraintBuilder::ComputeConstraint(
   transform::Rigid3d constraint_transform;
   ceres_scan_matcher_.Match(pose_estimate, pose_estimate,
                             {{&constant_data->high_resolution_point_cloud,
-                              submap_scan_matcher->high_resolution_hybrid_grid},
+                              &submap->high_resolution_hybrid_grid()},
                              {&constant_data->low_resolution_point_cloud,
-                              submap_scan_matcher->low_resolution_hybrid_grid}},
+                              &submap->low_resolution_hybrid_grid()}},
                             &constraint_transform, &unused_summary);
 
   constraint->reset(new OptimizationProblem::Constraint{
@@ -274,6 +292,8 @@ void ConstraintBuilder::FinishComputation(const int computation_index) {
                     << rotational_score_histogram_.ToString(10);
           LOG(INFO) << "Low resolution score histogram:\n"
                     << low_resolution_score_histogram_.ToString(10);
+          LOG(INFO) << "Scan matcher cache: "
+                    << submap_scan_matcher_cache_.GetStatistics().ToString();
         }
         constraints_.clear();
         callback = std::move(when_done_);
@@ -294,6 +314,11 @@ int ConstraintBuilder::GetNumFinishedScans() {
   return pending_computations_.begin()->first;
 }
 
+ConstraintBuilder::ScanMatcherCache::Statistics
+ConstraintBuilder::GetScanMatcherCacheStatistics() {
+  return submap_scan_matcher_cache_.GetStatistics();
+}
+
 }  // namespace sparse_pose_graph
 }  // namespace mapping_3d
 }  // namespace cartographer
@@ -21,12 +21,15 @@
 #include <deque>
 #include <functional>
 #include <limits>
+#include <memory>
+#include <set>
 #include <vector>
 
 #include "Eigen/Core"
 #include "Eigen/Geometry"
 #include "cartographer/common/fixed_ratio_sampler.h"
 #include "cartographer/common/histogram.h"
+#include "cartographer/common/lru_cache.h"
 #include "cartographer/common/lua_parameter_dictionary.h"
 #include "cartographer/common/math.h"
 #include "cartographer/common/mutex.h"
@@ -51,11 +54,18 @@ namespace sparse_pose_graph {
 // done the 'callback' will be called with the result and another
 // MaybeAdd(Global)Constraint()/WhenDone() cycle can follow.
 //
+// Scan matchers of submaps are cached within the memory budget given by
+// 'precomputation_grid_cache_size_in_mb'. The least recently used ones are
+// evicted and rebuilt when needed again.
+//
 // This class is thread-safe.
 class ConstraintBuilder {
  public:
   using Constraint = mapping::SparsePoseGraph::Constraint;
   using Result = std::vector<Constraint>;
+  using ScanMatcherCache =
+      common::LruCache<mapping::SubmapId,
+                       scan_matching::FastCorrelativeScanMatcher>;
 
   ConstraintBuilder(
       const mapping::sparse_pose_graph::proto::ConstraintBuilderOptions&
@@ -68,7 +78,9 @@ class ConstraintBuilder {
 
   // Schedules exploring a new constraint between 'submap' identified by
   // 'submap_id', and the 'compressed_point_cloud' for 'node_id'.
-  // The 'initial_pose' is relative to the 'submap'.
+  // The 'initial_pose' is relative to the 'submap'. The 'submap_nodes' in the
+  // 'submap' frame are kept to build its scan matcher, also when it is rebuilt
+  // after an eviction.
   //
   // The pointees of 'submap' and 'compressed_point_cloud' must stay valid until
   // all computations are finished.
@@ -76,7 +88,7 @@ class ConstraintBuilder {
       const mapping::SubmapId& submap_id, const Submap* submap,
       const mapping::NodeId& node_id,
       const mapping::TrajectoryNode::Data* const constant_data,
-      const std::vector<mapping::TrajectoryNode>& submap_nodes,
+      std::shared_ptr<const std::vector<mapping::TrajectoryNode>> submap_nodes,
       const transform::Rigid3d& initial_pose);
 
   // Schedules exploring a new constraint between 'submap' identified by
@@ -92,7 +104,7 @@ class ConstraintBuilder {
       const mapping::SubmapId& submap_id, const Submap* submap,
       const mapping::NodeId& node_id,
       const mapping::TrajectoryNode::Data* const constant_data,
-      const std::vector<mapping::TrajectoryNode>& submap_nodes,
+      std::shared_ptr<const std::vector<mapping::TrajectoryNode>> submap_nodes,
       const Eigen::Quaterniond& gravity_alignment);
 
   // Must be called after all computations related to one node have been added.
@@ -105,38 +117,45 @@ class ConstraintBuilder {
   // Returns the number of consecutive finished scans.
   int GetNumFinishedScans();
 
- private:
-  struct SubmapScanMatcher {
-    const HybridGrid* high_resolution_hybrid_grid;
-    const HybridGrid* low_resolution_hybrid_grid;
-    std::unique_ptr<scan_matching::FastCorrelativeScanMatcher>
-        fast_correlative_scan_matcher;
-  };
+  // Returns the statistics of the scan matcher cache.
+  ScanMatcherCache::Statistics GetScanMatcherCacheStatistics();
 
+ private:
   // Either schedules the 'work_item', or if needed, schedules the scan matcher
   // construction and queues the 'work_item'.
   void ScheduleSubmapScanMatcherConstructionAndQueueWorkItem(
       const mapping::SubmapId& submap_id,
-      const std::vector<mapping::TrajectoryNode>& submap_nodes,
+      const std::shared_ptr<const std::vector<mapping::TrajectoryNode>>&
+          submap_nodes,
       const Submap* submap, const std::function<void()>& work_item)
       REQUIRES(mutex_);
 
-  // Constructs the scan matcher for a 'submap', then schedules its work items.
+  // Constructs the scan matcher for a 'submap' unless it is cached, then
+  // schedules its work items.
   void ConstructSubmapScanMatcher(
       const mapping::SubmapId& submap_id,
-      const std::vector<mapping::TrajectoryNode>& submap_nodes,
+      const std::shared_ptr<const std::vector<mapping::TrajectoryNode>>&
+          submap_nodes,
       const Submap* submap) EXCLUDES(mutex_);
 
-  // Returns the scan matcher for a submap, which has to exist.
-  const SubmapScanMatcher* GetSubmapScanMatcher(
-      const mapping::SubmapId& submap_id) EXCLUDES(mutex_);
+  // Returns the scan matcher for a submap from the cache, building it if
+  // needed.
+  std::shared_ptr<const scan_matching::FastCorrelativeScanMatcher>
+  GetOrBuildSubmapScanMatcher(
+      const mapping::SubmapId& submap_id,
+      const std::shared_ptr<const std::vector<mapping::TrajectoryNode>>&
+          submap_nodes,
+      const Submap* submap) EXCLUDES(mutex_);
 
   // Runs in a background thread and does computations for an additional
-  // constraint.
+  // constraint. The scan matcher for the submap has to have been constructed
+  // before, it is only rebuilt if it has been evicted from the cache since.
   // As output, it may create a new Constraint in 'constraint'.
   void ComputeConstraint(
-      const mapping::SubmapId& submap_id, const mapping::NodeId& node_id,
-      bool match_full_submap,
+      const mapping::SubmapId& submap_id, const Submap* submap,
+      const std::shared_ptr<const std::vector<mapping::TrajectoryNode>>&
+          submap_nodes,
+      const mapping::NodeId& node_id, bool match_full_submap,
       const mapping::TrajectoryNode::Data* const constant_data,
       const transform::Rigid3d& initial_pose,
       std::unique_ptr<Constraint>* constraint) EXCLUDES(mutex_);
@@ -166,9 +185,11 @@ class ConstraintBuilder {
   // keep pointers valid when adding more entries.
   std::deque<std::unique_ptr<Constraint>> constraints_ GUARDED_BY(mutex_);
 
-  // Map of already constructed scan matchers by 'submap_id'.
-  std::map<mapping::SubmapId, SubmapScanMatcher> submap_scan_matchers_
-      GUARDED_BY(mutex_);
+  // Submaps for which scan matchers have already been constructed.
+  std::set<mapping::SubmapId> submap_scan_matchers_ GUARDED_BY(mutex_);
+
+  // Scan matchers by 'submap_id' within the memory budget.
+  ScanMatcherCache submap_scan_matcher_cache_;
 
   // Map by 'submap_id' of scan matchers under construction, and the work
   // to do once construction is done.
@@ -0,0 +1,212 @@
+/*
+ * Copyright 2017 The Cartographer Authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "cartographer/mapping_3d/sparse_pose_graph/constraint_builder.h"
+
+#include <cmath>
+#include <memory>
+#include <vector>
+
+#include "cartographer/common/lua_parameter_dictionary_test_helpers.h"
+#include "cartographer/common/make_unique.h"
+#include "cartographer/common/mutex.h"
+#include "cartographer/common/time.h"
+#include "cartographer/mapping/sparse_pose_graph/constraint_builder.h"
+#include "cartographer/mapping_3d/range_data_inserter.h"
+#include "cartographer/mapping_3d/scan_matching/rotational_scan_matcher.h"
+#include "cartographer/transform/rigid_transform_test_helpers.h"
+#include "gmock/gmock.h"
+
+namespace cartographer {
+namespace mapping_3d {
+namespace sparse_pose_graph {
+namespace {
+
+constexpr int kRotationalHistogramSize = 120;
+
+class ConstraintBuilderTest : public ::testing::Test {
+ protected:
+  ConstraintBuilderTest()
+      : range_data_inserter_(CreateRangeDataInserterOptions(
+            common::MakeDictionary(R"text(
+                return {
+                  hit_probability = 0.7,
+                  miss_probability = 0.4,
+                  num_free_space_voxels = 0,
+                })text")
+                .get())),
+        thread_pool_(1) {
+    // Extrudes a wavy, irregularly circular curve to a wall that is unique
+    // rotationally around the z axis.
+    for (float t = 0.f; t < 2.f * M_PI; t += 0.01f) {
+      const float r = (std::sin(20.f * t) + 2.f) * std::sin(t + 2.f) + 2.f;
+      for (float z = -1.f; z <= 1.f; z += 0.25f) {
+        point_cloud_.emplace_back(r * std::sin(t), r * std::cos(t), z);
+      }
+    }
+    constant_data_ = std::make_shared<const mapping::TrajectoryNode::Data>(
+        mapping::TrajectoryNode::Data{
+            common::FromUniversal(0),
+            Eigen::Quaterniond::Identity(),
+            {},
+            point_cloud_,
+            point_cloud_,
+            scan_matching::RotationalScanMatcher::ComputeHistogram(
+                point_cloud_, kRotationalHistogramSize)});
+    submap_nodes_ =
+        std::make_shared<const std::vector<mapping::TrajectoryNode>>(
+            std::vector<mapping::TrajectoryNode>{
+                {constant_data_, transform::Rigid3d::Identity()}});
+
+    auto parameter_dictionary = common::MakeDictionary(R"text(
+        return {
+          sampling_ratio = 1.,
+          max_constraint_distance = 6.,
+          min_score = 0.5,
+          global_localization_min_score = 0.6,
+          loop_closure_translation_weight = 1.,
+          loop_closure_rotation_weight = 1.,
+          log_matches = false,
+          precomputation_grid_cache_size_in_mb = 1,
+          serialize_precomputation_grids = false,
+          fast_correlative_scan_matcher = {
+            linear_search_window = 3.,
+            angular_search_window = 0.1,
+            branch_and_bound_depth = 3,
+            parallel_branch_and_bound = false,
+          },
+          ceres_scan_matcher = {
+            occupied_space_weight = 20.,
+            translation_weight = 10.,
+            rotation_weight = 1.,
+            use_analytic_occupied_space_cost = false,
+            ceres_solver_options = {
+              use_nonmonotonic_steps = true,
+              max_num_iterations = 50,
+              num_threads = 1,
+            },
+          },
+          fast_correlative_scan_matcher_3d = {
+            branch_and_bound_depth = 4,
+            full_resolution_depth = 3,
+            min_rotational_score = 0.1,
+            min_low_resolution_score = 0.5,
+            linear_xy_search_window = 1.,
+            linear_z_search_window = 0.5,
+            angular_search_window = 0.1,
+            parallel_branch_and_bound = false,
+          },
+          ceres_scan_matcher_3d = {
+            occupied_space_weight_0 = 20.,
+            occupied_space_weight_1 = 20.,
+            translation_weight = 10.,
+            rotation_weight = 1.,
+            only_optimize_yaw = true,
+            ceres_solver_options = {
+              use_nonmonotonic_steps = true,
+              max_num_iterations = 50,
+              num_threads = 1,
+            },
+          },
+        })text");
+    constraint_builder_ = common::make_unique<ConstraintBuilder>(
+        mapping::sparse_pose_graph::CreateConstraintBuilderOptions(
+            parameter_dictionary.get()),
+        &thread_pool_);
+  }
+
+  // Returns a finished submap of the 'point_cloud_'.
+  std::unique_ptr<Submap> CreateSubmap() {
+    auto submap = common::make_unique<Submap>(
+        0.1f /* high_resolution */, 0.3f /* low_resolution */,
+        transform::Rigid3d::Identity());
+    submap->InsertRangeData(
+        sensor::RangeData{Eigen::Vector3f::Zero(), point_cloud_, {}},
+        range_data_inserter_, 20 /* high_resolution_max_range */);
+    submap->Finish();
+    return submap;
+  }
+
+  // Matches the node against 'submap' starting from 'initial_pose' and
+  // returns the resulting constraints once all computations are done.
+  ConstraintBuilder::Result MatchNode(const mapping::SubmapId& submap_id,
+                                      const Submap* const submap,
+                                      const transform::Rigid3d& initial_pose) {
+    constraint_builder_->MaybeAddConstraint(
+        submap_id, submap, mapping::NodeId{0, 0}, constant_data_.get(),
+        submap_nodes_, initial_pose);
+    constraint_builder_->NotifyEndOfScan();
+    common::Mutex mutex;
+    bool done = false;
+    ConstraintBuilder::Result result;
+    constraint_builder_->WhenDone(
+        [&mutex, &done, &result](const ConstraintBuilder::Result& constraints) {
+          common::MutexLocker locker(&mutex);
+          result = constraints;
+          done = true;
+        });
+    common::MutexLocker locker(&mutex);
+    locker.Await([&done]() { return done; });
+    return result;
+  }
+
+  RangeDataInserter range_data_inserter_;
+  sensor::PointCloud point_cloud_;
+  std::shared_ptr<const mapping::TrajectoryNode::Data> constant_data_;
+  std::shared_ptr<const std::vector<mapping::TrajectoryNode>> submap_nodes_;
+  common::ThreadPool thread_pool_;
+  std::unique_ptr<ConstraintBuilder> constraint_builder_;
+};
+
+TEST_F(ConstraintBuilderTest, RebuildsEvictedScanMatcher) {
+  const std::unique_ptr<Submap> submap_0 = CreateSubmap();
+  const std::unique_ptr<Submap> submap_1 = CreateSubmap();
+  const mapping::SubmapId submap_id_0{0, 0};
+  const mapping::SubmapId submap_id_1{0, 1};
+  const transform::Rigid3d initial_pose =
+      transform::Rigid3d::Translation(Eigen::Vector3d(0.3, -0.2, 0.1)) *
+      transform::Rigid3d::Rotation(
+          Eigen::AngleAxisd(0.05, Eigen::Vector3d::UnitZ()));
+
+  const ConstraintBuilder::Result first_result =
+      MatchNode(submap_id_0, submap_0.get(), initial_pose);
+  ASSERT_EQ(1, first_result.size());
+  EXPECT_THAT(first_result[0].pose.zbar_ij,
+              transform::IsNearly(transform::Rigid3d::Identity(), 0.15));
+  // The budget only fits one scan matcher, so the next one evicts it.
+  const auto statistics = constraint_builder_->GetScanMatcherCacheStatistics();
+  ASSERT_GT(2 * statistics.size_in_bytes, 1024 * 1024);
+
+  EXPECT_EQ(1, MatchNode(submap_id_1, submap_1.get(), initial_pose).size());
+  EXPECT_EQ(1,
+            constraint_builder_->GetScanMatcherCacheStatistics().num_evictions);
+
+  const ConstraintBuilder::Result rebuilt_result =
+      MatchNode(submap_id_0, submap_0.get(), initial_pose);
+  const auto rebuilt_statistics =
+      constraint_builder_->GetScanMatcherCacheStatistics();
+  EXPECT_EQ(3, rebuilt_statistics.num_misses);
+  EXPECT_EQ(2, rebuilt_statistics.num_evictions);
+  ASSERT_EQ(1, rebuilt_result.size());
+  EXPECT_EQ(submap_id_0, rebuilt_result[0].submap_id);
+  EXPECT_THAT(rebuilt_result[0].pose.zbar_ij,
+              transform::IsNearly(first_result[0].pose.zbar_ij, 1e-9));
+}
+
+}  // namespace
+}  // namespace sparse_pose_graph
+}  // namespace mapping_3d
+}  // namespace cartographer
@@ -18,6 +18,7 @@
 
 #include <algorithm>
 #include <array>
+#include <chrono>
 #include <cmath>
 #include <iterator>
 #include <map>
@@ -46,6 +47,25 @@ namespace cartographer {
 namespace mapping_3d {
 namespace sparse_pose_graph {
 
+namespace {
+
+// Returns an iterator to the last IMU data not after 'time', as expected by
+// IntegrateImu().
+std::deque<sensor::ImuData>::const_iterator FindImuData(
+    const std::deque<sensor::ImuData>& imu_data, const common::Time time) {
+  auto it = std::upper_bound(
+      imu_data.cbegin(), imu_data.cend(), time,
+      [](const common::Time time, const sensor::ImuData& imu_data) {
+        return time < imu_data.time;
+      });
+  if (it != imu_data.cbegin()) {
+    --it;
+  }
+  return it;
+}
+
+}  // namespace
+
 OptimizationProblem::OptimizationProblem(
     const mapping::sparse_pose_graph::proto::OptimizationProblemOptions&
         options,
@@ -113,282 +133,433 @@ void OptimizationProblem::SetMaxNumIterations(const int32 max_num_iterations) {
 
 void OptimizationProblem::Solve(const std::vector<Constraint>& constraints,
                                 const std::set<int>& frozen_trajectories) {
+  PrepareSolve(constraints, frozen_trajectories);
+  SolvePrepared();
+  FinishSolve();
+}
+
+void OptimizationProblem::PrepareSolve(
+    const std::vector<Constraint>& constraints,
+    const std::set<int>& frozen_trajectories) {
+  CHECK(!solve_prepared_);
   if (node_data_.empty()) {
     // Nothing to optimize.
     return;
   }
 
-  ceres::Problem::Options problem_options;
-  ceres::Problem problem(problem_options);
+  const auto update_start = std::chrono::steady_clock::now();
+  UpdateProblem(constraints, frozen_trajectories);
+  problem_update_duration_ = std::chrono::steady_clock::now() - update_start;
+  solve_prepared_ = true;
+}
 
-  const auto translation_parameterization =
-      [this]() -> std::unique_ptr<ceres::LocalParameterization> {
-    return fix_z_ == FixZ::kYes
-               ? common::make_unique<ceres::SubsetParameterization>(
-                     3, std::vector<int>{2})
-               : nullptr;
-  };
+void OptimizationProblem::SolvePrepared() {
+  if (!solve_prepared_) {
+    return;
+  }
 
-  // Set the starting point.
-  CHECK(!submap_data_.empty());
-  CHECK(!submap_data_[0].empty());
-  // TODO(hrapp): Move ceres data into SubmapData.
-  std::vector<std::map<int, CeresPose>> C_submaps(submap_data_.size());
-  std::vector<std::map<int, CeresPose>> C_nodes(node_data_.size());
-  bool first_submap = true;
-  for (size_t trajectory_id = 0; trajectory_id != submap_data_.size();
+  ceres::Solver::Summary summary;
+  ceres::Solve(
+      common::CreateCeresSolverOptions(options_.ceres_solver_options()),
+      problem_.get(), &summary);
+  if (options_.log_solver_summary()) {
+    LOG(INFO) << summary.FullReport();
+    LOG(INFO) << "Updating the problem took "
+              << problem_update_duration_.count() << " s, solving it took "
+              << summary.total_time_in_seconds << " s.";
+  }
+}
+
+void OptimizationProblem::FinishSolve() {
+  if (!solve_prepared_) {
+    return;
+  }
+  solve_prepared_ = false;
+
+  if (options_.log_solver_summary()) {
+    for (size_t trajectory_id = 0; trajectory_id != trajectory_data_.size();
+         ++trajectory_id) {
+      if (trajectory_id != 0) {
+        LOG(INFO) << "Trajectory " << trajectory_id << ":";
+      }
+      LOG(INFO) << "Gravity was: "
+                << trajectory_data_[trajectory_id].gravity_constant;
+      const auto& imu_calibration =
+          trajectory_data_[trajectory_id].imu_calibration;
+      LOG(INFO) << "IMU correction was: "
+                << common::RadToDeg(2. * std::acos(imu_calibration[0]))
+                << " deg (" << imu_calibration[0] << ", " << imu_calibration[1]
+                << ", " << imu_calibration[2] << ", " << imu_calibration[3]
+                << ")";
+    }
+  }
+
+  // Store the result.
+  for (size_t trajectory_id = 0; trajectory_id != ceres_trajectory_data_.size();
        ++trajectory_id) {
-    const bool frozen = frozen_trajectories.count(trajectory_id);
-    for (const auto& index_submap_data : submap_data_[trajectory_id]) {
-      const int submap_index = index_submap_data.first;
-      if (first_submap) {
-        first_submap = false;
-        // Fix the first submap of the first trajectory except for allowing
-        // gravity alignment.
-        C_submaps[trajectory_id].emplace(
-            std::piecewise_construct, std::forward_as_tuple(submap_index),
-            std::forward_as_tuple(
-                index_submap_data.second.pose, translation_parameterization(),
-                common::make_unique<ceres::AutoDiffLocalParameterization<
-                    ConstantYawQuaternionPlus, 4, 2>>(),
-                &problem));
-        problem.SetParameterBlockConstant(
-            C_submaps[trajectory_id].at(submap_index).translation());
-      } else {
-        C_submaps[trajectory_id].emplace(
-            std::piecewise_construct, std::forward_as_tuple(submap_index),
-            std::forward_as_tuple(
-                index_submap_data.second.pose, translation_parameterization(),
-                common::make_unique<ceres::QuaternionParameterization>(),
-                &problem));
+    const CeresTrajectoryData& ceres_data =
+        ceres_trajectory_data_[trajectory_id];
+    // Submaps and nodes added while solving have not been optimized. They
+    // move along with the last optimized submap.
+    transform::Rigid3d correction = transform::Rigid3d::Identity();
+    if (!ceres_data.submaps.empty()) {
+      const auto& last_submap = *ceres_data.submaps.rbegin();
+      correction =
+          last_submap.second.ToRigid() *
+          submap_data_[trajectory_id].at(last_submap.first).pose.inverse();
+    }
+    if (trajectory_id < submap_data_.size()) {
+      for (auto& index_submap_data : submap_data_[trajectory_id]) {
+        transform::Rigid3d& pose = index_submap_data.second.pose;
+        pose = index_submap_data.first < ceres_data.next_submap_index
+                   ? ceres_data.submaps.at(index_submap_data.first).ToRigid()
+                   : correction * pose;
       }
-      if (frozen) {
-        problem.SetParameterBlockConstant(
-            C_submaps[trajectory_id].at(submap_index).rotation());
-        problem.SetParameterBlockConstant(
-            C_submaps[trajectory_id].at(submap_index).translation());
+    }
+    if (trajectory_id < node_data_.size()) {
+      for (auto& index_node_data : node_data_[trajectory_id]) {
+        transform::Rigid3d& pose = index_node_data.second.pose;
+        pose = index_node_data.first < ceres_data.next_node_index
+                   ? ceres_data.nodes.at(index_node_data.first).ToRigid()
+                   : correction * pose;
       }
     }
   }
-  for (size_t trajectory_id = 0; trajectory_id != node_data_.size();
+
+  if (!options_.incremental_problem()) {
+    ceres_trajectory_data_.clear();
+    problem_.reset();
+    num_constraints_in_problem_ = 0;
+    imu_residual_blocks_with_missing_data_.clear();
+    nodes_without_fixed_frame_pose_.clear();
+  }
+}
+
+void OptimizationProblem::UpdateProblem(
+    const std::vector<Constraint>& constraints,
+    const std::set<int>& frozen_trajectories) {
+  if (problem_ == nullptr) {
+    ceres::Problem::Options problem_options;
+    // Residuals are replaced in a persistent problem once late sensor data
+    // arrives.
+    problem_options.enable_fast_removal = options_.incremental_problem();
+    problem_ = common::make_unique<ceres::Problem>(problem_options);
+  }
+  CHECK(!submap_data_.empty());
+  CHECK(!submap_data_[0].empty());
+  ceres_trajectory_data_.resize(
+      std::max(submap_data_.size(), node_data_.size()));
+  imu_residual_blocks_with_missing_data_.resize(ceres_trajectory_data_.size());
+  nodes_without_fixed_frame_pose_.resize(ceres_trajectory_data_.size());
+
+  // Add the starting points of new submaps and nodes and fix the poses of all
+  // submaps and nodes of frozen trajectories.
+  std::vector<mapping::NodeId> new_node_ids;
+  for (size_t trajectory_id = 0; trajectory_id != ceres_trajectory_data_.size();
        ++trajectory_id) {
+    CeresTrajectoryData& ceres_data = ceres_trajectory_data_[trajectory_id];
     const bool frozen = frozen_trajectories.count(trajectory_id);
-    for (const auto& index_node_data : node_data_[trajectory_id]) {
-      const int node_index = index_node_data.first;
-      C_nodes[trajectory_id].emplace(
-          std::piecewise_construct, std::forward_as_tuple(node_index),
-          std::forward_as_tuple(
-              index_node_data.second.pose, translation_parameterization(),
-              common::make_unique<ceres::QuaternionParameterization>(),
-              &problem));
-      if (frozen) {
-        problem.SetParameterBlockConstant(
-            C_nodes[trajectory_id].at(node_index).rotation());
-        problem.SetParameterBlockConstant(
-            C_nodes[trajectory_id].at(node_index).translation());
+    if (frozen != ceres_data.frozen) {
+      for (auto& index_ceres_pose : ceres_data.submaps) {
+        SetCeresPoseFrozen(&index_ceres_pose.second, frozen);
+      }
+      for (auto& index_ceres_pose : ceres_data.nodes) {
+        SetCeresPoseFrozen(&index_ceres_pose.second, frozen);
+      }
+      ceres_data.frozen = frozen;
+    }
+    if (trajectory_id < submap_data_.size()) {
+      for (auto it = submap_data_[trajectory_id].lower_bound(
+               ceres_data.next_submap_index);
+           it != submap_data_[trajectory_id].end(); ++it) {
+        // There is no trimming in 3D, so the first submap of the first
+        // trajectory never changes.
+        const bool first_submap =
+            trajectory_id == 0 && ceres_data.submaps.empty();
+        if (first_submap) {
+          // Fix the first submap of the first trajectory except for allowing
+          // gravity alignment.
+          ceres_data.submaps.emplace(
+              std::piecewise_construct, std::forward_as_tuple(it->first),
+              std::forward_as_tuple(
+                  it->second.pose, TranslationParameterization(),
+                  common::make_unique<ceres::AutoDiffLocalParameterization<
+                      ConstantYawQuaternionPlus, 4, 2>>(),
+                  problem_.get()));
+        } else {
+          ceres_data.submaps.emplace(
+              std::piecewise_construct, std::forward_as_tuple(it->first),
+              std::forward_as_tuple(
+                  it->second.pose, TranslationParameterization(),
+                  common::make_unique<ceres::QuaternionParameterization>(),
+                  problem_.get()));
+        }
+        if (frozen) {
+          SetCeresPoseFrozen(&ceres_data.submaps.at(it->first), true);
+        }
+        ceres_data.next_submap_index = it->first + 1;
+      }
+    }
+    if (trajectory_id < node_data_.size()) {
+      for (auto it = node_data_[trajectory_id].lower_bound(
+               ceres_data.next_node_index);
+           it != node_data_[trajectory_id].end(); ++it) {
+        ceres_data.nodes.emplace(
+            std::piecewise_construct, std::forward_as_tuple(it->first),
+            std::forward_as_tuple(
+                it->second.pose, TranslationParameterization(),
+                common::make_unique<ceres::QuaternionParameterization>(),
+                problem_.get()));
+        if (frozen) {
+          SetCeresPoseFrozen(&ceres_data.nodes.at(it->first), true);
+        }
+        new_node_ids.push_back(
+            mapping::NodeId{static_cast<int>(trajectory_id), it->first});
+        ceres_data.next_node_index = it->first + 1;
       }
     }
   }
-  // Add cost functions for intra- and inter-submap constraints.
-  for (const Constraint& constraint : constraints) {
-    problem.AddResidualBlock(
+  problem_->SetParameterBlockConstant(
+      ceres_trajectory_data_[0].submaps.begin()->second.translation());
+
+  // Add cost functions for new intra- and inter-submap constraints.
+  CHECK_LE(num_constraints_in_problem_, constraints.size());
+  for (auto it = constraints.begin() + num_constraints_in_problem_;
+       it != constraints.end(); ++it) {
+    const Constraint& constraint = *it;
+    CeresPose& submap_pose =
+        ceres_trajectory_data_.at(constraint.submap_id.trajectory_id)
+            .submaps.at(constraint.submap_id.submap_index);
+    CeresPose& node_pose =
+        ceres_trajectory_data_.at(constraint.node_id.trajectory_id)
+            .nodes.at(constraint.node_id.node_index);
+    problem_->AddResidualBlock(
         new ceres::AutoDiffCostFunction<SpaCostFunction, 6, 4, 3, 4, 3>(
             new SpaCostFunction(constraint.pose)),
         // Only loop closure constraints should have a loss function.
         constraint.tag == Constraint::INTER_SUBMAP
             ? new ceres::HuberLoss(options_.huber_scale())
             : nullptr,
-        C_submaps.at(constraint.submap_id.trajectory_id)
-            .at(constraint.submap_id.submap_index)
-            .rotation(),
-        C_submaps.at(constraint.submap_id.trajectory_id)
-            .at(constraint.submap_id.submap_index)
-            .translation(),
-        C_nodes.at(constraint.node_id.trajectory_id)
-            .at(constraint.node_id.node_index)
-            .rotation(),
-        C_nodes.at(constraint.node_id.trajectory_id)
-            .at(constraint.node_id.node_index)
-            .translation());
+        submap_pose.rotation(), submap_pose.translation(), node_pose.rotation(),
+        node_pose.translation());
   }
+  num_constraints_in_problem_ = constraints.size();
 
   // Add constraints based on IMU observations of angular velocities and
-  // linear acceleration.
+  // linear acceleration, and fixed frame pose constraints.
   trajectory_data_.resize(imu_data_.size());
   CHECK_GE(trajectory_data_.size(), node_data_.size());
-  for (size_t trajectory_id = 0; trajectory_id != node_data_.size();
-       ++trajectory_id) {
-    if (node_data_[trajectory_id].empty()) {
-      // We skip empty trajectories which might not have any IMU data.
-      continue;
-    }
-    TrajectoryData& trajectory_data = trajectory_data_.at(trajectory_id);
-    problem.AddParameterBlock(trajectory_data.imu_calibration.data(), 4,
-                              new ceres::QuaternionParameterization());
-    const std::deque<sensor::ImuData>& imu_data = imu_data_.at(trajectory_id);
-    CHECK(!imu_data.empty());
-
-    auto imu_it = imu_data.cbegin();
-    for (auto node_it = node_data_[trajectory_id].begin();;) {
-      const int first_node_index = node_it->first;
-      const NodeData& first_node_data = node_it->second;
-      ++node_it;
-      if (node_it == node_data_[trajectory_id].end()) {
-        break;
-      }
+  UpdateResidualsWithLateData();
+  for (const mapping::NodeId& node_id : new_node_ids) {
+    AddImuResiduals(node_id);
+    AddFixedFramePoseResidual(node_id);
+  }
+}
 
-      const int second_node_index = node_it->first;
-      const NodeData& second_node_data = node_it->second;
+std::unique_ptr<ceres::LocalParameterization>
+OptimizationProblem::TranslationParameterization() const {
+  return fix_z_ == FixZ::kYes
+             ? common::make_unique<ceres::SubsetParameterization>(
+                   3, std::vector<int>{2})
+             : nullptr;
+}
 
-      if (second_node_index != first_node_index + 1) {
-        continue;
-      }
+void OptimizationProblem::SetCeresPoseFrozen(CeresPose* const ceres_pose,
+                                             const bool frozen) {
+  if (frozen) {
+    problem_->SetParameterBlockConstant(ceres_pose->rotation());
+    problem_->SetParameterBlockConstant(ceres_pose->translation());
+  } else {
+    problem_->SetParameterBlockVariable(ceres_pose->rotation());
+    problem_->SetParameterBlockVariable(ceres_pose->translation());
+  }
+}
 
-      // Skip IMU data before the node.
-      while ((imu_it + 1) != imu_data.cend() &&
-             (imu_it + 1)->time <= first_node_data.time) {
-        ++imu_it;
-      }
+void OptimizationProblem::AddImuResiduals(const mapping::NodeId& node_id) {
+  const int trajectory_id = node_id.trajectory_id;
+  TrajectoryData& trajectory_data = trajectory_data_.at(trajectory_id);
+  if (!problem_->HasParameterBlock(trajectory_data.imu_calibration.data())) {
+    problem_->AddParameterBlock(trajectory_data.imu_calibration.data(), 4,
+                                new ceres::QuaternionParameterization());
+  }
+  const std::deque<sensor::ImuData>& imu_data = imu_data_.at(trajectory_id);
+  CHECK(!imu_data.empty());
 
-      auto imu_it2 = imu_it;
-      const IntegrateImuResult<double> result = IntegrateImu(
-          imu_data, first_node_data.time, second_node_data.time, &imu_it);
-      const auto next_node_it = std::next(node_it);
-      if (next_node_it != node_data_[trajectory_id].end() &&
-          next_node_it->first == second_node_index + 1) {
-        const int third_node_index = next_node_it->first;
-        const NodeData& third_node_data = next_node_it->second;
-        const common::Time first_time = first_node_data.time;
-        const common::Time second_time = second_node_data.time;
-        const common::Time third_time = third_node_data.time;
-        const common::Duration first_duration = second_time - first_time;
-        const common::Duration second_duration = third_time - second_time;
-        const common::Time first_center = first_time + first_duration / 2;
-        const common::Time second_center = second_time + second_duration / 2;
-        const IntegrateImuResult<double> result_to_first_center =
-            IntegrateImu(imu_data, first_time, first_center, &imu_it2);
-        const IntegrateImuResult<double> result_center_to_center =
-            IntegrateImu(imu_data, first_center, second_center, &imu_it2);
-        // 'delta_velocity' is the change in velocity from the point in time
-        // halfway between the first and second poses to halfway between second
-        // and third pose. It is computed from IMU data and still contains a
-        // delta due to gravity. The orientation of this vector is in the IMU
-        // frame at the second pose.
-        const Eigen::Vector3d delta_velocity =
-            (result.delta_rotation.inverse() *
-             result_to_first_center.delta_rotation) *
-            result_center_to_center.delta_velocity;
-        problem.AddResidualBlock(
-            new ceres::AutoDiffCostFunction<AccelerationCostFunction, 3, 4, 3,
-                                            3, 3, 1, 4>(
-                new AccelerationCostFunction(
-                    options_.acceleration_weight(), delta_velocity,
-                    common::ToSeconds(first_duration),
-                    common::ToSeconds(second_duration))),
-            nullptr, C_nodes[trajectory_id].at(second_node_index).rotation(),
-            C_nodes[trajectory_id].at(first_node_index).translation(),
-            C_nodes[trajectory_id].at(second_node_index).translation(),
-            C_nodes[trajectory_id].at(third_node_index).translation(),
-            &trajectory_data.gravity_constant,
-            trajectory_data.imu_calibration.data());
-      }
-      problem.AddResidualBlock(
+  const std::map<int, NodeData>& node_data = node_data_[trajectory_id];
+  std::map<int, CeresPose>& ceres_nodes =
+      ceres_trajectory_data_[trajectory_id].nodes;
+  if (node_data.count(node_id.node_index - 1) == 0) {
+    return;
+  }
+  const NodeData& second_node_data = node_data.at(node_id.node_index - 1);
+  const NodeData& third_node_data = node_data.at(node_id.node_index);
+  CeresPose& second_node = ceres_nodes.at(node_id.node_index - 1);
+  CeresPose& third_node = ceres_nodes.at(node_id.node_index);
+
+  // Until IMU data up to the node arrived, the residuals are computed from the
+  // data available and replaced later.
+  std::vector<ceres::ResidualBlockId>* residual_blocks = nullptr;
+  if (options_.incremental_problem() &&
+      ImuDataMayArrive(trajectory_id, third_node_data.time)) {
+    residual_blocks =
+        &imu_residual_blocks_with_missing_data_[trajectory_id]
+             [node_id.node_index];
+  }
+
+  auto imu_it = FindImuData(imu_data, second_node_data.time);
+  const IntegrateImuResult<double> result = IntegrateImu(
+      imu_data, second_node_data.time, third_node_data.time, &imu_it);
+  const ceres::ResidualBlockId rotation_residual_block =
+      problem_->AddResidualBlock(
           new ceres::AutoDiffCostFunction<RotationCostFunction, 3, 4, 4, 4>(
               new RotationCostFunction(options_.rotation_weight(),
                                        result.delta_rotation)),
-          nullptr, C_nodes[trajectory_id].at(first_node_index).rotation(),
-          C_nodes[trajectory_id].at(second_node_index).rotation(),
+          nullptr, second_node.rotation(), third_node.rotation(),
           trajectory_data.imu_calibration.data());
-    }
+  if (residual_blocks != nullptr) {
+    residual_blocks->push_back(rotation_residual_block);
   }
 
-  // Add fixed frame pose constraints.
-  std::deque<CeresPose> C_fixed_frames;
-  for (size_t trajectory_id = 0; trajectory_id != node_data_.size();
-       ++trajectory_id) {
-    if (trajectory_id >= fixed_frame_pose_data_.size()) {
-      break;
+  if (node_data.count(node_id.node_index - 2) == 0) {
+    return;
+  }
+  const NodeData& first_node_data = node_data.at(node_id.node_index - 2);
+  CeresPose& first_node = ceres_nodes.at(node_id.node_index - 2);
+  const common::Time first_time = first_node_data.time;
+  const common::Time second_time = second_node_data.time;
+  const common::Time third_time = third_node_data.time;
+  const common::Duration first_duration = second_time - first_time;
+  const common::Duration second_duration = third_time - second_time;
+  const common::Time first_center = first_time + first_duration / 2;
+  const common::Time second_center = second_time + second_duration / 2;
+  imu_it = FindImuData(imu_data, first_time);
+  auto imu_it2 = imu_it;
+  const IntegrateImuResult<double> result_first_to_second =
+      IntegrateImu(imu_data, first_time, second_time, &imu_it);
+  const IntegrateImuResult<double> result_to_first_center =
+      IntegrateImu(imu_data, first_time, first_center, &imu_it2);
+  const IntegrateImuResult<double> result_center_to_center =
+      IntegrateImu(imu_data, first_center, second_center, &imu_it2);
+  // 'delta_velocity' is the change in velocity from the point in time halfway
+  // between the first and second poses to halfway between second and third
+  // pose. It is computed from IMU data and still contains a delta due to
+  // gravity. The orientation of this vector is in the IMU frame at the second
+  // pose.
+  const Eigen::Vector3d delta_velocity =
+      (result_first_to_second.delta_rotation.inverse() *
+       result_to_first_center.delta_rotation) *
+      result_center_to_center.delta_velocity;
+  const ceres::ResidualBlockId acceleration_residual_block =
+      problem_->AddResidualBlock(
+          new ceres::AutoDiffCostFunction<AccelerationCostFunction, 3, 4, 3,
+                                          3, 3, 1, 4>(
+              new AccelerationCostFunction(
+                  options_.acceleration_weight(), delta_velocity,
+                  common::ToSeconds(first_duration),
+                  common::ToSeconds(second_duration))),
+          nullptr, second_node.rotation(), first_node.translation(),
+          second_node.translation(), third_node.translation(),
+          &trajectory_data.gravity_constant,
+          trajectory_data.imu_calibration.data());
+  if (residual_blocks != nullptr) {
+    residual_blocks->push_back(acceleration_residual_block);
+  }
+}
+
+void OptimizationProblem::AddFixedFramePoseResidual(
+    const mapping::NodeId& node_id) {
+  const int trajectory_id = node_id.trajectory_id;
+  if (trajectory_id >= static_cast<int>(fixed_frame_pose_data_.size())) {
+    return;
+  }
+  const NodeData& node_data = node_data_[trajectory_id].at(node_id.node_index);
+  if (!fixed_frame_pose_data_.at(trajectory_id).Has(node_data.time)) {
+    if (options_.incremental_problem() &&
+        FixedFramePoseDataMayArrive(trajectory_id, node_data.time)) {
+      nodes_without_fixed_frame_pose_[trajectory_id].insert(
+          node_id.node_index);
     }
+    return;
+  }
 
-    bool fixed_frame_pose_initialized = false;
+  const mapping::SparsePoseGraph::Constraint::Pose constraint_pose{
+      fixed_frame_pose_data_.at(trajectory_id).Lookup(node_data.time),
+      options_.fixed_frame_pose_translation_weight(),
+      options_.fixed_frame_pose_rotation_weight()};
+
+  CeresTrajectoryData& ceres_data = ceres_trajectory_data_[trajectory_id];
+  if (ceres_data.fixed_frame == nullptr) {
+    const transform::Rigid3d fixed_frame_pose_in_map =
+        node_data.pose * constraint_pose.zbar_ij.inverse();
+    ceres_data.fixed_frame = common::make_unique<CeresPose>(
+        transform::Rigid3d(
+            fixed_frame_pose_in_map.translation(),
+            Eigen::AngleAxisd(
+                transform::GetYaw(fixed_frame_pose_in_map.rotation()),
+                Eigen::Vector3d::UnitZ())),
+        nullptr,
+        common::make_unique<
+            ceres::AutoDiffLocalParameterization<YawOnlyQuaternionPlus, 4, 1>>(),
+        problem_.get());
+  }
 
-    for (auto& index_node_data : node_data_[trajectory_id]) {
-      const int node_index = index_node_data.first;
-      const NodeData& node_data = index_node_data.second;
-      if (!fixed_frame_pose_data_.at(trajectory_id).Has(node_data.time)) {
-        continue;
-      }
+  CeresPose& node = ceres_data.nodes.at(node_id.node_index);
+  problem_->AddResidualBlock(
+      new ceres::AutoDiffCostFunction<SpaCostFunction, 6, 4, 3, 4, 3>(
+          new SpaCostFunction(constraint_pose)),
+      nullptr, ceres_data.fixed_frame->rotation(),
+      ceres_data.fixed_frame->translation(), node.rotation(),
+      node.translation());
+}
 
-      const mapping::SparsePoseGraph::Constraint::Pose constraint_pose{
-          fixed_frame_pose_data_.at(trajectory_id).Lookup(node_data.time),
-          options_.fixed_frame_pose_translation_weight(),
-          options_.fixed_frame_pose_rotation_weight()};
-
-      if (!fixed_frame_pose_initialized) {
-        const transform::Rigid3d fixed_frame_pose_in_map =
-            node_data.pose * constraint_pose.zbar_ij.inverse();
-        C_fixed_frames.emplace_back(
-            transform::Rigid3d(
-                fixed_frame_pose_in_map.translation(),
-                Eigen::AngleAxisd(
-                    transform::GetYaw(fixed_frame_pose_in_map.rotation()),
-                    Eigen::Vector3d::UnitZ())),
-            nullptr,
-            common::make_unique<ceres::AutoDiffLocalParameterization<
-                YawOnlyQuaternionPlus, 4, 1>>(),
-            &problem);
-        fixed_frame_pose_initialized = true;
+void OptimizationProblem::UpdateResidualsWithLateData() {
+  // Nodes are added in order of time, so data arrives for them in order.
+  for (size_t trajectory_id = 0;
+       trajectory_id != imu_residual_blocks_with_missing_data_.size();
+       ++trajectory_id) {
+    auto& imu_residual_blocks =
+        imu_residual_blocks_with_missing_data_[trajectory_id];
+    while (!imu_residual_blocks.empty()) {
+      const auto it = imu_residual_blocks.begin();
+      const mapping::NodeId node_id{static_cast<int>(trajectory_id),
+                                    it->first};
+      if (ImuDataMayArrive(trajectory_id,
+                           node_data_[trajectory_id].at(it->first).time)) {
+        break;
       }
-
-      problem.AddResidualBlock(
-          new ceres::AutoDiffCostFunction<SpaCostFunction, 6, 4, 3, 4, 3>(
-              new SpaCostFunction(constraint_pose)),
-          nullptr, C_fixed_frames.back().rotation(),
-          C_fixed_frames.back().translation(),
-          C_nodes.at(trajectory_id).at(node_index).rotation(),
-          C_nodes.at(trajectory_id).at(node_index).translation());
+      for (const ceres::ResidualBlockId residual_block : it->second) {
+        problem_->RemoveResidualBlock(residual_block);
+      }
+      imu_residual_blocks.erase(it);
+      AddImuResiduals(node_id);
     }
-  }
 
-  // Solve.
-  ceres::Solver::Summary summary;
-  ceres::Solve(
-      common::CreateCeresSolverOptions(options_.ceres_solver_options()),
-      &problem, &summary);
-  if (options_.log_solver_summary()) {
-    LOG(INFO) << summary.FullReport();
-    for (size_t trajectory_id = 0; trajectory_id != trajectory_data_.size();
-         ++trajectory_id) {
-      if (trajectory_id != 0) {
-        LOG(INFO) << "Trajectory " << trajectory_id << ":";
+    auto& node_indices = nodes_without_fixed_frame_pose_[trajectory_id];
+    while (!node_indices.empty()) {
+      const mapping::NodeId node_id{static_cast<int>(trajectory_id),
+                                    *node_indices.begin()};
+      if (FixedFramePoseDataMayArrive(
+              trajectory_id,
+              node_data_[trajectory_id].at(node_id.node_index).time)) {
+        break;
       }
-      LOG(INFO) << "Gravity was: "
-                << trajectory_data_[trajectory_id].gravity_constant;
-      const auto& imu_calibration =
-          trajectory_data_[trajectory_id].imu_calibration;
-      LOG(INFO) << "IMU correction was: "
-                << common::RadToDeg(2. * std::acos(imu_calibration[0]))
-                << " deg (" << imu_calibration[0] << ", " << imu_calibration[1]
-                << ", " << imu_calibration[2] << ", " << imu_calibration[3]
-                << ")";
+      node_indices.erase(node_indices.begin());
+      AddFixedFramePoseResidual(node_id);
     }
   }
+}
 
-  // Store the result.
-  for (size_t trajectory_id = 0; trajectory_id != submap_data_.size();
-       ++trajectory_id) {
-    for (auto& index_submap_data : submap_data_[trajectory_id]) {
-      index_submap_data.second.pose =
-          C_submaps[trajectory_id].at(index_submap_data.first).ToRigid();
-    }
-  }
-  for (size_t trajectory_id = 0; trajectory_id != node_data_.size();
-       ++trajectory_id) {
-    for (auto& index_node_data : node_data_[trajectory_id]) {
-      index_node_data.second.pose =
-          C_nodes[trajectory_id].at(index_node_data.first).ToRigid();
-    }
-  }
+bool OptimizationProblem::ImuDataMayArrive(const int trajectory_id,
+                                           const common::Time time) const {
+  const std::deque<sensor::ImuData>& imu_data = imu_data_.at(trajectory_id);
+  return !imu_data.empty() && imu_data.back().time < time;
+}
+
+bool OptimizationProblem::FixedFramePoseDataMayArrive(
+    const int trajectory_id, const common::Time time) const {
+  return trajectory_id < static_cast<int>(fixed_frame_pose_data_.size()) &&
+         !fixed_frame_pose_data_[trajectory_id].empty() &&
+         fixed_frame_pose_data_[trajectory_id].latest_time() < time;
 }
 
 const std::vector<std::map<int, NodeData>>& OptimizationProblem::node_data()
@@ -18,8 +18,10 @@
 #define CARTOGRAPHER_MAPPING_3D_SPARSE_POSE_GRAPH_OPTIMIZATION_PROBLEM_H_
 
 #include <array>
+#include <chrono>
 #include <deque>
 #include <map>
+#include <memory>
 #include <set>
 #include <vector>
 
@@ -29,6 +31,7 @@
 #include "cartographer/common/time.h"
 #include "cartographer/mapping/sparse_pose_graph.h"
 #include "cartographer/mapping/sparse_pose_graph/proto/optimization_problem_options.pb.h"
+#include "cartographer/mapping_3d/ceres_pose.h"
 #include "cartographer/sensor/fixed_frame_pose_data.h"
 #include "cartographer/sensor/imu_data.h"
 #include "cartographer/sensor/odometry_data.h"
@@ -77,10 +80,21 @@ class OptimizationProblem {
 
   void SetMaxNumIterations(int32 max_num_iterations);
 
-  // Computes the optimized poses.
+  // Computes the optimized poses. If 'options.incremental_problem()' is set,
+  // 'constraints' must be the constraints passed to the last call followed by
+  // new ones.
   void Solve(const std::vector<Constraint>& constraints,
              const std::set<int>& frozen_trajectories);
 
+  // Solve() split into three steps. Only SolvePrepared() is time consuming.
+  // While it runs, other threads may add data. FinishSolve() stores the
+  // optimized poses and moves submaps and nodes added since PrepareSolve()
+  // along with the last optimized submap of their trajectory.
+  void PrepareSolve(const std::vector<Constraint>& constraints,
+                    const std::set<int>& frozen_trajectories);
+  void SolvePrepared();
+  void FinishSolve();
+
   const std::vector<std::map<int, NodeData>>& node_data() const;
   const std::vector<std::map<int, SubmapData>>& submap_data() const;
 
@@ -92,14 +106,60 @@ class OptimizationProblem {
     int next_node_index = 0;
   };
 
+  // Parameter blocks of one trajectory in 'problem_'.
+  struct CeresTrajectoryData {
+    std::map<int, CeresPose> submaps;
+    std::map<int, CeresPose> nodes;
+    std::unique_ptr<CeresPose> fixed_frame;
+    // Submaps and nodes with lower indices have already been added.
+    int next_submap_index = 0;
+    int next_node_index = 0;
+    bool frozen = false;
+  };
+
+  // Adds the parameter blocks and residual blocks which are not yet part of
+  // 'problem_', creating it if necessary.
+  void UpdateProblem(const std::vector<Constraint>& constraints,
+                     const std::set<int>& frozen_trajectories);
+  std::unique_ptr<ceres::LocalParameterization> TranslationParameterization()
+      const;
+  void SetCeresPoseFrozen(CeresPose* ceres_pose, bool frozen);
+  void AddImuResiduals(const mapping::NodeId& node_id);
+  void AddFixedFramePoseResidual(const mapping::NodeId& node_id);
+  // Recomputes residuals of nodes that were added before the IMU or fixed
+  // frame pose data for them arrived, once it did.
+  void UpdateResidualsWithLateData();
+  // Returns true if 'trajectory_id' has IMU or fixed frame pose data, but not
+  // yet up to 'time'.
+  bool ImuDataMayArrive(int trajectory_id, common::Time time) const;
+  bool FixedFramePoseDataMayArrive(int trajectory_id, common::Time time) const;
+
   mapping::sparse_pose_graph::proto::OptimizationProblemOptions options_;
   FixZ fix_z_;
   std::vector<std::deque<sensor::ImuData>> imu_data_;
   std::vector<std::map<int, NodeData>> node_data_;
   std::vector<transform::TransformInterpolationBuffer> odometry_data_;
   std::vector<std::map<int, SubmapData>> submap_data_;
-  std::vector<TrajectoryData> trajectory_data_;
+  // A deque, so that the IMU calibration parameter blocks in a persistent
+  // 'problem_' stay valid when trajectories are added.
+  std::deque<TrajectoryData> trajectory_data_;
   std::vector<transform::TransformInterpolationBuffer> fixed_frame_pose_data_;
+
+  // Unless 'options_.incremental_problem()' is set, the Ceres problem only
+  // exists from PrepareSolve() to FinishSolve().
+  std::unique_ptr<ceres::Problem> problem_;
+  std::vector<CeresTrajectoryData> ceres_trajectory_data_;
+  size_t num_constraints_in_problem_ = 0;
+  // Nodes of a persistent 'problem_' that were added before the IMU data for
+  // them arrived, with the residual blocks computed from the data available
+  // then, by trajectory and node index.
+  std::vector<std::map<int, std::vector<ceres::ResidualBlockId>>>
+      imu_residual_blocks_with_missing_data_;
+  // Nodes of a persistent 'problem_' that were added before the fixed frame
+  // pose data for them arrived, by trajectory.
+  std::vector<std::set<int>> nodes_without_fixed_frame_pose_;
+  bool solve_prepared_ = false;
+  std::chrono::duration<double> problem_update_duration_;
 };
 
 }  // namespace sparse_pose_graph
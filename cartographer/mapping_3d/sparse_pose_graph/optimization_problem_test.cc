@@ -17,11 +17,13 @@
 #include "cartographer/mapping_3d/sparse_pose_graph/optimization_problem.h"
 
 #include <random>
+#include <string>
 
 #include "Eigen/Core"
 #include "cartographer/common/lua_parameter_dictionary_test_helpers.h"
 #include "cartographer/common/time.h"
 #include "cartographer/mapping/sparse_pose_graph/optimization_problem_options.h"
+#include "cartographer/sensor/fixed_frame_pose_data.h"
 #include "cartographer/transform/transform.h"
 #include "glog/logging.h"
 #include "gmock/gmock.h"
@@ -31,7 +33,8 @@ namespace mapping_3d {
 namespace sparse_pose_graph {
 namespace {
 
-class OptimizationProblemTest : public ::testing::Test {
+// The parameter selects whether the Ceres problem is kept between solves.
+class OptimizationProblemTest : public ::testing::TestWithParam<bool> {
  protected:
   OptimizationProblemTest()
       : optimization_problem_(CreateOptions(), OptimizationProblem::FixZ::kNo),
@@ -39,7 +42,9 @@ class OptimizationProblemTest : public ::testing::Test {
 
   mapping::sparse_pose_graph::proto::OptimizationProblemOptions
   CreateOptions() {
-    auto parameter_dictionary = common::MakeDictionary(R"text(
+    const std::string incremental_problem = GetParam() ? "true" : "false";
+    auto parameter_dictionary = common::MakeDictionary(
+        R"text(
         return {
           acceleration_weight = 1e-4,
           rotation_weight = 1e-2,
@@ -49,6 +54,8 @@ class OptimizationProblemTest : public ::testing::Test {
           fixed_frame_pose_translation_weight = 1e1,
           fixed_frame_pose_rotation_weight = 1e2,
           log_solver_summary = true,
+          incremental_problem = )text" +
+        incremental_problem + R"text(,
           ceres_solver_options = {
             use_nonmonotonic_steps = false,
             max_num_iterations = 200,
@@ -103,7 +110,7 @@ transform::Rigid3d AddNoise(const transform::Rigid3d& transform,
                             noisy_rotation);
 }
 
-TEST_F(OptimizationProblemTest, ReducesNoise) {
+TEST_P(OptimizationProblemTest, ReducesNoise) {
   constexpr int kNumNodes = 100;
   const transform::Rigid3d kSubmap0Transform = transform::Rigid3d::Identity();
   const transform::Rigid3d kSubmap2Transform = transform::Rigid3d::Rotation(
@@ -169,6 +176,14 @@ TEST_F(OptimizationProblemTest, ReducesNoise) {
   optimization_problem_.AddSubmap(kTrajectoryId, kSubmap0Transform);
   optimization_problem_.AddSubmap(kTrajectoryId, kSubmap2Transform);
   const std::set<int> kFrozen;
+  if (GetParam()) {
+    // Solve with half of the constraints first, so that the remaining ones
+    // are added to the existing problem.
+    optimization_problem_.Solve(
+        std::vector<OptimizationProblem::Constraint>(
+            constraints.begin(), constraints.begin() + constraints.size() / 2),
+        kFrozen);
+  }
   optimization_problem_.Solve(constraints, kFrozen);
 
   double translation_error_after = 0.;
@@ -185,6 +200,112 @@ TEST_F(OptimizationProblemTest, ReducesNoise) {
   EXPECT_GT(0.8 * rotation_error_before, rotation_error_after);
 }
 
+TEST_P(OptimizationProblemTest, UsesLateFixedFramePoseData) {
+  constexpr int kNumNodes = 20;
+  const int kTrajectoryId = 0;
+  std::vector<transform::Rigid3d> ground_truth_poses;
+  std::vector<common::Time> times;
+  common::Time now = common::FromUniversal(0);
+  for (int j = 0; j != kNumNodes; ++j) {
+    ground_truth_poses.push_back(RandomTransform(10., 3.));
+    times.push_back(now);
+    const transform::Rigid3d pose =
+        AddNoise(ground_truth_poses.back(), RandomYawOnlyTransform(0.2, 0.3));
+    optimization_problem_.AddImuData(
+        kTrajectoryId, sensor::ImuData{now, Eigen::Vector3d::UnitZ() * 9.81,
+                                       Eigen::Vector3d::Zero()});
+    optimization_problem_.AddTrajectoryNode(kTrajectoryId, now, pose, pose);
+    now += common::FromSeconds(0.01);
+  }
+  optimization_problem_.AddSubmap(kTrajectoryId,
+                                  transform::Rigid3d::Identity());
+
+  // Fixed frame poses for the second half of the nodes only arrive after the
+  // first solve.
+  const std::vector<OptimizationProblem::Constraint> kNoConstraints;
+  const std::set<int> kFrozen;
+  for (int j = 0; j != kNumNodes / 2; ++j) {
+    optimization_problem_.AddFixedFramePoseData(
+        kTrajectoryId,
+        sensor::FixedFramePoseData{times[j], ground_truth_poses[j]});
+  }
+  optimization_problem_.Solve(kNoConstraints, kFrozen);
+  for (int j = kNumNodes / 2; j != kNumNodes; ++j) {
+    optimization_problem_.AddFixedFramePoseData(
+        kTrajectoryId,
+        sensor::FixedFramePoseData{times[j], ground_truth_poses[j]});
+  }
+  optimization_problem_.Solve(kNoConstraints, kFrozen);
+
+  // Only the poses relative to each other are determined by the fixed frame.
+  const auto& node_data = optimization_problem_.node_data().at(kTrajectoryId);
+  for (int j = 1; j != kNumNodes; ++j) {
+    const transform::Rigid3d error =
+        (ground_truth_poses[0].inverse() * ground_truth_poses[j]).inverse() *
+        node_data.at(0).pose.inverse() * node_data.at(j).pose;
+    EXPECT_NEAR(0., error.translation().norm(), 1e-2) << j;
+    EXPECT_NEAR(0., transform::GetAngle(error), 1e-2) << j;
+  }
+}
+
+TEST_P(OptimizationProblemTest, MovesDataAddedWhileSolving) {
+  const int kTrajectoryId = 0;
+  const auto translation = [](const double x) {
+    return transform::Rigid3d::Translation(Eigen::Vector3d(x, 0., 0.));
+  };
+  common::Time now = common::FromUniversal(0);
+  const auto add_node = [this, &now, kTrajectoryId](
+                            const transform::Rigid3d& pose) {
+    optimization_problem_.AddImuData(
+        kTrajectoryId, sensor::ImuData{now, Eigen::Vector3d::UnitZ() * 9.81,
+                                       Eigen::Vector3d::Zero()});
+    optimization_problem_.AddTrajectoryNode(kTrajectoryId, now, pose, pose);
+    now += common::FromSeconds(0.1);
+  };
+
+  // Node 'j' is at x = j. Submap 1 is at x = 3, but starts 0.5 m off.
+  std::vector<OptimizationProblem::Constraint> constraints;
+  for (int j = 0; j != 6; ++j) {
+    add_node(translation(j));
+    constraints.push_back(OptimizationProblem::Constraint{
+        mapping::SubmapId{kTrajectoryId, 0}, mapping::NodeId{kTrajectoryId, j},
+        OptimizationProblem::Constraint::Pose{translation(j), 1e2, 1e2},
+        OptimizationProblem::Constraint::INTRA_SUBMAP});
+    if (j >= 3) {
+      constraints.push_back(OptimizationProblem::Constraint{
+          mapping::SubmapId{kTrajectoryId, 1},
+          mapping::NodeId{kTrajectoryId, j},
+          OptimizationProblem::Constraint::Pose{translation(j - 3), 1e2, 1e2},
+          OptimizationProblem::Constraint::INTRA_SUBMAP});
+    }
+  }
+  optimization_problem_.AddSubmap(kTrajectoryId, translation(0.));
+  optimization_problem_.AddSubmap(kTrajectoryId, translation(3.5));
+
+  const std::set<int> kFrozen;
+  optimization_problem_.PrepareSolve(constraints, kFrozen);
+  // Local SLAM keeps placing data relative to the unoptimized submap 1.
+  add_node(translation(6.5));
+  optimization_problem_.AddSubmap(kTrajectoryId, translation(6.5));
+  optimization_problem_.SolvePrepared();
+  optimization_problem_.FinishSolve();
+
+  const auto& submap_data =
+      optimization_problem_.submap_data().at(kTrajectoryId);
+  const auto& node_data = optimization_problem_.node_data().at(kTrajectoryId);
+  EXPECT_NEAR(3., submap_data.at(1).pose.translation().x(), 1e-3);
+  EXPECT_NEAR(6., node_data.at(6).pose.translation().x(), 1e-3);
+  EXPECT_NEAR(6., submap_data.at(2).pose.translation().x(), 1e-3);
+  EXPECT_NEAR(3.,
+              (submap_data.at(1).pose.inverse() * node_data.at(6).pose)
+                  .translation()
+                  .x(),
+              1e-9);
+}
+
+INSTANTIATE_TEST_CASE_P(IncrementalProblem, OptimizationProblemTest,
+                        ::testing::Bool());
+
 }  // namespace
 }  // namespace sparse_pose_graph
 }  // namespace mapping_3d
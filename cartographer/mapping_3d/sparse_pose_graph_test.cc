@@ -0,0 +1,339 @@
+/*
+ * Copyright 2017 The Cartographer Authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "cartographer/mapping_3d/sparse_pose_graph.h"
+
+#include <algorithm>
+#include <cmath>
+#include <memory>
+#include <string>
+#include <thread>
+
+#include "cartographer/common/lua_parameter_dictionary_test_helpers.h"
+#include "cartographer/common/make_unique.h"
+#include "cartographer/common/mutex.h"
+#include "cartographer/common/thread_pool.h"
+#include "cartographer/common/time.h"
+#include "cartographer/mapping_3d/scan_matching/rotational_scan_matcher.h"
+#include "cartographer/mapping_3d/submaps.h"
+#include "cartographer/sensor/imu_data.h"
+#include "cartographer/transform/rigid_transform.h"
+#include "cartographer/transform/rigid_transform_test_helpers.h"
+#include "cartographer/transform/transform.h"
+#include "gmock/gmock.h"
+
+namespace cartographer {
+namespace mapping_3d {
+namespace {
+
+constexpr int kRotationalHistogramSize = 120;
+
+// The parameter selects whether the Ceres problem is kept between solves.
+class SparsePoseGraphTest : public ::testing::TestWithParam<bool> {
+ protected:
+  SparsePoseGraphTest() : thread_pool_(1) {
+    // Extrudes a wavy, irregularly circular curve to a wall that is unique
+    // rotationally around the z axis.
+    for (float t = 0.f; t < 2.f * M_PI; t += 0.02f) {
+      const float r = (std::sin(20.f * t) + 2.f) * std::sin(t + 2.f);
+      for (float z = -1.f; z <= 1.f; z += 0.5f) {
+        point_cloud_.emplace_back(r * std::sin(t), r * std::cos(t), z);
+      }
+    }
+
+    {
+      auto parameter_dictionary = common::MakeDictionary(R"text(
+          return {
+            high_resolution = 0.1,
+            high_resolution_max_range = 20.,
+            low_resolution = 0.3,
+            num_range_data = 1,
+            range_data_inserter = {
+              hit_probability = 0.7,
+              miss_probability = 0.4,
+              num_free_space_voxels = 0,
+            },
+          })text");
+      active_submaps_ = common::make_unique<ActiveSubmaps>(
+          CreateSubmapsOptions(parameter_dictionary.get()));
+    }
+
+    {
+      const std::string incremental_problem = GetParam() ? "true" : "false";
+      auto parameter_dictionary = common::MakeDictionary(
+          R"text(
+          return {
+            optimize_every_n_scans = 1000,
+            constraint_builder = {
+              sampling_ratio = 1.,
+              max_constraint_distance = 6.,
+              min_score = 0.5,
+              global_localization_min_score = 0.6,
+              loop_closure_translation_weight = 1.,
+              loop_closure_rotation_weight = 1.,
+              log_matches = true,
+              precomputation_grid_cache_size_in_mb = 64,
+              serialize_precomputation_grids = false,
+              fast_correlative_scan_matcher = {
+                linear_search_window = 3.,
+                angular_search_window = 0.1,
+                branch_and_bound_depth = 3,
+                parallel_branch_and_bound = false,
+              },
+              ceres_scan_matcher = {
+                occupied_space_weight = 20.,
+                translation_weight = 10.,
+                rotation_weight = 1.,
+                use_analytic_occupied_space_cost = false,
+                ceres_solver_options = {
+                  use_nonmonotonic_steps = true,
+                  max_num_iterations = 50,
+                  num_threads = 1,
+                },
+              },
+              fast_correlative_scan_matcher_3d = {
+                branch_and_bound_depth = 3,
+                full_resolution_depth = 3,
+                min_rotational_score = 0.1,
+                min_low_resolution_score = 0.5,
+                linear_xy_search_window = 1.,
+                linear_z_search_window = 0.5,
+                angular_search_window = 0.1,
+                parallel_branch_and_bound = false,
+              },
+              ceres_scan_matcher_3d = {
+                occupied_space_weight_0 = 20.,
+                occupied_space_weight_1 = 20.,
+                translation_weight = 10.,
+                rotation_weight = 1.,
+                only_optimize_yaw = true,
+                ceres_solver_options = {
+                  use_nonmonotonic_steps = true,
+                  max_num_iterations = 50,
+                  num_threads = 1,
+                },
+              },
+            },
+            matcher_translation_weight = 1.,
+            matcher_rotation_weight = 1.,
+            optimization_problem = {
+              acceleration_weight = 1.,
+              rotation_weight = 1e2,
+              huber_scale = 1.,
+              consecutive_scan_translation_penalty_factor = 0.,
+              consecutive_scan_rotation_penalty_factor = 0.,
+              fixed_frame_pose_translation_weight = 1e1,
+              fixed_frame_pose_rotation_weight = 1e2,
+              log_solver_summary = true,
+              incremental_problem = )text" +
+          incremental_problem + R"text(,
+              ceres_solver_options = {
+                use_nonmonotonic_steps = false,
+                max_num_iterations = 200,
+                num_threads = 1,
+              },
+            },
+            max_num_final_iterations = 200,
+            global_sampling_ratio = 0.01,
+            log_residual_histograms = true,
+            global_constraint_search_after_n_seconds = 10.0,
+          })text");
+      sparse_pose_graph_options_ =
+          mapping::CreateSparsePoseGraphOptions(parameter_dictionary.get());
+      sparse_pose_graph_ = common::make_unique<SparsePoseGraph>(
+          sparse_pose_graph_options_, &thread_pool_);
+    }
+
+    current_pose_ = transform::Rigid3d::Identity();
+  }
+
+  // Adds a scan 'movement' away from the last one, 0.1 s later, and the IMU
+  // data of standing still at its time.
+  void MoveRelative(const transform::Rigid3d& movement) {
+    current_pose_ = current_pose_ * movement;
+    current_time_ += common::FromSeconds(0.1);
+    const sensor::PointCloud new_point_cloud = sensor::TransformPointCloud(
+        point_cloud_, current_pose_.inverse().cast<float>());
+    std::vector<std::shared_ptr<const Submap>> insertion_submaps;
+    for (const auto& submap : active_submaps_->submaps()) {
+      insertion_submaps.push_back(submap);
+    }
+    const sensor::RangeData range_data{
+        Eigen::Vector3f::Zero(), new_point_cloud, {}};
+    constexpr int kTrajectoryId = 0;
+    active_submaps_->InsertRangeData(
+        sensor::TransformRangeData(range_data, current_pose_.cast<float>()),
+        Eigen::Quaterniond::Identity());
+
+    sparse_pose_graph_->AddImuData(
+        kTrajectoryId,
+        sensor::ImuData{current_time_, Eigen::Vector3d(0., 0., 9.8),
+                        Eigen::Vector3d::Zero()});
+    sparse_pose_graph_->AddScan(
+        std::make_shared<const mapping::TrajectoryNode::Data>(
+            mapping::TrajectoryNode::Data{
+                current_time_,
+                Eigen::Quaterniond::Identity(),
+                {},
+                range_data.returns,
+                range_data.returns,
+                scan_matching::RotationalScanMatcher::ComputeHistogram(
+                    range_data.returns, kRotationalHistogramSize)}),
+        current_pose_, kTrajectoryId, insertion_submaps);
+  }
+
+  // Returns whether a loop closure was found between the node with
+  // 'node_index' and a submap in ['begin_submap_index', 'end_submap_index').
+  bool HasInterSubmapConstraint(const int node_index,
+                                const int begin_submap_index,
+                                const int end_submap_index) {
+    const auto snapshot = sparse_pose_graph_->GetSnapshot();
+    return std::any_of(
+        snapshot->constraints.begin(), snapshot->constraints.end(),
+        [=](const mapping::SparsePoseGraph::Constraint& constraint) {
+          return constraint.tag ==
+                     mapping::SparsePoseGraph::Constraint::INTER_SUBMAP &&
+                 constraint.node_id.trajectory_id == 0 &&
+                 constraint.node_id.node_index == node_index &&
+                 constraint.submap_id.trajectory_id == 0 &&
+                 constraint.submap_id.submap_index >= begin_submap_index &&
+                 constraint.submap_id.submap_index < end_submap_index;
+        });
+  }
+
+  // Occupies the only thread of the 'thread_pool_' until ReleaseThreadPool()
+  // is called. Constraint computations and the optimizations started from the
+  // thread pool are held up in the meantime.
+  void BlockThreadPool() {
+    common::MutexLocker locker(&thread_pool_block_mutex_);
+    thread_pool_blocked_ = false;
+    thread_pool_released_ = false;
+    thread_pool_.Schedule([this]() {
+      {
+        // Waiters are only notified when the lock is released.
+        common::MutexLocker locker(&thread_pool_block_mutex_);
+        thread_pool_blocked_ = true;
+      }
+      common::MutexLocker locker(&thread_pool_block_mutex_);
+      locker.Await([this]() { return thread_pool_released_; });
+    });
+    locker.Await([this]() { return thread_pool_blocked_; });
+  }
+
+  void ReleaseThreadPool() {
+    common::MutexLocker locker(&thread_pool_block_mutex_);
+    thread_pool_released_ = true;
+  }
+
+  sensor::PointCloud point_cloud_;
+  std::unique_ptr<ActiveSubmaps> active_submaps_;
+  common::Mutex thread_pool_block_mutex_;
+  bool thread_pool_blocked_ = false;
+  bool thread_pool_released_ = false;
+  common::ThreadPool thread_pool_;
+  mapping::proto::SparsePoseGraphOptions sparse_pose_graph_options_;
+  std::unique_ptr<SparsePoseGraph> sparse_pose_graph_;
+  transform::Rigid3d current_pose_;
+  common::Time current_time_ = common::FromUniversal(0);
+};
+
+TEST_P(SparsePoseGraphTest, EmptyMap) {
+  sparse_pose_graph_->RunFinalOptimization();
+  const auto nodes = sparse_pose_graph_->GetTrajectoryNodes();
+  EXPECT_THAT(nodes.size(), ::testing::Eq(0u));
+}
+
+TEST_P(SparsePoseGraphTest, AddsScansWhileOptimizationIsPending) {
+  mapping::proto::SparsePoseGraphOptions options = sparse_pose_graph_options_;
+  options.set_optimize_every_n_scans(2);
+  sparse_pose_graph_ =
+      common::make_unique<SparsePoseGraph>(options, &thread_pool_);
+  BlockThreadPool();
+  // The first optimization is requested after 3 scans and cannot start, so
+  // all later scans and IMU data are added as queued work items.
+  std::vector<transform::Rigid3d> poses;
+  std::thread add_scans([this, &poses]() {
+    for (int i = 0; i != 10; ++i) {
+      MoveRelative(transform::Rigid3d::Translation({0., 0.4, 0.}));
+      poses.emplace_back(current_pose_);
+    }
+  });
+  add_scans.join();
+  EXPECT_THAT(sparse_pose_graph_->GetTrajectoryNodes()[0].size(),
+              ::testing::Eq(10u));
+  ReleaseThreadPool();
+  sparse_pose_graph_->RunFinalOptimization();
+  const auto nodes = sparse_pose_graph_->GetTrajectoryNodes();
+  ASSERT_THAT(nodes.size(), ::testing::Eq(1u));
+  ASSERT_THAT(nodes[0].size(), ::testing::Eq(poses.size()));
+  for (size_t i = 0; i != poses.size(); ++i) {
+    EXPECT_THAT(nodes[0][i].pose, transform::IsNearly(poses[i], 1e-2)) << i;
+  }
+}
+
+TEST_P(SparsePoseGraphTest, RunsFinalOptimizationWhileAddingScans) {
+  // Every scan requests an optimization from the thread pool, which must not
+  // prepare a solve while a final optimization does and vice versa.
+  mapping::proto::SparsePoseGraphOptions options = sparse_pose_graph_options_;
+  options.set_optimize_every_n_scans(1);
+  sparse_pose_graph_ =
+      common::make_unique<SparsePoseGraph>(options, &thread_pool_);
+  std::vector<transform::Rigid3d> poses;
+  std::thread add_scans([this, &poses]() {
+    for (int i = 0; i != 20; ++i) {
+      MoveRelative(transform::Rigid3d::Translation({0., 0.4, 0.}));
+      poses.emplace_back(current_pose_);
+    }
+  });
+  for (int i = 0; i != 10; ++i) {
+    sparse_pose_graph_->RunFinalOptimization();
+  }
+  add_scans.join();
+  sparse_pose_graph_->RunFinalOptimization();
+  const auto nodes = sparse_pose_graph_->GetTrajectoryNodes();
+  ASSERT_THAT(nodes.size(), ::testing::Eq(1u));
+  ASSERT_THAT(nodes[0].size(), ::testing::Eq(poses.size()));
+  for (size_t i = 0; i != poses.size(); ++i) {
+    EXPECT_THAT(nodes[0][i].pose, transform::IsNearly(poses[i], 1e-2)) << i;
+  }
+}
+
+TEST_P(SparsePoseGraphTest, FinalOptimizationWaitsForAllComputations) {
+  BlockThreadPool();
+  MoveRelative(transform::Rigid3d::Identity());
+  MoveRelative(transform::Rigid3d::Identity());
+  MoveRelative(transform::Rigid3d::Translation({0., 5., 0.}));
+  MoveRelative(transform::Rigid3d::Identity());
+  const int begin_submap_index = sparse_pose_graph_->num_submaps(0);
+  MoveRelative(transform::Rigid3d::Translation({0., -5., 0.}));
+  MoveRelative(transform::Rigid3d::Identity());
+  MoveRelative(transform::Rigid3d::Identity());
+  // None of the constraints can be computed before the thread pool is
+  // released, which happens while the final optimization is waiting.
+  std::thread run_final_optimization(
+      [this]() { sparse_pose_graph_->RunFinalOptimization(); });
+  ReleaseThreadPool();
+  run_final_optimization.join();
+  EXPECT_TRUE(HasInterSubmapConstraint(0, begin_submap_index,
+                                       sparse_pose_graph_->num_submaps(0)));
+}
+
+INSTANTIATE_TEST_CASE_P(IncrementalProblem, SparsePoseGraphTest,
+                        ::testing::Bool());
+
+}  // namespace
+}  // namespace mapping_3d
+}  // namespace cartographer
@@ -30,7 +30,7 @@ namespace {
 
 // Number of items that can be queued up before we log which queues are waiting
 // for data.
-const int kMaxQueueSize = 500;
+constexpr size_t kMaxQueueSize = 500;
 
 }  // namespace
 
@@ -49,6 +49,7 @@ OrderedMultiQueue::~OrderedMultiQueue() {
 void OrderedMultiQueue::AddQueue(const QueueKey& queue_key, Callback callback) {
   CHECK_EQ(queues_.count(queue_key), 0);
   queues_[queue_key].callback = std::move(callback);
+  empty_unfinished_queues_.insert(queue_key);
 }
 
 void OrderedMultiQueue::MarkQueueAsFinished(const QueueKey& queue_key) {
@@ -57,6 +58,10 @@ void OrderedMultiQueue::MarkQueueAsFinished(const QueueKey& queue_key) {
   auto& queue = it->second;
   CHECK(!queue.finished);
   queue.finished = true;
+  if (Peek(queue) == nullptr) {
+    empty_unfinished_queues_.erase(queue_key);
+    queues_.erase(it);
+  }
   Dispatch();
 }
 
@@ -68,7 +73,7 @@ void OrderedMultiQueue::Add(const QueueKey& queue_key,
         << "Ignored data for queue: '" << queue_key << "'";
     return;
   }
-  it->second.queue.Push(std::move(data));
+  Push(it, std::move(data));
   Dispatch();
 }
 
@@ -91,70 +96,100 @@ QueueKey OrderedMultiQueue::GetBlocker() const {
 
 void OrderedMultiQueue::Dispatch() {
   while (true) {
-    const Data* next_data = nullptr;
-    Queue* next_queue = nullptr;
-    QueueKey next_queue_key;
-    for (auto it = queues_.begin(); it != queues_.end();) {
-      const auto* data = it->second.queue.Peek<Data>();
-      if (data == nullptr) {
-        if (it->second.finished) {
-          queues_.erase(it++);
-          continue;
-        }
-        CannotMakeProgress(it->first);
-        return;
-      }
-      if (next_data == nullptr || data->GetTime() < next_data->GetTime()) {
-        next_data = data;
-        next_queue = &it->second;
-        next_queue_key = it->first;
-      }
-      CHECK_LE(last_dispatched_time_, next_data->GetTime())
-          << "Non-sorted data added to queue: '" << it->first << "'";
-      ++it;
+    if (!empty_unfinished_queues_.empty()) {
+      CannotMakeProgress(*empty_unfinished_queues_.begin());
+      return;
     }
-    if (next_data == nullptr) {
+    if (heap_.empty()) {
       CHECK(queues_.empty());
       return;
     }
+    const HeapEntry next = heap_.top();
+    CHECK_LE(last_dispatched_time_, next.time)
+        << "Non-sorted data added to queue: '" << *next.queue_key << "'";
 
     // If we haven't dispatched any data for this trajectory yet, fast forward
     // all queues of this trajectory until a common start time has been reached.
     const common::Time common_start_time =
-        GetCommonStartTime(next_queue_key.trajectory_id);
+        GetCommonStartTime(next.queue_key->trajectory_id);
 
-    if (next_data->GetTime() >= common_start_time) {
+    if (next.time >= common_start_time) {
       // Happy case, we are beyond the 'common_start_time' already.
-      last_dispatched_time_ = next_data->GetTime();
-      next_queue->callback(next_queue->queue.Pop());
-    } else if (next_queue->queue.Size() < 2) {
-      if (!next_queue->finished) {
+      last_dispatched_time_ = next.time;
+      next.queue->callback(PopHeapTop());
+    } else if (next.queue->queue.Size() < 2) {
+      if (!next.queue->finished) {
         // We cannot decide whether to drop or dispatch this yet.
-        CannotMakeProgress(next_queue_key);
+        CannotMakeProgress(*next.queue_key);
         return;
       }
-      last_dispatched_time_ = next_data->GetTime();
-      next_queue->callback(next_queue->queue.Pop());
+      last_dispatched_time_ = next.time;
+      next.queue->callback(PopHeapTop());
     } else {
       // We take a peek at the time after next data. If it also is not beyond
       // 'common_start_time' we drop 'next_data', otherwise we just found the
       // first packet to dispatch from this queue.
-      std::unique_ptr<Data> next_data_owner = next_queue->queue.Pop();
-      if (next_queue->queue.Peek<Data>()->GetTime() > common_start_time) {
-        last_dispatched_time_ = next_data->GetTime();
-        next_queue->callback(std::move(next_data_owner));
+      std::unique_ptr<Data> next_data_owner = PopHeapTop();
+      if (Peek(*next.queue)->GetTime() > common_start_time) {
+        last_dispatched_time_ = next.time;
+        next.queue->callback(std::move(next_data_owner));
       }
     }
+
+    // Only now that the callback has run, an emptied queue can be removed.
+    if (Peek(*next.queue) == nullptr) {
+      if (next.queue->finished) {
+        queues_.erase(queues_.find(*next.queue_key));
+      } else {
+        empty_unfinished_queues_.insert(*next.queue_key);
+      }
+    }
+  }
+}
+
+void OrderedMultiQueue::Push(const std::map<QueueKey, Queue>::iterator it,
+                             std::unique_ptr<Data> data) {
+  Queue& queue = it->second;
+  const bool was_empty = Peek(queue) == nullptr;
+  const common::Time time = data->GetTime();
+  if (!queue.queue.TryPush(std::move(data))) {
+    queue.queue.Grow();
+    CHECK(queue.queue.TryPush(std::move(data)));
   }
+  if (queue.queue.Size() == kMaxQueueSize + 1) {
+    ++num_oversized_queues_;
+  }
+  if (was_empty) {
+    empty_unfinished_queues_.erase(it->first);
+    heap_.push(HeapEntry{time, &it->first, &queue});
+  }
+}
+
+std::unique_ptr<Data> OrderedMultiQueue::PopHeapTop() {
+  Queue* const queue = heap_.top().queue;
+  const QueueKey* const queue_key = heap_.top().queue_key;
+  heap_.pop();
+  std::unique_ptr<Data> data;
+  CHECK(queue->queue.TryPop(&data));
+  if (queue->queue.Size() == kMaxQueueSize) {
+    --num_oversized_queues_;
+  }
+  const Data* const next_data = Peek(*queue);
+  if (next_data != nullptr) {
+    heap_.push(HeapEntry{next_data->GetTime(), queue_key, queue});
+  }
+  return data;
+}
+
+const Data* OrderedMultiQueue::Peek(const Queue& queue) {
+  const std::unique_ptr<Data>* const data = queue.queue.Peek();
+  return data == nullptr ? nullptr : data->get();
 }
 
 void OrderedMultiQueue::CannotMakeProgress(const QueueKey& queue_key) {
   blocker_ = queue_key;
-  for (auto& entry : queues_) {
-    if (entry.second.queue.Size() > kMaxQueueSize) {
-      LOG_EVERY_N(WARNING, 60) << "Queue waiting for data: " << queue_key;
-      return;
-    }
+  if (num_oversized_queues_ > 0) {
+    LOG_EVERY_N(WARNING, 60) << "Queue waiting for data: " << queue_key;
   }
 }
 
@@ -165,8 +200,8 @@ common::Time OrderedMultiQueue::GetCommonStartTime(const int trajectory_id) {
   if (emplace_result.second) {
     for (auto& entry : queues_) {
       if (entry.first.trajectory_id == trajectory_id) {
-        common_start_time = std::max(
-            common_start_time, entry.second.queue.Peek<Data>()->GetTime());
+        common_start_time =
+            std::max(common_start_time, Peek(entry.second)->GetTime());
       }
     }
     LOG(INFO) << "All sensor data for trajectory " << trajectory_id
@@ -20,10 +20,13 @@
 #include <functional>
 #include <map>
 #include <memory>
+#include <queue>
+#include <set>
 #include <string>
 #include <tuple>
+#include <vector>
 
-#include "cartographer/common/blocking_queue.h"
+#include "cartographer/common/mpsc_queue.h"
 #include "cartographer/common/port.h"
 #include "cartographer/common/time.h"
 #include "cartographer/sensor/data.h"
@@ -44,6 +47,8 @@ struct QueueKey {
 // Maintains multiple queues of sorted sensor data and dispatches it in merge
 // sorted order. It will wait to see at least one value for each unfinished
 // queue before dispatching the next time ordered value across all queues.
+// The queue to dispatch from is taken from a min-heap of the non-empty queues
+// keyed by the time of their first value, so dispatching is O(log #queues).
 //
 // This class is thread-compatible.
 class OrderedMultiQueue {
@@ -76,12 +81,31 @@ class OrderedMultiQueue {
 
  private:
   struct Queue {
-    common::BlockingQueue<std::unique_ptr<Data>> queue;
+    // Only accessed from the thread using the OrderedMultiQueue, so this never
+    // blocks and can be grown whenever it is full.
+    common::MpscQueue<std::unique_ptr<Data>> queue;
     Callback callback;
     bool finished = false;
   };
 
+  // Entry of 'heap_' for the non-empty queue 'queue' whose first value has
+  // 'time'. Ties are broken by the queue key to dispatch in a deterministic
+  // order.
+  struct HeapEntry {
+    common::Time time;
+    const QueueKey* queue_key;
+    Queue* queue;
+
+    bool operator>(const HeapEntry& other) const {
+      return std::forward_as_tuple(time, *queue_key) >
+             std::forward_as_tuple(other.time, *other.queue_key);
+    }
+  };
+
   void Dispatch();
+  void Push(std::map<QueueKey, Queue>::iterator it, std::unique_ptr<Data> data);
+  std::unique_ptr<Data> PopHeapTop();
+  static const Data* Peek(const Queue& queue);
   void CannotMakeProgress(const QueueKey& queue_key);
   common::Time GetCommonStartTime(int trajectory_id);
 
@@ -90,6 +114,18 @@ class OrderedMultiQueue {
 
   std::map<int, common::Time> common_start_time_per_trajectory_;
   std::map<QueueKey, Queue> queues_;
+
+  // Non-empty queues ordered by the time of their first value.
+  std::priority_queue<HeapEntry, std::vector<HeapEntry>,
+                      std::greater<HeapEntry>>
+      heap_;
+
+  // Unfinished queues that are empty, i.e. which are blocking dispatching.
+  std::set<QueueKey> empty_unfinished_queues_;
+
+  // Number of queues holding more than 'kMaxQueueSize' values.
+  int num_oversized_queues_ = 0;
+
   QueueKey blocker_;
 };
 
@@ -0,0 +1,316 @@
+/*
+ * Copyright 2017 The Cartographer Authors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Measures the cost of adding and dispatching one message through the
+// OrderedMultiQueue, compared to the previous implementation which kept a
+// BlockingQueue per sensor and scanned all queues for each dispatched message.
+// Messages are either added round robin or replayed as they would arrive from
+// the sensors of many trajectories, each at its own rate and latency.
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "cartographer/common/blocking_queue.h"
+#include "cartographer/common/time.h"
+#include "cartographer/sensor/data.h"
+#include "cartographer/sensor/imu_data.h"
+#include "cartographer/sensor/ordered_multi_queue.h"
+#include "gflags/gflags.h"
+#include "glog/logging.h"
+
+DEFINE_int32(num_trajectories, 4, "Number of trajectories.");
+DEFINE_int32(num_sensors, 10, "Number of sensors per trajectory.");
+DEFINE_int32(num_messages, 1000000,
+             "Number of messages to dispatch round robin.");
+DEFINE_int32(num_replayed_trajectories, 20,
+             "Number of trajectories to replay sensor data for. Each has 5 "
+             "sensors.");
+DEFINE_double(replay_duration, 60., "Seconds of sensor data to replay.");
+
+namespace cartographer {
+namespace sensor {
+namespace {
+
+double SecondsSince(const std::chrono::steady_clock::time_point start) {
+  const std::chrono::duration<double> elapsed =
+      std::chrono::steady_clock::now() - start;
+  return elapsed.count();
+}
+
+// The OrderedMultiQueue as it was before its queues became lock-free ring
+// buffers and it started to dispatch from a min-heap.
+class ReferenceOrderedMultiQueue {
+ public:
+  using Callback = OrderedMultiQueue::Callback;
+
+  ~ReferenceOrderedMultiQueue() {
+    for (auto& entry : queues_) {
+      CHECK(entry.second.finished);
+    }
+  }
+
+  void AddQueue(const QueueKey& queue_key, Callback callback) {
+    CHECK_EQ(queues_.count(queue_key), 0);
+    queues_[queue_key].callback = std::move(callback);
+  }
+
+  void MarkQueueAsFinished(const QueueKey& queue_key) {
+    auto it = queues_.find(queue_key);
+    CHECK(it != queues_.end());
+    CHECK(!it->second.finished);
+    it->second.finished = true;
+    Dispatch();
+  }
+
+  void Add(const QueueKey& queue_key, std::unique_ptr<Data> data) {
+    auto it = queues_.find(queue_key);
+    CHECK(it != queues_.end());
+    it->second.queue.Push(std::move(data));
+    Dispatch();
+  }
+
+ private:
+  struct Queue {
+    common::BlockingQueue<std::unique_ptr<Data>> queue;
+    Callback callback;
+    bool finished = false;
+  };
+
+  void Dispatch() {
+    while (true) {
+      const Data* next_data = nullptr;
+      Queue* next_queue = nullptr;
+      QueueKey next_queue_key;
+      for (auto it = queues_.begin(); it != queues_.end();) {
+        const auto* data = it->second.queue.Peek<Data>();
+        if (data == nullptr) {
+          if (it->second.finished) {
+            queues_.erase(it++);
+            continue;
+          }
+          return;
+        }
+        if (next_data == nullptr || data->GetTime() < next_data->GetTime()) {
+          next_data = data;
+          next_queue = &it->second;
+          next_queue_key = it->first;
+        }
+        CHECK_LE(last_dispatched_time_, next_data->GetTime());
+        ++it;
+      }
+      if (next_data == nullptr) {
+        CHECK(queues_.empty());
+        return;
+      }
+      const common::Time common_start_time =
+          GetCommonStartTime(next_queue_key.trajectory_id);
+      if (next_data->GetTime() >= common_start_time) {
+        last_dispatched_time_ = next_data->GetTime();
+        next_queue->callback(next_queue->queue.Pop());
+      } else if (next_queue->queue.Size() < 2) {
+        if (!next_queue->finished) {
+          return;
+        }
+        last_dispatched_time_ = next_data->GetTime();
+        next_queue->callback(next_queue->queue.Pop());
+      } else {
+        std::unique_ptr<Data> next_data_owner = next_queue->queue.Pop();
+        if (next_queue->queue.Peek<Data>()->GetTime() > common_start_time) {
+          last_dispatched_time_ = next_data->GetTime();
+          next_queue->callback(std::move(next_data_owner));
+        }
+      }
+    }
+  }
+
+  common::Time GetCommonStartTime(const int trajectory_id) {
+    auto emplace_result = common_start_time_per_trajectory_.emplace(
+        trajectory_id, common::Time::min());
+    common::Time& common_start_time = emplace_result.first->second;
+    if (emplace_result.second) {
+      for (auto& entry : queues_) {
+        if (entry.first.trajectory_id == trajectory_id) {
+          common_start_time = std::max(
+              common_start_time, entry.second.queue.Peek<Data>()->GetTime());
+        }
+      }
+    }
+    return common_start_time;
+  }
+
+  common::Time last_dispatched_time_ = common::Time::min();
+  std::map<int, common::Time> common_start_time_per_trajectory_;
+  std::map<QueueKey, Queue> queues_;
+};
+
+struct Message {
+  int queue_index;
+  common::Time time;
+};
+
+// Returns the messages of all queues in the order they are added, which is
+// round robin with one message per queue and step.
+std::vector<Message> GenerateMessages(const int num_queues) {
+  std::vector<Message> messages;
+  for (int i = 0; i != FLAGS_num_messages; ++i) {
+    messages.push_back(
+        Message{i % num_queues, common::FromUniversal(i / num_queues)});
+  }
+  return messages;
+}
+
+struct Sensor {
+  const char* sensor_id;
+  double rate;     // in Hz
+  double latency;  // in seconds
+};
+
+// Sensors of a typical robot. Data arrives 'latency' after it was measured.
+const std::vector<Sensor> kSensors = {
+    {"imu", 200., 0.001},
+    {"odometry", 50., 0.005},
+    {"horizontal_laser", 40., 0.025},
+    {"vertical_laser", 40., 0.025},
+    {"fixed_frame_pose", 10., 0.05},
+};
+
+// Returns the messages of the sensors of 'FLAGS_num_replayed_trajectories'
+// trajectories in the order of their arrival.
+std::vector<Message> GenerateReplayMessages() {
+  std::vector<std::pair<double, Message>> arrivals;
+  for (int trajectory_id = 0;
+       trajectory_id != FLAGS_num_replayed_trajectories; ++trajectory_id) {
+    for (size_t i = 0; i != kSensors.size(); ++i) {
+      const Sensor& sensor = kSensors[i];
+      const int queue_index = trajectory_id * kSensors.size() + i;
+      // Trajectories are offset to not all measure at the same times.
+      const double offset = 1e-4 * trajectory_id;
+      for (int j = 0; j < FLAGS_replay_duration * sensor.rate; ++j) {
+        const double time = offset + j / sensor.rate;
+        arrivals.emplace_back(
+            time + sensor.latency,
+            Message{queue_index,
+                    common::FromUniversal(0) + common::FromSeconds(time)});
+      }
+    }
+  }
+  std::stable_sort(arrivals.begin(), arrivals.end(),
+                   [](const std::pair<double, Message>& lhs,
+                      const std::pair<double, Message>& rhs) {
+                     return lhs.first < rhs.first;
+                   });
+  std::vector<Message> messages;
+  for (const auto& arrival : arrivals) {
+    messages.push_back(arrival.second);
+  }
+  return messages;
+}
+
+// Adds 'messages' to a new 'MultiQueue' and returns the seconds spent adding
+// and dispatching them. The dispatched messages are appended to 'dispatched'.
+template <typename MultiQueue>
+double Benchmark(const std::vector<QueueKey>& queue_keys,
+                 const std::vector<Message>& messages,
+                 std::vector<std::pair<int, common::Time>>* const dispatched) {
+  std::vector<std::unique_ptr<Data>> data;
+  for (const Message& message : messages) {
+    data.push_back(MakeDispatchable(ImuData{
+        message.time, Eigen::Vector3d::Zero(), Eigen::Vector3d::Zero()}));
+  }
+  MultiQueue multi_queue;
+  for (int i = 0; i != static_cast<int>(queue_keys.size()); ++i) {
+    multi_queue.AddQueue(queue_keys[i],
+                         [i, dispatched](std::unique_ptr<Data> data) {
+                           dispatched->emplace_back(i, data->GetTime());
+                         });
+  }
+  const auto start = std::chrono::steady_clock::now();
+  for (size_t i = 0; i != messages.size(); ++i) {
+    multi_queue.Add(queue_keys[messages[i].queue_index], std::move(data[i]));
+  }
+  for (const QueueKey& queue_key : queue_keys) {
+    multi_queue.MarkQueueAsFinished(queue_key);
+  }
+  return SecondsSince(start);
+}
+
+// Dispatches 'messages' with both implementations, checks that they agree and
+// prints the cost per message.
+void BenchmarkAndReport(const std::string& name,
+                        const std::vector<QueueKey>& queue_keys,
+                        const std::vector<Message>& messages) {
+  std::vector<std::pair<int, common::Time>> reference_dispatched;
+  const double reference_seconds = Benchmark<ReferenceOrderedMultiQueue>(
+      queue_keys, messages, &reference_dispatched);
+  std::vector<std::pair<int, common::Time>> dispatched;
+  const double seconds =
+      Benchmark<OrderedMultiQueue>(queue_keys, messages, &dispatched);
+  CHECK(dispatched == reference_dispatched) << name;
+
+  std::cout << name << ": " << queue_keys.size() << " queues, "
+            << dispatched.size() << " messages dispatched\n"
+            << "  Previous OrderedMultiQueue: "
+            << 1e9 * reference_seconds / messages.size() << " ns per message\n"
+            << "  OrderedMultiQueue: " << 1e9 * seconds / messages.size()
+            << " ns per message\n";
+}
+
+void Run() {
+  CHECK_GT(FLAGS_num_trajectories, 0);
+  CHECK_GT(FLAGS_num_sensors, 0);
+  CHECK_GT(FLAGS_num_messages, 0);
+  CHECK_GT(FLAGS_num_replayed_trajectories, 0);
+  CHECK_GT(FLAGS_replay_duration, 0.);
+  std::vector<QueueKey> queue_keys;
+  for (int trajectory_id = 0; trajectory_id != FLAGS_num_trajectories;
+       ++trajectory_id) {
+    for (int i = 0; i != FLAGS_num_sensors; ++i) {
+      queue_keys.push_back(
+          QueueKey{trajectory_id, "sensor_" + std::to_string(i)});
+    }
+  }
+  BenchmarkAndReport("Round robin", queue_keys,
+                     GenerateMessages(queue_keys.size()));
+
+  queue_keys.clear();
+  for (int trajectory_id = 0;
+       trajectory_id != FLAGS_num_replayed_trajectories; ++trajectory_id) {
+    for (const Sensor& sensor : kSensors) {
+      queue_keys.push_back(QueueKey{trajectory_id, sensor.sensor_id});
+    }
+  }
+  BenchmarkAndReport("Replay", queue_keys, GenerateReplayMessages());
+}
+
+}  // namespace
+}  // namespace sensor
+}  // namespace cartographer
+
+int main(int argc, char** argv) {
+  google::InitGoogleLogging(argv[0]);
+  FLAGS_logtostderr = true;
+  google::SetUsageMessage(
+      "\n\n"
+      "Benchmarks adding and dispatching messages in the OrderedMultiQueue.\n");
+  google::ParseCommandLineFlags(&argc, &argv, true);
+  ::cartographer::sensor::Run();
+}
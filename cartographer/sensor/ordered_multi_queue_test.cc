@@ -16,6 +16,7 @@
 
 #include "cartographer/sensor/ordered_multi_queue.h"
 
+#include <string>
 #include <vector>
 
 #include "cartographer/common/make_unique.h"
@@ -111,6 +112,70 @@ TEST_F(OrderedMultiQueueTest, CommonStartTimePerTrajectory) {
   EXPECT_EQ(values_.size(), 4);
 }
 
+TEST_F(OrderedMultiQueueTest, ManyValuesWhileBlocked) {
+  constexpr int kNumValues = 1000;
+  for (int i = 0; i != kNumValues; ++i) {
+    queue_.Add(kFirst, MakeImu(i));
+  }
+  queue_.Add(kSecond, MakeImu(0));
+  EXPECT_TRUE(values_.empty());
+  queue_.Flush();
+
+  EXPECT_EQ(kNumValues + 1, values_.size());
+  for (size_t i = 0; i < values_.size() - 1; ++i) {
+    EXPECT_LE(values_[i]->GetTime(), values_[i + 1]->GetTime());
+  }
+}
+
+TEST_F(OrderedMultiQueueTest, Blocker) {
+  queue_.Add(kFirst, MakeImu(1));
+  EXPECT_EQ(kSecond.sensor_id, queue_.GetBlocker().sensor_id);
+  EXPECT_EQ(kSecond.trajectory_id, queue_.GetBlocker().trajectory_id);
+  queue_.Add(kSecond, MakeImu(2));
+  EXPECT_EQ(kThird.trajectory_id, queue_.GetBlocker().trajectory_id);
+  queue_.Add(kThird, MakeImu(3));
+  // Undecided whether to drop the value before the common start time.
+  EXPECT_TRUE(values_.empty());
+  EXPECT_EQ(kFirst.sensor_id, queue_.GetBlocker().sensor_id);
+  EXPECT_EQ(kFirst.trajectory_id, queue_.GetBlocker().trajectory_id);
+  queue_.Flush();
+  EXPECT_EQ(3, values_.size());
+}
+
+TEST(OrderedMultiQueueManyQueuesTest, MergeSorted) {
+  constexpr int kNumTrajectories = 4;
+  constexpr int kNumSensors = 25;
+  constexpr int kNumValues = 100;
+  OrderedMultiQueue queue;
+  std::vector<std::unique_ptr<Data>> values;
+  for (int trajectory_id = 0; trajectory_id != kNumTrajectories;
+       ++trajectory_id) {
+    for (int sensor = 0; sensor != kNumSensors; ++sensor) {
+      queue.AddQueue(QueueKey{trajectory_id, std::to_string(sensor)},
+                     [&values](std::unique_ptr<Data> data) {
+                       values.push_back(std::move(data));
+                     });
+    }
+  }
+  for (int i = 0; i != kNumValues; ++i) {
+    for (int trajectory_id = 0; trajectory_id != kNumTrajectories;
+         ++trajectory_id) {
+      for (int sensor = 0; sensor != kNumSensors; ++sensor) {
+        // Sensors run at different rates, but all start at time 0.
+        queue.Add(QueueKey{trajectory_id, std::to_string(sensor)},
+                  MakeDispatchable(sensor::ImuData{
+                      common::FromUniversal(i * (sensor + 1)),
+                      Eigen::Vector3d::Zero(), Eigen::Vector3d::Zero()}));
+      }
+    }
+  }
+  queue.Flush();
+  EXPECT_EQ(kNumTrajectories * kNumSensors * kNumValues, values.size());
+  for (size_t i = 0; i < values.size() - 1; ++i) {
+    EXPECT_LE(values[i]->GetTime(), values[i + 1]->GetTime());
+  }
+}
+
 }  // namespace
 }  // namespace sensor
 }  // namespace cartographer
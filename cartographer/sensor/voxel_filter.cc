@@ -17,6 +17,7 @@
 #include "cartographer/sensor/voxel_filter.h"
 
 #include <cmath>
+#include <vector>
 
 #include "cartographer/common/math.h"
 
@@ -36,6 +37,117 @@ PointCloud FilterByMaxRange(const PointCloud& point_cloud,
   return result;
 }
 
+// Finds the voxels of a given edge length occupied by the points of a point
+// cloud. A single open addressing hash table is reused for all edge lengths,
+// entries of previous edge lengths are told apart by their generation.
+class VoxelOccupancy {
+ public:
+  explicit VoxelOccupancy(const PointCloud& point_cloud)
+      : point_cloud_(point_cloud), slots_(kMinNumSlots, kEmptySlot) {}
+
+  // Returns true if the points occupy at least 'min_num_voxels' voxels of edge
+  // length 'size'. Stops as soon as enough voxels were found.
+  bool OccupiesAtLeast(const float size, const size_t min_num_voxels) {
+    StartGeneration();
+    for (const Eigen::Vector3f& point : point_cloud_) {
+      if (num_voxels_ >= min_num_voxels) {
+        break;
+      }
+      Insert(GetCellIndex(point, size));
+    }
+    return num_voxels_ >= min_num_voxels;
+  }
+
+  // Returns the first point in each voxel of edge length 'size', the same as
+  // VoxelFiltered().
+  PointCloud Filter(const float size) {
+    StartGeneration();
+    PointCloud result;
+    for (const Eigen::Vector3f& point : point_cloud_) {
+      if (Insert(GetCellIndex(point, size))) {
+        result.push_back(point);
+      }
+    }
+    return result;
+  }
+
+ private:
+  static constexpr size_t kMinNumSlots = 1024;
+
+  struct Slot {
+    Eigen::Array3i cell_index;
+    int generation;
+  };
+  static const Slot kEmptySlot;
+
+  // Same as HybridGridBase::GetCellIndex() for a grid of resolution 'size'.
+  static Eigen::Array3i GetCellIndex(const Eigen::Vector3f& point,
+                                     const float size) {
+    const Eigen::Array3f index = point.array() / size;
+    return Eigen::Array3i(common::RoundToInt(index.x()),
+                          common::RoundToInt(index.y()),
+                          common::RoundToInt(index.z()));
+  }
+
+  static size_t Hash(const Eigen::Array3i& cell_index) {
+    return static_cast<uint32>(cell_index.x()) * 73856093u ^
+           static_cast<uint32>(cell_index.y()) * 19349663u ^
+           static_cast<uint32>(cell_index.z()) * 83492791u;
+  }
+
+  void StartGeneration() {
+    ++generation_;
+    CHECK_GT(generation_, 0);
+    num_voxels_ = 0;
+  }
+
+  // Returns true if 'cell_index' was not occupied yet in this generation.
+  bool Insert(const Eigen::Array3i& cell_index) {
+    const size_t mask = slots_.size() - 1;
+    for (size_t i = Hash(cell_index) & mask;; i = (i + 1) & mask) {
+      Slot& slot = slots_[i];
+      if (slot.generation != generation_) {
+        slot = Slot{cell_index, generation_};
+        break;
+      }
+      if ((slot.cell_index == cell_index).all()) {
+        return false;
+      }
+    }
+    ++num_voxels_;
+    // Keep the table at most half full.
+    if (2 * num_voxels_ > slots_.size()) {
+      Grow();
+    }
+    return true;
+  }
+
+  // Doubles the number of slots, keeping the entries of this generation.
+  void Grow() {
+    std::vector<Slot> old_slots(2 * slots_.size(), kEmptySlot);
+    old_slots.swap(slots_);
+    const size_t mask = slots_.size() - 1;
+    for (const Slot& old_slot : old_slots) {
+      if (old_slot.generation != generation_) {
+        continue;
+      }
+      size_t i = Hash(old_slot.cell_index) & mask;
+      while (slots_[i].generation == generation_) {
+        i = (i + 1) & mask;
+      }
+      slots_[i] = old_slot;
+    }
+  }
+
+  const PointCloud& point_cloud_;
+  std::vector<Slot> slots_;
+  int generation_ = 0;
+  size_t num_voxels_ = 0;
+};
+
+const VoxelOccupancy::Slot VoxelOccupancy::kEmptySlot = {
+    Eigen::Array3i::Zero(), 0};
+
 PointCloud AdaptivelyVoxelFiltered(
     const proto::AdaptiveVoxelFilterOptions& options,
     const PointCloud& point_cloud) {
@@ -43,7 +155,10 @@ PointCloud AdaptivelyVoxelFiltered(
     // 'point_cloud' is already sparse enough.
     return point_cloud;
   }
-  PointCloud result = VoxelFiltered(point_cloud, options.max_length());
+  // Only whether enough voxels are occupied matters during the search below,
+  // the filtered point cloud is computed once for the chosen edge length.
+  VoxelOccupancy voxel_occupancy(point_cloud);
+  PointCloud result = voxel_occupancy.Filter(options.max_length());
   if (result.size() >= options.min_num_points()) {
     // Filtering with 'max_length' resulted in a sufficiently dense point cloud.
     return result;
@@ -51,28 +166,29 @@ PointCloud AdaptivelyVoxelFiltered(
   // Search for a 'low_length' that is known to result in a sufficiently
   // dense point cloud. We give up and use the full 'point_cloud' if reducing
   // the edge length by a factor of 1e-2 is not enough.
+  float result_length = options.max_length();
   for (float high_length = options.max_length();
        high_length > 1e-2f * options.max_length(); high_length /= 2.f) {
     float low_length = high_length / 2.f;
-    result = VoxelFiltered(point_cloud, low_length);
-    if (result.size() >= options.min_num_points()) {
+    result_length = low_length;
+    if (voxel_occupancy.OccupiesAtLeast(low_length,
+                                        options.min_num_points())) {
       // Binary search to find the right amount of filtering. 'low_length' gave
-      // a sufficiently dense 'result', 'high_length' did not. We stop when the
-      // edge length is at most 10% off.
+      // a sufficiently dense point cloud, 'high_length' did not. We stop when
+      // the edge length is at most 10% off.
       while ((high_length - low_length) / low_length > 1e-1f) {
         const float mid_length = (low_length + high_length) / 2.f;
-        const PointCloud candidate = VoxelFiltered(point_cloud, mid_length);
-        if (candidate.size() >= options.min_num_points()) {
+        if (voxel_occupancy.OccupiesAtLeast(mid_length,
+                                            options.min_num_points())) {
           low_length = mid_length;
-          result = candidate;
         } else {
           high_length = mid_length;
         }
       }
-      return result;
+      return voxel_occupancy.Filter(low_length);
     }
   }
-  return result;
+  return voxel_occupancy.Filter(result_length);
 }
 
 }  // namespace
@@ -86,11 +202,16 @@ PointCloud VoxelFiltered(const PointCloud& point_cloud, const float size) {
 VoxelFilter::VoxelFilter(const float size) : voxels_(size) {}
 
 void VoxelFilter::InsertPointCloud(const PointCloud& point_cloud) {
+  std::vector<Eigen::Array3i> cell_indices;
+  cell_indices.reserve(point_cloud.size());
   for (const Eigen::Vector3f& point : point_cloud) {
-    auto* const value = voxels_.mutable_value(voxels_.GetCellIndex(point));
-    if (*value == 0) {
-      point_cloud_.push_back(point);
-      *value = 1;
+    cell_indices.push_back(voxels_.GetCellIndex(point));
+  }
+  const std::vector<uint8*> values = voxels_.GetMutableValues(cell_indices);
+  for (size_t i = 0; i != point_cloud.size(); ++i) {
+    if (*values[i] == 0) {
+      point_cloud_.push_back(point_cloud[i]);
+      *values[i] = 1;
     }
   }
 }
@@ -35,6 +35,47 @@ TEST(VoxelFilterTest, ReturnsTheFirstPointInEachVoxel) {
               ContainerEq(PointCloud{point_cloud[0], point_cloud[2]}));
 }
 
+TEST(AdaptiveVoxelFilterTest, ReturnsSparsePointCloudUnchanged) {
+  PointCloud point_cloud = {{0.f, 0.f, 0.f},
+                            {0.1f, -0.1f, 0.1f},
+                            {0.3f, -0.1f, 0.f},
+                            {0.f, 0.f, 0.1f}};
+  proto::AdaptiveVoxelFilterOptions options;
+  options.set_max_length(1.f);
+  options.set_min_num_points(10);
+  options.set_max_range(10.f);
+  EXPECT_THAT(AdaptiveVoxelFilter(options).Filter(point_cloud),
+              ContainerEq(point_cloud));
+}
+
+TEST(AdaptiveVoxelFilterTest, FindsEdgeLengthKeepingMinNumPoints) {
+  PointCloud point_cloud;
+  for (int x = -20; x != 20; ++x) {
+    for (int y = -20; y != 20; ++y) {
+      point_cloud.emplace_back(0.05f * x, 0.05f * y, 0.f);
+    }
+  }
+  proto::AdaptiveVoxelFilterOptions options;
+  options.set_max_length(2.f);
+  options.set_min_num_points(100);
+  options.set_max_range(10.f);
+  PointCloud point_cloud_with_outlier = point_cloud;
+  point_cloud_with_outlier.emplace_back(20.f, 0.f, 0.f);
+  const PointCloud result =
+      AdaptiveVoxelFilter(options).Filter(point_cloud_with_outlier);
+  EXPECT_LE(100, result.size());
+  EXPECT_GT(200, result.size());
+  // Points of the result are the first ones in their voxels.
+  bool found_voxel_size = false;
+  for (float size = 0.01f; size < 2.f; size += 0.001f) {
+    if (VoxelFiltered(point_cloud, size) == result) {
+      found_voxel_size = true;
+      break;
+    }
+  }
+  EXPECT_TRUE(found_voxel_size);
+}
+
 }  // namespace
 }  // namespace sensor
 }  // namespace cartographer
@@ -22,15 +22,19 @@ SPARSE_POSE_GRAPH = {
     loop_closure_translation_weight = 1.1e4,
     loop_closure_rotation_weight = 1e5,
     log_matches = true,
+    precomputation_grid_cache_size_in_mb = 4096,
+    serialize_precomputation_grids = false,
     fast_correlative_scan_matcher = {
       linear_search_window = 7.,
       angular_search_window = math.rad(30.),
       branch_and_bound_depth = 7,
+      parallel_branch_and_bound = false,
     },
     ceres_scan_matcher = {
       occupied_space_weight = 20.,
       translation_weight = 10.,
       rotation_weight = 1.,
+      use_analytic_occupied_space_cost = false,
       ceres_solver_options = {
         use_nonmonotonic_steps = true,
         max_num_iterations = 10,
@@ -45,6 +49,7 @@ SPARSE_POSE_GRAPH = {
       linear_xy_search_window = 5.,
       linear_z_search_window = 1.,
       angular_search_window = math.rad(15.),
+      parallel_branch_and_bound = false,
     },
     ceres_scan_matcher_3d = {
       occupied_space_weight_0 = 5.,
@@ -70,6 +75,7 @@ SPARSE_POSE_GRAPH = {
     fixed_frame_pose_translation_weight = 1e1,
     fixed_frame_pose_rotation_weight = 1e2,
     log_solver_summary = false,
+    incremental_problem = false,
     ceres_solver_options = {
       use_nonmonotonic_steps = false,
       max_num_iterations = 50,
@@ -40,12 +40,14 @@ TRAJECTORY_BUILDER_2D = {
     angular_search_window = math.rad(20.),
     translation_delta_cost_weight = 1e-1,
     rotation_delta_cost_weight = 1e-1,
+    branch_and_bound_depth = 1,
   },
 
   ceres_scan_matcher = {
     occupied_space_weight = 1.,
     translation_weight = 10.,
     rotation_weight = 40.,
+    use_analytic_occupied_space_cost = true,
     ceres_solver_options = {
       use_nonmonotonic_steps = false,
       max_num_iterations = 20,
@@ -68,6 +70,8 @@ TRAJECTORY_BUILDER_2D = {
       insert_free_space = true,
       hit_probability = 0.55,
       miss_probability = 0.49,
+      num_threads = 1,
     },
+    quantize_finished_submaps = false,
   },
 }
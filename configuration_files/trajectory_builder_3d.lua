@@ -38,6 +38,7 @@ TRAJECTORY_BUILDER_3D = {
     angular_search_window = math.rad(1.),
     translation_delta_cost_weight = 1e-1,
     rotation_delta_cost_weight = 1e-1,
+    branch_and_bound_depth = 1,
   },
 
   ceres_scan_matcher = {